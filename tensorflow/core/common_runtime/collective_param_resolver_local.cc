@@ -40,10 +40,39 @@ void CollectiveParamResolverLocal::InstanceRec::WaitForOutMu(mutex_lock& lock) {
   while (!out_mu_available) out_cv.wait(lock);
 }
 
+namespace {
+// Costs of the links between tasks, keyed by the pair of task names in
+// ascending order.
+typedef std::map<std::pair<string, string>, double> TaskLinkCosts;
+
+// Parses ConfigProto.Experimental.collective_link_costs.  Returns an empty
+// map if "spec" is malformed.
+TaskLinkCosts ParseTaskLinkCosts(const string& spec) {
+  TaskLinkCosts costs;
+  for (const string& entry :
+       str_util::Split(spec, ',', str_util::SkipEmpty())) {
+    std::vector<string> fields =
+        str_util::Split(entry, ' ', str_util::SkipEmpty());
+    double cost;
+    if (fields.size() != 3 || !strings::safe_strtod(fields[2], &cost) ||
+        cost < 0) {
+      LOG(WARNING) << "Ignoring malformed collective_link_costs entry \""
+                   << entry << "\"";
+      return TaskLinkCosts();
+    }
+    if (fields[1] < fields[0]) std::swap(fields[0], fields[1]);
+    costs[std::make_pair(fields[0], fields[1])] = cost;
+  }
+  return costs;
+}
+}  // namespace
+
 CollectiveParamResolverLocal::CollectiveParamResolverLocal(
     const ConfigProto& config, const DeviceMgr* dev_mgr,
     DeviceResolverInterface* dev_resolver, const string& task_name)
     : nccl_(config.experimental().collective_nccl()),
+      link_costs_(
+          ParseTaskLinkCosts(config.experimental().collective_link_costs())),
       dev_mgr_(dev_mgr),
       dev_resolver_(dev_resolver),
       task_name_(task_name) {}
@@ -351,6 +380,95 @@ void OrderTaskDeviceMap(const string& gpu_ring_order, TaskDeviceMap* tdm) {
   }
 }
 
+// The cost of a ring: the cost of its most expensive link, and the total cost
+// of its links.  Compared lexicographically.
+typedef std::pair<double, double> RingCost;
+
+RingCost ComputeRingCost(const std::vector<std::vector<double>>& link_cost,
+                         const std::vector<int>& ring) {
+  RingCost cost(0, 0);
+  for (int i = 0; i < ring.size(); ++i) {
+    const double c = link_cost[ring[i]][ring[(i + 1) % ring.size()]];
+    cost.first = std::max(cost.first, c);
+    cost.second += c;
+  }
+  return cost;
+}
+
+// Rings of up to this many tasks are ordered by trying all orders.
+constexpr int kMaxTasksForExhaustiveRingSearch = 8;
+
+// Reorders "tasks" into a ring whose most expensive link is as cheap as
+// possible, breaking ties by the total cost of the links.  Links missing from
+// "costs" have cost 1.  The result only depends on the input, so every task
+// computes the same order.
+void OrderTasksByLinkCost(const TaskLinkCosts& costs,
+                          std::vector<string>* tasks) {
+  const int n = tasks->size();
+  if (n <= 3) return;  // All rings are equivalent.
+  std::vector<std::vector<double>> link_cost(n, std::vector<double>(n, 0));
+  for (int i = 0; i < n; ++i) {
+    for (int j = i + 1; j < n; ++j) {
+      auto it = costs.find(std::make_pair(std::min((*tasks)[i], (*tasks)[j]),
+                                          std::max((*tasks)[i], (*tasks)[j])));
+      link_cost[i][j] = link_cost[j][i] = it == costs.end() ? 1 : it->second;
+    }
+  }
+  std::vector<int> ring(n);
+  for (int i = 0; i < n; ++i) ring[i] = i;
+  std::vector<int> best = ring;
+  RingCost best_cost = ComputeRingCost(link_cost, best);
+  if (n <= kMaxTasksForExhaustiveRingSearch) {
+    // Rotations of a ring are equivalent, so the first task stays in place.
+    while (std::next_permutation(ring.begin() + 1, ring.end())) {
+      const RingCost cost = ComputeRingCost(link_cost, ring);
+      if (cost < best_cost) {
+        best = ring;
+        best_cost = cost;
+      }
+    }
+  } else {
+    // Build a ring by repeatedly following the cheapest link from the last
+    // task, then reverse segments of it while that makes it cheaper.
+    for (int i = 1; i < n; ++i) {
+      int next = i;
+      for (int j = i + 1; j < n; ++j) {
+        if (link_cost[ring[i - 1]][ring[j]] <
+            link_cost[ring[i - 1]][ring[next]]) {
+          next = j;
+        }
+      }
+      std::swap(ring[i], ring[next]);
+    }
+    best = ring;
+    best_cost = ComputeRingCost(link_cost, best);
+    bool improved = true;
+    while (improved) {
+      improved = false;
+      for (int i = 1; i < n - 1; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+          std::reverse(ring.begin() + i, ring.begin() + j + 1);
+          const RingCost cost = ComputeRingCost(link_cost, ring);
+          if (cost < best_cost) {
+            best = ring;
+            best_cost = cost;
+            improved = true;
+          } else {
+            ring = best;
+          }
+        }
+      }
+    }
+  }
+  std::vector<string> ordered;
+  ordered.reserve(n);
+  for (int i : best) ordered.push_back((*tasks)[i]);
+  VLOG(2) << "Ordered tasks by link cost, max " << best_cost.first
+          << " total " << best_cost.second << ": "
+          << str_util::Join(ordered, " ");
+  *tasks = std::move(ordered);
+}
+
 // The first time a shared CollectiveParams is established for a
 // shared set of instances we compute a good rank order for all the
 // devices in the group, that is appropriate for a ring algorithm.
@@ -358,22 +476,29 @@ void OrderTaskDeviceMap(const string& gpu_ring_order, TaskDeviceMap* tdm) {
 // sharing the same device group where there is more than one good
 // order.
 GlobalDeviceMap EstablishGlobalRank(
-    CollectiveParams* cp, const std::vector<DeviceAttributes>& attributes) {
+    CollectiveParams* cp, const std::vector<DeviceAttributes>& attributes,
+    const TaskLinkCosts& link_costs) {
   VLOG(1) << "EstablishGlobalRank";
   GlobalDeviceMap gdm = BuildDevRecs(cp->instance, attributes);
   for (auto& iter : gdm) {
     TaskDeviceMap& tdm = iter.second;
     OrderTaskDeviceMap(cp->instance.gpu_ring_order, &tdm);
   }
-  // Connect the global rank order by the order in which tasks first appear.
-  std::set<string> ordered_tasks;
-  int next_rank = 0;
+  // Connect the global rank order by the order in which tasks first appear,
+  // or by the cheapest ring of tasks if link costs are known.
+  std::set<string> seen_tasks;
+  std::vector<string> ordered_tasks;
   for (int i = 0; i < cp->instance.task_names.size(); ++i) {
     const string& task_name = cp->instance.task_names[i];
-    if (ordered_tasks.find(task_name) != ordered_tasks.end()) {
-      continue;
+    if (seen_tasks.insert(task_name).second) {
+      ordered_tasks.push_back(task_name);
     }
-    ordered_tasks.insert(task_name);
+  }
+  if (!link_costs.empty()) {
+    OrderTasksByLinkCost(link_costs, &ordered_tasks);
+  }
+  int next_rank = 0;
+  for (const string& task_name : ordered_tasks) {
     TaskDeviceMap* tdm = &gdm[task_name];
     for (auto& it : *tdm) {
       it.second.global_rank = it.second.local_rank + next_rank;
@@ -536,7 +661,8 @@ void CollectiveParamResolverLocal::CompleteDefaultRanking(
   // Establish an instance-specific default rank order for devices
   // based on localities.  This rank order should be a good ring
   // order, if possible.
-  GlobalDeviceMap gdm = EstablishGlobalRank(&ir->shared, attributes);
+  GlobalDeviceMap gdm =
+      EstablishGlobalRank(&ir->shared, attributes, link_costs_);
   // Reflect the new global ranking on shared
   size_t num_devices = ir->shared.group.group_size;
   std::vector<string> new_device_names(num_devices, "");
@@ -16,9 +16,11 @@ limitations under the License.
 #define TENSORFLOW_CORE_COMMON_RUNTIME_COLLECTIVE_PARAM_RESOLVER_LOCAL_H_
 
 #include <functional>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "tensorflow/core/framework/collective.h"
@@ -228,6 +230,9 @@ class CollectiveParamResolverLocal : public ParamResolverInterface {
       TF_LOCKS_EXCLUDED(irec->out_mu);
 
   const bool nccl_;
+  // Costs of the links between tasks, keyed by the pair of task names in
+  // ascending order. See ConfigProto.Experimental.collective_link_costs.
+  const std::map<std::pair<string, string>, double> link_costs_;
   const DeviceMgr* dev_mgr_;
   DeviceResolverInterface* dev_resolver_;  // Not owned.
   string task_name_;
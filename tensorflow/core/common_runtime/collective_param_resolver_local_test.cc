@@ -23,7 +23,9 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/protobuf/config.pb.h"
 #include "tensorflow/core/public/session_options.h"
+#include "tensorflow/core/util/device_name_utils.h"
 
 namespace tensorflow {
 
@@ -74,6 +76,37 @@ class CollectiveParamResolverLocalTest : public ::testing::Test {
     }
   }
 
+  // Returns the device order that CompleteDefaultRanking() picks for a group
+  // with "num_devs_per_task" CPUs on each of "num_tasks" tasks, given the
+  // collective_link_costs "link_costs".
+  std::vector<string> RankDevicesByLinkCost(int num_tasks,
+                                            int num_devs_per_task,
+                                            const string& link_costs) {
+    ConfigProto config;
+    config.mutable_experimental()->set_collective_link_costs(link_costs);
+    CollectiveParamResolverLocal prl(config, device_mgr_.get(), drl_.get(),
+                                     "/job:worker/replica:0/task:0");
+    CollectiveParamResolverLocal::InstanceRec ir;
+    CollectiveParams cp;
+    mutex_lock l(ir.out_mu);
+    ir.shared.name = "PRLTest";
+    ir.shared.group.device_type = DeviceType("CPU");
+    ir.shared.group.num_tasks = num_tasks;
+    ir.shared.group.group_size = num_tasks * num_devs_per_task;
+    for (int task = 0; task < num_tasks; ++task) {
+      for (int dev = 0; dev < num_devs_per_task; ++dev) {
+        const string task_name =
+            strings::StrCat("/job:worker/replica:0/task:", task);
+        ir.shared.instance.task_names.push_back(task_name);
+        ir.shared.instance.device_names.push_back(
+            strings::StrCat(task_name, "/device:CPU:", dev));
+      }
+    }
+    std::vector<DeviceAttributes> attributes(ir.shared.group.group_size);
+    prl.CompleteDefaultRanking(nullptr, &cp, &ir, attributes);
+    return ir.shared.instance.device_names;
+  }
+
   std::unique_ptr<DeviceMgr> device_mgr_;
   std::unique_ptr<DeviceResolverLocal> drl_;
   std::unique_ptr<CollectiveParamResolverLocal> prl_;
@@ -155,6 +188,69 @@ TEST_F(CollectiveParamResolverLocalTest, CompleteDefaultRanking) {
                             });
 }
 
+TEST_F(CollectiveParamResolverLocalTest, CompleteDefaultRankingByLinkCost) {
+  // Tasks 0 and 2 share a host, as do tasks 1 and 3.  The only cheap links
+  // across hosts are 0-3 and 1-2.
+  const string kLinkCosts =
+      "/job:worker/replica:0/task:0 /job:worker/replica:0/task:2 1,"
+      "/job:worker/replica:0/task:1 /job:worker/replica:0/task:3 1,"
+      "/job:worker/replica:0/task:0 /job:worker/replica:0/task:3 5,"
+      "/job:worker/replica:0/task:1 /job:worker/replica:0/task:2 5,"
+      "/job:worker/replica:0/task:0 /job:worker/replica:0/task:1 10,"
+      "/job:worker/replica:0/task:2 /job:worker/replica:0/task:3 10";
+  EXPECT_EQ(RankDevicesByLinkCost(4, 2, kLinkCosts),
+            std::vector<string>({
+                "/job:worker/replica:0/task:0/device:CPU:0",
+                "/job:worker/replica:0/task:0/device:CPU:1",
+                "/job:worker/replica:0/task:2/device:CPU:0",
+                "/job:worker/replica:0/task:2/device:CPU:1",
+                "/job:worker/replica:0/task:1/device:CPU:0",
+                "/job:worker/replica:0/task:1/device:CPU:1",
+                "/job:worker/replica:0/task:3/device:CPU:0",
+                "/job:worker/replica:0/task:3/device:CPU:1",
+            }));
+
+  // Without usable link costs, tasks are ordered by name.
+  const std::vector<string> by_name = {
+      "/job:worker/replica:0/task:0/device:CPU:0",
+      "/job:worker/replica:0/task:1/device:CPU:0",
+      "/job:worker/replica:0/task:2/device:CPU:0",
+      "/job:worker/replica:0/task:3/device:CPU:0",
+  };
+  EXPECT_EQ(RankDevicesByLinkCost(4, 1, ""), by_name);
+  EXPECT_EQ(RankDevicesByLinkCost(4, 1, "not a link cost"), by_name);
+}
+
+TEST_F(CollectiveParamResolverLocalTest, CompleteDefaultRankingManyTasks) {
+  // Even and odd tasks are on different hosts, so a good ring crosses
+  // between hosts only twice.
+  constexpr int kNumTasks = 12;
+  string link_costs;
+  for (int i = 0; i < kNumTasks; ++i) {
+    for (int j = i + 1; j < kNumTasks; ++j) {
+      strings::StrAppend(&link_costs, link_costs.empty() ? "" : ",",
+                         "/job:worker/replica:0/task:", i,
+                         " /job:worker/replica:0/task:", j, " ",
+                         i % 2 == j % 2 ? 1 : 10);
+    }
+  }
+  std::vector<string> devices =
+      RankDevicesByLinkCost(kNumTasks, 1, link_costs);
+  ASSERT_EQ(devices.size(), kNumTasks);
+  EXPECT_EQ(devices[0], "/job:worker/replica:0/task:0/device:CPU:0");
+  std::set<string> distinct(devices.begin(), devices.end());
+  EXPECT_EQ(distinct.size(), kNumTasks);
+  int host_changes = 0;
+  for (int i = 0; i < kNumTasks; ++i) {
+    DeviceNameUtils::ParsedName a, b;
+    ASSERT_TRUE(DeviceNameUtils::ParseFullName(devices[i], &a));
+    ASSERT_TRUE(
+        DeviceNameUtils::ParseFullName(devices[(i + 1) % kNumTasks], &b));
+    if (a.task % 2 != b.task % 2) ++host_changes;
+  }
+  EXPECT_EQ(host_changes, 2);
+}
+
 TEST_F(CollectiveParamResolverLocalTest, CompleteParamsReduction1Task) {
   CollectiveParams cps[NUM_DEVS];
   Status statuses[NUM_DEVS];
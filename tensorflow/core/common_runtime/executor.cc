@@ -36,6 +36,7 @@ limitations under the License.
 #include "tensorflow/core/framework/control_flow.h"
 #include "tensorflow/core/framework/device_attributes.pb.h"
 #include "tensorflow/core/framework/log_memory.h"
+#include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/node_def_util.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/op_segment.h"
@@ -348,6 +349,8 @@ class ExecutorState {
   ScopedStepContainer* step_container_;
   StepStatsCollectorInterface* const stats_collector_;
   const tracing::EventCollector* const event_collector_;
+  // Counts the kernel buffers of this step that reused an input buffer.
+  OpKernelContext::Params::ForwardingCounts forwarding_counts_;
   Context context_;
 
   // QUESTION: Make it a checkpoint::TensorSliceReaderCacheWrapper
@@ -652,6 +655,7 @@ void ExecutorState<PropagatorStateType>::Process(TaggedNode tagged_node,
 
   OpKernelContext::Params params;
   params.step_id = step_id_;
+  params.forwarding_counts = &forwarding_counts_;
   // Override device's threadpool if user provides an intra_op_threadpool
   Device* device = immutable_state_.params().device;
   if (user_device_) {
@@ -1201,6 +1205,15 @@ void ExecutorState<PropagatorStateType>::Finish() {
   CHECK(done_cb != nullptr);
   Device* device = immutable_state_.params().device;
 
+  const int64 num_forwarded = forwarding_counts_.forwarded.load();
+  const int64 num_allocated = forwarding_counts_.allocated.load();
+  metrics::RecordBufferForwarding(num_forwarded, num_allocated);
+  if (vlog_) {
+    VLOG(1) << "Step " << step_id << " on " << device->name() << " forwarded "
+            << num_forwarded << " of " << num_forwarded + num_allocated
+            << " forwardable kernel buffers.";
+  }
+
   if (vlog_ && !status.ok() && VLOG_IS_ON(1)) {
     // Logs verbose information about the current state of active and pending
     // nodes in the propagator.
@@ -38,6 +38,7 @@ limitations under the License.
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/monitoring/collection_registry.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/logging.h"
@@ -175,6 +176,54 @@ TEST_F(ExecutorTest, SimpleAdd) {
   EXPECT_EQ(2.0, V(out));  // out = 1.0 + 1.0 = 2.0
 }
 
+// Returns the number of outputs that reused an input buffer ("forwarded") or
+// were newly allocated ("allocated") over all steps so far.
+int64 BufferForwardingCount(const string& result) {
+  monitoring::CollectionRegistry::CollectMetricsOptions options;
+  auto metrics =
+      monitoring::CollectionRegistry::Default()->CollectMetrics(options);
+  auto it =
+      metrics->point_set_map.find("/tensorflow/core/graph_buffer_forwarding");
+  if (it == metrics->point_set_map.end()) return 0;
+  for (const auto& point : it->second->points) {
+    if (point->labels[0].value == result) return point->int64_value;
+  }
+  return 0;
+}
+
+TEST_F(ExecutorTest, ForwardsToLastConsumer) {
+  // x = cast(a); y = -x; s = shape(x)
+  //
+  // Neg is created before Shape, so it would run first and find the buffer of
+  // x still shared; the executor moves it after Shape so that it can reuse it.
+  auto g = absl::make_unique<Graph>(OpRegistry::Global());
+  auto in = test::graph::Recv(g.get(), "a", "int32", ALICE, 1, BOB);
+  auto x = test::graph::Cast(g.get(), in, DT_FLOAT);
+  auto neg = test::graph::Unary(g.get(), "Neg", x);
+  test::graph::Unary(g.get(), "Shape", x);
+  test::graph::Send(g.get(), neg, "b", BOB, 1, ALICE);
+  Create(std::move(g));
+
+  const int64 forwarded = BufferForwardingCount("forwarded");
+  Rendezvous::Args rendez_args;
+  Tensor a(DT_INT32, TensorShape({16}));
+  a.flat<int32>().setConstant(3);
+  TF_ASSERT_OK(
+      rendez_->Send(Key(ALICE, kIncarnation, BOB, "a"), rendez_args, a, false));
+  Executor::Args args;
+  args.rendezvous = rendez_;
+  args.runner = runner_;
+  args.run_all_kernels_inline = true;
+  TF_ASSERT_OK(exec_->Run(args));
+  Tensor out;
+  bool is_dead = false;
+  TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), rendez_args,
+                             &out, &is_dead));
+  test::ExpectTensorEqual<float>(
+      out, test::AsTensor<float>(std::vector<float>(16, -3.0f), {16}));
+  EXPECT_EQ(forwarded + 1, BufferForwardingCount("forwarded"));
+}
+
 TEST_F(ExecutorTest, SelfAdd) {
   // v0 <- a
   // v1 = v0 + v0
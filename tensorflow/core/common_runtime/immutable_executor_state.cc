@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/core/common_runtime/immutable_executor_state.h"
 
+#include <algorithm>
+
 #include "absl/memory/memory.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/metrics.h"
@@ -22,6 +24,7 @@ limitations under the License.
 #include "tensorflow/core/graph/edgeset.h"
 #include "tensorflow/core/graph/graph.h"
 #include "tensorflow/core/graph/graph_node_util.h"
+#include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/logging.h"
 
@@ -65,6 +68,45 @@ void GetMaxPendingCounts(const Node* n, size_t* max_pending,
   *max_pending = initial_count;
   *max_dead_count = num_in_edges;
 }
+
+// Returns true if the kernel of `item` may reuse the buffer of its input
+// `input_slot` for an output: it is synchronous, not a control flow node, and
+// has an output of the input's type. Forwarding succeeds only when the kernel
+// holds the last reference to the buffer.
+bool MayForwardInput(const NodeItem& item, int input_slot) {
+  if (item.kernel == nullptr || item.kernel_is_async || item.is_merge ||
+      item.is_enter_exit_or_next_iter || item.is_recv_or_switch ||
+      item.is_any_input_ref_typed) {
+    return false;
+  }
+  const DataType dtype = item.input_type(input_slot);
+  for (int i = 0; i < item.num_outputs; ++i) {
+    if (item.output_type(i) == dtype) return true;
+  }
+  return false;
+}
+
+// Orders the output edges of `item` so that, for every output, the consumers
+// that may forward it come after the others, and updates `is_last`
+// accordingly. Inexpensive consumers that become ready together are run inline
+// in edge order, and the last consumer receives the producer's reference, so
+// the forwarding consumers are the ones most likely to hold the last reference
+// when they run.
+void OrderOutputEdgesForForwarding(const GraphView& gview, NodeItem* item) {
+  gtl::MutableArraySlice<EdgeInfo> edges = item->mutable_output_edges();
+  if (edges.size() < 2) return;
+  std::stable_partition(edges.begin(), edges.end(), [&](const EdgeInfo& e) {
+    return !MayForwardInput(*gview.node(e.dst_id), e.input_slot);
+  });
+  gtl::InlinedVector<EdgeInfo*, 4> last_edges(item->num_outputs, nullptr);
+  for (EdgeInfo& e : edges) {
+    e.is_last = false;
+    if (e.output_slot >= 0) last_edges[e.output_slot] = &e;
+  }
+  for (EdgeInfo* e : last_edges) {
+    if (e != nullptr) e->is_last = true;
+  }
+}
 }  // namespace
 
 ImmutableExecutorState::FrameInfo* ImmutableExecutorState::EnsureFrameInfo(
@@ -241,11 +283,12 @@ Status ImmutableExecutorState::Initialize(const Graph& graph) {
   }
 
   // Rewrite each `EdgeInfo::input_slot` member to refer directly to the input
-  // location.
+  // location, after ordering the edges for buffer forwarding.
   for (const Node* n : graph.nodes()) {
     if (IsSink(n)) continue;
     const int id = n->id();
     NodeItem* item = gview_.node(id);
+    OrderOutputEdgesForForwarding(gview_, item);
 
     for (EdgeInfo& e : item->mutable_output_edges()) {
       const int dst_id = e.dst_id;
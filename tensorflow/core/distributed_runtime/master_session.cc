@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/master_session.h"
 
+#include <algorithm>
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
@@ -60,6 +61,18 @@ limitations under the License.
 
 namespace tensorflow {
 
+namespace {
+
+// The variables read and written by the nodes of one worker, by the name of
+// the node that owns the variable. The empty name stands for a variable that
+// can't be identified, such as a resource handle fed by the client.
+struct VariableAccesses {
+  std::unordered_set<string> reads;
+  std::unordered_set<string> writes;
+};
+
+}  // namespace
+
 // MasterSession wraps ClientGraph in a reference counted object.
 // This way, MasterSession can clear up the cache mapping Run requests to
 // compiled graphs while the compiled graph is still being used.
@@ -211,9 +224,14 @@ class MasterSession::ReffedClientGraph : public core::RefCounted {
                        RunCallableResponse* resp, CancellationManager* cm);
 
   // Calls workers to cleanup states for the step "step_id".  Calls
-  // `done` when all cleanup RPCs have completed.
+  // `done` when all cleanup RPCs have completed. For a pipelined step, the
+  // cleanup starts once all of its partitions have finished.
   void CleanupPartitionsAsync(int64 step_id, StatusCallback done);
 
+  // Waits until all pipelined steps that returned to the client have
+  // finished their remaining partitions.
+  void WaitForReturnedPipelinedSteps();
+
   // Post-processing of any runtime statistics gathered during execution.
   void ProcessStats(int64 step_id, PerStepState* pss, ProfileHandler* ph,
                     const RunOptions& options, RunMetadata* resp);
@@ -328,9 +346,175 @@ class MasterSession::ReffedClientGraph : public core::RefCounted {
   // destructor and does not wait for the rpc completion.
   void DeregisterPartitions();
 
+  // Issues the CleanupGraph calls for "step_id".
+  void DoCleanupPartitionsAsync(int64 step_id, StatusCallback done);
+
+  // Returns true if the step described by "pss" may return to the client
+  // before its partitions without fetches have finished, see
+  // ConfigProto.Experimental.max_pipelined_steps.
+  bool CanPipelineStep(const PerStepState& pss) const;
+
+  // Returns true if the partitions without fetches of one step may access a
+  // variable that the next step accesses, with at least one of the accesses
+  // being a write.
+  bool HasPipeliningConflict(
+      const std::unordered_map<string, VariableAccesses>& accesses) const;
+
+  // Set once the partitions are registered. Steps are only pipelined if their
+  // partitions that run after they return don't race with the next step on
+  // any variable.
+  bool pipelining_conflict_free_ = true;
+
+  // Waits until fewer than max_pipelined_steps pipelined steps are running,
+  // and records "step_id" as running. Returns the first error of a partition
+  // of an earlier step that finished after its step returned to the client.
+  Status StartPipelinedStep(int64 step_id);
+
+  // Must be called twice for each step started by StartPipelinedStep(): once
+  // with "background" false and the status returned to the client, and once
+  // with "background" true and the status of all partitions, when they have
+  // all finished.
+  void FinishPipelinedStep(int64 step_id, bool background,
+                           const Status& status);
+
+  // A step started by StartPipelinedStep() that has not finished yet.
+  struct PipelinedStep {
+    // Number of pending FinishPipelinedStep() calls.
+    int pending = 2;
+    // Whether the step has returned to the client.
+    bool returned = false;
+    bool error_returned_to_client = false;
+    Status background_status;
+    // Set if CleanupPartitionsAsync() was called before the partitions
+    // finished.
+    StatusCallback deferred_cleanup;
+  };
+
+  mutex pipeline_mu_;
+  condition_variable pipeline_cv_;
+  std::unordered_map<int64, PipelinedStep> pipelined_steps_
+      TF_GUARDED_BY(pipeline_mu_);
+  // First error of a partition that finished after its step had successfully
+  // returned to the client. Returned by the next pipelined step.
+  Status pipeline_status_ TF_GUARDED_BY(pipeline_mu_);
+
+  // A value fetched from a worker in an earlier step, see
+  // ConfigProto.Experimental.cache_fetched_tensors.
+  struct CachedFetch {
+    TensorDigest digest;
+    // Shares the buffer of the fetched value rather than copying it.
+    Tensor value;
+  };
+  // Cached values by rendezvous key.
+  typedef std::unordered_map<string, std::shared_ptr<const CachedFetch>>
+      CachedFetches;
+
+  // Adds the digests of the cached values for the recv keys of "req" to it,
+  // and records the cached values whose digests were sent in "*sent".
+  void AddCachedFetchDigests(MutableRunGraphRequestWrapper* req,
+                             CachedFetches* sent);
+
+  // If the worker left out the i^{th} value of "resp" because it matched a
+  // digest in "sent", restores it from "sent". Otherwise caches the value.
+  Status UpdateCachedFetch(const CachedFetches& sent, size_t i,
+                           MutableRunGraphResponseWrapper* resp);
+
+  mutex fetch_cache_mu_;
+  // Entries are replaced rather than modified, so that the steps that sent
+  // their digests can still use them.
+  CachedFetches fetch_cache_ TF_GUARDED_BY(fetch_cache_mu_);
+
   TF_DISALLOW_COPY_AND_ASSIGN(ReffedClientGraph);
 };
 
+namespace {
+
+bool IsVariableOp(const Node& node) {
+  static const auto* const kVariableOps = new std::unordered_set<string>{
+      "TemporaryVariable", "VarHandleOp", "Variable", "VariableV2"};
+  return kVariableOps->count(node.type_string()) > 0;
+}
+
+// Ops whose first output is their first input.
+bool IsForwardingOp(const Node& node) {
+  return node.IsIdentity() || node.IsEnter() || node.IsExit() ||
+         node.IsSwitch() || node.IsNextIteration();
+}
+
+bool IsVariableType(DataType dtype) {
+  return IsRefType(dtype) || dtype == DT_RESOURCE;
+}
+
+// Returns true and sets "*variable" if "output" of "node" is a ref or a
+// handle to a variable. Returns false if it is another kind of state, such as
+// a queue.
+bool FindSourceVariable(const Node* node, int output, string* variable) {
+  while (IsForwardingOp(*node) && output == 0) {
+    const Edge* edge;
+    if (!node->input_edge(0, &edge).ok()) break;
+    node = edge->src();
+    output = edge->src_output();
+  }
+  if (IsVariableOp(*node)) {
+    *variable = node->name();
+    return true;
+  }
+  // The value comes from outside of the graph, or one of several branches.
+  if (node->IsRecv() || node->IsArg() || node->IsMerge() ||
+      node->type_string() == "Placeholder" || IsForwardingOp(*node)) {
+    variable->clear();
+    return true;
+  }
+  return false;
+}
+
+// Records the variable accesses of the nodes of "graph", for each location
+// given by "node_to_loc".
+std::unordered_map<string, VariableAccesses> GetVariableAccesses(
+    const Graph& graph, const std::function<string(const Node*)>& node_to_loc) {
+  static const auto* const kResourceReadOps = new std::unordered_set<string>{
+      "ReadVariableOp", "ResourceGather", "ResourceGatherNd", "VariableShape",
+      "VarIsInitializedOp"};
+  std::unordered_map<string, VariableAccesses> accesses;
+  for (const Node* node : graph.op_nodes()) {
+    // The consumers of the forwarded value access the variable.
+    if (IsForwardingOp(*node) && node->num_outputs() > 0 &&
+        IsVariableType(node->output_type(0))) {
+      continue;
+    }
+    VariableAccesses* node_accesses = nullptr;
+    for (const Edge* edge : node->in_edges()) {
+      if (edge->IsControlEdge()) continue;
+      const DataType src_type = edge->src()->output_type(edge->src_output());
+      if (!IsVariableType(src_type)) continue;
+      string variable;
+      if (!FindSourceVariable(edge->src(), edge->src_output(), &variable)) {
+        continue;
+      }
+      const DataType input_type = node->input_type(edge->dst_input());
+      bool reads = true;
+      bool writes = false;
+      if (IsRefType(input_type)) {
+        // Assign overwrites the variable. The other ops with a ref input,
+        // like AssignAdd or ApplyGradientDescent, update it.
+        reads = node->type_string() != "Assign";
+        writes = true;
+      } else if (input_type == DT_RESOURCE) {
+        reads = node->type_string() != "AssignVariableOp";
+        writes = kResourceReadOps->count(node->type_string()) == 0;
+      }
+      if (node_accesses == nullptr) {
+        node_accesses = &accesses[node_to_loc(node)];
+      }
+      if (reads) node_accesses->reads.insert(variable);
+      if (writes) node_accesses->writes.insert(variable);
+    }
+  }
+  return accesses;
+}
+
+}  // namespace
+
 Status MasterSession::ReffedClientGraph::RegisterPartitions(
     PartitionOptions popts) {
   {  // Ensure register once.
@@ -345,6 +529,11 @@ Status MasterSession::ReffedClientGraph::RegisterPartitions(
       mu_.unlock();
       std::unordered_map<string, GraphDef> graph_defs;
       popts.flib_def = client_graph->flib_def.get();
+      std::unordered_map<string, VariableAccesses> variable_accesses;
+      if (session_opts_.config.experimental().max_pipelined_steps() > 1) {
+        variable_accesses =
+            GetVariableAccesses(client_graph->graph, popts.node_to_loc);
+      }
       Status s = DoBuildPartitions(popts, client_graph.get(), &graph_defs);
       if (s.ok()) {
         // NOTE(mrry): The pointers in `graph_defs_for_publishing` do not remain
@@ -359,6 +548,10 @@ Status MasterSession::ReffedClientGraph::RegisterPartitions(
         stats_publisher_->PublishGraphProto(graph_defs_for_publishing);
         s = DoRegisterPartitions(popts, std::move(graph_defs));
       }
+      if (s.ok() && !variable_accesses.empty()) {
+        pipelining_conflict_free_ =
+            !HasPipeliningConflict(variable_accesses);
+      }
       mu_.lock();
       init_result_ = s;
       init_done_.Notify();
@@ -500,7 +693,8 @@ namespace {
 // Helper class to manage "num" parallel RunGraph calls.
 class RunManyGraphs {
  public:
-  explicit RunManyGraphs(int num) : calls_(num), pending_(num) {}
+  explicit RunManyGraphs(int num)
+      : calls_(num), pending_(num), num_outstanding_(num) {}
 
   ~RunManyGraphs() {}
 
@@ -509,11 +703,25 @@ class RunManyGraphs {
     CallOptions opts;
     const string* worker_name;
     std::atomic<bool> done{false};
+    // If true, Wait() does not wait for this call.
+    bool trailing = false;
     std::unique_ptr<MutableRunGraphRequestWrapper> req;
     std::unique_ptr<MutableRunGraphResponseWrapper> resp;
   };
   Call* get(int index) { return &calls_[index]; }
 
+  // Lets Wait() return without waiting for the index-th call. Must be called
+  // before the call is issued.
+  void SetTrailing(int index) {
+    get(index)->trailing = true;
+    pending_.DecrementCount();
+  }
+
+  // Sets a callback that is called with the overall status once all calls,
+  // including trailing ones, are done. Must be called before any call is
+  // issued.
+  void SetAllDone(StatusCallback all_done) { all_done_ = std::move(all_done); }
+
   // When the index-th call is done, updates the overall status.
   void WhenDone(int index, const Status& s) {
     TRACEPRINTF("Partition %d %s", index, s.ToString().c_str());
@@ -532,7 +740,17 @@ class RunManyGraphs {
           Status(s.code(), strings::StrCat("From ", *call->worker_name, ":\n",
                                            s.error_message())));
     }
-    pending_.DecrementCount();
+    bool all_done;
+    {
+      mutex_lock l(mu_);
+      all_done = --num_outstanding_ == 0;
+    }
+    if (!call->trailing) {
+      pending_.DecrementCount();
+    }
+    if (all_done && all_done_) {
+      all_done_(status());
+    }
   }
 
   void StartCancel() {
@@ -563,7 +781,7 @@ class RunManyGraphs {
         << "RunStep still blocked after 60 seconds. Failed with error status: "
         << status();
     for (const Call& call : calls_) {
-      if (!call.done) {
+      if (!call.done && !call.trailing) {
         LOG(ERROR) << "- No response from RunGraph call to worker: "
                    << *call.worker_name;
       }
@@ -582,7 +800,9 @@ class RunManyGraphs {
   gtl::InlinedVector<Call, 4> calls_;
 
   BlockingCounter pending_;
+  StatusCallback all_done_;
   mutable mutex mu_;
+  int num_outstanding_ TF_GUARDED_BY(mu_);
   StatusGroup status_group_ TF_GUARDED_BY(mu_);
   bool cancel_issued_ TF_GUARDED_BY(mu_) = false;
 
@@ -666,11 +886,17 @@ Status MasterSession::ReffedClientGraph::RunPartitionsHelper(
   }
 
   const int num = partitions_.size();
-  RunManyGraphs calls(num);
+  // Shared with the RunGraph callbacks, which outlive this call for the
+  // trailing partitions of a pipelined step.
+  auto calls = std::make_shared<RunManyGraphs>(num);
+  const bool cache_fetches =
+      !is_partial_ &&
+      session_opts_.config.experimental().cache_fetched_tensors();
+  std::vector<CachedFetches> sent_fetches(cache_fetches ? num : 0);
 
   for (int i = 0; i < num; ++i) {
     const Part& part = partitions_[i];
-    RunManyGraphs::Call* c = calls.get(i);
+    RunManyGraphs::Call* c = calls->get(i);
     c->worker_name = &part.name;
     c->req.reset(part.worker->CreateRunGraphRequest());
     c->resp.reset(part.worker->CreateRunGraphResponse());
@@ -729,44 +955,73 @@ Status MasterSession::ReffedClientGraph::RunPartitionsHelper(
         c->req->add_recv_key(key);
       }
     }
+    if (cache_fetches) {
+      AddCachedFetchDigests(c->req.get(), &sent_fetches[i]);
+    }
+  }
+
+  auto token = cm->get_cancellation_token();
+  const bool pipelined = CanPipelineStep(*pss);
+  if (pipelined) {
+    TF_RETURN_IF_ERROR(StartPipelinedStep(step_id));
+    // Partitions that produce no fetches may keep running after this step
+    // returns. The cancellation callback stays registered until they finish.
+    for (int i = 0; i < num; ++i) {
+      if (partitions_[i].key_fetch.empty()) {
+        calls->SetTrailing(i);
+      }
+    }
+    Ref();
+    calls->SetAllDone([this, cm, token, step_id](const Status& s) {
+      cm->TryDeregisterCallback(token);
+      FinishPipelinedStep(step_id, /*background=*/true, s);
+      Unref();
+    });
   }
 
   // Issues RunGraph calls.
   for (int i = 0; i < num; ++i) {
     const Part& part = partitions_[i];
-    RunManyGraphs::Call* call = calls.get(i);
+    RunManyGraphs::Call* call = calls->get(i);
     TRACEPRINTF("Partition %d %s", i, part.name.c_str());
     part.worker->RunGraphAsync(
         &call->opts, call->req.get(), call->resp.get(),
-        std::bind(&RunManyGraphs::WhenDone, &calls, i, std::placeholders::_1));
+        [calls, i](const Status& s) { calls->WhenDone(i, s); });
   }
 
   // Waits for the RunGraph calls.
-  call_opts->SetCancelCallback([&calls]() {
+  call_opts->SetCancelCallback([calls]() {
     LOG(INFO) << "Client requested cancellation for RunStep, cancelling "
                  "worker operations.";
-    calls.StartCancel();
+    calls->StartCancel();
   });
-  auto token = cm->get_cancellation_token();
   const bool success =
-      cm->RegisterCallback(token, [&calls]() { calls.StartCancel(); });
+      cm->RegisterCallback(token, [calls]() { calls->StartCancel(); });
   if (!success) {
-    calls.StartCancel();
+    calls->StartCancel();
   }
-  calls.Wait();
+  calls->Wait();
   call_opts->ClearCancelCallback();
+  if (pipelined) {
+    FinishPipelinedStep(
+        step_id, /*background=*/false,
+        success ? calls->status() : errors::Cancelled("Step was cancelled"));
+  }
   if (success) {
-    cm->DeregisterCallback(token);
+    if (!pipelined) {
+      cm->DeregisterCallback(token);
+    }
   } else {
     return errors::Cancelled("Step was cancelled");
   }
-  TF_RETURN_IF_ERROR(calls.status());
+  TF_RETURN_IF_ERROR(calls->status());
 
   // Collects fetches and metadata.
   Status status;
   for (int i = 0; i < num; ++i) {
+    if (calls->get(i)->trailing) continue;
     const Part& part = partitions_[i];
-    MutableRunGraphResponseWrapper* run_graph_resp = calls.get(i)->resp.get();
+    MutableRunGraphResponseWrapper* run_graph_resp = calls->get(i)->resp.get();
     for (size_t j = 0; j < run_graph_resp->num_recvs(); ++j) {
       auto iter = part.key_fetch.find(run_graph_resp->recv_key(j));
       if (iter == part.key_fetch.end()) {
@@ -775,6 +1030,12 @@ Status MasterSession::ReffedClientGraph::RunPartitionsHelper(
         break;
       }
       const string& fetch = iter->second;
+      if (cache_fetches) {
+        status.Update(UpdateCachedFetch(sent_fetches[i], j, run_graph_resp));
+        if (!status.ok()) {
+          break;
+        }
+      }
       status.Update(
           resp->AddTensorFromRunGraphResponse(fetch, run_graph_resp, j));
       if (!status.ok()) {
@@ -924,6 +1185,19 @@ class CleanupBroadcastHelper {
 
 void MasterSession::ReffedClientGraph::CleanupPartitionsAsync(
     int64 step_id, StatusCallback done) {
+  {
+    mutex_lock l(pipeline_mu_);
+    auto it = pipelined_steps_.find(step_id);
+    if (it != pipelined_steps_.end()) {
+      it->second.deferred_cleanup = std::move(done);
+      return;
+    }
+  }
+  DoCleanupPartitionsAsync(step_id, std::move(done));
+}
+
+void MasterSession::ReffedClientGraph::DoCleanupPartitionsAsync(
+    int64 step_id, StatusCallback done) {
   const int num = partitions_.size();
   // Helper object will be deleted when the final call completes.
   CleanupBroadcastHelper* helper =
@@ -936,6 +1210,153 @@ void MasterSession::ReffedClientGraph::CleanupPartitionsAsync(
   }
 }
 
+void MasterSession::ReffedClientGraph::AddCachedFetchDigests(
+    MutableRunGraphRequestWrapper* req, CachedFetches* sent) {
+  mutex_lock l(fetch_cache_mu_);
+  for (size_t i = 0; i < req->num_recvs(); ++i) {
+    const string& key = req->recv_key(i);
+    auto it = fetch_cache_.find(key);
+    if (it == fetch_cache_.end()) {
+      req->add_recv_cached_digest(TensorDigest::default_instance());
+    } else {
+      req->add_recv_cached_digest(it->second->digest);
+      sent->emplace(key, it->second);
+    }
+  }
+}
+
+Status MasterSession::ReffedClientGraph::UpdateCachedFetch(
+    const CachedFetches& sent, size_t i,
+    MutableRunGraphResponseWrapper* resp) {
+  const string& key = resp->recv_key(i);
+  if (resp->recv_unchanged(i)) {
+    auto it = sent.find(key);
+    if (it == sent.end() ||
+        !SameTensorDigest(it->second->digest, resp->recv_digest(i))) {
+      return errors::Internal("Worker left out fetch key ", key,
+                              " whose value is not cached");
+    }
+    resp->SetRecvValue(i, it->second->value);
+    return Status::OK();
+  }
+  if (resp->recv_digest(i).hash() == 0) {
+    return Status::OK();
+  }
+  auto cached = std::make_shared<CachedFetch>();
+  cached->digest = resp->recv_digest(i);
+  // Unlike the TensorProto overload, this leaves the value in "resp", and
+  // only shares its buffer if "resp" is held in memory.
+  TF_RETURN_IF_ERROR(resp->RecvValue(i, &cached->value));
+  mutex_lock l(fetch_cache_mu_);
+  fetch_cache_[key] = std::move(cached);
+  return Status::OK();
+}
+
+bool MasterSession::ReffedClientGraph::CanPipelineStep(
+    const PerStepState& pss) const {
+  // Run metadata is assembled from all partitions before the step returns.
+  return session_opts_.config.experimental().max_pipelined_steps() > 1 &&
+         !is_partial_ &&
+         pipelining_conflict_free_ &&
+         collective_graph_key_ == BuildGraphOptions::kNoCollectiveGraphKey &&
+         !pss.collect_timeline && !pss.collect_costs && !pss.collect_rpcs &&
+         !pss.collect_partition_graphs;
+}
+
+bool MasterSession::ReffedClientGraph::HasPipeliningConflict(
+    const std::unordered_map<string, VariableAccesses>& accesses) const {
+  // The empty name stands for any variable.
+  std::unordered_set<string> all_writes;
+  for (const auto& loc_accesses : accesses) {
+    all_writes.insert(loc_accesses.second.writes.begin(),
+                      loc_accesses.second.writes.end());
+  }
+  for (const Part& part : partitions_) {
+    // Only the partitions without fetches still run after the step returns.
+    if (!part.key_fetch.empty()) continue;
+    auto it = accesses.find(part.name);
+    if (it == accesses.end()) continue;
+    const VariableAccesses& trailing = it->second;
+    string conflict;
+    if (!trailing.writes.empty()) {
+      conflict = *trailing.writes.begin();
+    } else if (!trailing.reads.empty() && !all_writes.empty() &&
+               (trailing.reads.count("") > 0 || all_writes.count("") > 0)) {
+      conflict = all_writes.count("") > 0 ? "" : *all_writes.begin();
+    } else {
+      for (const string& variable : trailing.reads) {
+        if (all_writes.count(variable) > 0) {
+          conflict = variable;
+          break;
+        }
+      }
+      if (conflict.empty()) continue;
+    }
+    LOG(INFO) << "Not pipelining the steps of session " << session_handle_
+              << ": partition " << part.name
+              << " runs after its step returns and accesses variable "
+              << (conflict.empty() ? "<unknown>" : conflict)
+              << ", which the next step also accesses.";
+    return true;
+  }
+  return false;
+}
+
+Status MasterSession::ReffedClientGraph::StartPipelinedStep(int64 step_id) {
+  const size_t max_steps =
+      session_opts_.config.experimental().max_pipelined_steps();
+  mutex_lock l(pipeline_mu_);
+  while (pipelined_steps_.size() >= max_steps) {
+    pipeline_cv_.wait(l);
+  }
+  Status s = pipeline_status_;
+  pipeline_status_ = Status::OK();
+  if (s.ok()) {
+    pipelined_steps_.emplace(step_id, PipelinedStep());
+  }
+  return s;
+}
+
+void MasterSession::ReffedClientGraph::FinishPipelinedStep(
+    int64 step_id, bool background, const Status& status) {
+  StatusCallback cleanup;
+  {
+    mutex_lock l(pipeline_mu_);
+    auto it = pipelined_steps_.find(step_id);
+    CHECK(it != pipelined_steps_.end()) << "Unknown pipelined step " << step_id;
+    PipelinedStep& step = it->second;
+    if (background) {
+      step.background_status = status;
+    } else {
+      step.returned = true;
+      step.error_returned_to_client = !status.ok();
+    }
+    if (--step.pending > 0) return;
+    if (!step.error_returned_to_client && !step.background_status.ok()) {
+      LOG(WARNING) << "A partition of step " << step_id
+                   << " failed after the step returned: "
+                   << step.background_status;
+      pipeline_status_.Update(step.background_status);
+    }
+    cleanup = std::move(step.deferred_cleanup);
+    pipelined_steps_.erase(it);
+    pipeline_cv_.notify_all();
+  }
+  if (cleanup) {
+    DoCleanupPartitionsAsync(step_id, std::move(cleanup));
+  }
+}
+
+void MasterSession::ReffedClientGraph::WaitForReturnedPipelinedSteps() {
+  mutex_lock l(pipeline_mu_);
+  while (std::any_of(pipelined_steps_.begin(), pipelined_steps_.end(),
+                     [](const std::pair<const int64, PipelinedStep>& step) {
+                       return step.second.returned;
+                     })) {
+    pipeline_cv_.wait(l);
+  }
+}
+
 void MasterSession::ReffedClientGraph::ProcessStats(int64 step_id,
                                                     PerStepState* pss,
                                                     ProfileHandler* ph,
@@ -2096,9 +2517,24 @@ Status MasterSession::ReleaseCallable(const ReleaseCallableRequest& req,
 }
 
 Status MasterSession::Close() {
+  std::vector<ReffedClientGraph*> pipelined;
   {
     mutex_lock l(mu_);
     closed_ = true;  // All subsequent calls to Run() or Extend() will fail.
+    for (const auto& p : run_graphs_) {
+      p.second->Ref();
+      pipelined.push_back(p.second);
+    }
+    for (const auto& p : callables_) {
+      p.second->Ref();
+      pipelined.push_back(p.second);
+    }
+  }
+  // The partitions of the pipelined steps that already returned to the client
+  // must complete: the client considers these steps done.
+  for (ReffedClientGraph* rcg : pipelined) {
+    rcg->WaitForReturnedPipelinedSteps();
+    rcg->Unref();
   }
   cancellation_manager_.StartCancel();
   std::vector<ReffedClientGraph*> to_unref;
@@ -366,6 +366,20 @@ void InMemoryRunGraphRequest::add_recv_key(const string& recv_key) {
   recvs_.push_back(recv_key);
 }
 
+size_t InMemoryRunGraphRequest::num_recv_cached_digests() const {
+  return recv_cached_digests_.size();
+}
+
+const TensorDigest& InMemoryRunGraphRequest::recv_cached_digest(
+    size_t i) const {
+  return recv_cached_digests_[i];
+}
+
+void InMemoryRunGraphRequest::add_recv_cached_digest(
+    const TensorDigest& digest) {
+  recv_cached_digests_.push_back(digest);
+}
+
 bool InMemoryRunGraphRequest::is_partial() const { return is_partial_; }
 
 void InMemoryRunGraphRequest::set_is_partial(bool is_partial) {
@@ -413,6 +427,9 @@ const RunGraphRequest& InMemoryRunGraphRequest::ToProto() const {
     for (size_t i = 0; i < num_recvs(); ++i) {
       proto_version_->add_recv_key(recv_key(i));
     }
+    for (size_t i = 0; i < num_recv_cached_digests(); ++i) {
+      *proto_version_->add_recv_cached_digest() = recv_cached_digest(i);
+    }
     proto_version_->set_is_partial(is_partial());
     proto_version_->set_is_last_partial_run(is_last_partial_run());
   }
@@ -513,6 +530,20 @@ void MutableProtoRunGraphRequest::add_recv_key(const string& recv_key) {
   request_.add_recv_key(recv_key);
 }
 
+size_t MutableProtoRunGraphRequest::num_recv_cached_digests() const {
+  return request_.recv_cached_digest_size();
+}
+
+const TensorDigest& MutableProtoRunGraphRequest::recv_cached_digest(
+    size_t i) const {
+  return request_.recv_cached_digest(i);
+}
+
+void MutableProtoRunGraphRequest::add_recv_cached_digest(
+    const TensorDigest& digest) {
+  *request_.add_recv_cached_digest() = digest;
+}
+
 bool MutableProtoRunGraphRequest::is_partial() const {
   return request_.is_partial();
 }
@@ -594,6 +625,14 @@ const string& ProtoRunGraphRequest::recv_key(size_t i) const {
   return request_->recv_key(i);
 }
 
+size_t ProtoRunGraphRequest::num_recv_cached_digests() const {
+  return request_->recv_cached_digest_size();
+}
+
+const TensorDigest& ProtoRunGraphRequest::recv_cached_digest(size_t i) const {
+  return request_->recv_cached_digest(i);
+}
+
 bool ProtoRunGraphRequest::is_partial() const { return request_->is_partial(); }
 
 bool ProtoRunGraphRequest::is_last_partial_run() const {
@@ -632,6 +671,39 @@ void InMemoryRunGraphResponse::AddRecv(const string& key, const Tensor& value) {
   recvs_.emplace_back(key, value);
 }
 
+bool SameTensorDigest(const TensorDigest& a, const TensorDigest& b) {
+  return a.hash() != 0 && a.hash() == b.hash() &&
+         a.fingerprint() == b.fingerprint() && a.num_bytes() == b.num_bytes();
+}
+
+const TensorDigest& InMemoryRunGraphResponse::recv_digest(size_t i) const {
+  return i < recv_digests_.size() ? recv_digests_[i]
+                                  : TensorDigest::default_instance();
+}
+
+bool InMemoryRunGraphResponse::recv_unchanged(size_t i) const {
+  return i < recv_unchanged_.size() && recv_unchanged_[i];
+}
+
+void InMemoryRunGraphResponse::SetRecvValue(size_t i, const Tensor& value) {
+  recvs_[i].second = value;
+}
+
+void InMemoryRunGraphResponse::AddHashedRecv(const string& key,
+                                             const Tensor& value,
+                                             const TensorDigest& digest) {
+  recvs_.emplace_back(key, value);
+  recv_digests_.push_back(digest);
+  recv_unchanged_.push_back(false);
+}
+
+void InMemoryRunGraphResponse::AddUnchangedRecv(const string& key,
+                                                const TensorDigest& digest) {
+  recvs_.emplace_back(key, Tensor());
+  recv_digests_.push_back(digest);
+  recv_unchanged_.push_back(true);
+}
+
 StepStats* InMemoryRunGraphResponse::mutable_step_stats() {
   return &step_stats_;
 }
@@ -700,6 +772,34 @@ void OwnedProtoRunGraphResponse::AddRecv(const string& key,
   value.AsProtoTensorContent(value_proto);
 }
 
+const TensorDigest& OwnedProtoRunGraphResponse::recv_digest(size_t i) const {
+  return i < response_.recv_digest_size() ? response_.recv_digest(i)
+                                          : TensorDigest::default_instance();
+}
+
+bool OwnedProtoRunGraphResponse::recv_unchanged(size_t i) const {
+  return i < response_.recv_unchanged_size() && response_.recv_unchanged(i);
+}
+
+void OwnedProtoRunGraphResponse::SetRecvValue(size_t i, const Tensor& value) {
+  value.AsProtoTensorContent(response_.mutable_recv(i)->mutable_tensor());
+}
+
+void OwnedProtoRunGraphResponse::AddHashedRecv(const string& key,
+                                               const Tensor& value,
+                                               const TensorDigest& digest) {
+  AddRecv(key, value);
+  *response_.add_recv_digest() = digest;
+  response_.add_recv_unchanged(false);
+}
+
+void OwnedProtoRunGraphResponse::AddUnchangedRecv(const string& key,
+                                                  const TensorDigest& digest) {
+  response_.add_recv()->set_name(key);
+  *response_.add_recv_digest() = digest;
+  response_.add_recv_unchanged(true);
+}
+
 StepStats* OwnedProtoRunGraphResponse::mutable_step_stats() {
   return response_.mutable_step_stats();
 }
@@ -771,6 +871,36 @@ void NonOwnedProtoRunGraphResponse::AddRecv(const string& key,
   value.AsProtoTensorContent(value_proto);
 }
 
+const TensorDigest& NonOwnedProtoRunGraphResponse::recv_digest(
+    size_t i) const {
+  return i < response_->recv_digest_size() ? response_->recv_digest(i)
+                                           : TensorDigest::default_instance();
+}
+
+bool NonOwnedProtoRunGraphResponse::recv_unchanged(size_t i) const {
+  return i < response_->recv_unchanged_size() && response_->recv_unchanged(i);
+}
+
+void NonOwnedProtoRunGraphResponse::SetRecvValue(size_t i,
+                                                 const Tensor& value) {
+  value.AsProtoTensorContent(response_->mutable_recv(i)->mutable_tensor());
+}
+
+void NonOwnedProtoRunGraphResponse::AddHashedRecv(const string& key,
+                                                  const Tensor& value,
+                                                  const TensorDigest& digest) {
+  AddRecv(key, value);
+  *response_->add_recv_digest() = digest;
+  response_->add_recv_unchanged(false);
+}
+
+void NonOwnedProtoRunGraphResponse::AddUnchangedRecv(
+    const string& key, const TensorDigest& digest) {
+  response_->add_recv()->set_name(key);
+  *response_->add_recv_digest() = digest;
+  response_->add_recv_unchanged(true);
+}
+
 StepStats* NonOwnedProtoRunGraphResponse::mutable_step_stats() {
   return response_->mutable_step_stats();
 }
@@ -282,6 +282,12 @@ class RunGraphRequestWrapper {
   virtual size_t num_recvs() const = 0;
   virtual const string& recv_key(size_t i) const = 0;
 
+  // Digests of the values that the caller holds from earlier steps for each
+  // of the recv keys, with a zero `hash` if it holds none. Empty if the
+  // caller does not cache fetched values.
+  virtual size_t num_recv_cached_digests() const = 0;
+  virtual const TensorDigest& recv_cached_digest(size_t i) const = 0;
+
   // True if the RunGraphRequest is a partial run request.
   virtual bool is_partial() const = 0;
 
@@ -322,6 +328,8 @@ class MutableRunGraphRequestWrapper : public RunGraphRequestWrapper {
       const string& send_key) = 0;
 
   virtual void add_recv_key(const string& recv_key) = 0;
+  // Must be called once per recv key, in the same order, if at all.
+  virtual void add_recv_cached_digest(const TensorDigest& digest) = 0;
   virtual void set_is_partial(bool is_partial) = 0;
   virtual void set_is_last_partial_run(bool is_last_partial_run) = 0;
   virtual void set_store_errors_in_response_body(bool store_errors) = 0;
@@ -341,6 +349,8 @@ class InMemoryRunGraphRequest : public MutableRunGraphRequestWrapper {
   Status SendValue(size_t i, Tensor* out_tensor) const override;
   size_t num_recvs() const override;
   const string& recv_key(size_t i) const override;
+  size_t num_recv_cached_digests() const override;
+  const TensorDigest& recv_cached_digest(size_t i) const override;
   bool is_partial() const override;
   bool is_last_partial_run() const override;
   const RunGraphRequest& ToProto() const override;
@@ -360,6 +370,7 @@ class InMemoryRunGraphRequest : public MutableRunGraphRequestWrapper {
       const RunCallableRequest& run_callable_request, size_t i,
       const string& send_key) override;
   void add_recv_key(const string& recv_key) override;
+  void add_recv_cached_digest(const TensorDigest& digest) override;
   void set_is_partial(bool is_partial) override;
   void set_is_last_partial_run(bool is_last_partial_run) override;
   void set_store_errors_in_response_body(bool store_errors) override;
@@ -373,6 +384,7 @@ class InMemoryRunGraphRequest : public MutableRunGraphRequestWrapper {
   ExecutorOpts exec_opts_;
   gtl::InlinedVector<std::pair<string, Tensor>, 4> sends_;
   gtl::InlinedVector<string, 4> recvs_;
+  gtl::InlinedVector<TensorDigest, 4> recv_cached_digests_;
   bool is_partial_ = false;
   bool is_last_partial_run_ = false;
   bool store_errors_in_response_body_ = false;
@@ -401,6 +413,8 @@ class MutableProtoRunGraphRequest : public MutableRunGraphRequestWrapper {
   Status SendValue(size_t i, Tensor* out_tensor) const override;
   size_t num_recvs() const override;
   const string& recv_key(size_t i) const override;
+  size_t num_recv_cached_digests() const override;
+  const TensorDigest& recv_cached_digest(size_t i) const override;
   bool is_partial() const override;
   bool is_last_partial_run() const override;
   bool store_errors_in_response_body() const override;
@@ -420,6 +434,7 @@ class MutableProtoRunGraphRequest : public MutableRunGraphRequestWrapper {
       const RunCallableRequest& run_callable_request, size_t i,
       const string& send_key) override;
   void add_recv_key(const string& recv_key) override;
+  void add_recv_cached_digest(const TensorDigest& digest) override;
   void set_is_partial(bool is_partial) override;
   void set_is_last_partial_run(bool is_last_partial_run) override;
   void set_store_errors_in_response_body(bool store_errors) override;
@@ -444,6 +459,8 @@ class ProtoRunGraphRequest : public RunGraphRequestWrapper {
   Status SendValue(size_t i, Tensor* out_tensor) const override;
   size_t num_recvs() const override;
   const string& recv_key(size_t i) const override;
+  size_t num_recv_cached_digests() const override;
+  const TensorDigest& recv_cached_digest(size_t i) const override;
   bool is_partial() const override;
   bool is_last_partial_run() const override;
   bool store_errors_in_response_body() const override;
@@ -467,6 +484,10 @@ class ProtoRunGraphRequest : public RunGraphRequestWrapper {
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// Returns true if "a" and "b" are the digests of hashed values and all of
+// their fields match.
+bool SameTensorDigest(const TensorDigest& a, const TensorDigest& b);
+
 // Abstract interface for a mutable RunGraphResponse message.
 //
 // Note that there is no corresponding (immutable)
@@ -486,6 +507,22 @@ class MutableRunGraphResponseWrapper {
   virtual Status RecvValue(size_t i, Tensor* out_tensor) = 0;
   virtual void AddRecv(const string& key, const Tensor& value) = 0;
 
+  // Digests of the recv values, if the request carried
+  // `recv_cached_digest`. `recv_digest(i)` has a zero `hash` if the value was
+  // not hashed, and `recv_unchanged(i)` is true if the value was left out
+  // because the caller already holds it. The caller may then restore it with
+  // `SetRecvValue()`.
+  virtual const TensorDigest& recv_digest(size_t i) const = 0;
+  virtual bool recv_unchanged(size_t i) const = 0;
+  virtual void SetRecvValue(size_t i, const Tensor& value) = 0;
+  // Like `AddRecv()`, but also records the digest of "value". Must not be
+  // mixed with `AddRecv()` in the same response.
+  virtual void AddHashedRecv(const string& key, const Tensor& value,
+                             const TensorDigest& digest) = 0;
+  // Adds a recv whose value, with digest "digest", is left out.
+  virtual void AddUnchangedRecv(const string& key,
+                                const TensorDigest& digest) = 0;
+
   // Submessages that store performance statistics about the subgraph
   // execution, if necessary.
   virtual StepStats* mutable_step_stats() = 0;
@@ -523,6 +560,13 @@ class InMemoryRunGraphResponse : public MutableRunGraphResponseWrapper {
   Status RecvValue(size_t i, TensorProto* out_tensor) override;
   Status RecvValue(size_t i, Tensor* out_tensor) override;
   void AddRecv(const string& key, const Tensor& value) override;
+  const TensorDigest& recv_digest(size_t i) const override;
+  bool recv_unchanged(size_t i) const override;
+  void SetRecvValue(size_t i, const Tensor& value) override;
+  void AddHashedRecv(const string& key, const Tensor& value,
+                     const TensorDigest& digest) override;
+  void AddUnchangedRecv(const string& key,
+                        const TensorDigest& digest) override;
   StepStats* mutable_step_stats() override;
   CostGraphDef* mutable_cost_graph() override;
   size_t num_partition_graphs() const override;
@@ -539,6 +583,8 @@ class InMemoryRunGraphResponse : public MutableRunGraphResponseWrapper {
 
  private:
   gtl::InlinedVector<std::pair<string, Tensor>, 4> recvs_;
+  gtl::InlinedVector<TensorDigest, 4> recv_digests_;
+  gtl::InlinedVector<bool, 4> recv_unchanged_;
   StepStats step_stats_;
   CostGraphDef cost_graph_;
   std::vector<GraphDef> partition_graphs_;
@@ -556,6 +602,13 @@ class OwnedProtoRunGraphResponse : public MutableRunGraphResponseWrapper {
   Status RecvValue(size_t i, TensorProto* out_tensor) override;
   Status RecvValue(size_t i, Tensor* out_tensor) override;
   void AddRecv(const string& key, const Tensor& value) override;
+  const TensorDigest& recv_digest(size_t i) const override;
+  bool recv_unchanged(size_t i) const override;
+  void SetRecvValue(size_t i, const Tensor& value) override;
+  void AddHashedRecv(const string& key, const Tensor& value,
+                     const TensorDigest& digest) override;
+  void AddUnchangedRecv(const string& key,
+                        const TensorDigest& digest) override;
   StepStats* mutable_step_stats() override;
   CostGraphDef* mutable_cost_graph() override;
   size_t num_partition_graphs() const override;
@@ -583,6 +636,13 @@ class NonOwnedProtoRunGraphResponse : public MutableRunGraphResponseWrapper {
   Status RecvValue(size_t i, TensorProto* out_tensor) override;
   Status RecvValue(size_t i, Tensor* out_tensor) override;
   void AddRecv(const string& key, const Tensor& value) override;
+  const TensorDigest& recv_digest(size_t i) const override;
+  bool recv_unchanged(size_t i) const override;
+  void SetRecvValue(size_t i, const Tensor& value) override;
+  void AddHashedRecv(const string& key, const Tensor& value,
+                     const TensorDigest& digest) override;
+  void AddUnchangedRecv(const string& key,
+                        const TensorDigest& digest) override;
   StepStats* mutable_step_stats() override;
   CostGraphDef* mutable_cost_graph() override;
   size_t num_partition_graphs() const override;
@@ -37,6 +37,14 @@ Tensor TensorB() {
   return b_tensor;
 }
 
+TensorDigest Digest(uint64 hash, uint64 fingerprint, int64 num_bytes) {
+  TensorDigest digest;
+  digest.set_hash(hash);
+  digest.set_fingerprint(fingerprint);
+  digest.set_num_bytes(num_bytes);
+  return digest;
+}
+
 void BuildRunStepRequest(MutableRunStepRequestWrapper* request) {
   request->set_session_handle("handle");
   request->set_partial_run_handle("partial_handle");
@@ -80,6 +88,8 @@ void BuildRunGraphRequest(const RunStepRequestWrapper& run_step_request,
                                                             "send_1"));
   run_graph_request->add_recv_key("recv_2");
   run_graph_request->add_recv_key("recv_3");
+  run_graph_request->add_recv_cached_digest(TensorDigest());
+  run_graph_request->add_recv_cached_digest(Digest(42, 43, 16));
   run_graph_request->set_is_partial(true);
 }
 
@@ -95,6 +105,10 @@ void CheckRunGraphRequest(const RunGraphRequestWrapper& request) {
   test::ExpectTensorEqual<int32>(TensorA(), val);
   TF_EXPECT_OK(request.SendValue(1, &val));
   test::ExpectTensorEqual<int32>(TensorB(), val);
+  ASSERT_EQ(2, request.num_recv_cached_digests());
+  EXPECT_EQ(0, request.recv_cached_digest(0).hash());
+  EXPECT_TRUE(
+      SameTensorDigest(Digest(42, 43, 16), request.recv_cached_digest(1)));
   EXPECT_TRUE(request.is_partial());
   EXPECT_FALSE(request.is_last_partial_run());
 }
@@ -130,6 +144,29 @@ void CheckRunGraphResponse(MutableRunGraphResponseWrapper* response) {
             response->mutable_partition_graph(0)->versions().min_consumer());
 }
 
+void BuildHashedRunGraphResponse(
+    MutableRunGraphResponseWrapper* run_graph_response) {
+  run_graph_response->AddHashedRecv("recv_2", TensorA(), Digest(17, 18, 16));
+  run_graph_response->AddUnchangedRecv("recv_3", Digest(42, 43, 8));
+}
+
+void CheckHashedRunGraphResponse(MutableRunGraphResponseWrapper* response) {
+  ASSERT_EQ(2, response->num_recvs());
+  EXPECT_EQ("recv_2", response->recv_key(0));
+  EXPECT_EQ("recv_3", response->recv_key(1));
+  EXPECT_TRUE(SameTensorDigest(Digest(17, 18, 16), response->recv_digest(0)));
+  EXPECT_TRUE(SameTensorDigest(Digest(42, 43, 8), response->recv_digest(1)));
+  EXPECT_FALSE(response->recv_unchanged(0));
+  EXPECT_TRUE(response->recv_unchanged(1));
+  Tensor val;
+  TF_EXPECT_OK(response->RecvValue(0, &val));
+  test::ExpectTensorEqual<int32>(TensorA(), val);
+
+  response->SetRecvValue(1, TensorB());
+  TF_EXPECT_OK(response->RecvValue(1, &val));
+  test::ExpectTensorEqual<int32>(TensorB(), val);
+}
+
 void BuildRunStepResponse(MutableRunGraphResponseWrapper* run_graph_response,
                           MutableRunStepResponseWrapper* run_step_response) {
   TF_EXPECT_OK(run_step_response->AddTensorFromRunGraphResponse(
@@ -251,6 +288,37 @@ TEST(MessageWrappers, RunGraphResponse_Basic) {
   CheckRunGraphResponse(&non_owned_proto_response);
 }
 
+TEST(MessageWrappers, RunGraphResponse_Hashed) {
+  InMemoryRunGraphResponse in_memory_response;
+  BuildHashedRunGraphResponse(&in_memory_response);
+  CheckHashedRunGraphResponse(&in_memory_response);
+
+  OwnedProtoRunGraphResponse owned_proto_response;
+  BuildHashedRunGraphResponse(&owned_proto_response);
+  CheckHashedRunGraphResponse(&owned_proto_response);
+
+  RunGraphResponse response_proto;
+  NonOwnedProtoRunGraphResponse non_owned_proto_response(&response_proto);
+  BuildHashedRunGraphResponse(&non_owned_proto_response);
+  CheckHashedRunGraphResponse(&non_owned_proto_response);
+
+  // Responses that are not hashed report no hashes.
+  OwnedProtoRunGraphResponse unhashed_response;
+  BuildRunGraphResponse(&unhashed_response);
+  EXPECT_EQ(0, unhashed_response.recv_digest(0).hash());
+  EXPECT_FALSE(unhashed_response.recv_unchanged(0));
+}
+
+TEST(MessageWrappers, SameTensorDigest) {
+  EXPECT_TRUE(SameTensorDigest(Digest(1, 2, 3), Digest(1, 2, 3)));
+  // Values match only if both hashes and the size match.
+  EXPECT_FALSE(SameTensorDigest(Digest(1, 2, 3), Digest(7, 2, 3)));
+  EXPECT_FALSE(SameTensorDigest(Digest(1, 2, 3), Digest(1, 7, 3)));
+  EXPECT_FALSE(SameTensorDigest(Digest(1, 2, 3), Digest(1, 2, 7)));
+  // Values that were not hashed never match.
+  EXPECT_FALSE(SameTensorDigest(TensorDigest(), TensorDigest()));
+}
+
 TEST(MessageWrappers, RunStepResponse_Basic) {
   {
     // Worker -(in memory)-> Master -(in memory)-> Client.
@@ -22,7 +22,9 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/graph/default_device.h"
 #include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
 #include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/lib/core/notification.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/init_main.h"
@@ -862,6 +864,239 @@ TEST(SessionTest, SharedVar) {
   }
 }
 
+// Adds a FIFO queue of scalar floats, shared between the sessions.
+static Node* SharedFloatQueue(Graph* g, const string& shared_name) {
+  Node* queue;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "FIFOQueueV2")
+                  .Attr("component_types", {DT_FLOAT})
+                  .Attr("shared_name", shared_name)
+                  .Finalize(g, &queue));
+  return queue;
+}
+
+static Node* Dequeue(Graph* g, Node* queue) {
+  Node* dequeue;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "QueueDequeueV2")
+                  .Input(queue)
+                  .Attr("component_types", {DT_FLOAT})
+                  .Finalize(g, &dequeue));
+  return dequeue;
+}
+
+static Node* Enqueue(Graph* g, Node* queue, Node* value) {
+  Node* enqueue;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "QueueEnqueueV2")
+                  .Input(queue)
+                  .Input({NodeBuilder::NodeOut(value)})
+                  .Finalize(g, &enqueue));
+  return enqueue;
+}
+
+TEST(SessionTest, PipelinedSteps) {
+  std::unique_ptr<test::TestCluster> cluster;
+  TF_CHECK_OK(test::TestCluster::MakeTestCluster(Devices(1, 0), 2, &cluster));
+  const string master = cluster->targets()[0];
+  CHECK_GE(cluster->devices().size(), 2);
+  const string& worker_dev = cluster->devices()[0].name();
+  const string& ps_dev = cluster->devices()[1].name();
+
+  // The step fetches "fetch" from the worker, and moves a value from "in" to
+  // "out" on the parameter server. The move blocks until "in" has a value, so
+  // it only finishes after the step returned.
+  GraphDef gdef;
+  string move_name;
+  string fetch_name;
+  string feed_in_name;
+  string out_size_name;
+  {
+    Graph g(OpRegistry::Global());
+    Tensor one(DT_FLOAT, TensorShape({}));
+    one.scalar<float>()() = 1.0;
+    Node* in = SharedFloatQueue(&g, "pipelined_steps_in");
+    Node* out = SharedFloatQueue(&g, "pipelined_steps_out");
+    Node* move = Enqueue(&g, out, Dequeue(&g, in));
+    Node* feed_in = Enqueue(&g, in, test::graph::Constant(&g, one));
+    Node* out_size;
+    TF_CHECK_OK(NodeBuilder(g.NewName("n"), "QueueSizeV2")
+                    .Input(out)
+                    .Finalize(&g, &out_size));
+    Node* fetch = test::graph::Identity(&g, test::graph::Constant(&g, one));
+    move_name = move->name();
+    fetch_name = fetch->name();
+    feed_in_name = feed_in->name();
+    out_size_name = out_size->name();
+    test::graph::ToGraphDef(&g, &gdef);
+    for (NodeDef& node : *gdef.mutable_node()) {
+      node.set_device(ps_dev);
+    }
+    SetDevice(&gdef, fetch_name, worker_dev);
+  }
+
+  SessionOptions options = Options(master, 1);
+  options.config.mutable_experimental()->set_max_pipelined_steps(2);
+  std::unique_ptr<Session> sess(NewRemote(options));
+  TF_CHECK_OK(sess->Create(gdef));
+  // Returns although the move is blocked.
+  std::vector<Tensor> ret;
+  TF_CHECK_OK(sess->Run({}, {fetch_name}, {move_name}, &ret));
+  ASSERT_EQ(ret.size(), 1);
+  IsSingleFloatValue(ret[0], 1.0);
+
+  // Close() waits for the move rather than cancelling it.
+  Notification closed;
+  std::unique_ptr<Thread> close_thread(
+      Env::Default()->StartThread(ThreadOptions(), "close", [&sess, &closed]() {
+        TF_CHECK_OK(sess->Close());
+        closed.Notify();
+      }));
+  Env::Default()->SleepForMicroseconds(100000);
+  EXPECT_FALSE(closed.HasBeenNotified());
+
+  std::unique_ptr<Session> other(NewRemote(Options(master, 1)));
+  TF_CHECK_OK(other->Create(gdef));
+  TF_CHECK_OK(other->Run({}, {}, {feed_in_name}, nullptr));
+  closed.WaitForNotification();
+  close_thread.reset();
+
+  TF_CHECK_OK(other->Run({}, {out_size_name}, {}, &ret));
+  ASSERT_EQ(ret.size(), 1);
+  EXPECT_EQ(ret[0].scalar<int32>()(), 1);
+  TF_CHECK_OK(other->Close());
+}
+
+TEST(SessionTest, PipelinedStepsWithVariableConflicts) {
+  std::unique_ptr<test::TestCluster> cluster;
+  TF_CHECK_OK(test::TestCluster::MakeTestCluster(Devices(1, 0), 2, &cluster));
+  const string master = cluster->targets()[0];
+  CHECK_GE(cluster->devices().size(), 2);
+  const string& worker_dev = cluster->devices()[0].name();
+  const string& ps_dev = cluster->devices()[1].name();
+
+  // The step fetches "fetch" from the worker, and adds a value dequeued from
+  // "in" to "var" on the parameter server. The next step could read "var"
+  // before the addition, so the step must not return before it.
+  GraphDef gdef;
+  string init_name;
+  string inc_name;
+  string get_name;
+  string fetch_name;
+  string feed_in_name;
+  {
+    Graph g(OpRegistry::Global());
+    Tensor one(DT_FLOAT, TensorShape({}));
+    one.scalar<float>()() = 1.0;
+    Tensor zero(DT_FLOAT, TensorShape({}));
+    zero.scalar<float>()() = 0.0;
+    Node* var = test::graph::Var(&g, DT_FLOAT, one.shape());
+    Node* init = test::graph::Assign(&g, var, test::graph::Constant(&g, zero));
+    Node* in = SharedFloatQueue(&g, "variable_conflicts_in");
+    Node* inc;
+    TF_CHECK_OK(NodeBuilder(g.NewName("n"), "AssignAdd")
+                    .Input(var)
+                    .Input(Dequeue(&g, in))
+                    .Attr("use_locking", true)
+                    .Finalize(&g, &inc));
+    Node* feed_in = Enqueue(&g, in, test::graph::Constant(&g, one));
+    Node* fetch = test::graph::Identity(&g, test::graph::Constant(&g, one));
+    init_name = init->name();
+    inc_name = inc->name();
+    get_name = var->name();
+    fetch_name = fetch->name();
+    feed_in_name = feed_in->name();
+    test::graph::ToGraphDef(&g, &gdef);
+    for (NodeDef& node : *gdef.mutable_node()) {
+      node.set_device(ps_dev);
+    }
+    SetDevice(&gdef, fetch_name, worker_dev);
+  }
+
+  SessionOptions options = Options(master, 1);
+  options.config.mutable_experimental()->set_max_pipelined_steps(2);
+  std::unique_ptr<Session> sess(NewRemote(options));
+  TF_CHECK_OK(sess->Create(gdef));
+  TF_CHECK_OK(sess->Run({}, {}, {init_name}, nullptr));
+
+  Notification returned;
+  std::unique_ptr<Thread> run_thread(
+      Env::Default()->StartThread(ThreadOptions(), "run", [&]() {
+        std::vector<Tensor> ret;
+        TF_CHECK_OK(sess->Run({}, {fetch_name}, {inc_name}, &ret));
+        returned.Notify();
+      }));
+  Env::Default()->SleepForMicroseconds(100000);
+  EXPECT_FALSE(returned.HasBeenNotified());
+
+  std::unique_ptr<Session> other(NewRemote(Options(master, 1)));
+  TF_CHECK_OK(other->Create(gdef));
+  TF_CHECK_OK(other->Run({}, {}, {feed_in_name}, nullptr));
+  run_thread.reset();
+  TF_CHECK_OK(other->Close());
+
+  // The step returned after the addition.
+  std::vector<Tensor> ret;
+  TF_CHECK_OK(sess->Run({}, {get_name}, {}, &ret));
+  ASSERT_EQ(ret.size(), 1);
+  EXPECT_EQ(ret[0].scalar<float>()(), 1.0);
+  TF_CHECK_OK(sess->Close());
+}
+
+TEST(SessionTest, CacheFetchedTensors) {
+  std::unique_ptr<test::TestCluster> cluster;
+  TF_CHECK_OK(test::TestCluster::MakeTestCluster(Devices(1, 0), 2, &cluster));
+  const string master = cluster->targets()[0];
+  CHECK_GE(cluster->devices().size(), 2);
+  const string& ps_dev = cluster->devices()[1].name();
+
+  // "var" is fetched from the parameter server in every step, but only
+  // changes when "inc" runs.
+  GraphDef gdef;
+  string init_name;
+  string inc_name;
+  string get_name;
+  {
+    Graph g(OpRegistry::Global());
+    Tensor one(DT_FLOAT, TensorShape({1024}));
+    one.flat<float>().setConstant(1.0);
+    Tensor zero(DT_FLOAT, TensorShape({1024}));
+    zero.flat<float>().setZero();
+    Node* var = test::graph::Var(&g, DT_FLOAT, one.shape());
+    Node* init = test::graph::Assign(&g, var, test::graph::Constant(&g, zero));
+    Node* inc;
+    TF_CHECK_OK(NodeBuilder(g.NewName("n"), "AssignAdd")
+                    .Input(var)
+                    .Input(test::graph::Constant(&g, one))
+                    .Finalize(&g, &inc));
+    init_name = init->name();
+    inc_name = inc->name();
+    get_name = var->name();
+    test::graph::ToGraphDef(&g, &gdef);
+    for (NodeDef& node : *gdef.mutable_node()) {
+      node.set_device(ps_dev);
+    }
+  }
+
+  SessionOptions options = Options(master, 1);
+  options.config.mutable_experimental()->set_cache_fetched_tensors(true);
+  std::unique_ptr<Session> sess(NewRemote(options));
+  TF_CHECK_OK(sess->Create(gdef));
+  TF_CHECK_OK(sess->Run({}, {}, {init_name}, nullptr));
+  float expected = 0;
+  for (int i = 0; i < 10; ++i) {
+    if (i % 3 == 0) {
+      TF_CHECK_OK(sess->Run({}, {}, {inc_name}, nullptr));
+      ++expected;
+    }
+    std::vector<Tensor> ret;
+    TF_CHECK_OK(sess->Run({}, {get_name}, {}, &ret));
+    ASSERT_EQ(ret.size(), 1);
+    ASSERT_EQ(ret[0].NumElements(), 1024);
+    for (int j = 0; j < 1024; ++j) {
+      ASSERT_EQ(ret[0].flat<float>()(j), expected);
+    }
+  }
+  TF_CHECK_OK(sess->Close());
+}
+
 void CreateInvalidGraph(const string& graph_def_ascii,
                         const string& error_substring) {
   GraphDef graph;
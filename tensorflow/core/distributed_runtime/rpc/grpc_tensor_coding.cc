@@ -19,6 +19,7 @@ limitations under the License.
 #include "grpcpp/support/slice.h"
 #include "absl/flags/flag.h"
 #include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_reference.h"
@@ -64,15 +65,19 @@ void EncodeRecvTensorResponseToByteBuffer(const RecvTensorResponse& proto,
 // D2:  <varint32 length of R.tensor().tensor_content() data>
 // E:   <actual data for val's representation>
 //
-// If the tensor data is up to "kLargeTensorBytes", then A
+// If the tensor data is smaller than "kMinSharedTensorBytes", then A
 // through E will all be encoded into "*result" in a single grpc::Slice.
 //
-// If the tensor data is larger than "kLargeTensorBytes", then A through
-// D2 will be encoded in one grpc::Slice, and E will be encoded in a second
-// grpc::Slice that points to the backing store for the tensor data, to avoid
-// copying the tensor data (and the grpc::Slice setup will be arrange so as
-// to dereference the underlying tensor data buffer when it is no longer
-// needed in the "*result" ByteBuffer).
+// Otherwise A through D2 will be encoded in one grpc::Slice, and E will be
+// encoded in a second grpc::Slice that points to the backing store for the
+// tensor data, to avoid copying the tensor data (and the grpc::Slice setup
+// will be arrange so as to dereference the underlying tensor data buffer when
+// it is no longer needed in the "*result" ByteBuffer).
+//
+// Below "kMinSharedTensorBytes" the reference counting and the extra slice
+// cost more than the memcpy they would save.
+static constexpr size_t kMinSharedTensorBytes = 64;
+
 static int VarLengthEncodingSize(uint32 tag, size_t bytes) {
   return core::VarintLength(tag << 3) + core::VarintLength(bytes) + bytes;
 }
@@ -139,7 +144,6 @@ static void EncodeSkeleton(const Tensor& val, io::ProtoEncodeHelper* e) {
 
 void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
                               ::grpc::ByteBuffer* result) {
-  const int kLargeTensorBytes = 1024;
   RecvTensorResponse response;
   if (is_dead) {
     response.set_is_dead(is_dead);
@@ -151,6 +155,7 @@ void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
     // TODO(jeff,sanjay): If this becomes an issue, we could
     // go directly from val -> ByteBuffer, with some effort.
     val.AsProtoTensorContent(response.mutable_tensor());
+    metrics::RecordRpcTensorBytesCopied("send", val.TotalBytes());
 
     // Encode full protocol buffer to a ByteBuffer
     EncodeRecvTensorResponseToByteBuffer(response, result);
@@ -182,8 +187,8 @@ void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
     // backing store, with appropriate reference counts to keep the
     // backing store alive as needed.
     //
-    // We enable this behavior if the tensor is large.
-    bool share_tensor_slice_memory = (tdata.size() > kLargeTensorBytes);
+    // We enable this behavior for all but the smallest tensors.
+    bool share_tensor_slice_memory = (tdata.size() >= kMinSharedTensorBytes);
 
     // (Omitted internal-only conditional)
 
@@ -223,6 +228,12 @@ void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
       num_slices += 1;
     }
 
+    if (share_tensor_slice_memory) {
+      metrics::RecordRpcTensorBytesReferenced("send", tdata.size());
+    } else {
+      metrics::RecordRpcTensorBytesCopied("send", tdata.size());
+    }
+
     if (share_tensor_slice_memory) {
       // (E) Encode tensor data, but by sharing backing store
       const TensorBuffer* buf = DMAHelper::buffer(&val);
@@ -17,15 +17,37 @@ limitations under the License.
 
 #include "grpcpp/support/byte_buffer.h"
 #include "grpcpp/support/slice.h"
+#include "tensorflow/core/distributed_runtime/rpc/grpc_util.h"
+#include "tensorflow/core/distributed_runtime/tensor_coding.h"
+#include "tensorflow/core/framework/device_attributes.pb.h"
+#include "tensorflow/core/framework/device_base.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/protobuf/worker.pb.h"
 
 namespace tensorflow {
 
+class DummyDevice : public DeviceBase {
+ public:
+  explicit DummyDevice(Env* env) : DeviceBase(env) {
+    attr_.set_device_type("CPU");
+  }
+
+  const DeviceAttributes& attributes() const override { return attr_; }
+
+  Allocator* GetAllocator(AllocatorAttributes attr) override {
+    return cpu_allocator();
+  }
+
+ private:
+  DeviceAttributes attr_;
+};
+
 class GrpcTensorCodingTest : public ::testing::Test {
  public:
   void Validate(const Tensor& t, bool is_dead) {
@@ -100,4 +122,43 @@ TEST_F(GrpcTensorCodingTest, Simple) {
 
 TEST_F(GrpcTensorCodingTest, StringTensor) { DoTestForStrings(DT_STRING); }
 
+TEST_F(GrpcTensorCodingTest, ParseSharesAlignedContents) {
+  Tensor t(DT_FLOAT, TensorShape({64, 64}));
+  test::FillIota<float>(&t, 1.0f);
+  ::grpc::ByteBuffer buf;
+  grpc::EncodeTensorToByteBuffer(false, t, false, &buf);
+
+  DummyDevice cpu_device(Env::Default());
+  TensorResponse response;
+  response.InitAlloc(&cpu_device, AllocatorAttributes());
+  {
+    GrpcByteSource source(&buf);
+    TF_ASSERT_OK(response.ParseFrom(&source));
+  }
+  buf.Clear();
+
+  // The encoder references the tensor's own buffer for the contents, and the
+  // parser references the received slice, so no bytes were copied.
+  EXPECT_EQ(t.tensor_data().data(), response.tensor().tensor_data().data());
+  test::ExpectTensorEqual<float>(t, response.tensor());
+}
+
+TEST_F(GrpcTensorCodingTest, ParseCopiesForGpuCompatibleAllocations) {
+  Tensor t(DT_FLOAT, TensorShape({64, 64}));
+  test::FillIota<float>(&t, 1.0f);
+  ::grpc::ByteBuffer buf;
+  grpc::EncodeTensorToByteBuffer(false, t, false, &buf);
+
+  DummyDevice cpu_device(Env::Default());
+  AllocatorAttributes attr;
+  attr.set_gpu_compatible(true);
+  TensorResponse response;
+  response.InitAlloc(&cpu_device, attr);
+  GrpcByteSource source(&buf);
+  TF_ASSERT_OK(response.ParseFrom(&source));
+
+  EXPECT_NE(t.tensor_data().data(), response.tensor().tensor_data().data());
+  test::ExpectTensorEqual<float>(t, response.tensor());
+}
+
 }  // namespace tensorflow
@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/rpc/grpc_util.h"
 #include "tensorflow/core/distributed_runtime/tensor_coding.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/random/random.h"
 
 namespace tensorflow {
@@ -31,8 +33,42 @@ double GenerateUniformRandomNumberBetween(double a, double b) {
   return a + GenerateUniformRandomNumber() * (b - a);
 }
 
+// A TensorBuffer that points into the slices of a received ByteBuffer and
+// keeps them alive by holding its own reference to each of them.
+class GrpcSliceTensorBuffer : public TensorBuffer {
+ public:
+  GrpcSliceTensorBuffer(const ::grpc::ByteBuffer& buffer, const char* data,
+                        size_t size)
+      : TensorBuffer(const_cast<char*>(data)), buffer_(buffer), size_(size) {}
+
+  size_t size() const override { return size_; }
+
+  TensorBuffer* root_buffer() override { return this; }
+
+  void FillAllocationDescription(AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocator_name("grpc");
+  }
+
+  bool OwnsMemory() const override { return false; }
+
+ private:
+  // Copying a ByteBuffer only adds references to its slices.
+  const ::grpc::ByteBuffer buffer_;
+  const size_t size_;
+};
+
 }  // namespace
 
+TensorBuffer* GrpcByteSource::ShareContents(const char* data,
+                                            size_t num_bytes) {
+  // Slices up to GRPC_SLICE_INLINED_SIZE bytes store their data inside the
+  // slice struct itself, so their address changes when the ByteBuffer is
+  // copied.  Only refcounted slices can be shared.
+  if (num_bytes <= GRPC_SLICE_INLINED_SIZE) return nullptr;
+  return new GrpcSliceTensorBuffer(*buffer_, data, num_bytes);
+}
+
 int64 ComputeBackoffMicroseconds(int current_retry_attempt, int64 min_delay,
                                  int64 max_delay) {
   DCHECK_GE(current_retry_attempt, 0);
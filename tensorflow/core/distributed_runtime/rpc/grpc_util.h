@@ -53,6 +53,10 @@ class GrpcByteSource : public TensorResponse::Source {
     return stream_;
   }
 
+  // Shares the slices of the underlying ByteBuffer, which are reference
+  // counted, so "data" stays valid for as long as the returned buffer lives.
+  TensorBuffer* ShareContents(const char* data, size_t num_bytes) override;
+
  private:
   void DeleteStream() {
     if (stream_) {
@@ -39,11 +39,13 @@ limitations under the License.
 #include "tensorflow/core/distributed_runtime/rpc/grpc_tensor_coding.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_util.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_worker_service_impl.h"
+#include "tensorflow/core/distributed_runtime/shared_memory_ring.h"
 #include "tensorflow/core/distributed_runtime/worker.h"
 #include "tensorflow/core/distributed_runtime/worker_cache.h"
 #include "tensorflow/core/distributed_runtime/worker_session.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/collective.h"
+#include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
@@ -147,6 +149,7 @@ class GrpcWorkerServiceThread {
     SETUP_FOR_REQUEST(RunGraph, 100, true);
     SETUP_FOR_REQUEST(CleanupGraph, 100, false);
     SETUP_FOR_REQUEST(MarkRecvFinished, 10, false);
+    SETUP_FOR_REQUEST(RecvTensors, 100, true);
 
     // TODO(ncteisen): Determine a better policy for enqueuing the
     // appropriate number of each request type.
@@ -283,6 +286,25 @@ class GrpcWorkerServiceThread {
     EnqueueRecvTensorRequestRaw();
   }
 
+  void RecvTensorsHandler(
+      WorkerCall<RecvTensorsRequest, RecvTensorsResponse>* call) {
+    Schedule([this, call]() {
+      CallOptions* call_opts = new CallOptions;
+      call->SetCancelCallback([call_opts]() { call_opts->StartCancel(); });
+      worker_->RecvTensorsAsync(
+          call_opts, &call->request, &call->response,
+          [call, call_opts](const Status& s) {
+            call->ClearCancelCallback();
+            delete call_opts;
+            if (!s.ok()) {
+              VLOG(1) << "Bad response from RecvTensors:" << s;
+            }
+            call->SendResponse(ToGrpcStatus(s));
+          });
+    });
+    ENQUEUE_REQUEST(RecvTensors, true);
+  }
+
   void RecvBufHandler(WorkerCall<RecvBufRequest, RecvBufResponse>* call) {
     Schedule([this, call]() {
       CallOptions* call_opts = new CallOptions;
@@ -416,6 +438,41 @@ class GrpcWorkerService : public AsyncServiceInterface {
   TF_DISALLOW_COPY_AND_ASSIGN(GrpcWorkerService);
 };
 
+// Calls "done" with "val" once it can be returned on the wire: tensors that
+// live in accelerator memory are first copied to host memory.
+void CopyRecvTensorToHost(
+    Device* src_dev, const Rendezvous::Args& send_args, const Tensor& val,
+    bool is_dead, StringPiece key,
+    std::function<void(const Tensor&, bool, const Status&)> done) {
+  // DMA can only be used for Tensors that do not fall into the following
+  // three odd edge cases: 1) a zero-size buffer, 2) a dead tensor which has
+  // an uninit value, and 3) the tensor has the on_host allocation attribute,
+  // i.e. it's in CPU RAM *independent of its assigned device type*.
+  const bool on_host = send_args.alloc_attrs.on_host();
+  if (src_dev->tensorflow_gpu_device_info() && (!on_host)) {
+    DeviceContext* send_dev_context = send_args.device_context;
+    AllocatorAttributes alloc_attrs;
+    alloc_attrs.set_gpu_compatible(true);
+    alloc_attrs.set_on_host(true);
+    Allocator* alloc = src_dev->GetAllocator(alloc_attrs);
+    Tensor* copy = new Tensor(alloc, val.dtype(), val.shape());
+    CHECK(send_dev_context)
+        << "send dev name: " << src_dev->name()
+        << " gpu_info: " << src_dev->tensorflow_gpu_device_info();
+    // "val" is on an accelerator device. Uses the device_context to fill the
+    // copy on host.
+    StatusCallback copy_ready = [done, copy, is_dead](const Status& s) {
+      // The value is now ready to be returned on the wire.
+      done(*copy, is_dead, s);
+      delete copy;
+    };
+    CopyDeviceToHost(&val, alloc, alloc, key, src_dev, copy, send_dev_context,
+                     copy_ready);
+    return;
+  }
+  done(val, is_dead, Status::OK());
+}
+
 }  // namespace
 
 GrpcWorker::GrpcWorker(WorkerEnv* worker_env, const ConfigProto& config)
@@ -447,10 +504,12 @@ void GrpcWorker::GrpcRecvTensorAsync(CallOptions* opts,
 
   bool cache_enabled = (response_cache_ != nullptr && request_id != 0);
 
-  auto do_response = [response, done, cache_enabled](const Tensor& tensor,
-                                                     bool is_dead,
-                                                     const Status& status) {
-    if (status.ok()) {
+  auto do_response = [this, request, response, done, cache_enabled](
+                         const Tensor& tensor, bool is_dead,
+                         const Status& status) {
+    if (status.ok() &&
+        !MaybeEncodeTensorToSharedMemory(*request, is_dead, tensor,
+                                         cache_enabled, response)) {
       grpc::EncodeTensorToByteBuffer(is_dead, tensor, cache_enabled, response);
     }
     done(status);
@@ -515,44 +574,294 @@ void GrpcWorker::GrpcRecvTensorAsync(CallOptions* opts,
           const Rendezvous::Args& recv_args, const Tensor& val,
           const bool is_dead) {
         opts->ClearCancelCallback();
-        if (status.ok()) {
-          // DMA can only be used for Tensors that do not fall into
-          // the following three odd edge cases: 1) a zero-size
-          // buffer, 2) a dead tensor which has an uninit value, and
-          // 3) the tensor has the on_host allocation attribute,
-          // i.e. it's in CPU RAM *independent of its assigned
-          // device type*.
-          const bool on_host = send_args.alloc_attrs.on_host();
+        if (!status.ok()) {
+          rendezvous_done(val, is_dead, status);
+          return;
+        }
+        CopyRecvTensorToHost(src_dev, send_args, val, is_dead,
+                             request->rendezvous_key(), rendezvous_done);
+      });
+}
+
+bool GrpcWorker::MaybeEncodeTensorToSharedMemory(
+    const RecvTensorRequest& request, bool is_dead, const Tensor& val,
+    bool require_ack, ::grpc::ByteBuffer* result) {
+  const uint64 num_bytes = val.TotalBytes();
+  if (is_dead || num_bytes == 0 || !DataTypeCanUseMemcpy(val.dtype())) {
+    return false;
+  }
+  std::shared_ptr<SharedMemoryRing> ring = GetSharedMemoryRing(request);
+  uint64 offset;
+  // The receiver abandons the record by request id if it never gets the
+  // response.
+  if (ring == nullptr ||
+      !ring->Allocate(num_bytes, request.request_id(), &offset)) {
+    return false;
+  }
+  memcpy(ring->Data(offset, num_bytes), DMAHelper::base(&val), num_bytes);
+  ring->Commit(offset);
+  metrics::RecordRpcTensorBytesCopied("send", num_bytes);
+
+  RecvTensorResponse proto;
+  proto.set_require_ack(require_ack);
+  proto.set_send_start_micros(env_->env->NowMicros());
+  proto.mutable_tensor()->set_dtype(val.dtype());
+  val.shape().AsProto(proto.mutable_tensor()->mutable_tensor_shape());
+  SharedMemoryRecvTensorResponseExtra extra;
+  extra.set_offset(offset);
+  extra.set_num_bytes(num_bytes);
+  proto.mutable_transport_options()->PackFrom(extra);
+  grpc::EncodeRecvTensorResponseToByteBuffer(proto, result);
+  return true;
+}
+
+std::shared_ptr<SharedMemoryRing> GrpcWorker::GetSharedMemoryRing(
+    const RecvTensorRequest& request) {
+  if (!request.has_transport_options()) return nullptr;
+  SharedMemoryRecvTensorRequestExtra extra;
+  if (!request.transport_options().UnpackTo(&extra) ||
+      extra.host_id() != SharedMemoryHostId()) {
+    return nullptr;
+  }
+  mutex_lock l(shared_memory_mu_);
+  auto it = shared_memory_rings_.find(extra.ring_name());
+  if (it == shared_memory_rings_.end()) {
+    std::unique_ptr<SharedMemoryRing> ring;
+    Status s = SharedMemoryRing::Open(extra.ring_name(), &ring);
+    if (!s.ok()) {
+      LOG(WARNING) << "Sending RecvTensor responses for ring "
+                   << extra.ring_name() << " over gRPC: " << s;
+    }
+    it = shared_memory_rings_.emplace(extra.ring_name(), std::move(ring)).first;
+  }
+  return it->second;
+}
+
+void GrpcWorker::PruneSharedMemoryRings() {
+  mutex_lock l(shared_memory_mu_);
+  for (auto it = shared_memory_rings_.begin();
+       it != shared_memory_rings_.end();) {
+    // Rings that failed to open are retried, in case their owner restarted.
+    if (it->second == nullptr || it->second->IsOrphaned()) {
+      VLOG(1) << "Unmapping shared memory ring " << it->first;
+      it = shared_memory_rings_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// All members are guarded by GrpcWorker::pending_recvs_mu_.
+struct GrpcWorker::PendingRecv {
+  string key;
+  bool ready = false;
+  Status status;
+  Tensor tensor;
+  bool is_dead = false;
+  // The RecvTensors call currently waiting for this tensor, if any, and the
+  // position of the tensor in its request.
+  std::shared_ptr<RecvTensorsCall> waiter;
+  int index = 0;
+};
+
+// All members other than the constant ones are guarded by
+// GrpcWorker::pending_recvs_mu_.
+struct GrpcWorker::RecvTensorsCall {
+  CallOptions* opts = nullptr;
+  const RecvTensorsRequest* request = nullptr;
+  RecvTensorsResponse* response = nullptr;
+  StatusCallback done;
+  std::vector<std::shared_ptr<PendingRecv>> recvs;
+  size_t num_ready = 0;
+  bool window_armed = false;
+  bool window_expired = false;
+  bool finished = false;
+};
+
+void GrpcWorker::RecvTensorsAsync(CallOptions* opts,
+                                  const RecvTensorsRequest* request,
+                                  RecvTensorsResponse* response,
+                                  StatusCallback done) {
+  const int64 step_id = request->step_id();
+  const int num_keys = request->rendezvous_key_size();
+  if (num_keys == 0) {
+    // There is nothing to wait for, and no tensor would ever complete the
+    // call.
+    done(Status::OK());
+    return;
+  }
+  std::vector<Rendezvous::ParsedKey> parsed(num_keys);
+  std::vector<Device*> src_devs(num_keys, nullptr);
+  for (int i = 0; i < num_keys; ++i) {
+    Status s = Rendezvous::ParseKey(request->rendezvous_key(i), &parsed[i]);
+    if (s.ok()) {
+      s = PrepareRecvTensor(parsed[i], &src_devs[i]);
+    }
+    if (!s.ok()) {
+      done(s);
+      return;
+    }
+  }
+
+  auto call = std::make_shared<RecvTensorsCall>();
+  call->opts = opts;
+  call->request = request;
+  call->response = response;
+  call->done = std::move(done);
+  // Indices of the keys for which a rendezvous receive must be started.
+  std::vector<int> to_start;
+  Status s;
+  {
+    mutex_lock l(pending_recvs_mu_);
+    auto& step_recvs = pending_recvs_[step_id];
+    for (int i = 0; i < num_keys && s.ok(); ++i) {
+      auto it = step_recvs.find(request->rendezvous_key(i));
+      if (it != step_recvs.end() && it->second->waiter != nullptr) {
+        s = errors::AlreadyExists("Tensor ", request->rendezvous_key(i),
+                                  " of step ", step_id,
+                                  " is already being received");
+      }
+    }
+    for (int i = 0; i < num_keys && s.ok(); ++i) {
+      std::shared_ptr<PendingRecv>& recv =
+          step_recvs[request->rendezvous_key(i)];
+      if (recv == nullptr) {
+        recv = std::make_shared<PendingRecv>();
+        recv->key = request->rendezvous_key(i);
+        to_start.push_back(i);
+      } else if (recv->ready) {
+        ++call->num_ready;
+      }
+      recv->waiter = call;
+      recv->index = i;
+      call->recvs.push_back(recv);
+    }
+  }
+  if (!s.ok()) {
+    call->done(s);
+    return;
+  }
+
+  // As for RecvTensor, a cancellation only fails this call: the tensors stay
+  // registered so that a retry can still pick them up. The response is sent
+  // from another thread because "opts" is locked while the callback runs.
+  opts->SetCancelCallback([this, call]() {
+    env_->env->SchedClosure([this, call]() {
+      FinishRecvTensors(call, errors::Cancelled("RecvTensors cancelled"));
+    });
+  });
+  MaybeFinishRecvTensors(call);
+
+  for (int i : to_start) {
+    std::shared_ptr<PendingRecv> recv = call->recvs[i];
+    Device* src_dev = src_devs[i];
+    env_->rendezvous_mgr->RecvLocalAsync(
+        step_id, parsed[i],
+        [this, recv, src_dev](const Status& status,
+                              const Rendezvous::Args& send_args,
+                              const Rendezvous::Args& recv_args,
+                              const Tensor& val, const bool is_dead) {
+          auto ready = [this, recv](const Tensor& val, bool is_dead,
+                                    const Status& status) {
+            OnPendingRecvReady(recv, val, is_dead, status);
+          };
+          if (!status.ok()) {
+            ready(val, is_dead, status);
+            return;
+          }
+          CopyRecvTensorToHost(src_dev, send_args, val, is_dead, recv->key,
+                               ready);
+        });
+  }
+}
+
+void GrpcWorker::OnPendingRecvReady(const std::shared_ptr<PendingRecv>& recv,
+                                    const Tensor& val, bool is_dead,
+                                    const Status& status) {
+  std::shared_ptr<RecvTensorsCall> waiter;
+  {
+    mutex_lock l(pending_recvs_mu_);
+    recv->ready = true;
+    recv->status = status;
+    recv->tensor = val;
+    recv->is_dead = is_dead;
+    waiter = recv->waiter;
+    if (waiter != nullptr) {
+      ++waiter->num_ready;
+    }
+  }
+  if (waiter != nullptr) {
+    MaybeFinishRecvTensors(waiter);
+  }
+}
+
+void GrpcWorker::MaybeFinishRecvTensors(
+    const std::shared_ptr<RecvTensorsCall>& call) {
+  const int64 window_micros = call->request->batch_window_micros();
+  {
+    mutex_lock l(pending_recvs_mu_);
+    if (call->finished || call->num_ready == 0) return;
+    if (call->num_ready < call->recvs.size() && window_micros > 0 &&
+        !call->window_expired) {
+      if (!call->window_armed) {
+        call->window_armed = true;
+        env_->env->SchedClosureAfter(window_micros, [this, call]() {
           {
-            // Non-DMA cases.
-            if (src_dev->tensorflow_gpu_device_info() && (!on_host)) {
-              DeviceContext* send_dev_context = send_args.device_context;
-              AllocatorAttributes alloc_attrs;
-              alloc_attrs.set_gpu_compatible(true);
-              alloc_attrs.set_on_host(true);
-              Allocator* alloc = src_dev->GetAllocator(alloc_attrs);
-              Tensor* copy = new Tensor(alloc, val.dtype(), val.shape());
-              CHECK(send_dev_context)
-                  << "send dev name: " << src_dev->name()
-                  << " gpu_info: " << src_dev->tensorflow_gpu_device_info();
-              // "val" is on an accelerator device. Uses the device_context to
-              // fill the copy on host.
-              StatusCallback copy_ready = [rendezvous_done, copy,
-                                           is_dead](const Status& s) {
-                // The value is now ready to be returned on the wire.
-                rendezvous_done(*copy, is_dead, s);
-                delete copy;
-              };
-
-              CopyDeviceToHost(&val, alloc, alloc, request->rendezvous_key(),
-                               src_dev, copy, send_dev_context, copy_ready);
-              return;
-            }
+            mutex_lock l(pending_recvs_mu_);
+            call->window_expired = true;
           }
-        }
+          MaybeFinishRecvTensors(call);
+        });
+      }
+      return;
+    }
+  }
+  FinishRecvTensors(call, Status::OK());
+}
 
-        rendezvous_done(val, is_dead, status);
-      });
+void GrpcWorker::FinishRecvTensors(const std::shared_ptr<RecvTensorsCall>& call,
+                                   const Status& status) {
+  const int64 step_id = call->request->step_id();
+  std::vector<std::shared_ptr<PendingRecv>> ready;
+  {
+    mutex_lock l(pending_recvs_mu_);
+    if (call->finished) return;
+    call->finished = true;
+    auto step_it = pending_recvs_.find(step_id);
+    for (const auto& recv : call->recvs) {
+      recv->waiter.reset();
+      if (!status.ok() || !recv->ready) continue;
+      ready.push_back(recv);
+      // Returned tensors are consumed, exactly as with RecvTensor.
+      if (step_it != pending_recvs_.end()) {
+        step_it->second.erase(recv->key);
+      }
+    }
+    if (step_it != pending_recvs_.end() && step_it->second.empty()) {
+      pending_recvs_.erase(step_it);
+    }
+  }
+  call->opts->ClearCancelCallback();
+
+  Status s = status;
+  for (const auto& recv : ready) {
+    s.Update(recv->status);
+  }
+  if (s.ok()) {
+    const int64 send_start_micros = env_->env->NowMicros();
+    for (const auto& recv : ready) {
+      RecvTensorResponse* proto = call->response->add_tensors();
+      proto->set_is_dead(recv->is_dead);
+      proto->set_send_start_micros(send_start_micros);
+      if (recv->tensor.IsInitialized()) {
+        recv->tensor.AsProtoTensorContent(proto->mutable_tensor());
+      } else {
+        proto->mutable_tensor()->set_dtype(recv->tensor.dtype());
+      }
+      call->response->add_key_index(recv->index);
+    }
+  }
+  call->done(s);
 }
 
 namespace {
@@ -734,6 +1043,11 @@ void GrpcWorker::CleanupGraphAsync(const CleanupGraphRequest* request,
     // a worker crashes before acking a request.
     response_cache_->CleanEntriesForStep(request->step_id());
   }
+  {
+    mutex_lock l(pending_recvs_mu_);
+    pending_recvs_.erase(request->step_id());
+  }
+  PruneSharedMemoryRings();
   Worker::CleanupGraphAsync(request, response, done);
 }
 
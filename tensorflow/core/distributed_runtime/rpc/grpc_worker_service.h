@@ -19,8 +19,10 @@ limitations under the License.
 #include <memory>
 #include <unordered_map>
 #include "grpcpp/server_builder.h"
+#include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_response_cache.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_worker_service_impl.h"
+#include "tensorflow/core/distributed_runtime/shared_memory_ring.h"
 #include "tensorflow/core/distributed_runtime/worker.h"
 #include "tensorflow/core/protobuf/worker.pb.h"
 
@@ -46,6 +48,14 @@ class GrpcWorker : public Worker {
                                    ::grpc::ByteBuffer* response,
                                    StatusCallback done);
 
+  // Responds once at least one of the requested tensors is available, after
+  // waiting up to request->batch_window_micros() for the others. Tensors that
+  // are not included in the response stay registered with the rendezvous, so
+  // a follow-up request for them does not wait for them to be sent again.
+  void RecvTensorsAsync(CallOptions* opts, const RecvTensorsRequest* request,
+                        RecvTensorsResponse* response,
+                        StatusCallback done) override;
+
   void LoggingAsync(const LoggingRequest* request, LoggingResponse* response,
                     StatusCallback done) override;
 
@@ -63,8 +73,57 @@ class GrpcWorker : public Worker {
   void RemoveCacheEntryForId(int64 request_id);
 
  private:
+  // If "request" offers a shared memory ring that this process can map, copies
+  // the content of "val" into it and encodes a RecvTensorResponse pointing at
+  // the copy into "*result". Returns false, leaving "*result" untouched, if the
+  // tensor has to be sent through gRPC instead.
+  bool MaybeEncodeTensorToSharedMemory(const RecvTensorRequest& request,
+                                       bool is_dead, const Tensor& val,
+                                       bool require_ack,
+                                       ::grpc::ByteBuffer* result);
+
+  // Returns the ring offered by "request", or nullptr if there is none or it
+  // is not usable from this process.
+  std::shared_ptr<SharedMemoryRing> GetSharedMemoryRing(
+      const RecvTensorRequest& request);
+
+  // Unmaps the rings of receivers that exited or were restarted.
+  void PruneSharedMemoryRings();
+
+  struct PendingRecv;
+  struct RecvTensorsCall;
+
+  // Records the outcome of the rendezvous receive behind "recv", and responds
+  // to the RecvTensors call waiting for it if that call is now complete.
+  void OnPendingRecvReady(const std::shared_ptr<PendingRecv>& recv,
+                          const Tensor& val, bool is_dead,
+                          const Status& status);
+
+  // Responds to "call" if enough of its tensors are available, or arms its
+  // batching window.
+  void MaybeFinishRecvTensors(const std::shared_ptr<RecvTensorsCall>& call);
+
+  // Responds to "call" with the tensors available so far, or with "status" if
+  // it is not OK.
+  void FinishRecvTensors(const std::shared_ptr<RecvTensorsCall>& call,
+                         const Status& status);
+
   std::unique_ptr<GrpcResponseCache> response_cache_;
   const int32 recv_buf_max_chunk_;
+
+  mutex shared_memory_mu_;
+  // Receiver rings by name. Rings that failed to open map to nullptr, so that
+  // they are not retried on every request. Shared with the responses that are
+  // being written into them.
+  std::unordered_map<string, std::shared_ptr<SharedMemoryRing>>
+      shared_memory_rings_ TF_GUARDED_BY(shared_memory_mu_);
+
+  mutex pending_recvs_mu_;
+  // Rendezvous receives started for RecvTensors calls whose tensors have not
+  // been returned yet, by step id and rendezvous key.
+  absl::flat_hash_map<
+      int64, absl::flat_hash_map<string, std::shared_ptr<PendingRecv>>>
+      pending_recvs_ TF_GUARDED_BY(pending_recvs_mu_);
 };
 
 std::unique_ptr<GrpcWorker> NewGrpcWorker(WorkerEnv* worker_env,
@@ -0,0 +1,55 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/rpc/grpc_worker_service.h"
+
+#include "tensorflow/core/distributed_runtime/call_options.h"
+#include "tensorflow/core/distributed_runtime/worker_env.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/notification.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/protobuf/worker.pb.h"
+
+namespace tensorflow {
+namespace {
+
+TEST(GrpcWorkerTest, RecvTensorsWithoutKeys) {
+  WorkerEnv env;
+  env.env = Env::Default();
+  std::unique_ptr<GrpcWorker> worker = NewGrpcWorker(&env, ConfigProto());
+
+  CallOptions opts;
+  RecvTensorsRequest request;
+  request.set_step_id(1);
+  request.set_batch_window_micros(1000);
+  RecvTensorsResponse response;
+  Notification n;
+  Status status = errors::Unknown("Not done");
+  worker->RecvTensorsAsync(&opts, &request, &response,
+                           [&status, &n](const Status& s) {
+                             status = s;
+                             n.Notify();
+                           });
+  // The call completes right away, as there is nothing to receive.
+  ASSERT_TRUE(n.HasBeenNotified());
+  TF_EXPECT_OK(status);
+  EXPECT_EQ(0, response.tensors_size());
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -15,33 +15,47 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/rpc/rpc_rendezvous_mgr.h"
 
+#include <map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "tensorflow/core/common_runtime/device.h"
 #include "tensorflow/core/common_runtime/device_mgr.h"
 #include "tensorflow/core/common_runtime/dma_helper.h"
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/distributed_runtime/request_id.h"
+#include "tensorflow/core/distributed_runtime/shared_memory_ring.h"
 #include "tensorflow/core/distributed_runtime/tensor_coding.h"
 #include "tensorflow/core/distributed_runtime/worker_cache.h"
 #include "tensorflow/core/distributed_runtime/worker_interface.h"
+#include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/gtl/map_util.h"
 #include "tensorflow/core/lib/strings/numbers.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/notification.h"
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/protobuf/transport_options.pb.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
 namespace {
 
+class RpcRecvTensorsCall;
+
 class RpcRemoteRendezvous : public BaseRemoteRendezvous {
  public:
-  RpcRemoteRendezvous(const WorkerEnv* env, int64 step_id)
-      : BaseRemoteRendezvous(env, step_id) {}
+  RpcRemoteRendezvous(const WorkerEnv* env, int64 step_id,
+                      std::shared_ptr<SharedMemoryRing> shared_memory_ring,
+                      int64 recv_tensors_window_micros)
+      : BaseRemoteRendezvous(env, step_id),
+        shared_memory_ring_(std::move(shared_memory_ring)),
+        recv_tensors_window_micros_(recv_tensors_window_micros) {}
 
  protected:
   void RecvFromRemoteAsync(const Rendezvous::ParsedKey& parsed,
@@ -51,6 +65,31 @@ class RpcRemoteRendezvous : public BaseRemoteRendezvous {
  private:
   ~RpcRemoteRendezvous() override {}
 
+  // Issues one RecvTensor RPC for "parsed".
+  void RecvFromRemoteUnbatchedAsync(const Rendezvous::ParsedKey& parsed,
+                                    const Rendezvous::Args& args,
+                                    DoneCallback done);
+
+  // Adds "parsed" to the RecvTensors batch that is being collected for its
+  // source worker, starting a new batch if there is none.
+  void RecvFromRemoteBatchedAsync(const Rendezvous::ParsedKey& parsed,
+                                  const Rendezvous::Args& args,
+                                  DoneCallback done);
+
+  // Stops collecting receives into "call" and issues it.
+  void StartBatch(RpcRecvTensorsCall* call);
+
+  const std::shared_ptr<SharedMemoryRing> shared_memory_ring_;
+  const int64 recv_tensors_window_micros_;
+
+  mutex batch_mu_;
+  // Batches that are still collecting receives, by source worker and
+  // cancellation manager.
+  std::map<std::pair<string, CancellationManager*>, RpcRecvTensorsCall*>
+      collecting_batches_ TF_GUARDED_BY(batch_mu_);
+  // Source workers that do not implement RecvTensors.
+  std::unordered_set<string> unbatched_workers_ TF_GUARDED_BY(batch_mu_);
+
   TF_DISALLOW_COPY_AND_ASSIGN(RpcRemoteRendezvous);
 };
 
@@ -61,7 +100,8 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
 
   void Init(WorkerInterface* wi, int64 step_id, StringPiece key,
             AllocatorAttributes alloc_attrs, Device* dst_device,
-            const Rendezvous::Args& recv_args, Rendezvous::DoneCallback done) {
+            const Rendezvous::Args& recv_args, Rendezvous::DoneCallback done,
+            SharedMemoryRing* shared_memory_ring) {
     wi_ = wi;
     alloc_attrs_ = alloc_attrs;
     dst_device_ = dst_device;
@@ -70,6 +110,19 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
     req_.set_step_id(step_id);
     req_.set_rendezvous_key(key.data(), key.size());
     req_.set_request_id(GetUniqueRequestId());
+    // The content read from the ring is copied into a tensor allocated by
+    // TensorResponse, which must therefore be in host memory.
+    if (shared_memory_ring != nullptr &&
+        (alloc_attrs.on_host() || dst_device->device_type() == DEVICE_CPU)) {
+      shared_memory_ring_ = shared_memory_ring;
+      // Frees the space of records abandoned by earlier calls that their
+      // senders committed since.
+      shared_memory_ring_->Reclaim();
+      SharedMemoryRecvTensorRequestExtra extra;
+      extra.set_host_id(SharedMemoryHostId());
+      extra.set_ring_name(shared_memory_ring->name());
+      req_.mutable_transport_options()->PackFrom(extra);
+    }
   }
 
   void Reset() {
@@ -80,6 +133,7 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
 
     alloc_attrs_ = AllocatorAttributes();
     dst_device_ = nullptr;
+    shared_memory_ring_ = nullptr;
     // We don't clear opts_ and assume that Init will set up the state for
     // opts_ appropriately.
     req_.Clear();
@@ -143,9 +197,17 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
       // Make sure the Rendezvous abort checking is finished before running the
       // callback, which might destroy the current call object.
       abort_checked->WaitForNotification();
-      if (!s.ok()) {
+      Status status = s;
+      if (status.ok()) {
+        status = MaybeReadSharedMemoryContents();
+      } else if (shared_memory_ring_ != nullptr) {
+        // The sender may have written the tensor to the ring before the call
+        // failed or was cancelled, but its location is lost with the response.
+        shared_memory_ring_->Abandon(req_.request_id());
+      }
+      if (!status.ok()) {
         mutex_lock l(mu_);
-        status_.Update(s);
+        status_.Update(status);
       }
       recv_done();
     };
@@ -168,11 +230,37 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
     abort_checked->Notify();
   }
 
+  // If the sender wrote the tensor content to our shared memory ring instead
+  // of the response, copies it into the already allocated response tensor and
+  // returns the space to the ring.
+  Status MaybeReadSharedMemoryContents() {
+    if (shared_memory_ring_ == nullptr) return Status::OK();
+    SharedMemoryRecvTensorResponseExtra extra;
+    if (!resp_.metadata().transport_options().UnpackTo(&extra)) {
+      return Status::OK();
+    }
+    const Tensor& tensor = resp_.tensor();
+    const char* src =
+        shared_memory_ring_->Data(extra.offset(), extra.num_bytes());
+    Status s;
+    if (src == nullptr || extra.num_bytes() != tensor.TotalBytes()) {
+      s = errors::Internal("Invalid shared memory location for ",
+                           req_.rendezvous_key(), ": ",
+                           extra.ShortDebugString());
+    } else {
+      memcpy(const_cast<void*>(DMAHelper::base(&tensor)), src,
+             extra.num_bytes());
+    }
+    shared_memory_ring_->Release(extra.offset());
+    return s;
+  }
+
   string src_worker_;
   string src_rel_device_;
   WorkerInterface* wi_;  // Not owned.
   AllocatorAttributes alloc_attrs_;
   Device* dst_device_;
+  SharedMemoryRing* shared_memory_ring_ = nullptr;  // Not owned.
   CallOptions opts_;
   RecvTensorRequest req_;
   TensorResponse resp_;
@@ -185,6 +273,160 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
   TF_DISALLOW_COPY_AND_ASSIGN(RpcRecvTensorCall);
 };
 
+// Used to retrieve several tensors of one step from the same remote process
+// with RecvTensors RPCs. Each response delivers the tensors that were
+// available when it was sent; the remaining ones are requested again until
+// all are delivered or the call fails.
+class RpcRecvTensorsCall : public BaseRecvTensorCall {
+ public:
+  struct Recv {
+    string key;
+    Device* dst_device;
+    Rendezvous::Args recv_args;
+    Rendezvous::DoneCallback done;
+  };
+
+  RpcRecvTensorsCall(const string& src_worker, WorkerInterface* wi,
+                     CancellationManager* cm, int64 step_id,
+                     int64 batch_window_micros)
+      : src_worker_(src_worker), wi_(wi), cm_(cm) {
+    req_.set_step_id(step_id);
+    req_.set_batch_window_micros(batch_window_micros);
+  }
+
+  // Must not be called after Start().
+  void Add(Recv recv) { pending_.push_back(std::move(recv)); }
+
+  void Start(std::function<void()> recv_done) override {
+    recv_done_ = std::move(recv_done);
+    if (!status().ok()) {
+      Finish();
+      return;
+    }
+    IssueRequest();
+  }
+
+  void StartAbort(const Status& s) override {
+    {
+      mutex_lock l(mu_);
+      status_.Update(s);
+    }
+    opts_.StartCancel();
+  }
+
+  Status status() const override {
+    mutex_lock l(mu_);
+    return status_;
+  }
+
+  const string& src_worker() const { return src_worker_; }
+  WorkerInterface* worker() const { return wi_; }
+  CancellationManager* cancellation_manager() const { return cm_; }
+
+  // The receives that have not been delivered. After the call has finished,
+  // they are to be failed with status() or retried by the caller.
+  std::vector<Recv>* pending() { return &pending_; }
+
+ private:
+  void IssueRequest() {
+    req_.clear_rendezvous_key();
+    for (const Recv& recv : pending_) {
+      req_.add_rendezvous_key(recv.key);
+    }
+    resp_.Clear();
+    auto abort_checked = std::make_shared<Notification>();
+    wi_->RecvTensorsAsync(&opts_, &req_, &resp_,
+                          [this, abort_checked](const Status& s) {
+                            abort_checked->WaitForNotification();
+                            OnResponse(s);
+                          });
+    // NOTE: As in RpcRecvTensorCall, `StartAbort` could have been called right
+    // before the RPC registered its cancellation to `opts_`.
+    if (!status().ok()) {
+      opts_.StartCancel();
+    }
+    abort_checked->Notify();
+  }
+
+  void OnResponse(const Status& rpc_status) {
+    Status s = rpc_status;
+    if (s.ok()) {
+      s = CheckResponse();
+    }
+    if (!s.ok()) {
+      {
+        mutex_lock l(mu_);
+        status_.Update(s);
+      }
+      Finish();
+      return;
+    }
+    std::vector<bool> delivered(pending_.size(), false);
+    for (int i = 0; i < resp_.tensors_size(); ++i) {
+      const int index = resp_.key_index(i);
+      Recv& recv = pending_[index];
+      TensorResponse tensor;
+      tensor.InitAlloc(recv.dst_device, recv.recv_args.alloc_attrs);
+      Status ts = tensor.InitFrom(resp_.mutable_tensors(i));
+      recv.done(ts, Rendezvous::Args(), recv.recv_args, tensor.tensor(),
+                tensor.metadata().is_dead());
+      delivered[index] = true;
+    }
+    std::vector<Recv> remaining;
+    for (size_t i = 0; i < pending_.size(); ++i) {
+      if (!delivered[i]) {
+        remaining.push_back(std::move(pending_[i]));
+      }
+    }
+    pending_.swap(remaining);
+    if (pending_.empty() || !status().ok()) {
+      Finish();
+      return;
+    }
+    IssueRequest();
+  }
+
+  // Runs the callback passed to Start(), which may delete this call.
+  void Finish() {
+    std::function<void()> recv_done = std::move(recv_done_);
+    recv_done();
+  }
+
+  // Validates the response against the request before any of the receives
+  // are delivered.
+  Status CheckResponse() const {
+    if (resp_.tensors_size() != resp_.key_index_size() ||
+        resp_.tensors_size() == 0) {
+      return errors::Internal("Malformed RecvTensors response from ",
+                              src_worker_, " for ", pending_.size(), " keys");
+    }
+    std::vector<bool> seen(pending_.size(), false);
+    for (int index : resp_.key_index()) {
+      if (index < 0 || index >= static_cast<int>(pending_.size()) ||
+          seen[index]) {
+        return errors::Internal("Invalid key index ", index,
+                                " in RecvTensors response from ", src_worker_);
+      }
+      seen[index] = true;
+    }
+    return Status::OK();
+  }
+
+  const string src_worker_;
+  WorkerInterface* const wi_;      // Not owned.
+  CancellationManager* const cm_;  // Not owned.
+  std::vector<Recv> pending_;
+  std::function<void()> recv_done_;
+  CallOptions opts_;
+  RecvTensorsRequest req_;
+  RecvTensorsResponse resp_;
+
+  mutable mutex mu_;
+  Status status_ TF_GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(RpcRecvTensorsCall);
+};
+
 class RpcRecvTensorFreeList {
  public:
   RpcRecvTensorFreeList() {}
@@ -234,6 +476,16 @@ void RpcRemoteRendezvous::RecvFromRemoteAsync(
     const Rendezvous::ParsedKey& parsed, const Rendezvous::Args& recv_args,
     DoneCallback done) {
   CHECK(is_initialized());
+  if (recv_tensors_window_micros_ > 0) {
+    RecvFromRemoteBatchedAsync(parsed, recv_args, std::move(done));
+  } else {
+    RecvFromRemoteUnbatchedAsync(parsed, recv_args, std::move(done));
+  }
+}
+
+void RpcRemoteRendezvous::RecvFromRemoteUnbatchedAsync(
+    const Rendezvous::ParsedKey& parsed, const Rendezvous::Args& recv_args,
+    DoneCallback done) {
   Status s;
 
   // Prepare a RecvTensor call that can handle being aborted.
@@ -270,7 +522,7 @@ void RpcRemoteRendezvous::RecvFromRemoteAsync(
   }
 
   call->Init(rwi, step_id_, parsed.FullKey(), recv_args.alloc_attrs, dst_device,
-             recv_args, std::move(done));
+             recv_args, std::move(done), shared_memory_ring_.get());
 
   // Record "call" in active_ so that it can be aborted cleanly.
   RegisterCall(call, recv_args);
@@ -305,14 +557,140 @@ void RpcRemoteRendezvous::RecvFromRemoteAsync(
   });
 }
 
+void RpcRemoteRendezvous::RecvFromRemoteBatchedAsync(
+    const Rendezvous::ParsedKey& parsed, const Rendezvous::Args& recv_args,
+    DoneCallback done) {
+  string src_worker, src_rel_device;
+  if (!DeviceNameUtils::SplitDeviceName(parsed.src_device, &src_worker,
+                                        &src_rel_device)) {
+    done(errors::Internal(parsed.src_device,
+                          " is invalid remote source device."),
+         Args(), recv_args, Tensor{}, false);
+    return;
+  }
+  WorkerSession* sess = session();
+  Device* dst_device;
+  Status s = sess->device_mgr()->LookupDevice(parsed.dst_device, &dst_device);
+  if (!s.ok()) {
+    done(s, Args(), recv_args, Tensor{}, false);
+    return;
+  }
+
+  bool batched = false;
+  RpcRecvTensorsCall* new_call = nullptr;
+  {
+    mutex_lock l(batch_mu_);
+    if (unbatched_workers_.count(src_worker) == 0) {
+      const auto batch_key =
+          std::make_pair(src_worker, recv_args.cancellation_manager);
+      RpcRecvTensorsCall* call = gtl::FindPtrOrNull(collecting_batches_,
+                                                    batch_key);
+      if (call == nullptr) {
+        // The worker will be released when the call finishes.
+        WorkerInterface* rwi =
+            sess->worker_cache()->GetOrCreateWorker(src_worker);
+        if (rwi == nullptr) {
+          s = errors::Internal("No worker known as ", src_worker);
+        } else {
+          call = new RpcRecvTensorsCall(src_worker, rwi,
+                                        recv_args.cancellation_manager,
+                                        step_id_, recv_tensors_window_micros_);
+          collecting_batches_[batch_key] = call;
+          new_call = call;
+        }
+      }
+      if (call != nullptr) {
+        call->Add({string(parsed.FullKey()), dst_device, recv_args,
+                   std::move(done)});
+        batched = true;
+      }
+    }
+  }
+  if (!s.ok()) {
+    done(s, Args(), recv_args, Tensor{}, false);
+    return;
+  }
+  if (!batched) {
+    // "src_worker" does not implement RecvTensors.
+    RecvFromRemoteUnbatchedAsync(parsed, recv_args, std::move(done));
+    return;
+  }
+  if (new_call == nullptr) return;
+
+  // Record "new_call" in active_ so that it can be aborted cleanly, and issue
+  // it once the receives that become ready to run in the meantime had a
+  // chance to join it.
+  RegisterCall(new_call, recv_args);
+  Ref();
+  env_->env->SchedClosureAfter(recv_tensors_window_micros_,
+                               [this, new_call]() { StartBatch(new_call); });
+}
+
+void RpcRemoteRendezvous::StartBatch(RpcRecvTensorsCall* call) {
+  {
+    mutex_lock l(batch_mu_);
+    collecting_batches_.erase(
+        std::make_pair(call->src_worker(), call->cancellation_manager()));
+  }
+  std::shared_ptr<WorkerCacheInterface> worker_cache =
+      session()->GetSharedWorkerCache();
+  call->Start([this, call, worker_cache]() {
+    // Removes "call" from active_. Prevent StartAbort().
+    DeregisterCall(call);
+    Status s = call->status();
+    worker_cache->ReleaseWorker(call->src_worker(), call->worker());
+    std::vector<RpcRecvTensorsCall::Recv> pending;
+    pending.swap(*call->pending());
+    const bool unimplemented = errors::IsUnimplemented(s);
+    if (unimplemented) {
+      mutex_lock l(batch_mu_);
+      unbatched_workers_.insert(call->src_worker());
+    }
+    delete call;
+    for (RpcRecvTensorsCall::Recv& recv : pending) {
+      Rendezvous::ParsedKey parsed;
+      if (unimplemented && Rendezvous::ParseKey(recv.key, &parsed).ok()) {
+        RecvFromRemoteUnbatchedAsync(parsed, recv.recv_args,
+                                     std::move(recv.done));
+      } else {
+        recv.done(s, Args(), recv.recv_args, Tensor{}, false);
+      }
+    }
+    Unref();
+  });
+}
+
 }  // namespace
 
 RpcRendezvousMgr::RpcRendezvousMgr(const WorkerEnv* env)
-    : BaseRendezvousMgr(env) {}
+    : BaseRendezvousMgr(env) {
+  Status window_status =
+      ReadInt64FromEnvVar("TF_RPC_RECV_TENSORS_BATCH_WINDOW_US", 0,
+                          &recv_tensors_window_micros_);
+  if (!window_status.ok()) {
+    LOG(WARNING) << window_status;
+  }
+  int64 ring_mb;
+  Status s = ReadInt64FromEnvVar("TF_RPC_SHARED_MEMORY_RING_MB", 0, &ring_mb);
+  if (!s.ok()) {
+    LOG(WARNING) << s;
+  } else if (ring_mb > 0) {
+    std::unique_ptr<SharedMemoryRing> ring;
+    s = SharedMemoryRing::Create(ring_mb << 20, &ring);
+    if (s.ok()) {
+      VLOG(1) << "Offering shared memory ring " << ring->name()
+              << " for same-host RecvTensor transfers.";
+      shared_memory_ring_ = std::move(ring);
+    } else {
+      LOG(WARNING) << "Not using shared memory for RecvTensor: " << s;
+    }
+  }
+}
 
 BaseRemoteRendezvous* RpcRendezvousMgr::Create(int64 step_id,
                                                const WorkerEnv* worker_env) {
-  return new RpcRemoteRendezvous(worker_env, step_id);
+  return new RpcRemoteRendezvous(worker_env, step_id, shared_memory_ring_,
+                                 recv_tensors_window_micros_);
 }
 
 }  // end namespace tensorflow
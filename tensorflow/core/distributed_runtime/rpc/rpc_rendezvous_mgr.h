@@ -16,7 +16,10 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_RPC_RENDEZVOUS_MGR_H_
 #define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_RPC_RENDEZVOUS_MGR_H_
 
+#include <memory>
+
 #include "tensorflow/core/distributed_runtime/base_rendezvous_mgr.h"
+#include "tensorflow/core/distributed_runtime/shared_memory_ring.h"
 #include "tensorflow/core/distributed_runtime/worker_env.h"
 #include "tensorflow/core/platform/macros.h"
 
@@ -42,6 +45,19 @@ class DeviceMgr;
 //
 // Tensors sent and recved through rendezvous managed by this
 // RendezvousMgr must have keys generated by Rendezvous::CreateKey.
+//
+// If the environment variable TF_RPC_SHARED_MEMORY_RING_MB is set to a
+// positive value, the manager creates a SharedMemoryRing of that many
+// megabytes and offers it to remote workers in its RecvTensor requests. A
+// worker that runs on the same host writes the tensor content into the ring
+// and only returns its location over RPC, saving the serialization and the
+// copies through the loopback socket. Other workers ignore the offer.
+//
+// If the environment variable TF_RPC_RECV_TENSORS_BATCH_WINDOW_US is set to a
+// positive value, receives from the same remote worker that are started
+// within that many microseconds of each other share RecvTensors RPCs instead
+// of issuing one RecvTensor RPC each. Remote workers that do not implement
+// RecvTensors are sent RecvTensor RPCs.
 class RpcRendezvousMgr : public BaseRendezvousMgr {
  public:
   explicit RpcRendezvousMgr(const WorkerEnv* env);
@@ -50,6 +66,13 @@ class RpcRendezvousMgr : public BaseRendezvousMgr {
   BaseRemoteRendezvous* Create(int64 step_id, const WorkerEnv* worker_env);
 
  private:
+  // Receive-side ring offered to same-host senders. Null when disabled.
+  // Shared with the rendezvous objects, which may outlive the manager.
+  std::shared_ptr<SharedMemoryRing> shared_memory_ring_;
+
+  // Batching window for RecvTensors RPCs, or 0 if batching is disabled.
+  int64 recv_tensors_window_micros_ = 0;
+
   TF_DISALLOW_COPY_AND_ASSIGN(RpcRendezvousMgr);
 };
 
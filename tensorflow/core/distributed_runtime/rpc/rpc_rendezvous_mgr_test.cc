@@ -15,18 +15,26 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/rpc/rpc_rendezvous_mgr.h"
 
+#include <stdlib.h>
+
+#include <algorithm>
+
 #include "tensorflow/core/common_runtime/process_util.h"
+#include "tensorflow/core/distributed_runtime/shared_memory_ring.h"
+#include "tensorflow/core/distributed_runtime/tensor_coding.h"
 #include "tensorflow/core/distributed_runtime/test_utils.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/control_flow.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/notification.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/blocking_counter.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/random.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/protobuf/transport_options.pb.h"
 
 namespace tensorflow {
 
@@ -57,6 +65,10 @@ class DummyWorker : public TestWorkerInterface {
  public:
   void RecvTensorAsync(CallOptions* opts, const RecvTensorRequest* request,
                        TensorResponse* response, StatusCallback done) override {
+    if (shared_memory_floats_ > 0 && request->has_transport_options()) {
+      RecvTensorThroughSharedMemory(opts, request, response, std::move(done));
+      return;
+    }
     SchedClosure([done = std::move(done)]() {
       // Simulate a random delay for RPC. This is needed to fill the entire
       // object buffer in `RpcRecvTensorFreeList` and trigger the destruction of
@@ -66,14 +78,115 @@ class DummyWorker : public TestWorkerInterface {
       done(Status::OK());
     });
   }
+
+  // Returns the tensors for every other requested key, each holding its key,
+  // so that the remaining keys have to be requested again.
+  void RecvTensorsAsync(CallOptions* opts, const RecvTensorsRequest* request,
+                        RecvTensorsResponse* response,
+                        StatusCallback done) override {
+    if (!recv_tensors_supported_) {
+      TestWorkerInterface::RecvTensorsAsync(opts, request, response,
+                                            std::move(done));
+      return;
+    }
+    {
+      mutex_lock l(mu_);
+      recv_tensors_batch_sizes_.push_back(request->rendezvous_key_size());
+    }
+    for (int i = 0; i < request->rendezvous_key_size(); i += 2) {
+      V(request->rendezvous_key(i))
+          .AsProtoTensorContent(response->add_tensors()->mutable_tensor());
+      response->add_key_index(i);
+    }
+    SchedClosure([done = std::move(done)]() { done(Status::OK()); });
+  }
+
+  void set_recv_tensors_supported(bool supported) {
+    recv_tensors_supported_ = supported;
+  }
+
+  std::vector<int> recv_tensors_batch_sizes() {
+    mutex_lock l(mu_);
+    return recv_tensors_batch_sizes_;
+  }
+
+  // Makes RecvTensor write a vector of "num_floats" ones into the shared
+  // memory ring offered by the request, like a worker on the same host.
+  void set_shared_memory_floats(int64 num_floats) {
+    shared_memory_floats_ = num_floats;
+  }
+
+  // Makes the next RecvTensor that writes to shared memory hang until it is
+  // cancelled. "record_written" is notified once the record is committed.
+  void HangNextSharedMemoryRecv(Notification* record_written) {
+    mutex_lock l(mu_);
+    record_written_ = record_written;
+  }
+
+ private:
+  void RecvTensorThroughSharedMemory(CallOptions* opts,
+                                     const RecvTensorRequest* request,
+                                     TensorResponse* response,
+                                     StatusCallback done) {
+    SharedMemoryRecvTensorRequestExtra request_extra;
+    CHECK(request->transport_options().UnpackTo(&request_extra));
+    std::unique_ptr<SharedMemoryRing> ring;
+    TF_CHECK_OK(SharedMemoryRing::Open(request_extra.ring_name(), &ring));
+    const uint64 num_bytes = shared_memory_floats_ * sizeof(float);
+    uint64 offset;
+    if (!ring->Allocate(num_bytes, request->request_id(), &offset)) {
+      SchedClosure([done = std::move(done)]() {
+        done(errors::ResourceExhausted("Shared memory ring is full"));
+      });
+      return;
+    }
+    std::fill_n(reinterpret_cast<float*>(ring->Data(offset, num_bytes)),
+                shared_memory_floats_, 1.0f);
+    ring->Commit(offset);
+
+    Notification* record_written;
+    {
+      mutex_lock l(mu_);
+      record_written = record_written_;
+      record_written_ = nullptr;
+    }
+    if (record_written != nullptr) {
+      opts->SetCancelCallback([done]() {
+        SchedClosure([done]() { done(errors::Cancelled("RecvTensor")); });
+      });
+      record_written->Notify();
+      return;
+    }
+
+    RecvTensorResponse proto;
+    proto.mutable_tensor()->set_dtype(DT_FLOAT);
+    proto.mutable_tensor()->mutable_tensor_shape()->add_dim()->set_size(
+        shared_memory_floats_);
+    SharedMemoryRecvTensorResponseExtra response_extra;
+    response_extra.set_offset(offset);
+    response_extra.set_num_bytes(num_bytes);
+    proto.mutable_transport_options()->PackFrom(response_extra);
+    Status s = response->InitFrom(&proto);
+    SchedClosure([done = std::move(done), s]() { done(s); });
+  }
+
+  bool recv_tensors_supported_ = true;
+  int64 shared_memory_floats_ = 0;
+  Notification* record_written_ TF_GUARDED_BY(mu_) = nullptr;
+  mutex mu_;
+  std::vector<int> recv_tensors_batch_sizes_ TF_GUARDED_BY(mu_);
 };
 
 // Fake cache implementation for WorkerEnv.
 class DummyWorkerCache : public WorkerCacheInterface {
+ public:
   void ListWorkers(std::vector<string>* workers) const override {}
   void ListWorkersInJob(const string& job_name,
                         std::vector<string>* workers) const override {}
   WorkerInterface* GetOrCreateWorker(const string& target) override {
+    return worker();
+  }
+  DummyWorker* worker() {
     if (dummy_remote_worker_ == nullptr) {
       // Ownership transferred to WorkerFreeList
       dummy_remote_worker_ = new DummyWorker;
@@ -100,7 +213,9 @@ static Device* CreateDevice(const char* type, const char* name) {
    public:
     explicit FakeDevice(const DeviceAttributes& attr) : Device(nullptr, attr) {}
     Status Sync() override { return Status::OK(); }
-    Allocator* GetAllocator(AllocatorAttributes) override { return nullptr; }
+    Allocator* GetAllocator(AllocatorAttributes) override {
+      return cpu_allocator();
+    }
   };
   DeviceAttributes attr;
   attr.set_name(name);
@@ -306,6 +421,53 @@ TEST_F(RpcRendezvousMgrTest, RemoteRecvOne) {
   rmgr_.Cleanup(step_id);
 }
 
+TEST_F(RpcRendezvousMgrTest, CancelledSharedMemoryRecvReleasesItsRecord) {
+  setenv("TF_RPC_SHARED_MEMORY_RING_MB", "1", 1);
+  RpcRendezvousMgr rmgr(&env);
+  unsetenv("TF_RPC_SHARED_MEMORY_RING_MB");
+  // Each tensor takes up most of the ring, so the second one only fits if the
+  // record written for the cancelled receive is reclaimed.
+  const int64 num_floats = (768 << 10) / sizeof(float);
+  cache_->worker()->set_shared_memory_floats(num_floats);
+  const int64 step_id = 123;
+  const Rendezvous::ParsedKey key = MakeKey(Rendezvous::CreateKey(
+      "/job:worker/replica:1/task:2/cpu:0", 7890,
+      "/job:mnist/replica:1/task:2/cpu:1", "foo", FrameAndIter(0, 0)));
+  {
+    RemoteRendezvous* rendez = rmgr.Find(step_id);
+    TF_ASSERT_OK(rendez->Initialize(&worker_session_));
+    core::ScopedUnref unref(rendez);
+
+    CancellationManager cm;
+    Rendezvous::Args args;
+    args.cancellation_manager = &cm;
+    Notification record_written;
+    cache_->worker()->HangNextSharedMemoryRecv(&record_written);
+    Notification cancelled;
+    Status status;
+    rendez->RecvAsync(key, args,
+                      [&cancelled, &status](
+                          const Status& s, const Rendezvous::Args&,
+                          const Rendezvous::Args&, const Tensor&, const bool) {
+                        status = s;
+                        cancelled.Notify();
+                      });
+    record_written.WaitForNotification();
+    cm.StartCancel();
+    cancelled.WaitForNotification();
+    EXPECT_TRUE(errors::IsCancelled(status)) << status;
+
+    Tensor val;
+    bool val_dead = false;
+    TF_ASSERT_OK(rendez->Recv(key, Rendezvous::Args(), &val, &val_dead));
+    ASSERT_EQ(DT_FLOAT, val.dtype());
+    ASSERT_EQ(num_floats, val.NumElements());
+    EXPECT_EQ(1.0f, val.flat<float>()(0));
+    EXPECT_EQ(1.0f, val.flat<float>()(num_floats - 1));
+  }
+  rmgr.Cleanup(step_id);
+}
+
 TEST_F(RpcRendezvousMgrTest, RemoteRecvAsyncMany) {
   const int64 step_id = 123;
   const Rendezvous::ParsedKey key = MakeKey(Rendezvous::CreateKey(
@@ -344,4 +506,69 @@ TEST_F(RpcRendezvousMgrTest, RemoteRecvAsyncMany) {
   rmgr_.Cleanup(step_id);
 }
 
+// Receives "num_keys" tensors through a manager that batches RecvTensors RPCs,
+// and returns the keys carried by the received tensors.
+std::vector<string> RecvManyBatched(const WorkerEnv* env,
+                                    WorkerSession* worker_session,
+                                    int num_keys, std::vector<string>* keys) {
+  setenv("TF_RPC_RECV_TENSORS_BATCH_WINDOW_US", "100000", 1);
+  RpcRendezvousMgr rmgr(env);
+  unsetenv("TF_RPC_RECV_TENSORS_BATCH_WINDOW_US");
+  const int64 step_id = 123;
+  std::vector<string> received;
+  {
+    RemoteRendezvous* rendez = rmgr.Find(step_id);
+    TF_CHECK_OK(rendez->Initialize(worker_session));
+    core::ScopedUnref unref(rendez);
+    mutex mu;
+    Status status;
+    BlockingCounter counter(num_keys);
+    for (int i = 0; i < num_keys; ++i) {
+      keys->push_back(Rendezvous::CreateKey(
+          "/job:worker/replica:1/task:2/cpu:0", 7890,
+          "/job:mnist/replica:1/task:2/cpu:1", strings::StrCat("foo", i),
+          FrameAndIter(0, 0)));
+      rendez->RecvAsync(
+          MakeKey(keys->back()), Rendezvous::Args(),
+          [&](const Status& s, const Rendezvous::Args&,
+              const Rendezvous::Args&, const Tensor& val, const bool) {
+            {
+              mutex_lock l(mu);
+              status.Update(s);
+              if (s.ok() && val.dtype() == DT_STRING &&
+                  TensorShapeUtils::IsScalar(val.shape())) {
+                received.push_back(V(val));
+              }
+            }
+            counter.DecrementCount();
+          });
+    }
+    counter.Wait();
+    TF_CHECK_OK(status);
+  }
+  rmgr.Cleanup(step_id);
+  std::sort(keys->begin(), keys->end());
+  std::sort(received.begin(), received.end());
+  return received;
+}
+
+TEST_F(RpcRendezvousMgrTest, RemoteRecvBatched) {
+  std::vector<string> keys;
+  std::vector<string> received =
+      RecvManyBatched(&env, &worker_session_, 10, &keys);
+  EXPECT_EQ(keys, received);
+  // All receives share the first RPC, and the ones that were not returned
+  // are requested again.
+  EXPECT_EQ(std::vector<int>({10, 5, 2, 1}),
+            cache_->worker()->recv_tensors_batch_sizes());
+}
+
+TEST_F(RpcRendezvousMgrTest, RemoteRecvBatchedFallsBackToRecvTensor) {
+  cache_->worker()->set_recv_tensors_supported(false);
+  std::vector<string> keys;
+  // DummyWorker::RecvTensorAsync() does not return any tensor content.
+  EXPECT_TRUE(RecvManyBatched(&env, &worker_session_, 10, &keys).empty());
+  EXPECT_TRUE(cache_->worker()->recv_tensors_batch_sizes().empty());
+}
+
 }  // namespace tensorflow
@@ -0,0 +1,373 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/shared_memory_ring.h"
+
+#if !defined(PLATFORM_WINDOWS)
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // !defined(PLATFORM_WINDOWS)
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/host_info.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+#if !defined(PLATFORM_WINDOWS)
+
+namespace {
+
+constexpr uint64 kRingMagic = 0x74665f73686d7231ULL;  // "tf_shmr1"
+
+// Every record starts on a kAlignment boundary, and its payload starts
+// kRecordHeaderBytes later, so payloads are suitably aligned for any tensor.
+constexpr uint64 kAlignment = 64;
+constexpr uint64 kRecordHeaderBytes = kAlignment;
+
+struct RecordHeader {
+  // Total size of the record, including this header and any padding.
+  uint64 size;
+  // Chosen by the writer, see SharedMemoryRing::Abandon().
+  uint64 tag;
+  // Non-zero once the reader has released the record, or for records that
+  // only pad the end of the ring.
+  uint32 released;
+  // Non-zero once the writer has written the whole payload.
+  uint32 committed;
+};
+static_assert(sizeof(RecordHeader) <= kRecordHeaderBytes,
+              "RecordHeader does not fit in its slot");
+
+uint64 RoundUp(uint64 n, uint64 multiple) {
+  return (n + multiple - 1) / multiple * multiple;
+}
+
+}  // namespace
+
+struct SharedMemoryRing::Header {
+  uint64 magic;
+  uint64 capacity;
+  // Monotonically increasing byte positions; the ring offset of a position is
+  // position % capacity. [tail, head) are allocated records.
+  uint64 head;
+  uint64 tail;
+  // The process that created the ring.
+  pid_t owner_pid;
+  pthread_mutex_t mu;
+};
+
+uint64 SharedMemoryRing::DataOffset() {
+  return RoundUp(sizeof(Header), kAlignment);
+}
+
+namespace {
+
+// Locks the process-shared ring mutex. If a process died while holding it,
+// takes it over: every update of the ring state is a handful of stores, so the
+// state is at worst missing the dead process' last allocation.
+class RingLock {
+ public:
+  explicit RingLock(pthread_mutex_t* mu) : mu_(mu) {
+    if (pthread_mutex_lock(mu_) == EOWNERDEAD) {
+      pthread_mutex_consistent(mu_);
+    }
+  }
+  ~RingLock() { pthread_mutex_unlock(mu_); }
+
+ private:
+  pthread_mutex_t* const mu_;
+};
+
+}  // namespace
+
+SharedMemoryRing::SharedMemoryRing(const string& name, bool owner, void* base,
+                                   uint64 mapped_size)
+    : name_(name),
+      owner_(owner),
+      base_(base),
+      mapped_size_(mapped_size),
+      header_(static_cast<Header*>(base)),
+      data_(static_cast<char*>(base) + DataOffset()),
+      capacity_(header_->capacity) {}
+
+SharedMemoryRing::~SharedMemoryRing() {
+  munmap(base_, mapped_size_);
+  if (owner_) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+Status SharedMemoryRing::Create(uint64 capacity,
+                                std::unique_ptr<SharedMemoryRing>* ring) {
+  capacity = RoundUp(capacity, kAlignment);
+  if (capacity == 0) {
+    return errors::InvalidArgument("SharedMemoryRing capacity must be > 0");
+  }
+  const string name = strings::StrCat("/tf_shm_ring_", getpid(), "_",
+                                      strings::Hex(random::New64()));
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return errors::Unavailable("shm_open(", name,
+                               ") failed: ", strerror(errno));
+  }
+  const uint64 mapped_size = DataOffset() + capacity;
+  if (ftruncate(fd, mapped_size) != 0) {
+    Status s = errors::ResourceExhausted("ftruncate(", name, ", ", mapped_size,
+                                         ") failed: ", strerror(errno));
+    close(fd);
+    shm_unlink(name.c_str());
+    return s;
+  }
+  void* base =
+      mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return errors::Unavailable("mmap(", name, ") failed: ", strerror(errno));
+  }
+
+  Header* header = static_cast<Header*>(base);
+  header->capacity = capacity;
+  header->head = 0;
+  header->tail = 0;
+  header->owner_pid = getpid();
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&header->mu, &attr);
+  pthread_mutexattr_destroy(&attr);
+  // Written last, so that Open() never sees a partially initialized ring.
+  __atomic_store_n(&header->magic, kRingMagic, __ATOMIC_RELEASE);
+
+  ring->reset(new SharedMemoryRing(name, /*owner=*/true, base, mapped_size));
+  return Status::OK();
+}
+
+Status SharedMemoryRing::Open(const string& name,
+                              std::unique_ptr<SharedMemoryRing>* ring) {
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return errors::Unavailable("shm_open(", name,
+                               ") failed: ", strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<uint64>(st.st_size) <= DataOffset()) {
+    close(fd);
+    return errors::FailedPrecondition(name, " is not a SharedMemoryRing");
+  }
+  const uint64 mapped_size = st.st_size;
+  void* base =
+      mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return errors::Unavailable("mmap(", name, ") failed: ", strerror(errno));
+  }
+  Header* header = static_cast<Header*>(base);
+  if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != kRingMagic ||
+      DataOffset() + header->capacity != mapped_size) {
+    munmap(base, mapped_size);
+    return errors::FailedPrecondition(name, " is not a SharedMemoryRing");
+  }
+  ring->reset(new SharedMemoryRing(name, /*owner=*/false, base, mapped_size));
+  return Status::OK();
+}
+
+constexpr int SharedMemoryRing::kMaxAbandonedTags;
+
+bool SharedMemoryRing::Allocate(uint64 num_bytes, uint64 tag, uint64* offset) {
+  const uint64 record_size =
+      RoundUp(kRecordHeaderBytes + num_bytes, kAlignment);
+  if (record_size > capacity_) return false;
+
+  RingLock l(&header_->mu);
+  uint64 pos = header_->head % capacity_;
+  // Records never wrap around the end of the ring; skip the remainder instead.
+  const uint64 padding = (pos + record_size > capacity_) ? capacity_ - pos : 0;
+  if (header_->head - header_->tail + padding + record_size > capacity_) {
+    return false;
+  }
+  if (padding > 0) {
+    RecordHeader* pad = reinterpret_cast<RecordHeader*>(data_ + pos);
+    pad->size = padding;
+    pad->tag = 0;
+    pad->released = 1;
+    pad->committed = 1;
+    header_->head += padding;
+    pos = 0;
+  }
+  RecordHeader* record = reinterpret_cast<RecordHeader*>(data_ + pos);
+  record->size = record_size;
+  record->tag = tag;
+  record->released = 0;
+  record->committed = 0;
+  header_->head += record_size;
+  *offset = pos + kRecordHeaderBytes;
+  return true;
+}
+
+char* SharedMemoryRing::Data(uint64 offset, uint64 num_bytes) const {
+  if (offset < kRecordHeaderBytes || offset > capacity_ ||
+      num_bytes > capacity_ - offset) {
+    return nullptr;
+  }
+  return data_ + offset;
+}
+
+namespace {
+
+bool IsValidRecordOffset(uint64 offset, uint64 capacity) {
+  return offset >= kRecordHeaderBytes && offset < capacity &&
+         offset % kAlignment == 0;
+}
+
+}  // namespace
+
+void SharedMemoryRing::Commit(uint64 offset) {
+  if (!IsValidRecordOffset(offset, capacity_)) {
+    LOG(ERROR) << "Ignoring commit of invalid offset " << offset << " in "
+               << name_;
+    return;
+  }
+  RingLock l(&header_->mu);
+  reinterpret_cast<RecordHeader*>(data_ + offset - kRecordHeaderBytes)
+      ->committed = 1;
+}
+
+void SharedMemoryRing::Release(uint64 offset) {
+  if (!IsValidRecordOffset(offset, capacity_)) {
+    LOG(ERROR) << "Ignoring release of invalid offset " << offset << " in "
+               << name_;
+    return;
+  }
+  RingLock l(&header_->mu);
+  reinterpret_cast<RecordHeader*>(data_ + offset - kRecordHeaderBytes)
+      ->released = 1;
+  ReclaimLocked();
+}
+
+void SharedMemoryRing::Abandon(uint64 tag) {
+  DCHECK(owner_) << "Only the owner of " << name_ << " may abandon records";
+  {
+    mutex_lock l(abandoned_mu_);
+    if (abandoned_.insert(tag).second) {
+      abandoned_order_.push_back(tag);
+      if (abandoned_order_.size() > kMaxAbandonedTags) {
+        abandoned_.erase(abandoned_order_.front());
+        abandoned_order_.pop_front();
+      }
+    }
+  }
+  Reclaim();
+}
+
+void SharedMemoryRing::Reclaim() {
+  RingLock l(&header_->mu);
+  ReclaimLocked();
+}
+
+bool SharedMemoryRing::IsOrphaned() const {
+  if (owner_) return false;
+  if (kill(header_->owner_pid, 0) != 0 && errno == ESRCH) return true;
+  // The owner unlinks the name when it destroys the ring.
+  int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd < 0) return errno == ENOENT;
+  close(fd);
+  return false;
+}
+
+bool SharedMemoryRing::IsAbandoned(uint64 tag) {
+  mutex_lock l(abandoned_mu_);
+  return abandoned_.count(tag) > 0;
+}
+
+void SharedMemoryRing::ReclaimLocked() {
+  while (header_->tail != header_->head) {
+    RecordHeader* oldest =
+        reinterpret_cast<RecordHeader*>(data_ + header_->tail % capacity_);
+    if (!oldest->released) {
+      if (!oldest->committed || !IsAbandoned(oldest->tag)) break;
+      oldest->released = 1;
+    }
+    header_->tail += oldest->size;
+  }
+}
+
+#else  // defined(PLATFORM_WINDOWS)
+
+struct SharedMemoryRing::Header {
+  uint64 capacity;
+};
+
+Status SharedMemoryRing::Create(uint64 capacity,
+                                std::unique_ptr<SharedMemoryRing>* ring) {
+  return errors::Unimplemented("SharedMemoryRing is not supported on Windows");
+}
+
+Status SharedMemoryRing::Open(const string& name,
+                              std::unique_ptr<SharedMemoryRing>* ring) {
+  return errors::Unimplemented("SharedMemoryRing is not supported on Windows");
+}
+
+SharedMemoryRing::~SharedMemoryRing() {}
+
+constexpr int SharedMemoryRing::kMaxAbandonedTags;
+
+bool SharedMemoryRing::Allocate(uint64 num_bytes, uint64 tag, uint64* offset) {
+  return false;
+}
+
+char* SharedMemoryRing::Data(uint64 offset, uint64 num_bytes) const {
+  return nullptr;
+}
+
+void SharedMemoryRing::Commit(uint64 offset) {}
+
+void SharedMemoryRing::Release(uint64 offset) {}
+
+void SharedMemoryRing::Abandon(uint64 tag) {}
+
+void SharedMemoryRing::Reclaim() {}
+
+bool SharedMemoryRing::IsOrphaned() const { return false; }
+
+#endif  // defined(PLATFORM_WINDOWS)
+
+const string& SharedMemoryHostId() {
+  static const string* host_id = [] {
+    string boot_id;
+    if (ReadFileToString(Env::Default(), "/proc/sys/kernel/random/boot_id",
+                         &boot_id)
+            .ok()) {
+      return new string(strings::StrCat(
+          port::Hostname(), "/", str_util::StripSuffix(boot_id, "\n")));
+    }
+    return new string(port::Hostname());
+  }();
+  return *host_id;
+}
+
+}  // namespace tensorflow
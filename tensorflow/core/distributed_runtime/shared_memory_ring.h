@@ -0,0 +1,154 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_SHARED_MEMORY_RING_H_
+#define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_SHARED_MEMORY_RING_H_
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// SharedMemoryRing is a byte ring buffer in a POSIX shared memory segment
+// that lets tasks running on the same host hand tensor contents to each other
+// without pushing them through a socket.
+//
+// The process that creates a ring owns it: it is the only reader, and the
+// segment is unlinked when the creating object is destroyed. Any number of
+// other processes on the host may Open() the ring by name and Allocate()
+// space in it concurrently; they write the payload, Commit() it and then tell
+// the reader (out of band, e.g. in an RPC response) the offset and size they
+// used. The reader copies the payload out and calls Release(). Records may be
+// released in any order; space is reclaimed once all older records are
+// released.
+//
+// Every record carries a tag chosen by the writer, e.g. the id of the request
+// it answers. If the out-of-band message is lost, e.g. because the RPC failed
+// or was cancelled, the reader never learns the offset of the record and
+// calls Abandon() with its tag instead, so that the record does not block the
+// ring forever.
+//
+// Allocation never blocks: when the ring is full Allocate() returns false and
+// the caller is expected to fall back to another transport.
+//
+// Thread safe, and safe across processes: the ring state is guarded by a
+// robust, process-shared mutex that lives in the segment itself.
+class SharedMemoryRing {
+ public:
+  // Creates a new ring with room for roughly `capacity` bytes of payload under
+  // a freshly generated name.
+  static Status Create(uint64 capacity,
+                       std::unique_ptr<SharedMemoryRing>* ring);
+
+  // Maps the existing ring called `name`, created by another process.
+  static Status Open(const string& name,
+                     std::unique_ptr<SharedMemoryRing>* ring);
+
+  ~SharedMemoryRing();
+
+  // The name under which other processes can Open() this ring.
+  const string& name() const { return name_; }
+
+  // Size in bytes of the payload area.
+  uint64 capacity() const { return capacity_; }
+
+  // Reserves `num_bytes` contiguous bytes for a record tagged `tag` and sets
+  // `*offset` to the start of the reservation. Returns false if the ring does
+  // not have enough free space. The returned memory is 64-byte aligned.
+  bool Allocate(uint64 num_bytes, uint64 tag, uint64* offset);
+
+  // Marks the record at `offset` as completely written. Abandoned records are
+  // only reclaimed once they are committed, so that their space is not reused
+  // while the writer is still copying into it.
+  void Commit(uint64 offset);
+
+  // Returns a pointer to the payload at `offset`, after checking that
+  // [offset, offset + num_bytes) lies within the ring. Returns nullptr
+  // otherwise, which protects readers from malformed offsets.
+  char* Data(uint64 offset, uint64 num_bytes) const;
+
+  // Returns the reservation starting at `offset` to the ring.
+  void Release(uint64 offset);
+
+  // Releases the committed records tagged `tag`, including the ones that are
+  // committed later, whose location the reader will never learn. Only the
+  // owner of the ring may call this. The most recent kMaxAbandonedTags tags
+  // are remembered; a record whose writer never commits it, e.g. because the
+  // writer died, still blocks the ring.
+  void Abandon(uint64 tag);
+
+  // Reclaims the space of the released and abandoned records that precede
+  // all records in use. Abandoned records that are committed after the call
+  // to Abandon() are only reclaimed by a later call to Abandon(), Reclaim()
+  // or Release(), so the owner should call this before offering the ring.
+  void Reclaim();
+
+  // Returns true if the owner of the ring destroyed it or exited, in which
+  // case nobody reads the ring anymore and it can be unmapped.
+  bool IsOrphaned() const;
+
+  static constexpr int kMaxAbandonedTags = 1024;
+
+ private:
+  struct Header;
+
+  // Offset of the payload area from the start of the segment.
+  static uint64 DataOffset();
+
+  // Advances the tail of the ring past released and abandoned records. The
+  // ring mutex must be held.
+  void ReclaimLocked();
+
+  // Returns true if `tag` was passed to Abandon().
+  bool IsAbandoned(uint64 tag);
+
+  SharedMemoryRing(const string& name, bool owner, void* base,
+                   uint64 mapped_size);
+
+  const string name_;
+  const bool owner_;
+  void* const base_;
+  const uint64 mapped_size_;
+  Header* const header_;
+  char* const data_;
+  const uint64 capacity_;
+
+  mutex abandoned_mu_;
+  // Abandoned tags, and the same tags in the order they were abandoned so
+  // that the oldest ones can be forgotten.
+  std::unordered_set<uint64> abandoned_ TF_GUARDED_BY(abandoned_mu_);
+  std::deque<uint64> abandoned_order_ TF_GUARDED_BY(abandoned_mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(SharedMemoryRing);
+};
+
+// Returns a string that identifies the machine this process runs on, for
+// deciding whether a peer can use a SharedMemoryRing created by this process.
+// Combines the hostname with the kernel boot id when it is available, so that
+// e.g. two containers that share a hostname are not confused with each other
+// across reboots.
+const string& SharedMemoryHostId();
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_SHARED_MEMORY_RING_H_
@@ -0,0 +1,182 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/shared_memory_ring.h"
+
+#include <string.h>
+
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr uint64 kTag = 1;
+
+TEST(SharedMemoryRingTest, WriteThroughOpenedRingReadThroughOwner) {
+  std::unique_ptr<SharedMemoryRing> owner;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1 << 16, &owner));
+  std::unique_ptr<SharedMemoryRing> writer;
+  TF_ASSERT_OK(SharedMemoryRing::Open(owner->name(), &writer));
+  EXPECT_EQ(owner->capacity(), writer->capacity());
+
+  const char kPayload[] = "hello from the other side";
+  uint64 offset;
+  ASSERT_TRUE(writer->Allocate(sizeof(kPayload), kTag, &offset));
+  EXPECT_EQ(0, offset % 64);
+  memcpy(writer->Data(offset, sizeof(kPayload)), kPayload, sizeof(kPayload));
+
+  EXPECT_STREQ(kPayload, owner->Data(offset, sizeof(kPayload)));
+  owner->Release(offset);
+}
+
+TEST(SharedMemoryRingTest, AllocateFailsWhenFull) {
+  std::unique_ptr<SharedMemoryRing> ring;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1024, &ring));
+  uint64 offset;
+  EXPECT_FALSE(ring->Allocate(1024, kTag, &offset));
+
+  uint64 first, second;
+  ASSERT_TRUE(ring->Allocate(448, kTag, &first));
+  ASSERT_TRUE(ring->Allocate(448, kTag, &second));
+  EXPECT_FALSE(ring->Allocate(1, kTag, &offset));
+  ring->Release(first);
+  EXPECT_TRUE(ring->Allocate(1, kTag, &offset));
+}
+
+TEST(SharedMemoryRingTest, ReclaimsSpaceOnlyInOrder) {
+  std::unique_ptr<SharedMemoryRing> ring;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1024, &ring));
+  uint64 a, b, offset;
+  ASSERT_TRUE(ring->Allocate(448, kTag, &a));
+  ASSERT_TRUE(ring->Allocate(448, kTag, &b));
+  // Releasing the newer record does not free space while the older one is
+  // still in use.
+  ring->Release(b);
+  EXPECT_FALSE(ring->Allocate(448, kTag, &offset));
+  ring->Release(a);
+  EXPECT_TRUE(ring->Allocate(896, kTag, &offset));
+}
+
+TEST(SharedMemoryRingTest, RecordsDoNotWrapAroundTheEnd) {
+  std::unique_ptr<SharedMemoryRing> ring;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1024, &ring));
+  uint64 a, b, c;
+  ASSERT_TRUE(ring->Allocate(576, kTag, &a));
+  ASSERT_TRUE(ring->Allocate(128, kTag, &b));
+  ring->Release(a);
+  // Only 192 bytes remain at the end of the ring, which is not enough for
+  // this record, so it is placed at the start.
+  ASSERT_TRUE(ring->Allocate(400, kTag, &c));
+  EXPECT_LT(c, b);
+  EXPECT_NE(nullptr, ring->Data(c, 400));
+  ring->Release(b);
+  ring->Release(c);
+  uint64 offset;
+  EXPECT_TRUE(ring->Allocate(448, kTag, &offset));
+}
+
+TEST(SharedMemoryRingTest, AbandonReclaimsCommittedRecords) {
+  std::unique_ptr<SharedMemoryRing> ring;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1024, &ring));
+  uint64 a, b, offset;
+  ASSERT_TRUE(ring->Allocate(448, /*tag=*/7, &a));
+  ASSERT_TRUE(ring->Allocate(448, /*tag=*/8, &b));
+  ring->Commit(a);
+  ring->Commit(b);
+  // The reader never learned where the record tagged 7 is.
+  ring->Abandon(7);
+  EXPECT_TRUE(ring->Allocate(448, kTag, &offset));
+  EXPECT_EQ(a, offset);
+  ring->Release(b);
+  ring->Release(offset);
+}
+
+TEST(SharedMemoryRingTest, AbandonedRecordsAreReclaimedOnlyOnceCommitted) {
+  std::unique_ptr<SharedMemoryRing> ring;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1024, &ring));
+  // The request was abandoned before the writer allocated its record.
+  ring->Abandon(7);
+  uint64 a, offset;
+  ASSERT_TRUE(ring->Allocate(896, /*tag=*/7, &a));
+  // The writer may still be copying into the record.
+  ring->Reclaim();
+  EXPECT_FALSE(ring->Allocate(448, kTag, &offset));
+  ring->Commit(a);
+  ring->Reclaim();
+  EXPECT_TRUE(ring->Allocate(896, kTag, &offset));
+}
+
+TEST(SharedMemoryRingTest, AbandonedTagsAreForgottenEventually) {
+  std::unique_ptr<SharedMemoryRing> ring;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1024, &ring));
+  for (int i = 0; i <= SharedMemoryRing::kMaxAbandonedTags; ++i) {
+    ring->Abandon(100 + i);
+  }
+  uint64 first, last, offset;
+  ASSERT_TRUE(ring->Allocate(448, /*tag=*/100, &first));
+  ring->Commit(first);
+  ring->Reclaim();
+  EXPECT_FALSE(ring->Allocate(896, kTag, &offset));
+  ring->Release(first);
+  ASSERT_TRUE(ring->Allocate(
+      448, /*tag=*/100 + SharedMemoryRing::kMaxAbandonedTags, &last));
+  ring->Commit(last);
+  ring->Reclaim();
+  EXPECT_TRUE(ring->Allocate(896, kTag, &offset));
+}
+
+TEST(SharedMemoryRingTest, DataRejectsOutOfRangeLocations) {
+  std::unique_ptr<SharedMemoryRing> ring;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1024, &ring));
+  EXPECT_EQ(nullptr, ring->Data(0, 16));
+  EXPECT_EQ(nullptr, ring->Data(64, 1024));
+  EXPECT_EQ(nullptr, ring->Data(2048, 1));
+  EXPECT_NE(nullptr, ring->Data(64, 960));
+}
+
+TEST(SharedMemoryRingTest, OpenFailsForUnknownName) {
+  std::unique_ptr<SharedMemoryRing> ring;
+  EXPECT_FALSE(SharedMemoryRing::Open("/tf_shm_ring_does_not_exist", &ring)
+                   .ok());
+}
+
+TEST(SharedMemoryRingTest, OpenFailsAfterOwnerIsDestroyed) {
+  std::unique_ptr<SharedMemoryRing> owner;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1024, &owner));
+  const string name = owner->name();
+  owner.reset();
+  std::unique_ptr<SharedMemoryRing> ring;
+  EXPECT_FALSE(SharedMemoryRing::Open(name, &ring).ok());
+}
+
+TEST(SharedMemoryRingTest, OpenedRingIsOrphanedAfterOwnerIsDestroyed) {
+  std::unique_ptr<SharedMemoryRing> owner;
+  TF_ASSERT_OK(SharedMemoryRing::Create(1024, &owner));
+  std::unique_ptr<SharedMemoryRing> ring;
+  TF_ASSERT_OK(SharedMemoryRing::Open(owner->name(), &ring));
+  EXPECT_FALSE(owner->IsOrphaned());
+  EXPECT_FALSE(ring->IsOrphaned());
+  owner.reset();
+  EXPECT_TRUE(ring->IsOrphaned());
+}
+
+TEST(SharedMemoryRingTest, HostIdIsStable) {
+  EXPECT_FALSE(SharedMemoryHostId().empty());
+  EXPECT_EQ(SharedMemoryHostId(), SharedMemoryHostId());
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -18,6 +18,7 @@ limitations under the License.
 #include "google/protobuf/any.pb.h"
 
 #include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
 
@@ -25,8 +26,14 @@ namespace tensorflow {
 
 TensorResponse::Source::~Source() {}
 
+TensorBuffer* TensorResponse::Source::ShareContents(const char* data,
+                                                    size_t num_bytes) {
+  return nullptr;
+}
+
 void TensorResponse::Clear() {
   on_host_ = false;
+  can_share_contents_ = false;
   device_ = nullptr;
   alloc_attrs_ = AllocatorAttributes();
   allocator_ = nullptr;
@@ -48,6 +55,10 @@ void TensorResponse::InitAlloc(DeviceBase* d, const AllocatorAttributes& aa) {
     on_host_ = true;
   }
   allocator_ = device_->GetAllocator(alloc_attrs_);
+  // Memory owned by the RPC layer is ordinary pageable host memory, so it can
+  // only stand in for an allocation that has no special requirements.
+  can_share_contents_ = on_host_ && !alloc_attrs_.gpu_compatible() &&
+                        !alloc_attrs_.nic_compatible();
 }
 
 Status TensorResponse::InitFrom(RecvTensorResponse* response) {
@@ -90,6 +101,7 @@ Status TensorResponse::ParseFrom(Source* source) {
     }
     Status s =
         device_->MakeTensorFromProto(meta_.tensor(), alloc_attrs_, &tensor_);
+    metrics::RecordRpcTensorBytesCopied("recv", tensor_.TotalBytes());
     // Reduce memory usage for big tensors.
     {
       TensorProto empty;
@@ -142,10 +154,19 @@ bool ReadNestedMessage(protobuf::io::CodedInputStream* input,
   return input->DecrementRecursionDepthAndPopLimit(p.first);
 }
 
+bool IsAlignedForTensor(const void* ptr) {
+#if EIGEN_MAX_ALIGN_BYTES == 0
+  return true;
+#else
+  return reinterpret_cast<intptr_t>(ptr) % EIGEN_MAX_ALIGN_BYTES == 0;
+#endif
+}
+
 }  // namespace
 
 bool TensorResponse::ParseTensorSubmessage(
-    protobuf::io::CodedInputStream* input, TensorProto* tensor_meta) {
+    Source* source, protobuf::io::CodedInputStream* input,
+    TensorProto* tensor_meta) {
   bool seen_tensor_content = false;
   while (true) {
     auto p = input->ReadTagWithCutoff(127);
@@ -196,14 +217,33 @@ bool TensorResponse::ParseTensorSubmessage(
         if (!ReadVarintSizeAsInt(input, &num_bytes)) return false;
         seen_tensor_content = true;
         TensorShape shape(tensor_meta->tensor_shape());
+        if (can_share_contents_ && num_bytes > 0) {
+          // If the whole content sits in one suitably aligned chunk of the
+          // underlying stream, reference it instead of copying it.
+          const void* data;
+          int size;
+          if (input->GetDirectBufferPointer(&data, &size) &&
+              size >= num_bytes && IsAlignedForTensor(data) &&
+              static_cast<size_t>(num_bytes) ==
+                  shape.num_elements() * DataTypeSize(tensor_meta->dtype())) {
+            TensorBuffer* shared = source->ShareContents(
+                static_cast<const char*>(data), num_bytes);
+            if (shared != nullptr) {
+              Tensor t(tensor_meta->dtype(), shape, shared);
+              shared->Unref();
+              if (!input->Skip(num_bytes)) return false;
+              metrics::RecordRpcTensorBytesReferenced("recv", num_bytes);
+              tensor_ = std::move(t);
+              break;
+            }
+          }
+        }
         Tensor t(allocator_, tensor_meta->dtype(), shape);
         StringPiece buf = t.tensor_data();
         if (static_cast<size_t>(num_bytes) != buf.size()) return false;
-        // TODO(jeff,sanjay): Figure out a way to avoid this copy if
-        // the underlying ZeroCopyInputStream data is properly aligned
-        // and compatible with what allocator_ wants.
         if (!input->ReadRaw(const_cast<char*>(buf.data()), num_bytes))
           return false;
+        metrics::RecordRpcTensorBytesCopied("recv", num_bytes);
         tensor_ = std::move(t);
         break;
       }
@@ -235,7 +275,7 @@ bool TensorResponse::ParseFast(Source* source) {
         std::pair<protobuf::io::CodedInputStream::Limit, int> p =
             input.IncrementRecursionDepthAndPushLimit(length);
         if (p.second < 0 ||
-            !ParseTensorSubmessage(&input, meta_.mutable_tensor())) {
+            !ParseTensorSubmessage(source, &input, meta_.mutable_tensor())) {
           return false;
         }
         if (!input.DecrementRecursionDepthAndPopLimit(p.first)) {
@@ -287,6 +327,7 @@ bool TensorResponse::ParseSlow(Source* source) {
     return false;
   }
   tensor_ = std::move(parsed);
+  metrics::RecordRpcTensorBytesCopied("recv", tensor_.TotalBytes());
 
   // Reduce memory usage for big tensors.
   {
@@ -27,6 +27,7 @@ namespace tensorflow {
 
 class Allocator;
 class DeviceBase;
+class TensorBuffer;
 class TensorProto;
 
 // TensorResponse can be used as the destination of an RPC that returns
@@ -64,6 +65,16 @@ class TensorResponse {
     // Ownership of the returned stream is retained by the Source and
     // should not be deleted by the caller.
     virtual ::tensorflow::protobuf::io::ZeroCopyInputStream* contents() = 0;
+
+    // Returns a TensorBuffer that refers to the "num_bytes" bytes starting at
+    // "data" without copying them, or nullptr if this source cannot keep that
+    // memory alive independently of the stream returned by contents().
+    // "data" must point into a single chunk yielded by that stream.
+    //
+    // On success the caller owns one reference to the returned buffer.
+    //
+    // The default implementation never shares memory.
+    virtual TensorBuffer* ShareContents(const char* data, size_t num_bytes);
   };
 
   // Parse the RecvTensorResponse encoded in the data yielded by
@@ -92,12 +103,16 @@ class TensorResponse {
   DeviceBase* device() const { return device_; }
 
  private:
-  bool ParseTensorSubmessage(protobuf::io::CodedInputStream* input,
+  bool ParseTensorSubmessage(Source* source,
+                             protobuf::io::CodedInputStream* input,
                              TensorProto* tensor_meta);
   bool ParseFast(Source* source);
   bool ParseSlow(Source* source);
 
   bool on_host_ = false;
+  // True if the tensor content may reference the source's memory directly
+  // instead of being copied into a buffer from allocator_.
+  bool can_share_contents_ = false;
   DeviceBase* device_ = nullptr;
   AllocatorAttributes alloc_attrs_;
   Allocator* allocator_ = nullptr;
@@ -23,10 +23,69 @@ limitations under the License.
 #include "tensorflow/core/distributed_runtime/rendezvous_mgr_interface.h"
 #include "tensorflow/core/distributed_runtime/tensor_coding.h"
 #include "tensorflow/core/distributed_runtime/worker_session.h"
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/platform/fingerprint.h"
 #include "tensorflow/core/platform/tracing.h"
 #include "tensorflow/core/profiler/lib/profiler_session.h"
 
 namespace tensorflow {
+namespace {
+
+// Returns the digest of the type, shape and content of "val", with a zero
+// `hash` if its content cannot be hashed.
+TensorDigest TensorContentDigest(const Tensor& val) {
+  TensorDigest digest;
+  uint64 hash = Hash64Combine(val.dtype(), val.dims());
+  uint64 fingerprint = FingerprintCat64(val.dtype(), val.dims());
+  for (int d = 0; d < val.dims(); ++d) {
+    hash = Hash64Combine(hash, val.dim_size(d));
+    fingerprint = FingerprintCat64(fingerprint, val.dim_size(d));
+  }
+  int64 num_bytes = 0;
+  auto add_content = [&](StringPiece data) {
+    hash = Hash64Combine(hash, Hash64(data.data(), data.size()));
+    fingerprint = FingerprintCat64(fingerprint, Fingerprint64(data));
+    num_bytes += data.size();
+  };
+  if (DataTypeCanUseMemcpy(val.dtype())) {
+    add_content(val.tensor_data());
+  } else if (val.dtype() == DT_STRING) {
+    const auto strings = val.flat<tstring>();
+    for (int64 i = 0; i < strings.size(); ++i) {
+      add_content(StringPiece(strings(i).data(), strings(i).size()));
+    }
+  } else {
+    return digest;
+  }
+  // A zero hash means "not hashed", so it is not a valid hash value.
+  digest.set_hash(hash == 0 ? 1 : hash);
+  digest.set_fingerprint(fingerprint);
+  digest.set_num_bytes(num_bytes);
+  return digest;
+}
+
+// Adds the values in "out" to "response" with their digests, leaving out the
+// values that match the digests that the caller sent in "request".
+void AddHashedRecvs(const RunGraphRequestWrapper& request,
+                    const GraphMgr::NamedTensors& out,
+                    MutableRunGraphResponseWrapper* response) {
+  std::unordered_map<string, const TensorDigest*> cached_digests;
+  for (size_t i = 0;
+       i < request.num_recvs() && i < request.num_recv_cached_digests(); ++i) {
+    cached_digests[request.recv_key(i)] = &request.recv_cached_digest(i);
+  }
+  for (const auto& p : out) {
+    const TensorDigest digest = TensorContentDigest(p.second);
+    auto it = cached_digests.find(p.first);
+    if (it != cached_digests.end() && SameTensorDigest(*it->second, digest)) {
+      response->AddUnchangedRecv(p.first, digest);
+    } else {
+      response->AddHashedRecv(p.first, p.second, digest);
+    }
+  }
+}
+
+}  // namespace
 
 Worker::Worker(WorkerEnv* env) : env_(env), recent_request_ids_(100000) {
   // Enable log history collection in StatusGroup so that recent warning and
@@ -221,7 +280,7 @@ void Worker::DoRunGraph(CallOptions* opts, RunGraphRequestWrapper* request,
   session->graph_mgr()->ExecuteAsync(
       request->graph_handle(), step_id, session.get(), request->exec_opts(),
       collector, response, cm, in,
-      [this, step_id, response, session, cm, out, token, collector,
+      [this, step_id, request, response, session, cm, out, token, collector,
        profiler_session, opts, done](const Status& status) {
         Status s = status;
         if (s.ok()) {
@@ -239,10 +298,14 @@ void Worker::DoRunGraph(CallOptions* opts, RunGraphRequestWrapper* request,
         }
 
         if (s.ok()) {
-          for (const auto& p : *out) {
-            const string& key = p.first;
-            const Tensor& val = p.second;
-            response->AddRecv(key, val);
+          if (request->num_recv_cached_digests() > 0) {
+            AddHashedRecvs(*request, *out, response);
+          } else {
+            for (const auto& p : *out) {
+              const string& key = p.first;
+              const Tensor& val = p.second;
+              response->AddRecv(key, val);
+            }
           }
         }
 
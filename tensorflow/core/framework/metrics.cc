@@ -58,6 +58,12 @@ auto* graph_unused_outputs = monitoring::Counter<1>::New(
     "/tensorflow/core/graph_unused_outputs",
     "The number of unused outputs for ops of a given type.", "name");
 
+auto* graph_buffer_forwarding = monitoring::Counter<1>::New(
+    "/tensorflow/core/graph_buffer_forwarding",
+    "The number of kernel output buffers that reused an input buffer "
+    "(\"forwarded\") or were allocated (\"allocated\").",
+    "result");
+
 auto* tf_data_autotune_counter = monitoring::Counter<1>::New(
     "/tensorflow/data/autotune", "tf.data autotuning", "name");
 
@@ -148,6 +154,12 @@ auto* mlir_import_failure_count = monitoring::Counter<0>::New(
     "/tensorflow/mlir/import_failure_count",
     "The number of jobs that failed during mlir import or verification.");
 
+auto* rpc_tensor_bytes = monitoring::Counter<2>::New(
+    "/tensorflow/core/rpc_tensor_bytes",
+    "The number of tensor content bytes encoded or decoded by RPC transports, "
+    "split by whether they were copied or referenced in place.",
+    "direction", "method");
+
 }  // namespace
 
 void RecordTFDataAutotune(const string& name) {
@@ -284,5 +296,24 @@ void RecordUnusedOutput(const string& op_name) {
   graph_unused_outputs->GetCell(op_name)->IncrementBy(1);
 }
 
+void RecordBufferForwarding(int64 forwarded, int64 allocated) {
+  static auto* forwarded_cell = graph_buffer_forwarding->GetCell("forwarded");
+  static auto* allocated_cell = graph_buffer_forwarding->GetCell("allocated");
+  if (forwarded > 0) forwarded_cell->IncrementBy(forwarded);
+  if (allocated > 0) allocated_cell->IncrementBy(allocated);
+}
+
+void RecordRpcTensorBytesCopied(const string& direction, int64 num_bytes) {
+  if (num_bytes > 0) {
+    rpc_tensor_bytes->GetCell(direction, "copied")->IncrementBy(num_bytes);
+  }
+}
+
+void RecordRpcTensorBytesReferenced(const string& direction, int64 num_bytes) {
+  if (num_bytes > 0) {
+    rpc_tensor_bytes->GetCell(direction, "referenced")->IncrementBy(num_bytes);
+  }
+}
+
 }  // namespace metrics
 }  // namespace tensorflow
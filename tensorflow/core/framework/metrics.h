@@ -96,6 +96,11 @@ void UpdateGraphExecTime(const uint64 running_time_usecs);
 // Records that one output of an op of type `op_name` was unused.
 void RecordUnusedOutput(const string& op_name);
 
+// Records the number of kernel outputs and temporaries of one graph execution
+// that reused an input buffer (`forwarded`), and that had to be allocated
+// because no input could be reused (`allocated`).
+void RecordBufferForwarding(int64 forwarded, int64 allocated);
+
 // Updates the metrics stored about time spent building graphs.
 //
 // By "GraphBuild", we refer to building a client graph, which is a sub-graph of
@@ -123,6 +128,18 @@ void UpdateXlaCompilationTime(const uint64 compilation_time_usecs);
 // Increment the number of jobs that failed during import to mlir.
 void IncrementMLIRImportFailureCount();
 
+// Records the number of tensor content bytes that an RPC transport copied
+// while encoding or decoding a tensor.
+//
+// The `direction` argument is either "send" or "recv".
+void RecordRpcTensorBytesCopied(const string& direction, int64 num_bytes);
+
+// Records the number of tensor content bytes that an RPC transport handed
+// over by reference (without copying) while encoding or decoding a tensor.
+//
+// The `direction` argument is either "send" or "recv".
+void RecordRpcTensorBytesReferenced(const string& direction, int64 num_bytes);
+
 }  // namespace metrics
 }  // namespace tensorflow
 
@@ -570,9 +570,11 @@ Status OpKernelContext::forward_input_or_allocate_temp(
                       type, shape, DEVICE_MEMORY, allocator_attr);
     if (new_tensor != nullptr) {
       *out_temp = std::move(*new_tensor);
+      record_forwarding(true);
       return Status::OK();
     }
   }
+  record_forwarding(false);
   return allocate_temp(type, shape, out_temp, allocator_attr);
 }
 
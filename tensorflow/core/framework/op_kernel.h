@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_FRAMEWORK_OP_KERNEL_H_
 #define TENSORFLOW_CORE_FRAMEWORK_OP_KERNEL_H_
 
+#include <atomic>
 #include <functional>
 #include <unordered_set>
 #include <utility>
@@ -697,6 +698,15 @@ class OpKernelContext {
     // Values in [0,...) represent reservations for the indexed output.
     const int* forward_from_array = nullptr;
 
+    // Counts of the buffers requested through forward_input_or_allocate_*()
+    // that reused an input, and of those that had to be allocated.
+    struct ForwardingCounts {
+      std::atomic<int64> forwarded{0};
+      std::atomic<int64> allocated{0};
+    };
+    // If non-null, the counts are updated by this kernel.
+    ForwardingCounts* forwarding_counts = nullptr;
+
     // For tracking actively running deferred ops.
     std::function<void()> inc_num_deferred_ops_function;
     std::function<void()> dec_num_deferred_ops_function;
@@ -1265,6 +1275,14 @@ class OpKernelContext {
  private:
   bool record_memory_consumption_ = false;
 
+  // Updates `params_->forwarding_counts`, if any.
+  void record_forwarding(bool forwarded) {
+    if (params_->forwarding_counts == nullptr) return;
+    auto& count = forwarded ? params_->forwarding_counts->forwarded
+                            : params_->forwarding_counts->allocated;
+    count.fetch_add(1, std::memory_order_relaxed);
+  }
+
   // Internal common method used when allocating tensor memory
   Status allocate_tensor(DataType type, const TensorShape& shape,
                          Tensor* out_tensor,
@@ -1642,9 +1660,11 @@ inline Status OpKernelContext::forward_input_or_allocate_output(
   for (int input_index : candidate_input_indices) {
     if (forward_input_to_output_with_shape(input_index, output_index,
                                            output_shape, output)) {
+      record_forwarding(true);
       return Status::OK();
     }
   }
+  record_forwarding(false);
   return allocate_output(output_index, output_shape, output);
 }
 
@@ -1655,9 +1675,11 @@ inline Status OpKernelContext::forward_input_or_allocate_output(
     if (forward_input_to_output_with_shape(input_name, output_name,
                                            output_shape, output)
             .ok()) {
+      record_forwarding(true);
       return Status::OK();
     }
   }
+  record_forwarding(false);
   return allocate_output(output_name, output_shape, output);
 }
 
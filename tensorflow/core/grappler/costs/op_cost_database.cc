@@ -0,0 +1,212 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/costs/op_cost_database.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/grappler/costs/robust_stats.h"
+#include "tensorflow/core/grappler/costs/utils.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/fingerprint.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+
+// Returns the part of `op_info` that determines the execution time of an op:
+// its type, its attributes, the type of its device and the types and shapes
+// of its inputs. Internal attributes, such as the colocation constraints, and
+// the values of constant inputs are dropped.
+OpInfo CanonicalOpInfo(const OpInfo& op_info) {
+  OpInfo canonical;
+  canonical.set_op(op_info.op());
+  for (const auto& attr : op_info.attr()) {
+    if (!absl::StartsWith(attr.first, "_")) {
+      (*canonical.mutable_attr())[attr.first] = attr.second;
+    }
+  }
+  canonical.mutable_device()->set_type(op_info.device().type());
+  for (const auto& input : op_info.inputs()) {
+    OpInfo::TensorProperties* canonical_input = canonical.add_inputs();
+    canonical_input->set_dtype(input.dtype());
+    *canonical_input->mutable_shape() = input.shape();
+  }
+  return canonical;
+}
+
+// Returns the key of `op_info`, which must be canonical.
+string OpKey(const OpInfo& op_info) {
+  std::vector<string> attrs;
+  for (const auto& attr : op_info.attr()) {
+    attrs.push_back(
+        strings::StrCat(attr.first, "=", SummarizeAttrValue(attr.second)));
+  }
+  std::sort(attrs.begin(), attrs.end());
+  string key = strings::StrCat(op_info.op(), "@", op_info.device().type());
+  for (const string& attr : attrs) {
+    strings::StrAppend(&key, ";", attr);
+  }
+  for (const auto& input : op_info.inputs()) {
+    strings::StrAppend(&key, ";", DataTypeString(input.dtype()),
+                       PartialTensorShape::DebugString(input.shape()));
+  }
+  return key;
+}
+
+}  // namespace
+
+constexpr int OpCostDatabase::kMaxSamplesPerOp;
+
+void OpCostDatabase::AddCostGraph(const GraphDef& graph,
+                                  const CostGraphDef& cost_graph) {
+  const OpPerformanceList op_performance_list =
+      CostGraphToOpPerformanceData(cost_graph, graph);
+  for (const OpPerformance& op_performance :
+       op_performance_list.op_performance()) {
+    AddOpPerformance(op_performance);
+  }
+}
+
+void OpCostDatabase::AddRunMetadata(const GraphDef& graph,
+                                    const RunMetadata& run_metadata) {
+  if (!run_metadata.has_cost_graph()) {
+    return;
+  }
+  if (run_metadata.partition_graphs_size() == 0) {
+    AddCostGraph(graph, run_metadata.cost_graph());
+    return;
+  }
+  // The partition graphs also have the Send and Recv nodes that were run.
+  GraphDef partition_graphs;
+  for (const GraphDef& partition_graph : run_metadata.partition_graphs()) {
+    partition_graphs.mutable_node()->MergeFrom(partition_graph.node());
+  }
+  AddCostGraph(partition_graphs, run_metadata.cost_graph());
+}
+
+void OpCostDatabase::AddOpPerformance(const OpPerformance& op_performance) {
+  // Nodes that weren't measured have a zero cost.
+  if (op_performance.compute_cost() <= 0) {
+    return;
+  }
+  OpInfo op = CanonicalOpInfo(op_performance.op());
+  const string key = OpKey(op);
+
+  mutex_lock l(mu_);
+  Entry& entry = entries_[key];
+  if (entry.compute_costs.empty()) {
+    entry.op = std::move(op);
+  }
+  entry.compute_costs.push_back(op_performance.compute_cost());
+  if (entry.compute_costs.size() > kMaxSamplesPerOp) {
+    entry.compute_costs.pop_front();
+  }
+  // The first steps and the steps that were preempted are much slower than
+  // the others, so a plain mean would overestimate the cost.
+  std::vector<double> samples(entry.compute_costs.begin(),
+                              entry.compute_costs.end());
+  entry.predicted_cost = RobustStats(std::move(samples)).mean();
+}
+
+bool OpCostDatabase::Lookup(const OpInfo& op_info,
+                            Costs::NanoSeconds* execution_time) const {
+  const string key = OpKey(CanonicalOpInfo(op_info));
+  tf_shared_lock l(mu_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return false;
+  }
+  *execution_time = Costs::NanoSeconds(it->second.predicted_cost);
+  return true;
+}
+
+int OpCostDatabase::num_ops() const {
+  tf_shared_lock l(mu_);
+  return entries_.size();
+}
+
+uint64 OpCostDatabase::Fingerprint() const {
+  tf_shared_lock l(mu_);
+  std::vector<string> predictions;
+  predictions.reserve(entries_.size());
+  for (const auto& entry : entries_) {
+    predictions.push_back(strings::StrCat(
+        entry.first, "=", static_cast<int64>(entry.second.predicted_cost)));
+  }
+  std::sort(predictions.begin(), predictions.end());
+  uint64 fingerprint = 0;
+  for (const string& prediction : predictions) {
+    fingerprint = FingerprintCat64(fingerprint, Fingerprint64(prediction));
+  }
+  return fingerprint;
+}
+
+Status OpCostDatabase::Save(const string& path) const {
+  OpPerformanceList op_performance_list;
+  {
+    tf_shared_lock l(mu_);
+    std::vector<const string*> keys;
+    keys.reserve(entries_.size());
+    for (const auto& entry : entries_) {
+      keys.push_back(&entry.first);
+    }
+    std::sort(keys.begin(), keys.end(),
+              [](const string* a, const string* b) { return *a < *b; });
+    for (const string* key : keys) {
+      const Entry& entry = entries_.at(*key);
+      for (int64 compute_cost : entry.compute_costs) {
+        OpPerformance* op_performance =
+            op_performance_list.add_op_performance();
+        *op_performance->mutable_op() = entry.op;
+        op_performance->set_compute_cost(compute_cost);
+      }
+    }
+  }
+  return WriteBinaryProto(Env::Default(), path, op_performance_list);
+}
+
+Status OpCostDatabase::Load(const string& path) {
+  OpPerformanceList op_performance_list;
+  TF_RETURN_IF_ERROR(
+      ReadBinaryProto(Env::Default(), path, &op_performance_list));
+  for (const OpPerformance& op_performance :
+       op_performance_list.op_performance()) {
+    AddOpPerformance(op_performance);
+  }
+  return Status::OK();
+}
+
+Status UpdateOpCostDatabase(const string& path, const GraphDef& graph,
+                            const std::vector<RunMetadata>& run_metadata) {
+  OpCostDatabase database;
+  if (Env::Default()->FileExists(path).ok()) {
+    TF_RETURN_IF_ERROR(database.Load(path));
+  }
+  for (const RunMetadata& metadata : run_metadata) {
+    database.AddRunMetadata(graph, metadata);
+  }
+  return database.Save(path);
+}
+
+}  // end namespace grappler
+}  // end namespace tensorflow
@@ -0,0 +1,112 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_GRAPPLER_COSTS_OP_COST_DATABASE_H_
+#define TENSORFLOW_CORE_GRAPPLER_COSTS_OP_COST_DATABASE_H_
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/core/framework/cost_graph.pb.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/grappler/costs/cost_estimator.h"
+#include "tensorflow/core/grappler/costs/op_performance_data.pb.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+
+namespace tensorflow {
+namespace grappler {
+
+// A database of op execution times measured in earlier runs, that cost
+// estimators use instead of their analytical estimates.
+//
+// The measurements come from the cost graphs built by the CostModelManager of
+// the runtime (RunMetadata::cost_graph, see GraphOptions::build_cost_model),
+// so they reflect the actual kernels and hardware. Ops are keyed by their
+// type, attributes, device type and input types and shapes, and the
+// execution time predicted for an op is the robust mean of the last samples
+// recorded for its key.
+//
+// Databases can be saved and loaded again, so that measurements collected in
+// production runs drive later optimizations: UpdateOpCostDatabase() and the
+// update_op_cost_database tool add the RunMetadata of such runs to a database
+// file. An OpLevelCostEstimator given a database uses it for the ops it
+// covers. The meta-optimizer loads RewriterConfig::op_cost_database and
+// passes it to the cost based passes of the memory optimizer.
+class OpCostDatabase {
+ public:
+  // Number of samples kept for each key. Older samples are dropped so that
+  // the predictions follow changes of the kernels or of the hardware.
+  static constexpr int kMaxSamplesPerOp = 64;
+
+  OpCostDatabase() {}
+
+  // Records the execution time measured for each node of `graph` that is in
+  // `cost_graph`.
+  void AddCostGraph(const GraphDef& graph, const CostGraphDef& cost_graph);
+
+  // Records the cost graph of `run_metadata`, which is empty unless the step
+  // was run with a cost model. The nodes are looked up in the partition graphs
+  // of `run_metadata` if it has any (see RunOptions::output_partition_graphs),
+  // and in `graph` otherwise.
+  void AddRunMetadata(const GraphDef& graph, const RunMetadata& run_metadata);
+
+  // Records the compute cost of a single execution of `op_performance.op()`.
+  void AddOpPerformance(const OpPerformance& op_performance);
+
+  // Sets `execution_time` to the time predicted for the op described by
+  // `op_info`. Returns false if there are no measurements for it.
+  bool Lookup(const OpInfo& op_info, Costs::NanoSeconds* execution_time) const;
+
+  // Number of distinct ops with measurements.
+  int num_ops() const;
+
+  // Returns a fingerprint of the predictions of the database.
+  uint64 Fingerprint() const;
+
+  // Writes the samples of the database to `path`, as an OpPerformanceList.
+  Status Save(const string& path) const;
+
+  // Adds the samples stored in `path` to the database.
+  Status Load(const string& path);
+
+ private:
+  struct Entry {
+    // The description of the op, without the fields that aren't in the key.
+    OpInfo op;
+    std::deque<int64> compute_costs;
+    double predicted_cost = 0;
+  };
+
+  mutable mutex mu_;
+  std::unordered_map<string, Entry> entries_ TF_GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(OpCostDatabase);
+};
+
+// Adds the measurements of `run_metadata`, see OpCostDatabase::AddRunMetadata,
+// to the database stored at `path`. Creates the database if `path` doesn't
+// exist.
+Status UpdateOpCostDatabase(const string& path, const GraphDef& graph,
+                            const std::vector<RunMetadata>& run_metadata);
+
+}  // end namespace grappler
+}  // end namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_GRAPPLER_COSTS_OP_COST_DATABASE_H_
@@ -0,0 +1,200 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/costs/op_cost_database.h"
+
+#include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/grappler/costs/op_level_cost_estimator.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+constexpr char kCpu[] = "/job:localhost/replica:0/task:0/device:CPU:0";
+
+class OpCostDatabaseTest : public ::testing::Test {
+ protected:
+  // Builds a graph where "op" runs `op_type` on the 32x16 float tensor
+  // produced by "input", and a cost graph where "op" took
+  // `compute_cost_micros`.
+  static void BuildGraphs(const string& op_type, int64 compute_cost_micros,
+                          GraphDef* graph, CostGraphDef* cost_graph) {
+    NodeDef* input = graph->add_node();
+    input->set_name("input");
+    input->set_op("Placeholder");
+    NodeDef* op = graph->add_node();
+    op->set_name("op");
+    op->set_op(op_type);
+    op->add_input("input");
+    SetAttrValue(DT_FLOAT, &(*op->mutable_attr())["T"]);
+    // Internal attributes don't change the cost of the op.
+    SetAttrValue("loc:@input", &(*op->mutable_attr())["_class"]);
+
+    CostGraphDef::Node* input_cost = cost_graph->add_node();
+    input_cost->set_name("input");
+    input_cost->set_device(kCpu);
+    input_cost->set_id(0);
+    CostGraphDef::Node::OutputInfo* output = input_cost->add_output_info();
+    output->set_dtype(DT_FLOAT);
+    output->mutable_shape()->add_dim()->set_size(32);
+    output->mutable_shape()->add_dim()->set_size(16);
+    CostGraphDef::Node* op_cost = cost_graph->add_node();
+    op_cost->set_name("op");
+    op_cost->set_device(kCpu);
+    op_cost->set_id(1);
+    op_cost->set_compute_cost(compute_cost_micros);
+  }
+
+  // Returns the description of `op_type` applied to a 32x16 float tensor on
+  // a CPU, as the cost estimators see it.
+  static OpInfo DescribeOp(const string& op_type) {
+    OpInfo op_info;
+    op_info.set_op(op_type);
+    SetAttrValue(DT_FLOAT, &(*op_info.mutable_attr())["T"]);
+    op_info.mutable_device()->set_type("CPU");
+    op_info.mutable_device()->set_frequency(1000);
+    op_info.mutable_device()->set_num_cores(4);
+    OpInfo::TensorProperties* input = op_info.add_inputs();
+    input->set_dtype(DT_FLOAT);
+    input->mutable_shape()->add_dim()->set_size(32);
+    input->mutable_shape()->add_dim()->set_size(16);
+    return op_info;
+  }
+};
+
+TEST_F(OpCostDatabaseTest, LookupMeasuredCost) {
+  GraphDef graph;
+  CostGraphDef cost_graph;
+  BuildGraphs("MyCustomOp", 250, &graph, &cost_graph);
+
+  OpCostDatabase database;
+  database.AddCostGraph(graph, cost_graph);
+  // The input wasn't measured.
+  EXPECT_EQ(1, database.num_ops());
+
+  Costs::NanoSeconds execution_time;
+  ASSERT_TRUE(database.Lookup(DescribeOp("MyCustomOp"), &execution_time));
+  EXPECT_EQ(250000, execution_time.count());
+
+  // Other ops and other shapes don't match.
+  EXPECT_FALSE(database.Lookup(DescribeOp("Relu"), &execution_time));
+  OpInfo other_shape = DescribeOp("MyCustomOp");
+  other_shape.mutable_inputs(0)->mutable_shape()->mutable_dim(0)->set_size(64);
+  EXPECT_FALSE(database.Lookup(other_shape, &execution_time));
+  OpInfo other_device = DescribeOp("MyCustomOp");
+  other_device.mutable_device()->set_type("GPU");
+  EXPECT_FALSE(database.Lookup(other_device, &execution_time));
+}
+
+TEST_F(OpCostDatabaseTest, IgnoresOutliers) {
+  OpCostDatabase database;
+  for (int64 compute_cost : {100, 102, 98, 101, 99, 100, 5000}) {
+    GraphDef graph;
+    CostGraphDef cost_graph;
+    BuildGraphs("MyCustomOp", compute_cost, &graph, &cost_graph);
+    database.AddCostGraph(graph, cost_graph);
+  }
+  Costs::NanoSeconds execution_time;
+  ASSERT_TRUE(database.Lookup(DescribeOp("MyCustomOp"), &execution_time));
+  EXPECT_NEAR(100000, execution_time.count(), 2000);
+}
+
+TEST_F(OpCostDatabaseTest, SaveAndLoad) {
+  GraphDef graph;
+  CostGraphDef cost_graph;
+  BuildGraphs("MyCustomOp", 250, &graph, &cost_graph);
+  OpCostDatabase database;
+  database.AddCostGraph(graph, cost_graph);
+
+  const string path =
+      io::JoinPath(testing::TmpDir(), "op_cost_database_test.pb");
+  TF_ASSERT_OK(database.Save(path));
+
+  OpCostDatabase loaded;
+  TF_ASSERT_OK(loaded.Load(path));
+  EXPECT_EQ(1, loaded.num_ops());
+  EXPECT_EQ(database.Fingerprint(), loaded.Fingerprint());
+  Costs::NanoSeconds execution_time;
+  ASSERT_TRUE(loaded.Lookup(DescribeOp("MyCustomOp"), &execution_time));
+  EXPECT_EQ(250000, execution_time.count());
+
+  EXPECT_FALSE(loaded.Load(io::JoinPath(testing::TmpDir(), "missing")).ok());
+}
+
+TEST_F(OpCostDatabaseTest, UpdateDatabaseFile) {
+  const string path =
+      io::JoinPath(testing::TmpDir(), "op_cost_database_update_test.pb");
+  Env::Default()->DeleteFile(path).IgnoreError();
+
+  // The nodes of the first run are found in its partition graphs.
+  RunMetadata with_partitions;
+  GraphDef graph;
+  BuildGraphs("MyCustomOp", 250, with_partitions.add_partition_graphs(),
+              with_partitions.mutable_cost_graph());
+  TF_ASSERT_OK(UpdateOpCostDatabase(path, graph, {with_partitions}));
+
+  // The second run is added to the database written by the first one.
+  RunMetadata without_partitions;
+  BuildGraphs("OtherOp", 100, &graph, without_partitions.mutable_cost_graph());
+  TF_ASSERT_OK(UpdateOpCostDatabase(path, graph, {without_partitions}));
+
+  OpCostDatabase database;
+  TF_ASSERT_OK(database.Load(path));
+  EXPECT_EQ(2, database.num_ops());
+  Costs::NanoSeconds execution_time;
+  ASSERT_TRUE(database.Lookup(DescribeOp("MyCustomOp"), &execution_time));
+  EXPECT_EQ(250000, execution_time.count());
+  ASSERT_TRUE(database.Lookup(DescribeOp("OtherOp"), &execution_time));
+  EXPECT_EQ(100000, execution_time.count());
+}
+
+TEST_F(OpCostDatabaseTest, UsedByOpLevelCostEstimator) {
+  OpContext op_context;
+  op_context.op_info = DescribeOp("MyCustomOp");
+  OpLevelCostEstimator estimator;
+  const Costs analytical_costs = estimator.PredictCosts(op_context);
+  EXPECT_TRUE(analytical_costs.inaccurate);
+
+  GraphDef graph;
+  CostGraphDef cost_graph;
+  BuildGraphs("MyCustomOp", 250, &graph, &cost_graph);
+  auto database = std::make_shared<OpCostDatabase>();
+  database->AddCostGraph(graph, cost_graph);
+  estimator.set_op_cost_database(database);
+
+  const Costs measured_costs = estimator.PredictCosts(op_context);
+  EXPECT_FALSE(measured_costs.inaccurate);
+  EXPECT_EQ(250000, measured_costs.execution_time.count());
+
+  // Other estimators are not affected.
+  EXPECT_TRUE(OpLevelCostEstimator().PredictCosts(op_context).inaccurate);
+
+  // Ops without measurements keep their analytical estimates.
+  op_context.op_info = DescribeOp("Relu");
+  estimator.set_op_cost_database(nullptr);
+  const Costs relu_costs = estimator.PredictCosts(op_context);
+  estimator.set_op_cost_database(database);
+  EXPECT_EQ(relu_costs.execution_time,
+            estimator.PredictCosts(op_context).execution_time);
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
@@ -558,6 +558,25 @@ OpLevelCostEstimator::OpLevelCostEstimator() {
 }
 
 Costs OpLevelCostEstimator::PredictCosts(const OpContext& op_context) const {
+  Costs costs = PredictAnalyticalCosts(op_context);
+  // Prefer the execution time measured in earlier runs, if there is one. The
+  // measurement includes the memory accesses.
+  Costs::NanoSeconds measured_time;
+  if (op_cost_database_ != nullptr &&
+      op_cost_database_->Lookup(op_context.op_info, &measured_time)) {
+    VLOG(1) << "Operation " << op_context.op_info.op() << " took "
+            << measured_time.count() << " ns in earlier runs.";
+    costs.execution_time = measured_time;
+    costs.compute_time = measured_time;
+    costs.memory_time = Costs::Duration::zero();
+    costs.intermediate_memory_time = Costs::Duration::zero();
+    costs.inaccurate = false;
+  }
+  return costs;
+}
+
+Costs OpLevelCostEstimator::PredictAnalyticalCosts(
+    const OpContext& op_context) const {
   const auto& op_info = op_context.op_info;
   auto it = device_cost_impl_.find(op_info.op());
   if (it != device_cost_impl_.end()) {
@@ -16,8 +16,11 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_GRAPPLER_COSTS_OP_LEVEL_COST_ESTIMATOR_H_
 #define TENSORFLOW_CORE_GRAPPLER_COSTS_OP_LEVEL_COST_ESTIMATOR_H_
 
+#include <memory>
+
 #include "tensorflow/core/grappler/costs/cost_estimator.h"
 #include "tensorflow/core/grappler/costs/op_context.h"
+#include "tensorflow/core/grappler/costs/op_cost_database.h"
 #include "tensorflow/core/grappler/costs/op_performance_data.pb.h"
 #include "tensorflow/core/util/padding.h"
 
@@ -34,12 +37,23 @@ class OpLevelCostEstimator {
   OpLevelCostEstimator();
   virtual ~OpLevelCostEstimator() {}
 
+  // Uses the measured execution time of the op if the op cost database has
+  // one, and the analytical estimate otherwise.
   virtual Costs PredictCosts(const OpContext& op_context) const;
 
+  // Sets the database of measured op costs that PredictCosts() consults. A
+  // null database leaves only the analytical estimates.
+  void set_op_cost_database(std::shared_ptr<const OpCostDatabase> database) {
+    op_cost_database_ = std::move(database);
+  }
+
   // Returns basic device performance info.
   virtual DeviceInfo GetDeviceInfo(const DeviceProperties& device) const;
 
  protected:
+  // Estimates the cost of an op from its operation count and memory accesses.
+  Costs PredictAnalyticalCosts(const OpContext& op_context) const;
+
   // Predict cost of an op for which no accurate estimator is defined.
   Costs PredictCostOfAnUnknownOp(const OpContext& op_context) const;
 
@@ -206,6 +220,7 @@ class OpLevelCostEstimator {
   // compute_time and memory_time, instead of sum of those two.
   bool compute_memory_overlap_;
   std::set<string> persistent_ops_;
+  std::shared_ptr<const OpCostDatabase> op_cost_database_;
 
  private:
   friend class OpLevelCostEstimatorTest;
@@ -0,0 +1,114 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Adds the op execution times measured in earlier runs to an op cost database
+// file, that RewriterConfig::op_cost_database can then point to. The runs
+// must have been made with a cost model, e.g. with
+// GraphOptions::build_cost_model set, and their RunMetadata written to files.
+// To use it, run something like this:
+//
+// bazel build tensorflow/core/grappler/costs:update_op_cost_database
+// bazel-bin/tensorflow/core/grappler/costs/update_op_cost_database \
+// --database=op_costs.pb --graph=my_graph.pb \
+// --run_metadata=step_100.pb,step_200.pb
+//
+// The graph is only needed for the RunMetadata without partition graphs.
+
+#include <vector>
+
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/grappler/costs/op_cost_database.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/util/command_line_flags.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+int ParseFlagsAndUpdateOpCostDatabase(int argc, char* argv[]) {
+  string database;
+  string graph_path;
+  string run_metadata_paths;
+  std::vector<Flag> flag_list = {
+      Flag("database", &database,
+           "op cost database file, created if it doesn't exist"),
+      Flag("graph", &graph_path, "graph file that the runs executed"),
+      Flag("run_metadata", &run_metadata_paths,
+           "comma separated RunMetadata files of the runs"),
+  };
+  string usage = Flags::Usage(argv[0], flag_list);
+
+  const bool parse_result = Flags::Parse(&argc, argv, flag_list);
+  // We need to call this to set up global state for TensorFlow.
+  port::InitMain(argv[0], &argc, &argv);
+
+  if (!parse_result) {
+    LOG(ERROR) << usage;
+    return -1;
+  }
+  if (argc > 1) {
+    LOG(ERROR) << "Unknown argument " << argv[1] << ".\n" << usage;
+    return -1;
+  }
+  if (database.empty() || run_metadata_paths.empty()) {
+    LOG(ERROR) << "database and run_metadata can't be empty.\n" << usage;
+    return -1;
+  }
+
+  GraphDef graph;
+  if (!graph_path.empty()) {
+    Status s = ReadTextOrBinaryProto(Env::Default(), graph_path, &graph);
+    if (!s.ok()) {
+      LOG(ERROR) << "Loading graph '" << graph_path << "' failed with "
+                 << s.error_message();
+      return -1;
+    }
+  }
+  std::vector<RunMetadata> run_metadata;
+  for (const string& path :
+       str_util::Split(run_metadata_paths, ',', str_util::SkipEmpty())) {
+    run_metadata.emplace_back();
+    Status s =
+        ReadTextOrBinaryProto(Env::Default(), path, &run_metadata.back());
+    if (!s.ok()) {
+      LOG(ERROR) << "Loading run metadata '" << path << "' failed with "
+                 << s.error_message();
+      return -1;
+    }
+    if (!run_metadata.back().has_cost_graph()) {
+      LOG(WARNING) << "Run metadata '" << path << "' has no cost graph";
+    }
+  }
+
+  Status s = UpdateOpCostDatabase(database, graph, run_metadata);
+  if (!s.ok()) {
+    LOG(ERROR) << "Updating op cost database '" << database << "' failed with "
+               << s.error_message();
+    return -1;
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
+
+int main(int argc, char* argv[]) {
+  return tensorflow::grappler::ParseFlagsAndUpdateOpCostDatabase(argc, argv);
+}
@@ -18,7 +18,10 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/constant_folding.h"
 
 #include <cmath>
+#include <list>
 
+#include "absl/strings/match.h"
+#include "absl/strings/str_join.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/substitute.h"
 #include "tensorflow/core/framework/allocator.h"
@@ -44,15 +47,20 @@ limitations under the License.
 #include "tensorflow/core/lib/core/stringpiece.h"
 #include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
+#include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/denormal.h"
 #include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/setround.h"
 #include "tensorflow/core/platform/tensor_coding.h"
 #include "tensorflow/core/public/version.h"
 #include "tensorflow/core/util/bcast.h"
+#include "tensorflow/core/util/device_name_utils.h"
 #include "tensorflow/core/util/saved_tensor_slice_util.h"
 
 namespace tensorflow {
@@ -63,6 +71,116 @@ using TensorVector = gtl::InlinedVector<TensorValue, 4>;
 const int64 kMaxConstantSize = 10 * 1024 * 1024;
 
 namespace {
+
+// Values folded by all the ConstantFolding instances of the process, so that
+// the computations repeated across graphs and function bodies are only
+// evaluated once. The least recently used values are evicted first.
+class FoldedValueCache {
+ public:
+  static FoldedValueCache* Global() {
+    static FoldedValueCache* cache = new FoldedValueCache;
+    return cache;
+  }
+
+  bool Lookup(const string& key, std::vector<Tensor>* values) {
+    mutex_lock l(mu_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+    *values = it->second.values;
+    return true;
+  }
+
+  void Insert(const string& key, const TensorVector& values) {
+    Entry entry;
+    for (const TensorValue& value : values) {
+      // Dead outputs can't be cached.
+      if (value.tensor == nullptr) {
+        return;
+      }
+      entry.values.push_back(*value.tensor);
+      entry.bytes += value.tensor->TotalBytes();
+    }
+    if (entry.bytes > kMaxEntryBytes) {
+      return;
+    }
+    mutex_lock l(mu_);
+    if (entries_.count(key) > 0) {
+      return;
+    }
+    lru_.push_front(key);
+    entry.lru_position = lru_.begin();
+    total_bytes_ += entry.bytes;
+    entries_.emplace(key, std::move(entry));
+    while (total_bytes_ > kMaxTotalBytes) {
+      auto evicted = entries_.find(lru_.back());
+      total_bytes_ -= evicted->second.bytes;
+      entries_.erase(evicted);
+      lru_.pop_back();
+    }
+  }
+
+ private:
+  static constexpr int64 kMaxTotalBytes = 64 * 1024 * 1024;
+  static constexpr int64 kMaxEntryBytes = 2 * kMaxConstantSize;
+
+  struct Entry {
+    std::vector<Tensor> values;
+    int64 bytes = 0;
+    std::list<string>::iterator lru_position;
+  };
+
+  mutex mu_;
+  std::list<string> lru_ TF_GUARDED_BY(mu_);
+  std::unordered_map<string, Entry> entries_ TF_GUARDED_BY(mu_);
+  int64 total_bytes_ TF_GUARDED_BY(mu_) = 0;
+};
+
+// Returns the key of the values of `node` evaluated on `inputs` in the
+// FoldedValueCache, i.e. its op and attributes and the fingerprints of its
+// inputs, or an empty string if they can't be fingerprinted.
+string FoldedValueCacheKey(const NodeDef& node, const TensorVector& inputs) {
+  std::vector<string> attrs;
+  for (const auto& attr : node.attr()) {
+    // Internal attributes don't change the values.
+    if (absl::StartsWith(attr.first, "_")) continue;
+    string attr_value;
+    if (!SerializeToStringDeterministic(attr.second, &attr_value)) {
+      return "";
+    }
+    attrs.push_back(strings::StrCat(attr.first, "=", attr_value));
+  }
+  std::sort(attrs.begin(), attrs.end());
+  string key = strings::StrCat(node.op(), "(", absl::StrJoin(attrs, ","), ")");
+  for (const TensorValue& input : inputs) {
+    if (!DataTypeCanUseMemcpy(input->dtype())) {
+      return "";
+    }
+    const Fprint128 fingerprint = Fingerprint128(input->tensor_data());
+    strings::StrAppend(&key, ";", DataTypeString(input->dtype()),
+                       input->shape().DebugString(),
+                       strings::Hex(fingerprint.high64, strings::kZeroPad16),
+                       strings::Hex(fingerprint.low64, strings::kZeroPad16));
+  }
+  return key;
+}
+
+// Returns the CPU device of the host of `device`, which is where the
+// ImmutableConst ops run.
+string HostDevice(const string& device) {
+  DeviceNameUtils::ParsedName parsed;
+  if (device.empty() || !DeviceNameUtils::ParseFullName(device, &parsed)) {
+    return device;
+  }
+  parsed.type = DEVICE_CPU;
+  parsed.has_type = true;
+  parsed.id = 0;
+  parsed.has_id = true;
+  return DeviceNameUtils::ParsedNameToString(parsed);
+}
+
 template <typename T>
 bool AllValuesAre(const TensorProto& proto, const T& value) {
   Tensor tensor;
@@ -187,8 +305,11 @@ float QuantizedTypeMaxAsFloat(DataType data_type) {
 }  // namespace
 
 ConstantFolding::ConstantFolding(RewriterConfig::Toggle opt_level,
-                                 DeviceBase* cpu_device)
-    : opt_level_(opt_level), cpu_device_(cpu_device) {
+                                 DeviceBase* cpu_device,
+                                 const string& large_constants_dir)
+    : opt_level_(opt_level),
+      cpu_device_(cpu_device),
+      large_constants_dir_(large_constants_dir) {
   resource_mgr_.reset(new ResourceMgr());
 }
 
@@ -996,8 +1117,11 @@ bool ConstantFolding::IsFoldableUncached(
       if (output_shape.IsFullyDefined()) {
         const int64 num_bytes =
             output_shape.num_elements() * DataTypeSize(output_prop.dtype());
-        if (num_bytes > input_size_bytes && num_bytes > kMaxConstantSize) {
-          // Do not fold nodes if the in-memory size of output is too large.
+        if (num_bytes > input_size_bytes && num_bytes > kMaxConstantSize &&
+            (large_constants_dir_.empty() ||
+             !DataTypeCanUseMemcpy(output_prop.dtype()))) {
+          // Do not fold nodes if the in-memory size of output is too large,
+          // unless it can be stored in a separate file.
           // Notice that this is not exactly the same check used in
           // CreateNodeDef() where the actual encoded size is checked.
           return false;
@@ -1294,8 +1418,55 @@ Status ConstantFolding::EvaluateNode(const NodeDef& node,
                                               resource_mgr_.get(), output);
 }
 
+Status ConstantFolding::CreateMemmappedNodeDef(const string& name,
+                                              const Tensor& tensor,
+                                              NodeDef* node) const {
+  if (!DataTypeCanUseMemcpy(tensor.dtype())) {
+    return errors::InvalidArgument("Can't store ", name, " of type ",
+                                   DataTypeString(tensor.dtype()),
+                                   " in a file");
+  }
+  // The files are named after their contents, so identical values folded in
+  // different graphs or functions share a file.
+  const StringPiece data = tensor.tensor_data();
+  const Fprint128 fingerprint = Fingerprint128(data);
+  const string path = io::JoinPath(
+      large_constants_dir_,
+      strings::StrCat("folded_", DataTypeString(tensor.dtype()), "_",
+                      strings::Hex(fingerprint.high64, strings::kZeroPad16),
+                      strings::Hex(fingerprint.low64, strings::kZeroPad16),
+                      ".bin"));
+  Env* env = Env::Default();
+  if (!env->FileExists(path).ok()) {
+    TF_RETURN_IF_ERROR(env->RecursivelyCreateDir(large_constants_dir_));
+    // Write to a temporary file first, so that other processes never map a
+    // partial file.
+    string temp_path = path;
+    if (!env->CreateUniqueFileName(&temp_path, ".tmp")) {
+      return errors::Internal("Failed to create a temporary file name for ",
+                              path);
+    }
+    Status s = WriteStringToFile(env, temp_path, data);
+    if (s.ok()) s = env->RenameFile(temp_path, path);
+    if (!s.ok()) {
+      env->DeleteFile(temp_path).IgnoreError();
+      return s;
+    }
+  }
+
+  *node = NodeDef();
+  node->set_name(name);
+  node->set_op("ImmutableConst");
+  auto* attr = node->mutable_attr();
+  SetAttrValue(tensor.dtype(), &(*attr)["dtype"]);
+  SetAttrValue(tensor.shape(), &(*attr)["shape"]);
+  SetAttrValue(path, &(*attr)["memory_region_name"]);
+  return Status::OK();
+}
+
 Status ConstantFolding::EvaluateOneFoldable(const NodeDef& node,
                                             std::vector<NodeDef>* outputs,
+                                            std::vector<Tensor>* values,
                                             bool* result_too_large) {
   TensorVector inputs;
   TensorVector output_tensors;
@@ -1323,20 +1494,42 @@ Status ConstantFolding::EvaluateOneFoldable(const NodeDef& node,
                     strings::StrCat("Can't fold ", node.name(), ", its ", input,
                                     " isn't constant"));
     }
-    TF_RETURN_IF_ERROR(CheckAttrExists(*input_node, "value"));
-    const TensorProto& raw_val = input_node->attr().at("value").tensor();
-    Tensor* value = new Tensor(raw_val.dtype(), raw_val.tensor_shape());
-    CHECK(value->FromProto(raw_val));
+    Tensor* value;
+    auto folded_value = folded_values_.find(input_node->name());
+    if (folded_value != folded_values_.end()) {
+      value = new Tensor(folded_value->second);
+    } else {
+      TF_RETURN_IF_ERROR(CheckAttrExists(*input_node, "value"));
+      const TensorProto& raw_val = input_node->attr().at("value").tensor();
+      value = new Tensor(raw_val.dtype(), raw_val.tensor_shape());
+      CHECK(value->FromProto(raw_val));
+    }
     inputs.emplace_back(value);
     total_inputs_size += value->TotalBytes();
   }
 
-  TF_RETURN_IF_ERROR(EvaluateNode(node, inputs, &output_tensors));
+  // Reuse the values of an identical computation folded earlier, possibly in
+  // another graph or function.
+  const string cache_key = FoldedValueCacheKey(node, inputs);
+  std::vector<Tensor> cached_values;
+  if (!cache_key.empty() &&
+      FoldedValueCache::Global()->Lookup(cache_key, &cached_values)) {
+    VLOG(2) << "Reusing the folded value of " << node.name();
+    for (const Tensor& cached_value : cached_values) {
+      output_tensors.emplace_back(new Tensor(cached_value));
+    }
+  } else {
+    TF_RETURN_IF_ERROR(EvaluateNode(node, inputs, &output_tensors));
+    if (!cache_key.empty()) {
+      FoldedValueCache::Global()->Insert(cache_key, output_tensors);
+    }
+  }
   if (output_tensors.empty()) {
     return Status(error::INVALID_ARGUMENT, "Expected at least one output.");
   }
 
   outputs->resize(output_tensors.size());
+  values->resize(output_tensors.size());
   for (size_t i = 0; i < output_tensors.size(); i++) {
     string node_name = OptimizedNodeName(node, "-folded");
     if (output_tensors.size() > 1) {
@@ -1345,10 +1538,15 @@ Status ConstantFolding::EvaluateOneFoldable(const NodeDef& node,
     if (output_tensors[i].tensor) {
       Status s = CreateNodeDef(node_name, output_tensors[i], &outputs->at(i),
                                total_inputs_size);
+      if (!s.ok() && !large_constants_dir_.empty()) {
+        s = CreateMemmappedNodeDef(node_name, *output_tensors[i].tensor,
+                                   &outputs->at(i));
+      }
       if (!s.ok()) {
         *result_too_large = true;
         return s;
       }
+      values->at(i) = *output_tensors[i].tensor;
     } else {
       // Create an empty NodeDef to identify dead outputs (e.g. the output of a
       // switch that's not selected by the switch predicate).
@@ -1458,8 +1656,9 @@ Status ConstantFolding::FoldNode(NodeDef* node, GraphDef* output_graph,
   }
 
   std::vector<NodeDef> const_nodes;
+  std::vector<Tensor> values;
   TF_RETURN_IF_ERROR(
-      EvaluateOneFoldable(*node, &const_nodes, result_too_large));
+      EvaluateOneFoldable(*node, &const_nodes, &values, result_too_large));
   VLOG(2) << "Folded node: " << SummarizeNodeDef(*node);
 
   NodeDef* constant_output = nullptr;
@@ -1500,10 +1699,19 @@ Status ConstantFolding::FoldNode(NodeDef* node, GraphDef* output_graph,
       }
     }
 
+    // Only constants are folded further, the large values stored in files
+    // are left alone.
+    const bool is_memmapped = const_node->op() == "ImmutableConst";
+
     // We rewrite the existing node if it only has a single output, and
     // create new nodes otherwise.
     if (const_nodes.size() == 1) {
-      node->set_op("Const");
+      node->set_op(const_node->op());
+      if (is_memmapped) {
+        node->set_device(HostDevice(node->device()));
+      } else {
+        folded_values_[node->name()] = values[i];
+      }
       // Note we need to clear the inputs in NodeMap before we clear the inputs
       // in the node, otherwise NodeMap would see empty inputs and effectively
       // does nothing.
@@ -1523,7 +1731,12 @@ Status ConstantFolding::FoldNode(NodeDef* node, GraphDef* output_graph,
       }
       NodeDef* added_node = output_graph->add_node();
       *added_node = *const_node;
-      added_node->set_device(node->device());
+      if (is_memmapped) {
+        added_node->set_device(HostDevice(node->device()));
+      } else {
+        added_node->set_device(node->device());
+        folded_values_[added_node->name()] = values[i];
+      }
       node_map_->AddNode(added_node->name(), added_node);
       for (const auto& input : added_node->input()) {
         node_map_->AddOutput(NodeName(input), added_node->name());
@@ -1579,6 +1792,9 @@ Status ConstantFolding::FoldNode(NodeDef* node, GraphDef* output_graph,
 Status ConstantFolding::FoldGraph(
     const GraphProperties& properties, GraphDef* output,
     absl::flat_hash_set<string>* nodes_to_not_simplify) {
+  folded_values_.clear();
+  auto folded_values_cleanup =
+      gtl::MakeCleanup([this] { folded_values_.clear(); });
   std::unordered_set<string> processed_nodes;
   std::deque<NodeDef*> queue;
   for (int i = 0; i < graph_->node_size(); i++) {
@@ -46,7 +46,11 @@ class ConstantFolding : public GraphOptimizer {
                                      NodeMap* node_map);
 
   explicit ConstantFolding(DeviceBase* cpu_device);
-  ConstantFolding(RewriterConfig::Toggle opt_level, DeviceBase* cpu_device);
+  // If `large_constants_dir` is non-empty, the folded values larger than
+  // kMaxConstantSize are stored in files of this directory and read by
+  // ImmutableConst nodes instead of being left unfolded.
+  ConstantFolding(RewriterConfig::Toggle opt_level, DeviceBase* cpu_device,
+                  const string& large_constants_dir = "");
 
   ~ConstantFolding() override {}
 
@@ -91,8 +95,15 @@ class ConstantFolding : public GraphOptimizer {
                       const gtl::InlinedVector<TensorValue, 4>& inputs,
                       gtl::InlinedVector<TensorValue, 4>* output) const;
 
+  // Evaluates `node` and sets `outputs` to the nodes that produce its output
+  // values, which are also returned in `values`.
   Status EvaluateOneFoldable(const NodeDef& node, std::vector<NodeDef>* outputs,
+                             std::vector<Tensor>* values,
                              bool* result_too_large);
+  // Stores `tensor` in a file of large_constants_dir_ and sets `node` to an
+  // ImmutableConst that maps it.
+  Status CreateMemmappedNodeDef(const string& name, const Tensor& tensor,
+                                NodeDef* node) const;
 
   Status FoldMergeNode(NodeDef* node, GraphDef* output_graph);
   Status FoldNode(NodeDef* node, GraphDef* output_graph,
@@ -331,6 +342,10 @@ class ConstantFolding : public GraphOptimizer {
   absl::flat_hash_set<string> nodes_allowlist_;
   absl::flat_hash_set<string> feed_nodes_;
   absl::flat_hash_map<string, bool> maybe_foldable_nodes_;
+  // The values of the nodes folded by the current FoldGraph() call, so that
+  // their consumers don't need to decode them from the graph again.
+  absl::flat_hash_map<string, Tensor> folded_values_;
+  string large_constants_dir_;
   bool has_fetch_;
   bool graph_modified_;
   bool graph_contains_assign_or_inplace_op_;
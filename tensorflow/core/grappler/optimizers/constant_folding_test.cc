@@ -26,6 +26,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils.h"
 #include "tensorflow/core/grappler/utils/grappler_test.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/tensor_coding.h"
@@ -3336,6 +3337,61 @@ TEST_F(ConstantFoldingTest, LargeConstant) {
   test::ExpectTensorEqual<float>(tensors_expected[0], tensors[0]);
 }
 
+TEST_F(ConstantFoldingTest, LargeConstantStoredInFile) {
+  tensorflow::Scope scope = tensorflow::Scope::NewRootScope();
+  Output mat_diag =
+      ops::Const(scope.WithOpName("mat_diag"), 3.14f, TensorShape({1024 * 4}));
+  Output mat = ops::Diag(scope.WithOpName("mat"), mat_diag);
+  Output out = ops::Identity(scope.WithOpName("out"), mat);
+
+  GrapplerItem item;
+  TF_CHECK_OK(scope.ToGraphDef(&item.graph));
+  item.fetch.push_back("out");
+
+  const string large_constants_dir =
+      io::JoinPath(testing::TmpDir(), "constant_folding_large_constants");
+  ConstantFolding optimizer(RewriterConfig::AGGRESSIVE, /*cpu_device=*/nullptr,
+                            large_constants_dir);
+  GraphDef output;
+  Status status = optimizer.Optimize(/*cluster=*/nullptr, item, &output);
+  TF_EXPECT_OK(status);
+
+  // The diag node is folded into a file that is mapped by an ImmutableConst
+  // node, so the graph itself stays small.
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "mat") {
+      EXPECT_EQ(node.op(), "ImmutableConst");
+      EXPECT_EQ(node.input_size(), 0);
+      EXPECT_EQ(node.attr().at("dtype").type(), DT_FLOAT);
+      const string& path = node.attr().at("memory_region_name").s();
+      EXPECT_TRUE(absl::StartsWith(path, large_constants_dir));
+      uint64 file_size = 0;
+      TF_EXPECT_OK(Env::Default()->GetFileSize(path, &file_size));
+      EXPECT_EQ(file_size, sizeof(float) * 4 * 1024 * 4 * 1024);
+      ++found;
+    }
+  }
+  EXPECT_EQ(found, 1);
+  EXPECT_LT(output.ByteSizeLong(), sizeof(int) * 4 * 1024 + 1000);
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch);
+  ASSERT_EQ(tensors_expected.size(), 1);
+  auto tensors = EvaluateNodes(output, item.fetch);
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectTensorEqual<float>(tensors_expected[0], tensors[0]);
+
+  // Folding the same values again reuses the file.
+  ConstantFolding other_optimizer(RewriterConfig::AGGRESSIVE,
+                                  /*cpu_device=*/nullptr, large_constants_dir);
+  GraphDef other_output;
+  TF_EXPECT_OK(
+      other_optimizer.Optimize(/*cluster=*/nullptr, item, &other_output));
+  std::vector<string> files;
+  TF_EXPECT_OK(Env::Default()->GetChildren(large_constants_dir, &files));
+  EXPECT_EQ(files.size(), 1);
+}
+
 TEST_F(ConstantFoldingTest, SwitchIdenticalInputs) {
   tensorflow::Scope s = tensorflow::Scope::NewRootScope();
   Output x = ops::Placeholder(s.WithOpName("x"), DT_BOOL,
@@ -38,7 +38,13 @@ namespace grappler {
 //
 // If the "ChooseFastest" configuration is enabled, it adds a
 // ChooseFastestBranch dataset node to pick between the original map->batch
-// branch and the vectorized batch->map branch.
+// branch and the vectorized batch->map branch. The node measures the time
+// each branch takes to produce its elements and keeps the faster one.
+//
+// The rewrite only runs when it is enabled in the dataset options, and only
+// for the map functions whose ops all have a vectorizer (see
+// vectorization/vectorizer_registry.h). Map functions with ragged outputs are
+// not vectorized.
 //
 class MapVectorization : public TFDataOptimizerBase {
  public:
@@ -53,8 +59,10 @@ class MapVectorization : public TFDataOptimizerBase {
       const tensorflow::RewriterConfig_CustomGraphOptimizer* config) override {
     if (!config) return Status::OK();
 
-    const string& choose_fastest_param =
-        config->parameter_map().at("use_choose_fastest").s();
+    auto it = config->parameter_map().find("use_choose_fastest");
+    // Without the parameter, the rewrite keeps its default behavior.
+    if (it == config->parameter_map().end()) return Status::OK();
+    const string& choose_fastest_param = it->second.s();
     if (choose_fastest_param == "true") {
       use_choose_fastest_ = true;
     } else if (choose_fastest_param == "false") {
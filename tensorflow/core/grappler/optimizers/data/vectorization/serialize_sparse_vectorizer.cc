@@ -0,0 +1,75 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/grappler/optimizers/data/vectorization/vectorizer_registry.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+
+// SerializeManySparse is the vectorized version of SerializeSparse.
+//
+// Sparse outputs of map functions are serialized by SerializeSparse, and the
+// serialized elements are batched along the first dimension. Serializing the
+// minibatch of sparse tensors with SerializeManySparse produces the same
+// batch. This only holds when the components of the sparse tensor represent
+// the whole minibatch, with the batch index as the first index dimension,
+// rather than a stack of per-element components. ParseExample, the vectorized
+// ParseSingleExample, produces its sparse outputs in that form.
+class SerializeSparseVectorizer : public Vectorizer {
+ public:
+  Status Vectorize(const Node& node, Graph* outer_scope,
+                   VectorizerInput&& inputs,
+                   VectorizerOutput* outputs) override {
+    if (inputs.size() != 3) {
+      return errors::Internal("Failed to vectorize ", node.type_string(),
+                              ". The op should have 3 inputs, but has ",
+                              inputs.size());
+    }
+
+    std::vector<NodeBuilder::NodeOut> components(3);
+    for (int i = 0; i < 3; ++i) {
+      TF_RETURN_IF_ERROR(inputs.stacked(i, &components[i]));
+      if (components[i].node->type_string() != "ParseExample") {
+        return errors::Unimplemented(
+            "Cannot vectorize ", node.type_string(),
+            " unless its inputs are the sparse outputs of ParseExample.");
+      }
+    }
+
+    Node* new_node;
+    auto node_builder = NodeBuilder(strings::StrCat("vectorized/", node.name()),
+                                    "SerializeManySparse")
+                            .Input(components[0])
+                            .Input(components[1])
+                            .Input(components[2]);
+    for (const auto& attr : node.attrs()) {
+      node_builder = node_builder.Attr(attr.first, attr.second);
+    }
+    TF_RETURN_IF_ERROR(node_builder.Finalize(outer_scope, &new_node));
+
+    // Add output mappings
+    outputs->push_back({new_node, 0, true});
+    return Status::OK();
+  }
+};
+
+REGISTER_VECTORIZER("SerializeSparse", SerializeSparseVectorizer);
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
@@ -0,0 +1,89 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/grappler/optimizers/data/vectorization/vectorizer_registry.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+
+// Vectorizer for string and decoding ops that act element-wise on their first
+// input. The other inputs, such as regex patterns, apply to all the elements
+// and must be unstacked. The outputs of these ops have the shape of their
+// first input, possibly with extra trailing dimensions, so the vectorized op
+// is the same as the original.
+class ElementwiseStringOpVectorizer : public Vectorizer {
+ public:
+  Status Vectorize(const Node& node, Graph* outer_scope,
+                   VectorizerInput&& inputs,
+                   VectorizerOutput* outputs) override {
+    NodeBuilder::NodeOut input;
+    TF_RETURN_IF_ERROR(inputs.stacked(0, &input));
+
+    std::vector<NodeBuilder::NodeOut> other_inputs;
+    other_inputs.resize(inputs.size() - 1);
+    for (size_t i = 1; i < inputs.size(); ++i) {
+      TF_RETURN_IF_ERROR(inputs.unstacked(i, &other_inputs[i - 1]));
+    }
+
+    Node* new_node;
+    auto node_builder = NodeBuilder(strings::StrCat("vectorized/", node.name()),
+                                    node.type_string())
+                            .Input(input);
+    for (const auto& other_input : other_inputs) {
+      node_builder = node_builder.Input(other_input);
+    }
+    for (const auto& attr : node.attrs()) {
+      node_builder = node_builder.Attr(attr.first, attr.second);
+    }
+    TF_RETURN_IF_ERROR(node_builder.Finalize(outer_scope, &new_node));
+
+    // Add output mappings
+    for (int i = 0; i < node.num_outputs(); ++i) {
+      outputs->emplace_back(new_node, i, true);
+    }
+    return Status::OK();
+  }
+};
+
+// String ops
+REGISTER_VECTORIZER("AsString", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("DecodeBase64", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("EncodeBase64", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("RegexFullMatch", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("RegexReplace", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StaticRegexFullMatch", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StaticRegexReplace", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StringLength", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StringLower", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StringStrip", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StringToHashBucket", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StringToHashBucketFast", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StringToHashBucketStrong", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StringUpper", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("UnicodeScript", ElementwiseStringOpVectorizer);
+
+// Parsing ops. DecodeRaw is left out: it requires all its input strings to
+// have the same length, which the elements it decoded one at a time didn't.
+REGISTER_VECTORIZER("DecodeCompressed", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("DecodeJSONExample", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("DecodePaddedRaw", ElementwiseStringOpVectorizer);
+REGISTER_VECTORIZER("StringToNumber", ElementwiseStringOpVectorizer);
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
@@ -1332,6 +1332,133 @@ TEST(VectorizerTest, VectorizeParseSingleExampleWithStackedDefaults) {
       function_utils::ContainsFunctionNodeWithOp("MapDefun", *vectorized));
 }
 
+TEST(VectorizerTest, VectorizeSerializeSparse) {
+  // The sparse outputs of ParseExample represent the whole minibatch, so
+  // SerializeSparse can be vectorized into SerializeManySparse.
+  FunctionDef inner = FunctionDefHelper::Create(
+      /*function_name=*/"inner_function",
+      /*in_def=*/{"arg0: string"},
+      /*out_def=*/{"ret0: variant"},
+      /*attr_def=*/{},
+      /*node_def=*/
+      {{{"Parse"},
+        "ParseSingleExample",
+        {"arg0"},
+        {
+            {"Tdense", DataTypeVector({})},
+            {"dense_keys", gtl::ArraySlice<string>({})},
+            {"dense_shapes", gtl::ArraySlice<TensorShape>({})},
+            {"num_sparse", 1},
+            {"sparse_keys", gtl::ArraySlice<string>({"spar_int"})},
+            {"sparse_types", DataTypeVector({DT_INT64})},
+        }},
+       {{"Serialize"},
+        "SerializeSparse",
+        {"Parse:sparse_indices:0", "Parse:sparse_values:0",
+         "Parse:sparse_shapes:0"},
+        {{"T", DT_INT64}, {"out_type", DT_VARIANT}}}},
+      /*ret_def=*/{{"ret0", "Serialize:serialized_sparse:0"}});
+
+  FunctionDefLibrary lib;
+  FunctionDef* vectorized;
+  TF_ASSERT_OK(WrapAndVectorize(inner, &lib, &vectorized));
+  EXPECT_FALSE(
+      function_utils::ContainsFunctionNodeWithOp("MapDefun", *vectorized));
+  EXPECT_TRUE(function_utils::ContainsFunctionNodeWithOp("SerializeManySparse",
+                                                         *vectorized));
+}
+
+TEST(VectorizerTest, VectorizeSerializeSparseWithStackedComponents) {
+  // Stacked components of per-element sparse tensors can't be serialized as
+  // a minibatch, so the node should not be vectorized.
+  FunctionDef inner = FunctionDefHelper::Create(
+      /*function_name=*/"inner_function",
+      /*in_def=*/{"arg0: int64", "arg1: int64", "arg2: int64"},
+      /*out_def=*/{"ret0: variant"},
+      /*attr_def=*/{},
+      /*node_def=*/
+      {{{"Serialize"},
+        "SerializeSparse",
+        {"arg0", "arg1", "arg2"},
+        {{"T", DT_INT64}, {"out_type", DT_VARIANT}}}},
+      /*ret_def=*/{{"ret0", "Serialize:serialized_sparse:0"}});
+
+  FunctionDefLibrary lib;
+  FunctionDef* vectorized;
+  TF_ASSERT_OK(WrapAndVectorize(inner, &lib, &vectorized));
+  EXPECT_TRUE(
+      function_utils::ContainsFunctionNodeWithOp("MapDefun", *vectorized));
+}
+
+TEST(VectorizerTest, VectorizeDecodeRaw) {
+  // DecodeRaw fails on strings of different lengths, which the elements of the
+  // batch may have, so the node should not be vectorized.
+  FunctionDef inner = FunctionDefHelper::Create(
+      /*function_name=*/"inner_function",
+      /*in_def=*/{"arg0: string"},
+      /*out_def=*/{"ret0: uint8"},
+      /*attr_def=*/{},
+      /*node_def=*/
+      {{{"Decode"},
+        "DecodeRaw",
+        {"arg0"},
+        {{"out_type", DT_UINT8}, {"little_endian", true}}}},
+      /*ret_def=*/{{"ret0", "Decode:output:0"}});
+
+  FunctionDefLibrary lib;
+  FunctionDef* vectorized;
+  TF_ASSERT_OK(WrapAndVectorize(inner, &lib, &vectorized));
+  EXPECT_TRUE(
+      function_utils::ContainsFunctionNodeWithOp("MapDefun", *vectorized));
+}
+
+TEST(VectorizerTest, VectorizeRegexReplace) {
+  FunctionDef inner = FunctionDefHelper::Create(
+      /*function_name=*/"inner_function",
+      /*in_def=*/{"arg0: string"},
+      /*out_def=*/{"ret0: string"},
+      /*attr_def=*/{},
+      /*node_def=*/
+      {FunctionDefHelper::Const("Pattern", tstring("a+")),
+       FunctionDefHelper::Const("Rewrite", tstring("b")),
+       {{"Replace"},
+        "RegexReplace",
+        {"arg0", "Pattern:output:0", "Rewrite:output:0"},
+        {{"replace_global", true}}}},
+      /*ret_def=*/{{"ret0", "Replace:output:0"}});
+
+  FunctionDefLibrary lib;
+  FunctionDef* vectorized;
+  TF_ASSERT_OK(WrapAndVectorize(inner, &lib, &vectorized));
+  EXPECT_FALSE(
+      function_utils::ContainsFunctionNodeWithOp("MapDefun", *vectorized));
+  EXPECT_TRUE(
+      function_utils::ContainsFunctionNodeWithOp("RegexReplace", *vectorized));
+}
+
+TEST(VectorizerTest, VectorizeRegexReplaceWithStackedPattern) {
+  // When the pattern differs between the elements, the node should not be
+  // vectorized.
+  FunctionDef inner = FunctionDefHelper::Create(
+      /*function_name=*/"inner_function",
+      /*in_def=*/{"arg0: string", "arg1: string"},
+      /*out_def=*/{"ret0: string"},
+      /*attr_def=*/{},
+      /*node_def=*/
+      {FunctionDefHelper::Const("Rewrite", tstring("b")),
+       {{"Replace"},
+        "RegexReplace",
+        {"arg0", "arg1", "Rewrite:output:0"},
+        {{"replace_global", true}}}},
+      /*ret_def=*/{{"ret0", "Replace:output:0"}});
+
+  FunctionDefLibrary lib;
+  FunctionDef* vectorized;
+  TF_ASSERT_OK(WrapAndVectorize(inner, &lib, &vectorized));
+  EXPECT_TRUE(
+      function_utils::ContainsFunctionNodeWithOp("MapDefun", *vectorized));
+}
+
 TEST(VectorizerTest, VectorizeTranspose) {
   FunctionDef inner = FunctionDefHelper::Create(
       /*function_name=*/"inner_function",
@@ -0,0 +1,511 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/horizontal_fusion.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_join.h"
+#include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/grappler/costs/graph_properties.h"
+#include "tensorflow/core/grappler/graph_analyzer/gen_node.h"
+#include "tensorflow/core/grappler/graph_analyzer/sig_node.h"
+#include "tensorflow/core/grappler/graph_analyzer/subgraph.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/op_types.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/grappler/utils/frame.h"
+#include "tensorflow/core/grappler/utils/topological_sort.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+
+constexpr char kHorizontalFusion[] = "HorizontalFusion";
+
+// Products of matrices larger than this (m * k * n) already keep the device
+// busy, batching them would only add the copies of their inputs.
+constexpr int64 kMaxBatchedMatMulSize = 128 * 128 * 128;
+
+// Maximal number of nodes in a layer.
+constexpr int kMaxLayerSize = 8;
+
+// A MatMul followed by the elementwise ops that only consume its result, in
+// the order of the chain. The nodes are referred to by name, since the graph
+// is sorted again after each rewrite.
+using Layer = std::vector<string>;
+
+// The types of the BatchMatMulV2 kernels on CPU and GPU. There is no bfloat16
+// kernel, even though MatMul has one.
+bool IsBatchableType(DataType dtype) {
+  return dtype == DT_FLOAT || dtype == DT_DOUBLE || dtype == DT_HALF;
+}
+
+bool IsBatchableActivation(const NodeDef& node) {
+  static const auto* const kActivations = new std::unordered_set<string>{
+      "Elu", "Relu", "Relu6", "Selu", "Sigmoid", "Tanh"};
+  return kActivations->count(node.op()) > 0;
+}
+
+class HorizontalFusionImpl {
+ public:
+  HorizontalFusionImpl(const GrapplerItem& item, GraphDef* graph)
+      : nodes_to_preserve_(item.NodesToPreserve()),
+        graph_(graph),
+        properties_(item) {}
+
+  Status Run();
+
+ private:
+  // Returns true if `node` can be part of a batched layer.
+  bool CanBeBatched(const NodeDef& node) const;
+
+  // Returns the layer starting at `matmul`, or an empty layer if it can't be
+  // batched.
+  Layer FindLayer(const NodeDef& matmul) const;
+
+  // Computes the key of `layer`: layers with the same key compute the same
+  // function of inputs of the same shapes.
+  Status LayerKey(const Layer& layer, const FrameView& frame_view,
+                  string* key) const;
+
+  // Returns true if `layer` depends on one of `nodes`, which all come after
+  // the node `min_index` in topological order.
+  bool DependsOn(const Layer& layer, const absl::flat_hash_set<string>& nodes,
+                 int min_index) const;
+
+  // Returns true if `layer` depends on one of the `batch` layers, or one of
+  // them depends on `layer`. The layers of `batch` must all come after the
+  // node `min_index` in topological order.
+  bool DependsOnBatch(const Layer& layer,
+                      const std::vector<const Layer*>& batch,
+                      const absl::flat_hash_set<string>& batch_nodes,
+                      int min_index) const;
+
+  // Replaces `layers`, that don't depend on each other and have the same key,
+  // by a batched computation.
+  void BatchLayers(const std::vector<const Layer*>& layers);
+
+  // Sorts the graph topologically, and updates the node map and the
+  // topological indices of the nodes.
+  Status SortGraph();
+
+  const std::unordered_set<string> nodes_to_preserve_;
+  GraphDef* graph_;
+  GraphProperties properties_;
+  std::unique_ptr<NodeMap> node_map_;
+  absl::flat_hash_map<string, int> topo_index_;
+};
+
+bool HorizontalFusionImpl::CanBeBatched(const NodeDef& node) const {
+  if (nodes_to_preserve_.count(node.name()) > 0 || HasControlInputs(node)) {
+    return false;
+  }
+  DataType dtype;
+  return TryGetNodeAttr(node, "T", &dtype) && IsBatchableType(dtype);
+}
+
+Layer HorizontalFusionImpl::FindLayer(const NodeDef& matmul) const {
+  if (!CanBeBatched(matmul)) {
+    return {};
+  }
+  const auto& matmul_props = properties_.GetInputProperties(matmul.name());
+  if (matmul_props.size() != 2) {
+    return {};
+  }
+  const PartialTensorShape a_shape(matmul_props[0].shape());
+  const PartialTensorShape b_shape(matmul_props[1].shape());
+  if (!a_shape.IsFullyDefined() || a_shape.dims() != 2 ||
+      !b_shape.IsFullyDefined() || b_shape.dims() != 2) {
+    return {};
+  }
+  bool transpose_a = false;
+  bool transpose_b = false;
+  TryGetNodeAttr(matmul, "transpose_a", &transpose_a);
+  TryGetNodeAttr(matmul, "transpose_b", &transpose_b);
+  const int64 m = a_shape.dim_size(transpose_a ? 1 : 0);
+  const int64 k = a_shape.dim_size(transpose_a ? 0 : 1);
+  const int64 n = b_shape.dim_size(transpose_b ? 0 : 1);
+  if (m * k * n > kMaxBatchedMatMulSize) {
+    return {};
+  }
+
+  // Extend the layer with the ops applied to the product. Only the last node
+  // of the layer may have other consumers, since the others are removed.
+  Layer layer = {matmul.name()};
+  const NodeDef* last = &matmul;
+  while (layer.size() < kMaxLayerSize &&
+         NumControlOutputs(*last, *node_map_) == 0) {
+    const auto& outputs = node_map_->GetOutputs(last->name());
+    if (outputs.size() != 1) {
+      break;
+    }
+    const NodeDef* consumer = *outputs.begin();
+    if (consumer->device() != matmul.device() || !CanBeBatched(*consumer)) {
+      break;
+    }
+    if (IsBiasAdd(*consumer)) {
+      if (consumer->input_size() != 2 || consumer->input(0) != last->name() ||
+          NodeName(consumer->input(1)) == last->name()) {
+        break;
+      }
+      const auto& bias_props = properties_.GetInputProperties(consumer->name());
+      if (bias_props.size() != 2) {
+        break;
+      }
+      const PartialTensorShape bias_shape(bias_props[1].shape());
+      if (!bias_shape.IsFullyDefined() || bias_shape.dims() != 1) {
+        break;
+      }
+    } else if (!IsBatchableActivation(*consumer) ||
+               consumer->input_size() != 1) {
+      break;
+    }
+    layer.push_back(consumer->name());
+    last = consumer;
+  }
+  return layer;
+}
+
+Status HorizontalFusionImpl::LayerKey(const Layer& layer,
+                                      const FrameView& frame_view,
+                                      string* key) const {
+  // The graph analyzer needs all the inputs of the nodes of the layer. The
+  // inputs computed outside of the layer are represented by placeholders, that
+  // are left out of the signature.
+  GraphDef layer_graph;
+  absl::flat_hash_set<string> added;
+  for (const string& name : layer) {
+    *layer_graph.add_node() = *node_map_->GetNode(name);
+    added.insert(name);
+  }
+  for (const string& name : layer) {
+    for (const string& input : node_map_->GetNode(name)->input()) {
+      const string input_node = NodeName(input);
+      if (added.insert(input_node).second) {
+        NodeDef* placeholder = layer_graph.add_node();
+        placeholder->set_name(input_node);
+        placeholder->set_op("Placeholder");
+      }
+    }
+  }
+  graph_analyzer::GenNodeMap gen_nodes;
+  TF_RETURN_IF_ERROR(
+      graph_analyzer::GenNode::BuildGraphInMap(layer_graph, &gen_nodes));
+  graph_analyzer::Subgraph::Identity id;
+  for (const string& name : layer) {
+    id.insert(gen_nodes.at(name).get());
+  }
+  graph_analyzer::Subgraph subgraph(std::move(id));
+  graph_analyzer::Signature signature;
+  subgraph.ExtractForSignature(&signature.map);
+  TF_RETURN_IF_ERROR(signature.Compute());
+
+  // The signature only describes the ops and their links. The layers must also
+  // agree on the attributes, the placement and the input shapes of the nodes.
+  *key = signature.ToString();
+  for (const graph_analyzer::SigNode* sig_node : signature.nodes) {
+    const NodeDef& node = *node_map_->GetNode(sig_node->name());
+    strings::StrAppend(key, ";", node.device(), "@",
+                       absl::StrJoin(frame_view.Frames(node), "/"));
+    std::vector<string> attrs;
+    for (const auto& attr : node.attr()) {
+      if (!absl::StartsWith(attr.first, "_")) {
+        attrs.push_back(
+            strings::StrCat(attr.first, "=", SummarizeAttrValue(attr.second)));
+      }
+    }
+    std::sort(attrs.begin(), attrs.end());
+    strings::StrAppend(key, ",", absl::StrJoin(attrs, ","));
+    for (const auto& input : properties_.GetInputProperties(node.name())) {
+      strings::StrAppend(key, ",", DataTypeString(input.dtype()),
+                         PartialTensorShape::DebugString(input.shape()));
+    }
+  }
+  return Status::OK();
+}
+
+bool HorizontalFusionImpl::DependsOn(const Layer& layer,
+                                     const absl::flat_hash_set<string>& nodes,
+                                     int min_index) const {
+  std::vector<const NodeDef*> queue;
+  for (const string& name : layer) {
+    queue.push_back(node_map_->GetNode(name));
+  }
+  absl::flat_hash_set<const NodeDef*> visited;
+  while (!queue.empty()) {
+    const NodeDef* node = queue.back();
+    queue.pop_back();
+    if (!visited.insert(node).second) {
+      continue;
+    }
+    if (nodes.contains(node->name())) {
+      return true;
+    }
+    // The nodes before the first one of `nodes` can't depend on them.
+    if (topo_index_.at(node->name()) < min_index) {
+      continue;
+    }
+    for (const string& input : node->input()) {
+      const NodeDef* fanin = node_map_->GetNode(input);
+      if (fanin != nullptr) {
+        queue.push_back(fanin);
+      }
+    }
+  }
+  return false;
+}
+
+bool HorizontalFusionImpl::DependsOnBatch(
+    const Layer& layer, const std::vector<const Layer*>& batch,
+    const absl::flat_hash_set<string>& batch_nodes, int min_index) const {
+  if (DependsOn(layer, batch_nodes, min_index)) {
+    return true;
+  }
+  // The layers are ordered by their MatMul, so the other nodes of an earlier
+  // layer, like a BiasAdd, can still consume the result of `layer`.
+  const absl::flat_hash_set<string> layer_nodes(layer.begin(), layer.end());
+  const int layer_index = topo_index_.at(layer.front());
+  for (const Layer* other : batch) {
+    if (DependsOn(*other, layer_nodes, layer_index)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void HorizontalFusionImpl::BatchLayers(
+    const std::vector<const Layer*>& layers) {
+  const int num_layers = layers.size();
+  const NodeDef& first_matmul = *node_map_->GetNode(layers[0]->front());
+  const string prefix =
+      AddPrefixToNodeName(first_matmul.name(), kHorizontalFusion);
+  const string& device = first_matmul.device();
+  const DataType dtype = first_matmul.attr().at("T").type();
+  VLOG(2) << "Batching " << num_layers << " layers like "
+          << first_matmul.name();
+
+  auto add_node = [&](const string& name, const string& op) {
+    NodeDef* node = graph_->add_node();
+    node->set_name(strings::StrCat(prefix, "/", name));
+    node->set_op(op);
+    node->set_device(device);
+    SetAttrValue(dtype, &(*node->mutable_attr())["T"]);
+    return node;
+  };
+  // Stacks the input `input` of the nodes at `position` in the layers.
+  auto add_pack = [&](int position, int input, const string& name) {
+    NodeDef* pack = add_node(name, "Pack");
+    for (const Layer* layer : layers) {
+      pack->add_input(node_map_->GetNode((*layer)[position])->input(input));
+    }
+    SetAttrValue(num_layers, &(*pack->mutable_attr())["N"]);
+    SetAttrValue(0, &(*pack->mutable_attr())["axis"]);
+    return pack;
+  };
+
+  // The products of [m, k] by [k, n] matrices become a product of
+  // [num_layers, m, k] by [num_layers, k, n] tensors.
+  NodeDef* a = add_pack(0, 0, "a");
+  NodeDef* b = add_pack(0, 1, "b");
+  NodeDef* batched = add_node("MatMul", "BatchMatMulV2");
+  batched->add_input(a->name());
+  batched->add_input(b->name());
+  bool transpose_a = false;
+  bool transpose_b = false;
+  TryGetNodeAttr(first_matmul, "transpose_a", &transpose_a);
+  TryGetNodeAttr(first_matmul, "transpose_b", &transpose_b);
+  SetAttrValue(transpose_a, &(*batched->mutable_attr())["adj_x"]);
+  SetAttrValue(transpose_b, &(*batched->mutable_attr())["adj_y"]);
+
+  for (int position = 1; position < layers[0]->size(); ++position) {
+    const NodeDef& node = *node_map_->GetNode((*layers[0])[position]);
+    if (IsBiasAdd(node)) {
+      // The [num_layers, n] biases are broadcast to the [num_layers, 1, n]
+      // rows of the products.
+      NodeDef* bias = add_pack(position, 1, strings::StrCat("bias_", position));
+      NodeDef* axis = graph_->add_node();
+      axis->set_name(strings::StrCat(prefix, "/bias_axis_", position));
+      axis->set_op("Const");
+      axis->set_device(device);
+      // Anchor the constant in the frame of the layers.
+      axis->add_input(AsControlDependency(a->name()));
+      Tensor axis_value(DT_INT32, TensorShape({}));
+      axis_value.scalar<int32>()() = 1;
+      SetAttrValue(DT_INT32, &(*axis->mutable_attr())["dtype"]);
+      axis_value.AsProtoTensorContent(
+          (*axis->mutable_attr())["value"].mutable_tensor());
+      NodeDef* expand =
+          add_node(strings::StrCat("ExpandDims_", position), "ExpandDims");
+      expand->add_input(bias->name());
+      expand->add_input(axis->name());
+      SetAttrValue(DT_INT32, &(*expand->mutable_attr())["Tdim"]);
+      NodeDef* add = add_node(strings::StrCat("BiasAdd_", position), "AddV2");
+      add->add_input(batched->name());
+      add->add_input(expand->name());
+      batched = add;
+    } else {
+      NodeDef* activation =
+          add_node(strings::StrCat(node.op(), "_", position), node.op());
+      for (const auto& attr : node.attr()) {
+        if (!absl::StartsWith(attr.first, "_")) {
+          (*activation->mutable_attr())[attr.first] = attr.second;
+        }
+      }
+      activation->add_input(batched->name());
+      batched = activation;
+    }
+  }
+
+  NodeDef* unpack = add_node("Unpack", "Unpack");
+  unpack->add_input(batched->name());
+  SetAttrValue(num_layers, &(*unpack->mutable_attr())["num"]);
+  SetAttrValue(0, &(*unpack->mutable_attr())["axis"]);
+
+  // The last node of each layer forwards its slice of the result, so that its
+  // consumers are unchanged. The other nodes are no longer used.
+  std::set<string> nodes_to_delete;
+  for (int i = 0; i < num_layers; ++i) {
+    const Layer& layer = *layers[i];
+    NodeDef* last = node_map_->GetNode(layer.back());
+    last->set_op("Identity");
+    last->clear_input();
+    last->add_input(i == 0 ? unpack->name()
+                           : strings::StrCat(unpack->name(), ":", i));
+    auto* attr = last->mutable_attr();
+    for (auto it = attr->begin(); it != attr->end();) {
+      if (it->first != "T" && !absl::StartsWith(it->first, "_")) {
+        it = attr->erase(it);
+      } else {
+        ++it;
+      }
+    }
+    nodes_to_delete.insert(layer.begin(), layer.end() - 1);
+  }
+  EraseNodesFromGraph(nodes_to_delete, graph_);
+}
+
+Status HorizontalFusionImpl::SortGraph() {
+  TF_RETURN_IF_ERROR(TopologicalSort(graph_));
+  node_map_.reset(new NodeMap(graph_));
+  topo_index_.clear();
+  for (int i = 0; i < graph_->node_size(); ++i) {
+    topo_index_[graph_->node(i).name()] = i;
+  }
+  return Status::OK();
+}
+
+Status HorizontalFusionImpl::Run() {
+  TF_RETURN_IF_ERROR(properties_.InferStatically(/*assume_valid_feeds=*/false));
+  TF_RETURN_IF_ERROR(SortGraph());
+  FrameView frame_view;
+  TF_RETURN_IF_ERROR(frame_view.InferFromGraph(*graph_));
+
+  // Group the layers by key, in topological order.
+  std::map<string, std::vector<Layer>> groups;
+  for (const NodeDef& node : graph_->node()) {
+    if (node.op() != "MatMul") {
+      continue;
+    }
+    Layer layer = FindLayer(node);
+    if (layer.empty()) {
+      continue;
+    }
+    string key;
+    Status s = LayerKey(layer, frame_view, &key);
+    if (!s.ok()) {
+      VLOG(2) << "Can't compute the signature of " << node.name() << ": " << s;
+      continue;
+    }
+    groups[key].push_back(std::move(layer));
+  }
+
+  for (auto& group : groups) {
+    std::vector<Layer> layers = std::move(group.second);
+    while (layers.size() > 1) {
+      // Pick the layers in topological order, skipping those that depend on
+      // the layers already picked or that these depend on, which are batched
+      // in the next round. Batching layers that depend on each other would
+      // create a cycle.
+      std::sort(layers.begin(), layers.end(),
+                [this](const Layer& a, const Layer& b) {
+                  return topo_index_.at(a.front()) < topo_index_.at(b.front());
+                });
+      const int min_index = topo_index_.at(layers.front().front());
+      std::vector<const Layer*> batch;
+      absl::flat_hash_set<string> batched_nodes;
+      std::vector<Layer> remaining;
+      for (Layer& layer : layers) {
+        if (!batch.empty() &&
+            DependsOnBatch(layer, batch, batched_nodes, min_index)) {
+          remaining.push_back(std::move(layer));
+          continue;
+        }
+        batch.push_back(&layer);
+        batched_nodes.insert(layer.begin(), layer.end());
+      }
+      if (batch.size() > 1) {
+        BatchLayers(batch);
+        TF_RETURN_IF_ERROR(SortGraph());
+      }
+      layers = std::move(remaining);
+    }
+  }
+  return Status::OK();
+}
+
+}  // namespace
+
+Status HorizontalFusion::Optimize(Cluster* cluster, const GrapplerItem& item,
+                                  GraphDef* output) {
+  int num_matmuls = 0;
+  for (const NodeDef& node : item.graph.node()) {
+    if (node.op() == "MatMul") {
+      ++num_matmuls;
+    }
+  }
+  if (num_matmuls < 2) {
+    return errors::Aborted("Nothing to do.");
+  }
+
+  *output = item.graph;
+  HorizontalFusionImpl fusion(item, output);
+  return fusion.Run();
+}
+
+void HorizontalFusion::Feedback(Cluster* cluster, const GrapplerItem& item,
+                                const GraphDef& optimize_output,
+                                double result) {
+  // Nothing to do for HorizontalFusion.
+}
+
+}  // end namespace grappler
+}  // end namespace tensorflow
@@ -0,0 +1,232 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/horizontal_fusion.h"
+
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/grappler/utils/grappler_test.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+class HorizontalFusionTest : public GrapplerTest {
+ protected:
+  // Adds a tower computing Relu(BiasAdd(MatMul(input, w), bias)) with random
+  // weights, and returns its output.
+  Output AddTower(const Scope& s, const string& name, Output input) {
+    Output w = ops::Const(s.WithOpName(strings::StrCat(name, "/w")),
+                          GenerateRandomTensor<DT_FLOAT>({16, 8}));
+    Output bias = ops::Const(s.WithOpName(strings::StrCat(name, "/bias")),
+                             GenerateRandomTensor<DT_FLOAT>({8}));
+    Output matmul =
+        ops::MatMul(s.WithOpName(strings::StrCat(name, "/matmul")), input, w);
+    Output bias_add = ops::BiasAdd(
+        s.WithOpName(strings::StrCat(name, "/bias_add")), matmul, bias);
+    return ops::Relu(s.WithOpName(strings::StrCat(name, "/relu")), bias_add);
+  }
+};
+
+TEST_F(HorizontalFusionTest, BatchIndependentTowers) {
+  Scope s = Scope::NewRootScope();
+  std::vector<std::pair<string, Tensor>> feeds;
+  for (int i = 0; i < 3; ++i) {
+    const string name = strings::StrCat("tower", i);
+    Output x = ops::Placeholder(s.WithOpName(strings::StrCat(name, "/x")),
+                                DT_FLOAT, ops::Placeholder::Shape({4, 16}));
+    Output relu = AddTower(s, name, x);
+    ops::Identity(s.WithOpName(strings::StrCat(name, "/out")), relu);
+    feeds.emplace_back(strings::StrCat(name, "/x"),
+                       GenerateRandomTensor<DT_FLOAT>({4, 16}));
+  }
+  // A layer of another shape isn't batched with the towers.
+  Output y = ops::Placeholder(s.WithOpName("y"), DT_FLOAT,
+                              ops::Placeholder::Shape({4, 8}));
+  Output v = ops::Const(s.WithOpName("v"), 1.0f, {8, 8});
+  Output other = ops::MatMul(s.WithOpName("other"), y, v);
+  ops::Identity(s.WithOpName("other_out"), other);
+  feeds.emplace_back("y", GenerateRandomTensor<DT_FLOAT>({4, 8}));
+
+  GrapplerItem item;
+  item.fetch = {"tower0/out", "tower1/out", "tower2/out", "other_out"};
+  item.feed = feeds;
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  HorizontalFusion optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+
+  int num_matmuls = 0;
+  int num_batched = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.op() == "MatMul") {
+      EXPECT_EQ("other", node.name());
+      ++num_matmuls;
+    } else if (node.op() == "BatchMatMulV2") {
+      ++num_batched;
+    }
+    EXPECT_NE("BiasAdd", node.op());
+  }
+  EXPECT_EQ(1, num_matmuls);
+  EXPECT_EQ(1, num_batched);
+
+  // The outputs of the towers are slices of the batched computation.
+  NodeMap node_map(&output);
+  for (int i = 0; i < 3; ++i) {
+    const NodeDef* relu =
+        node_map.GetNode(strings::StrCat("tower", i, "/relu"));
+    ASSERT_NE(nullptr, relu);
+    EXPECT_EQ("Identity", relu->op());
+    ASSERT_EQ(1, relu->input_size());
+    const NodeDef* unpack = node_map.GetNode(relu->input(0));
+    ASSERT_NE(nullptr, unpack);
+    EXPECT_EQ("Unpack", unpack->op());
+    EXPECT_EQ(nullptr,
+              node_map.GetNode(strings::StrCat("tower", i, "/matmul")));
+  }
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, feeds);
+  auto tensors = EvaluateNodes(output, item.fetch, feeds);
+  ASSERT_EQ(tensors_expected.size(), tensors.size());
+  for (int i = 0; i < tensors.size(); ++i) {
+    test::ExpectTensorNear<float>(tensors_expected[i], tensors[i], 1e-5);
+  }
+}
+
+TEST_F(HorizontalFusionTest, DependentTowersAreNotBatched) {
+  // The second tower consumes the output of the first one.
+  Scope s = Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({4, 16}));
+  Output first = AddTower(s, "first", x);
+  Output padded = ops::Concat(s.WithOpName("padded"), {first, first}, 1);
+  Output second = AddTower(s, "second", padded);
+  ops::Identity(s.WithOpName("out"), second);
+
+  GrapplerItem item;
+  item.fetch = {"out"};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  HorizontalFusion optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+
+  for (const NodeDef& node : output.node()) {
+    EXPECT_NE("BatchMatMulV2", node.op());
+  }
+  EXPECT_EQ(item.graph.node_size(), output.node_size());
+}
+
+TEST_F(HorizontalFusionTest, CrossDependentTowersAreNotBatched) {
+  // The bias of the first tower is computed from the output of the second
+  // one, even though the MatMul of the first tower comes first.
+  Scope s = Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("first/x"), DT_FLOAT,
+                              ops::Placeholder::Shape({4, 16}));
+  Output w = ops::Const(s.WithOpName("first/w"),
+                        GenerateRandomTensor<DT_FLOAT>({16, 8}));
+  Output matmul = ops::MatMul(s.WithOpName("first/matmul"), x, w);
+  Output y = ops::Placeholder(s.WithOpName("second/x"), DT_FLOAT,
+                              ops::Placeholder::Shape({4, 16}));
+  Output second = AddTower(s, "second", y);
+  ops::Identity(s.WithOpName("second/out"), second);
+  Output bias = ops::Mean(s.WithOpName("first/bias"), second, 0);
+  Output bias_add = ops::BiasAdd(s.WithOpName("first/bias_add"), matmul, bias);
+  Output relu = ops::Relu(s.WithOpName("first/relu"), bias_add);
+  ops::Identity(s.WithOpName("first/out"), relu);
+
+  GrapplerItem item;
+  item.fetch = {"first/out", "second/out"};
+  item.feed = {{"first/x", GenerateRandomTensor<DT_FLOAT>({4, 16})},
+               {"second/x", GenerateRandomTensor<DT_FLOAT>({4, 16})}};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  HorizontalFusion optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+  for (const NodeDef& node : output.node()) {
+    EXPECT_NE("BatchMatMulV2", node.op());
+  }
+  EXPECT_EQ(item.graph.node_size(), output.node_size());
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+  auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+  ASSERT_EQ(tensors_expected.size(), tensors.size());
+  for (int i = 0; i < tensors.size(); ++i) {
+    test::ExpectTensorNear<float>(tensors_expected[i], tensors[i], 1e-5);
+  }
+}
+
+TEST_F(HorizontalFusionTest, Bfloat16TowersAreNotBatched) {
+  // There is no bfloat16 BatchMatMulV2 kernel.
+  Scope s = Scope::NewRootScope();
+  for (int i = 0; i < 2; ++i) {
+    const string name = strings::StrCat("tower", i);
+    Output x = ops::Placeholder(s.WithOpName(strings::StrCat(name, "/x")),
+                                DT_BFLOAT16, ops::Placeholder::Shape({4, 16}));
+    Output w = ops::Cast(s.WithOpName(strings::StrCat(name, "/w")),
+                         ops::Const(s, 1.0f, {16, 8}), DT_BFLOAT16);
+    Output matmul =
+        ops::MatMul(s.WithOpName(strings::StrCat(name, "/matmul")), x, w);
+    ops::Identity(s.WithOpName(strings::StrCat(name, "/out")), matmul);
+  }
+
+  GrapplerItem item;
+  item.fetch = {"tower0/out", "tower1/out"};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  HorizontalFusion optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+  for (const NodeDef& node : output.node()) {
+    EXPECT_NE("BatchMatMulV2", node.op());
+  }
+}
+
+TEST_F(HorizontalFusionTest, LargeProductsAreNotBatched) {
+  Scope s = Scope::NewRootScope();
+  for (int i = 0; i < 2; ++i) {
+    const string name = strings::StrCat("tower", i);
+    Output x = ops::Placeholder(s.WithOpName(strings::StrCat(name, "/x")),
+                                DT_FLOAT, ops::Placeholder::Shape({512, 512}));
+    Output w = ops::Const(s.WithOpName(strings::StrCat(name, "/w")), 1.0f,
+                          {512, 512});
+    Output matmul =
+        ops::MatMul(s.WithOpName(strings::StrCat(name, "/matmul")), x, w);
+    ops::Identity(s.WithOpName(strings::StrCat(name, "/out")), matmul);
+  }
+
+  GrapplerItem item;
+  item.fetch = {"tower0/out", "tower1/out"};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  HorizontalFusion optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+  for (const NodeDef& node : output.node()) {
+    EXPECT_NE("BatchMatMulV2", node.op());
+  }
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
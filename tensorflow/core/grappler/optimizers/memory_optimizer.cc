@@ -30,6 +30,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/clusters/virtual_cluster.h"
 #include "tensorflow/core/grappler/costs/graph_memory.h"
 #include "tensorflow/core/grappler/costs/graph_properties.h"
+#include "tensorflow/core/grappler/costs/op_level_cost_estimator.h"
 #include "tensorflow/core/grappler/costs/utils.h"
 #include "tensorflow/core/grappler/graph_topology_view.h"
 #include "tensorflow/core/grappler/grappler_item.h"
@@ -41,6 +42,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils/traversal.h"
 #include "tensorflow/core/lib/math/math_util.h"
 #include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/mem.h"
 #include "tensorflow/core/protobuf/rewriter_config.pb.h"
 #include "tensorflow/core/util/device_name_utils.h"
 
@@ -440,6 +442,39 @@ void RecomputeSubgraph(
   }
 }
 
+// Duplicates the `recomputed_subgraphs` of `graph`, which must be sorted
+// topologically, and makes their targets use the copies.
+void RecomputeSubgraphs(
+    const std::vector<RecomputedSubGraph>& recomputed_subgraphs,
+    const NodeMap& node_map, GraphDef* graph) {
+  if (recomputed_subgraphs.empty()) {
+    return;
+  }
+  std::unordered_map<const NodeDef*, int> topological_numbering;
+  for (int node_number = 0; node_number < graph->node().size();
+       ++node_number) {
+    topological_numbering[graph->mutable_node(node_number)] =
+        graph->node().size() - node_number - 1;
+  }
+  // Duplicate the indicated sub-graphs and set up control dependencies
+  for (const RecomputedSubGraph& subgraph : recomputed_subgraphs) {
+    RecomputeSubgraph(subgraph.recomputed_source_nodes, subgraph.target_nodes,
+                      node_map, topological_numbering, graph);
+  }
+}
+
+// Nodes whose inputs we may want to recompute. This matches node names that
+// contain recomputation_targets_name_scope as a name scope, meaning it either
+// begins with or contains the name scope. Defaults to "gradients/" which will
+// match any node names that begins with "gradients/" or contains
+// "/gradients/".
+bool IsRecomputationTarget(const string& recomputation_targets_name_scope,
+                           const NodeDef& node) {
+  return absl::StartsWith(node.name(), recomputation_targets_name_scope) ||
+         static_cast<int>(node.name().find(
+             "/" + recomputation_targets_name_scope)) != -1;
+}
+
 void RecomputationRewritingPass(RewriterConfig::MemOptType optimization_level,
                                 const string& recomputation_targets_name_scope,
                                 GraphDef* graph, const GrapplerItem& item) {
@@ -461,15 +496,7 @@ void RecomputationRewritingPass(RewriterConfig::MemOptType optimization_level,
   }
   std::function<bool(const NodeDef&)> is_target =
       [&recomputation_targets_name_scope](const NodeDef& node) {
-        // Nodes whose inputs we may want to recompute. This matches node names
-        // that contain recomputation_targets_name_scope as a name scope,
-        // meaning it either begins with or contains the name scope.
-        // Defaults to "gradients/" which will match any node names that begins
-        // with "gradients/" or contains "/gradients/".
-        return absl::StartsWith(node.name(),
-                                recomputation_targets_name_scope) ||
-               static_cast<int>(node.name().find(
-                   "/" + recomputation_targets_name_scope)) != -1;
+        return IsRecomputationTarget(recomputation_targets_name_scope, node);
       };
 
   if (optimization_level == RewriterConfig::RECOMPUTATION_HEURISTICS ||
@@ -497,19 +524,7 @@ void RecomputationRewritingPass(RewriterConfig::MemOptType optimization_level,
         },
         is_target);
   }
-  if (!recomputed_subgraphs.empty()) {
-    std::unordered_map<const NodeDef*, int> topological_numbering;
-    for (int node_number = 0; node_number < graph->node().size();
-         ++node_number) {
-      topological_numbering[graph->mutable_node(node_number)] =
-          graph->node().size() - node_number - 1;
-    }
-    // Duplicate the indicated sub-graphs and set up control dependencies
-    for (const RecomputedSubGraph& subgraph : recomputed_subgraphs) {
-      RecomputeSubgraph(subgraph.recomputed_source_nodes, subgraph.target_nodes,
-                        node_map, topological_numbering, graph);
-    }
-  }
+  RecomputeSubgraphs(recomputed_subgraphs, node_map, graph);
 }
 
 bool SchedulingPass(Cluster* cluster, std::unique_ptr<GraphMemory>* memory_ptr,
@@ -740,6 +755,423 @@ bool SchedulingPass(Cluster* cluster, std::unique_ptr<GraphMemory>* memory_ptr,
   return updated_graph;
 }
 
+// Returns the largest peak memory usage over the devices of `cluster`.
+int64 PeakMemoryUsage(Cluster* cluster, const GraphMemory& memory) {
+  int64 peak = -1;
+  for (const auto& device : cluster->GetDevices()) {
+    peak = std::max(peak, memory.GetPeakMemoryUsage(device.first).used_memory);
+  }
+  return peak;
+}
+
+// Orders the nodes of `graph` with a list scheduler that picks, among the
+// ready nodes, the ones that don't increase the memory usage first, and then
+// the ones with the earliest required completion time. Returns the nodes in
+// that order.
+std::vector<const NodeDef*> MemoryAwareOrder(
+    const GraphDef& graph,
+    const std::unordered_map<string, const NodeDef*>& name_map,
+    const std::unordered_map<const NodeDef*, int64>& output_bytes,
+    const std::unordered_map<const NodeDef*, Costs::NanoSeconds>&
+        required_times) {
+  std::unordered_map<const NodeDef*, std::vector<const NodeDef*>> fanouts;
+  std::unordered_map<const NodeDef*, int> num_pending_fanins;
+  std::unordered_map<const NodeDef*, int> num_pending_data_fanouts;
+  std::vector<const NodeDef*> ready;
+  for (const NodeDef& node : graph.node()) {
+    for (const string& input : node.input()) {
+      const NodeDef* fanin = name_map.at(NodeName(input));
+      fanouts[fanin].push_back(&node);
+      ++num_pending_fanins[&node];
+      if (!IsControlInput(input)) ++num_pending_data_fanouts[fanin];
+    }
+    if (node.input_size() == 0) ready.push_back(&node);
+  }
+
+  // Returns the change of the memory usage when `node` runs: its outputs are
+  // allocated, and the outputs of the fanins it is the last consumer of are
+  // released.
+  const auto memory_delta = [&](const NodeDef* node) {
+    std::unordered_map<const NodeDef*, int> num_uses;
+    for (const string& input : node->input()) {
+      if (!IsControlInput(input)) ++num_uses[name_map.at(NodeName(input))];
+    }
+    int64 delta = output_bytes.at(node);
+    for (const auto& use : num_uses) {
+      if (num_pending_data_fanouts[use.first] == use.second) {
+        delta -= output_bytes.at(use.first);
+      }
+    }
+    return delta;
+  };
+
+  std::vector<const NodeDef*> order;
+  order.reserve(graph.node_size());
+  while (!ready.empty()) {
+    int best = 0;
+    std::pair<bool, Costs::NanoSeconds> best_key;
+    for (int i = 0; i < ready.size(); ++i) {
+      const std::pair<bool, Costs::NanoSeconds> key(
+          memory_delta(ready[i]) > 0, required_times.at(ready[i]));
+      if (i == 0 || key < best_key) {
+        best = i;
+        best_key = key;
+      }
+    }
+    const NodeDef* node = ready[best];
+    ready[best] = ready.back();
+    ready.pop_back();
+    order.push_back(node);
+
+    for (const string& input : node->input()) {
+      if (!IsControlInput(input)) {
+        --num_pending_data_fanouts[name_map.at(NodeName(input))];
+      }
+    }
+    for (const NodeDef* fanout : fanouts[node]) {
+      if (--num_pending_fanins[fanout] == 0) ready.push_back(fanout);
+    }
+  }
+  return order;
+}
+
+// Delays the producers of the large tensors that are live at the peak memory
+// usage to their position in a memory-aware ordering of the graph, by adding
+// a control dependency on the node that precedes them in that ordering. A
+// producer is only delayed if this doesn't increase the estimated critical
+// path, and the control dependencies are kept only if the peak memory usage
+// inferred by the virtual scheduler decreases.
+bool MemoryAwareOrderingPass(
+    Cluster* cluster, const std::shared_ptr<const OpCostDatabase>& op_costs,
+    std::unique_ptr<GraphMemory>* memory_ptr, GrapplerItem* item) {
+  // The static cost estimates don't model control flow, and a control
+  // dependency on a node that might be dead would change the semantics.
+  for (const NodeDef& node : item->graph.node()) {
+    if (IsControlFlow(node)) return false;
+  }
+
+  if ((*memory_ptr) == nullptr) {
+    memory_ptr->reset(new GraphMemory(*item));
+    Status s = (*memory_ptr)->InferStatically(cluster->GetDevices());
+    if (!s.ok()) {
+      memory_ptr->reset();
+      VLOG(1) << "Failed to infer memory usage: " << s.error_message();
+      return false;
+    }
+  }
+  const int64 peak_before = PeakMemoryUsage(cluster, **memory_ptr);
+  if (peak_before <= 0) return false;
+
+  // Only the producers of tensors that account for a significant share of
+  // the peak memory usage are worth delaying.
+  constexpr int kMinPeakShareInverse = 20;
+  std::unordered_set<string> large_producers;
+  for (const auto& device : cluster->GetDevices()) {
+    const GraphMemory::MemoryUsage& mem_usage =
+        (*memory_ptr)->GetPeakMemoryUsage(device.first);
+    for (const auto& live : mem_usage.live_tensors) {
+      if (live.memory_used * kMinPeakShareInverse >= mem_usage.used_memory) {
+        large_producers.insert(live.node);
+      }
+    }
+  }
+  if (large_producers.empty()) return false;
+
+  std::unordered_map<const NodeDef*, Costs::NanoSeconds> completion_times;
+  std::unordered_map<const NodeDef*, Costs::NanoSeconds> required_times;
+  Status s = EstimateEarliestExecutionTimes(*item, cluster, op_costs,
+                                            &completion_times);
+  if (s.ok()) {
+    s = EstimateRequiredTimes(*item, cluster, op_costs, completion_times,
+                              &required_times);
+  }
+  if (!s.ok()) {
+    VLOG(1) << "Failed to estimate execution times: " << s.error_message();
+    return false;
+  }
+
+  GraphProperties properties(*item);
+  s = properties.InferStatically(/*assume_valid_feeds=*/false,
+                                 /*aggressive_shape_inference=*/false,
+                                 /*include_tensor_values=*/false);
+  if (!s.ok()) {
+    VLOG(1) << "Failed to infer shapes: " << s.error_message();
+    return false;
+  }
+
+  std::unordered_map<string, const NodeDef*> name_map;
+  std::unordered_map<const NodeDef*, int64> output_bytes;
+  for (const NodeDef& node : item->graph.node()) {
+    name_map[node.name()] = &node;
+    int64 bytes = 0;
+    for (const auto& output : properties.GetOutputProperties(node.name())) {
+      bytes += CalculateTensorSize(output);
+    }
+    output_bytes[&node] = bytes;
+  }
+  for (const NodeDef& node : item->graph.node()) {
+    for (const string& input : node.input()) {
+      if (name_map.find(NodeName(input)) == name_map.end()) return false;
+    }
+  }
+  const std::vector<const NodeDef*> order =
+      MemoryAwareOrder(item->graph, name_map, output_bytes, required_times);
+  if (order.size() != item->graph.node_size()) return false;
+
+  const GraphDef original_graph = item->graph;
+  std::unordered_map<const NodeDef*, NodeDef*> mutable_nodes;
+  for (NodeDef& node : *item->graph.mutable_node()) {
+    mutable_nodes[&node] = &node;
+  }
+  int num_control_dependencies = 0;
+  for (int pos = 0; pos < order.size(); ++pos) {
+    const NodeDef* node = order[pos];
+    if (node->input_size() == 0 || !large_producers.count(node->name())) {
+      continue;
+    }
+    std::unordered_set<const NodeDef*> fanins;
+    Costs::NanoSeconds ready_time(0);
+    for (const string& input : node->input()) {
+      const NodeDef* fanin = name_map.at(NodeName(input));
+      fanins.insert(fanin);
+      ready_time = std::max(ready_time, completion_times[fanin]);
+    }
+    const Costs::NanoSeconds duration = completion_times[node] - ready_time;
+    const Costs::NanoSeconds required_time = required_times[node];
+
+    // Find the latest preceding node that the producer can wait for without
+    // finishing after its required time. The order is topological, so the
+    // new control dependency can't create a cycle.
+    for (int i = pos - 1; i >= 0; --i) {
+      const NodeDef* prev = order[i];
+      // Source nodes such as variables are ready from the start, so waiting
+      // for them would not delay the producer.
+      if (prev->input_size() == 0) continue;
+      // The producer already waits for this node, or would not be delayed.
+      if (fanins.count(prev) || completion_times[prev] <= ready_time) break;
+      if (prev->device() != node->device()) continue;
+      if (completion_times[prev] + duration <= required_time) {
+        mutable_nodes[node]->add_input(AsControlDependency(prev->name()));
+        ++num_control_dependencies;
+        break;
+      }
+    }
+  }
+  if (num_control_dependencies == 0) return false;
+
+  std::unique_ptr<GraphMemory> memory(new GraphMemory(*item));
+  s = memory->InferStatically(cluster->GetDevices());
+  const int64 peak_after = s.ok() ? PeakMemoryUsage(cluster, *memory) : -1;
+  if (peak_after < 0 || peak_after >= peak_before) {
+    VLOG(1) << "Memory-aware ordering doesn't reduce the peak memory usage ("
+            << peak_before << " bytes), reverting it";
+    item->graph = original_graph;
+    return false;
+  }
+  VLOG(1) << "Memory-aware ordering added " << num_control_dependencies
+          << " control dependencies, peak memory usage: " << peak_before
+          << " -> " << peak_after << " bytes";
+  *memory_ptr = std::move(memory);
+  return true;
+}
+
+// Selects the activations to recompute in the backward pass from cost
+// estimates instead of op types, so that it applies to any device. On each
+// device whose peak memory usage is above 80% of its memory, the tensors live
+// at the peak that feed recomputation targets are ranked by the memory that
+// recomputing them frees per nanosecond of estimated execution time. The best
+// ones are recomputed until the excess is covered, as long as the
+// recomputations add less than a third to the estimated step time. The
+// rewrite is kept only if the peak memory usage inferred by the virtual
+// scheduler decreases. CPU devices get `cpu_memory_budget` bytes, or the
+// free RAM if it is 0.
+bool CostBasedRecomputationPass(
+    const string& recomputation_targets_name_scope, Cluster* cluster,
+    const std::shared_ptr<const OpCostDatabase>& op_costs,
+    int64 cpu_memory_budget, std::unique_ptr<GraphMemory>* memory_ptr,
+    GrapplerItem* item) {
+  // The static cost estimates don't model control flow.
+  for (const NodeDef& node : item->graph.node()) {
+    if (IsControlFlow(node)) return false;
+  }
+
+  if ((*memory_ptr) == nullptr) {
+    memory_ptr->reset(new GraphMemory(*item));
+    Status s = (*memory_ptr)->InferStatically(cluster->GetDevices());
+    if (!s.ok()) {
+      memory_ptr->reset();
+      VLOG(1) << "Failed to infer memory usage: " << s.error_message();
+      return false;
+    }
+  }
+  const GraphMemory& memory = **memory_ptr;
+  const int64 peak_before = PeakMemoryUsage(cluster, memory);
+  if (peak_before <= 0) return false;
+
+  std::unordered_map<const NodeDef*, Costs::NanoSeconds> completion_times;
+  Status s = EstimateEarliestExecutionTimes(*item, cluster, op_costs,
+                                            &completion_times);
+  if (!s.ok()) {
+    VLOG(1) << "Failed to estimate execution times: " << s.error_message();
+    return false;
+  }
+  GraphProperties properties(*item);
+  s = properties.InferStatically(/*assume_valid_feeds=*/false,
+                                 /*aggressive_shape_inference=*/false,
+                                 /*include_tensor_values=*/false);
+  if (!s.ok()) {
+    VLOG(1) << "Failed to infer shapes: " << s.error_message();
+    return false;
+  }
+
+  NodeMap node_map(&item->graph);
+  int64 step_time = 0;
+  for (const NodeDef& node : item->graph.node()) {
+    step_time = std::max<int64>(step_time, completion_times[&node].count());
+  }
+  // Recomputing a node that is fed wouldn't use the fed value, and the
+  // original value of a fetched node stays alive anyway.
+  std::unordered_set<string> excluded_nodes = item->NodesToPreserve();
+  for (const auto& feed : item->feed) {
+    excluded_nodes.insert(NodeName(feed.first));
+  }
+  std::function<bool(const NodeDef&)> is_target =
+      [&recomputation_targets_name_scope](const NodeDef& node) {
+        return IsRecomputationTarget(recomputation_targets_name_scope, node);
+      };
+  auto is_recomputable = [&](const NodeDef& node) {
+    if (node.input_size() == 0 || is_target(node) ||
+        excluded_nodes.count(node.name()) > 0 || !IsFreeOfSideEffect(node)) {
+      return false;
+    }
+    for (const string& input : node.input()) {
+      const NodeDef* fanin = node_map.GetNode(input);
+      if (fanin == nullptr || is_target(*fanin)) return false;
+    }
+    // The recomputation only waits for the targets that feed the same
+    // targets as the node, so it would run right away if there are none.
+    for (const NodeDef* output : node_map.GetOutputs(node.name())) {
+      if (!is_target(*output)) continue;
+      for (const string& input : output->input()) {
+        const NodeDef* fanin = node_map.GetNode(input);
+        if (fanin != nullptr && fanin != &node && is_target(*fanin)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  struct Candidate {
+    string node;
+    int64 bytes_saved;
+    int64 cost;
+  };
+  std::unordered_set<string> to_recompute;
+  int64 recomputation_time = 0;
+  for (const auto& device : cluster->GetDevices()) {
+    const string& name = device.first;
+    const DeviceProperties& prop = device.second;
+    // The memory size of the CPU devices doesn't reflect the host memory.
+    int64 memory_size = prop.memory_size();
+    if (prop.type() == "CPU") {
+      memory_size =
+          cpu_memory_budget > 0 ? cpu_memory_budget : port::AvailableRam();
+      if (memory_size == kint64max) memory_size = 0;
+    }
+    if (memory_size <= 0) {
+      VLOG(1) << "Available memory unknown for device " << name;
+      continue;
+    }
+    const GraphMemory::MemoryUsage& mem_usage = memory.GetPeakMemoryUsage(name);
+    int64 required_savings = mem_usage.used_memory - memory_size * 0.8;
+    if (required_savings <= 0) {
+      continue;
+    }
+
+    std::unordered_map<string, int64> live_bytes;
+    for (const auto& live : mem_usage.live_tensors) {
+      live_bytes[live.node] += live.memory_used;
+    }
+    std::vector<Candidate> candidates;
+    for (const auto& live : live_bytes) {
+      const NodeDef* node = node_map.GetNode(live.first);
+      if (node == nullptr || to_recompute.count(node->name()) > 0 ||
+          !is_recomputable(*node)) {
+        continue;
+      }
+      // The inputs of the recomputation stay alive until it runs, which only
+      // costs memory at the peak if they aren't already live there or
+      // persistent.
+      int64 bytes_saved = live.second;
+      Costs::NanoSeconds ready_time(0);
+      const auto& input_props = properties.GetInputProperties(node->name());
+      for (int i = 0; i < node->input_size(); ++i) {
+        const NodeDef* fanin = node_map.GetNode(node->input(i));
+        ready_time = std::max(ready_time, completion_times[fanin]);
+        if (i < input_props.size() && !IsControlInput(node->input(i)) &&
+            !IsPersistent(*fanin) && live_bytes.count(fanin->name()) == 0) {
+          bytes_saved -= CalculateTensorSize(input_props[i]);
+        }
+      }
+      if (bytes_saved <= 0) {
+        continue;
+      }
+      const int64 cost =
+          std::max<int64>(1, (completion_times[node] - ready_time).count());
+      candidates.push_back({node->name(), bytes_saved, cost});
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) {
+                const double a_score = static_cast<double>(a.bytes_saved) *
+                                       static_cast<double>(b.cost);
+                const double b_score = static_cast<double>(b.bytes_saved) *
+                                       static_cast<double>(a.cost);
+                return a_score > b_score ||
+                       (a_score == b_score && a.node < b.node);
+              });
+    for (const Candidate& candidate : candidates) {
+      if (required_savings <= 0) {
+        break;
+      }
+      if ((recomputation_time + candidate.cost) * 3 > step_time) {
+        continue;
+      }
+      recomputation_time += candidate.cost;
+      required_savings -= candidate.bytes_saved;
+      to_recompute.insert(candidate.node);
+    }
+  }
+  if (to_recompute.empty()) return false;
+
+  const GraphDef original_graph = item->graph;
+  if (!TopologicalSort(&item->graph).ok()) return false;
+  NodeMap sorted_node_map(&item->graph);
+  std::vector<RecomputedSubGraph> recomputed_subgraphs = GetOpGroupsToRecompute(
+      &item->graph, sorted_node_map,
+      [&to_recompute](const NodeDef& node) {
+        return to_recompute.count(node.name()) > 0;
+      },
+      is_target);
+  RecomputeSubgraphs(recomputed_subgraphs, sorted_node_map, &item->graph);
+
+  std::unique_ptr<GraphMemory> new_memory(new GraphMemory(*item));
+  s = new_memory->InferStatically(cluster->GetDevices());
+  const int64 peak_after =
+      s.ok() ? PeakMemoryUsage(cluster, *new_memory) : -1;
+  if (peak_after < 0 || peak_after >= peak_before) {
+    VLOG(1) << "Cost-based recomputation doesn't reduce the peak memory usage ("
+            << peak_before << " bytes), reverting it";
+    item->graph = original_graph;
+    return false;
+  }
+  VLOG(1) << "Recomputing " << to_recompute.size() << " nodes for about "
+          << recomputation_time << "ns, peak memory usage: " << peak_before
+          << " -> " << peak_after << " bytes";
+  *memory_ptr = std::move(new_memory);
+  return true;
+}
+
 Status BuildSwapPair(NodeDef* node, int input_to_swap,
                      const std::unordered_map<string, const NodeDef*>& name_map,
                      GraphDef* graph,
@@ -978,7 +1410,8 @@ struct MemInfo {
 };
 
 static bool IdentifySwappingCandidates(
-    Cluster* cluster, GrapplerItem* item,
+    Cluster* cluster, const std::shared_ptr<const OpCostDatabase>& op_costs,
+    GrapplerItem* item,
     std::unique_ptr<GraphMemory>* memory_ptr,
     std::unordered_set<string>* skip_list,
     std::unordered_map<NodeDef*, SwapInfo>* nodes_to_swap) {
@@ -1013,7 +1446,10 @@ static bool IdentifySwappingCandidates(
 
     std::unordered_map<string, Costs::NanoSeconds> op_completion_times;
     {
-      VirtualCluster vcluster(cluster->GetDevices());
+      auto node_estimator = absl::make_unique<OpLevelCostEstimator>();
+      node_estimator->set_op_cost_database(op_costs);
+      VirtualCluster vcluster(cluster->GetDevices(), std::move(node_estimator),
+                              ReadyNodeManagerFactory("FirstReady"));
       if (!vcluster.Provision().ok()) {
         return false;
       }
@@ -1147,14 +1583,16 @@ static bool IdentifySwappingCandidates(
 }
 
 bool SwappingPass(RewriterConfig::MemOptType optimization_level,
-                  Cluster* cluster, std::unique_ptr<GraphMemory>* memory,
-                  GrapplerItem* item, std::unordered_set<string>* skip_list) {
+                  Cluster* cluster,
+                  const std::shared_ptr<const OpCostDatabase>& op_costs,
+                  std::unique_ptr<GraphMemory>* memory, GrapplerItem* item,
+                  std::unordered_set<string>* skip_list) {
   std::unordered_map<NodeDef*, SwapInfo> nodes_to_swap;
   if (optimization_level == RewriterConfig::DEFAULT_MEM_OPT ||
       optimization_level == RewriterConfig::SWAPPING_HEURISTICS ||
       optimization_level == RewriterConfig::HEURISTICS) {
     // Use heuristics to figure out what needs to be swapped;
-    IdentifySwappingCandidates(cluster, item, memory, skip_list,
+    IdentifySwappingCandidates(cluster, op_costs, item, memory, skip_list,
                                &nodes_to_swap);
   }
   // Look for manual annotations in the graph.
@@ -1201,7 +1639,9 @@ bool SwappingPass(RewriterConfig::MemOptType optimization_level,
   }
 
   std::unordered_map<const NodeDef*, Costs::NanoSeconds> execution_times;
-  if (!EstimateEarliestExecutionTimes(*item, cluster, &execution_times).ok()) {
+  if (!EstimateEarliestExecutionTimes(*item, cluster, op_costs,
+                                      &execution_times)
+           .ok()) {
     return false;
   }
 
@@ -1407,6 +1847,15 @@ Status MemoryOptimizer::Optimize(Cluster* cluster, const GrapplerItem& item,
   // infer the memory usage, so skip optimization if there are no fetches.
   std::unique_ptr<GraphMemory> memory;
   if (!item.fetch.empty() && cluster != nullptr) {
+    // Recompute the activations that free the most memory for their cost.
+    GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
+    if (optimization_level_ == RewriterConfig::RECOMPUTATION_HEURISTICS ||
+        optimization_level_ == RewriterConfig::HEURISTICS) {
+      CostBasedRecomputationPass(recomputation_targets_name_scope_, cluster,
+                                 op_costs_, cpu_memory_budget_, &memory,
+                                 &optimized_item);
+    }
+
     bool updated_graph = true;
     for (int i = 0; i < 25 && updated_graph; ++i) {
       GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
@@ -1428,14 +1877,21 @@ Status MemoryOptimizer::Optimize(Cluster* cluster, const GrapplerItem& item,
            optimization_level_ == RewriterConfig::HEURISTICS ||
            optimization_level_ == RewriterConfig::MANUAL) &&
           cluster != nullptr) {
-        if (SwappingPass(optimization_level_, cluster, &memory, &optimized_item,
-                         &skip_list)) {
+        if (SwappingPass(optimization_level_, cluster, op_costs_, &memory,
+                         &optimized_item, &skip_list)) {
           // Reset the inferred memory usage since the graph changed.
           memory.reset();
           updated_graph = true;
         }
       }
     }
+
+    // Reorder the remaining computations to lower the peak memory usage.
+    GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
+    if (optimization_level_ == RewriterConfig::SCHEDULING_HEURISTICS ||
+        optimization_level_ == RewriterConfig::HEURISTICS) {
+      MemoryAwareOrderingPass(cluster, op_costs_, &memory, &optimized_item);
+    }
   }
 
   optimized_graph->Swap(&optimized_item.graph);
@@ -17,7 +17,10 @@ limitations under the License.
 #define TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_MEMORY_OPTIMIZER_H_
 
 #include <string>
+#include <memory>
+
 #include "tensorflow/core/grappler/clusters/cluster.h"
+#include "tensorflow/core/grappler/costs/op_cost_database.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/optimizers/graph_optimizer.h"
 #include "tensorflow/core/protobuf/rewriter_config.pb.h"
@@ -40,6 +43,18 @@ class MemoryOptimizer : public GraphOptimizer {
         recomputation_targets_name_scope_(recomputation_targets_name_scope) {}
   ~MemoryOptimizer() override {}
 
+  // Sets the measured op costs that take precedence over the analytical
+  // estimates when deciding what to recompute, swap or reorder.
+  void set_op_cost_database(std::shared_ptr<const OpCostDatabase> op_costs) {
+    op_costs_ = std::move(op_costs);
+  }
+
+  // Sets the memory in bytes available on CPU devices when deciding what to
+  // recompute. See RewriterConfig::memory_optimizer_cpu_memory_budget.
+  void set_cpu_memory_budget(int64 cpu_memory_budget) {
+    cpu_memory_budget_ = cpu_memory_budget;
+  }
+
   string name() const override { return "memory_optimizer"; };
 
   bool UsesFunctionLibrary() const override { return false; }
@@ -53,6 +68,8 @@ class MemoryOptimizer : public GraphOptimizer {
  private:
   RewriterConfig::MemOptType optimization_level_;
   string recomputation_targets_name_scope_;
+  std::shared_ptr<const OpCostDatabase> op_costs_;
+  int64 cpu_memory_budget_ = 0;
 };
 
 }  // end namespace grappler
@@ -26,10 +26,12 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/grappler/clusters/virtual_cluster.h"
+#include "tensorflow/core/grappler/costs/graph_memory.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/utils.h"
 #include "tensorflow/core/grappler/utils/grappler_test.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/protobuf/device_properties.pb.h"
 
@@ -448,6 +450,135 @@ TEST_F(MemoryOptimizerTest, AccumulationRewrites) {
   }
 }
 
+TEST_F(MemoryOptimizerTest, MemoryAwareOrdering) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  // `late` is ready from the start, but only needed at the end: computing it
+  // early keeps it alive while the large temporaries y1, y2 and y3 are.
+  Output v = ops::Variable(s.WithOpName("v").WithDevice("/cpu:0"), {64, 128},
+                           DT_FLOAT);
+  Output late = ops::Square(s.WithOpName("late").WithDevice("/cpu:0"), v);
+  Output x = ops::Variable(s.WithOpName("x").WithDevice("/cpu:0"), {128, 128},
+                           DT_FLOAT);
+  Output y1 = ops::Square(s.WithOpName("y1").WithDevice("/cpu:0"), x);
+  Output y2 = ops::Square(s.WithOpName("y2").WithDevice("/cpu:0"), y1);
+  Output y3 = ops::Square(s.WithOpName("y3").WithDevice("/cpu:0"), y2);
+  Output w =
+      ops::Variable(s.WithOpName("w").WithDevice("/cpu:0"), {1, 128}, DT_FLOAT);
+  Output r = ops::MatMul(s.WithOpName("r").WithDevice("/cpu:0"), w, y3);
+  Output out = ops::Add(s.WithOpName("out").WithDevice("/cpu:0"), late, r);
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"out"};
+
+  std::unique_ptr<VirtualCluster> cluster(CreateVirtualCluster());
+  GraphMemory memory_before(item);
+  TF_EXPECT_OK(memory_before.InferStatically(cluster->GetDevices()));
+
+  MemoryOptimizer optimizer(RewriterConfig::SCHEDULING_HEURISTICS);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(cluster.get(), item, &output));
+
+  // `late` now waits for the end of the chain of temporaries.
+  NodeMap node_map(&output);
+  const NodeDef* new_late = node_map.GetNode("late");
+  ASSERT_NE(new_late, nullptr);
+  ASSERT_EQ(2, new_late->input_size());
+  EXPECT_EQ("v", new_late->input(0));
+  EXPECT_EQ("^y3", new_late->input(1));
+
+  GrapplerItem optimized = item.WithGraph(std::move(output));
+  GraphMemory memory_after(optimized);
+  TF_EXPECT_OK(memory_after.InferStatically(cluster->GetDevices()));
+  const string cpu = "/job:localhost/replica:0/task:0/cpu:0";
+  EXPECT_LT(memory_after.GetPeakMemoryUsage(cpu).used_memory,
+            memory_before.GetPeakMemoryUsage(cpu).used_memory);
+}
+
+TEST_F(MemoryOptimizerTest, CostBasedRecomputation) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice("/cpu:0");
+  // Maximum isn't one of the ops that are recomputed based on their type, so
+  // only the cost model can pick the activations to recompute.
+  Output x = ops::Variable(s.WithOpName("x"), {256, 256}, DT_FLOAT);
+  Output zero = ops::Const(s.WithOpName("zero"), 0.0f);
+  Output h1 = ops::Maximum(s.WithOpName("h1"), x, zero);
+  Output h2 = ops::Maximum(s.WithOpName("h2"), h1, zero);
+  Output h3 = ops::Maximum(s.WithOpName("h3"), h2, zero);
+  Output h4 = ops::Maximum(s.WithOpName("h4"), h3, zero);
+  Output g4 = ops::Mul(s.WithOpName("gradients/g4"), h4, h3);
+  Output g3 = ops::Mul(s.WithOpName("gradients/g3"), g4, h2);
+  Output g2 = ops::Mul(s.WithOpName("gradients/g2"), g3, h1);
+  Output g1 = ops::Mul(s.WithOpName("gradients/g1"), g2, x);
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"gradients/g1"};
+
+  std::unique_ptr<VirtualCluster> cluster(CreateVirtualCluster());
+  GraphMemory memory_before(item);
+  TF_EXPECT_OK(memory_before.InferStatically(cluster->GetDevices()));
+
+  MemoryOptimizer optimizer(RewriterConfig::RECOMPUTATION_HEURISTICS);
+  optimizer.set_cpu_memory_budget(1024 * 1024);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(cluster.get(), item, &output));
+
+  // h1 and h2 are recomputed once the backward pass reaches them. h3 and h4
+  // are consumed by the first gradient, so recomputing them wouldn't help.
+  NodeMap node_map(&output);
+  const NodeDef* new_g3 = node_map.GetNode("gradients/g3");
+  ASSERT_NE(new_g3, nullptr);
+  EXPECT_EQ("Recomputed/h2", new_g3->input(1));
+  const NodeDef* new_g2 = node_map.GetNode("gradients/g2");
+  ASSERT_NE(new_g2, nullptr);
+  EXPECT_EQ("Recomputed/h1", new_g2->input(1));
+  const NodeDef* recomputed_h2 = node_map.GetNode("Recomputed/h2");
+  ASSERT_NE(recomputed_h2, nullptr);
+  EXPECT_EQ("Recomputed/h1", recomputed_h2->input(0));
+  EXPECT_EQ(nullptr, node_map.GetNode("Recomputed/h3"));
+  EXPECT_EQ(nullptr, node_map.GetNode("Recomputed/h4"));
+
+  GrapplerItem optimized = item.WithGraph(std::move(output));
+  GraphMemory memory_after(optimized);
+  TF_EXPECT_OK(memory_after.InferStatically(cluster->GetDevices()));
+  const string cpu = "/job:localhost/replica:0/task:0/cpu:0";
+  EXPECT_LT(memory_after.GetPeakMemoryUsage(cpu).used_memory,
+            memory_before.GetPeakMemoryUsage(cpu).used_memory);
+}
+
+TEST_F(MemoryOptimizerTest, CostBasedRecomputationCpuMemoryBudget) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice("/cpu:0");
+  Output x = ops::Variable(s.WithOpName("x"), {256, 256}, DT_FLOAT);
+  Output zero = ops::Const(s.WithOpName("zero"), 0.0f);
+  Output h1 = ops::Maximum(s.WithOpName("h1"), x, zero);
+  Output h2 = ops::Maximum(s.WithOpName("h2"), h1, zero);
+  Output h3 = ops::Maximum(s.WithOpName("h3"), h2, zero);
+  Output h4 = ops::Maximum(s.WithOpName("h4"), h3, zero);
+  Output g4 = ops::Mul(s.WithOpName("gradients/g4"), h4, h3);
+  Output g3 = ops::Mul(s.WithOpName("gradients/g3"), g4, h2);
+  Output g2 = ops::Mul(s.WithOpName("gradients/g2"), g3, h1);
+  Output g1 = ops::Mul(s.WithOpName("gradients/g1"), g2, x);
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"gradients/g1"};
+
+  // As in CostBasedRecomputation, the peak memory usage exceeds 80% of the
+  // nominal 1 MiB of the CPU device, but not of the free RAM or of a larger
+  // budget.
+  std::unique_ptr<VirtualCluster> cluster(CreateVirtualCluster());
+  for (int64 budget : {int64{0}, int64{1} << 30}) {
+    MemoryOptimizer optimizer(RewriterConfig::RECOMPUTATION_HEURISTICS);
+    optimizer.set_cpu_memory_budget(budget);
+    GraphDef output;
+    TF_EXPECT_OK(optimizer.Optimize(cluster.get(), item, &output));
+    for (const NodeDef& node : output.node()) {
+      EXPECT_FALSE(str_util::StartsWith(node.name(), "Recomputed/"))
+          << "Budget " << budget << " recomputed " << node.name();
+    }
+  }
+}
+
 class RelaxAllocatorConstraintsTest : public GrapplerTest {};
 
 TEST_F(RelaxAllocatorConstraintsTest, SameDevice) {
@@ -26,6 +26,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor_util.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/grappler/clusters/virtual_cluster.h"
+#include "tensorflow/core/grappler/costs/op_cost_database.h"
 #include "tensorflow/core/grappler/optimizers/arithmetic_optimizer.h"
 #include "tensorflow/core/grappler/optimizers/auto_mixed_precision.h"
 #include "tensorflow/core/grappler/optimizers/auto_parallel.h"
@@ -36,6 +37,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/dependency_optimizer.h"
 #include "tensorflow/core/grappler/optimizers/function_optimizer.h"
 #include "tensorflow/core/grappler/optimizers/generic_layout_optimizer.h"
+#include "tensorflow/core/grappler/optimizers/horizontal_fusion.h"
 #include "tensorflow/core/grappler/optimizers/implementation_selector.h"
 #include "tensorflow/core/grappler/optimizers/loop_optimizer.h"
 #include "tensorflow/core/grappler/optimizers/memory_optimizer.h"
@@ -50,8 +52,16 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils/topological_sort.h"
 #include "tensorflow/core/grappler/utils/tpu.h"
 #include "tensorflow/core/grappler/verifiers/structure_verifier.h"
+#include "tensorflow/core/lib/core/blocking_counter.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/gtl/map_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/public/version.h"
 #include "tensorflow/core/util/dump_graph.h"
 #include "tensorflow/core/util/ptr_util.h"
 #include "tensorflow/core/util/xla_config_registry.h"
@@ -167,6 +177,126 @@ bool MemoryOptimizerEnabled(
   return mem_opt_type != RewriterConfig::NO_MEM_OPT;
 }
 
+// Returns the names of the functions called by the nodes of `func`, either
+// directly or through function attributes.
+absl::flat_hash_set<string> CalledFunctions(const FunctionDef& func) {
+  absl::flat_hash_set<string> called;
+  for (const NodeDef& node : func.node_def()) {
+    called.insert(node.op());
+    for (const auto& attr : node.attr()) {
+      const AttrValue& value = attr.second;
+      if (value.has_func()) called.insert(value.func().name());
+      for (const NameAttrList& list_func : value.list().func()) {
+        called.insert(list_func.name());
+      }
+    }
+  }
+  return called;
+}
+
+// Returns the path of the optimized graph for `item` in the optimization
+// cache in `cache_dir`. The file name is a fingerprint of everything the
+// result depends on: the input graph and its function library, the nodes to
+// preserve, the feed shapes, the available devices, the session config, the
+// measured op costs and the TensorFlow build.
+string OptimizationCachePath(const string& cache_dir, const GrapplerItem& item,
+                             const Cluster* cluster,
+                             const ConfigProto& config_proto,
+                             const OpCostDatabase* op_costs) {
+  string graph_bytes;
+  SerializeToStringDeterministic(item.graph, &graph_bytes);
+  const Fprint128 graph_fingerprint = Fingerprint128(graph_bytes);
+  graph_bytes.clear();
+
+  string config_bytes;
+  SerializeToStringDeterministic(config_proto, &config_bytes);
+
+  const auto sorted = [](std::vector<string> values) {
+    std::sort(values.begin(), values.end());
+    return absl::StrJoin(values, ",");
+  };
+  const std::unordered_set<string> preserve = item.NodesToPreserve();
+  std::vector<string> feeds;
+  for (const auto& feed : item.feed) {
+    feeds.push_back(strings::StrCat(feed.first, ":",
+                                    DataTypeString(feed.second.dtype()),
+                                    feed.second.shape().DebugString()));
+  }
+  std::vector<string> devices(item.devices().begin(), item.devices().end());
+  if (cluster != nullptr) {
+    for (const string& device : cluster->GetDeviceNames()) {
+      devices.push_back(device);
+    }
+  }
+  const GrapplerItem::OptimizationOptions& options =
+      item.optimization_options();
+  // The decisions based on costs change with the measured op costs.
+  const string signature = strings::StrCat(
+      sorted({preserve.begin(), preserve.end()}), ";", sorted(feeds), ";",
+      sorted(devices), ";", options.allow_non_differentiable_rewrites,
+      options.allow_pruning_stateful_and_dataset_ops,
+      options.optimize_function_library, options.is_eager_mode, ";",
+      config_bytes, ";", op_costs != nullptr ? op_costs->Fingerprint() : 0,
+      ";", TF_VERSION_STRING, ";", tf_git_version(), ";",
+      tf_compiler_version());
+  const Fprint128 signature_fingerprint = Fingerprint128(signature);
+
+  return io::JoinPath(
+      cache_dir,
+      strings::StrCat(
+          "grappler_",
+          strings::Hex(FingerprintCat64(graph_fingerprint.high64,
+                                        signature_fingerprint.high64),
+                       strings::kZeroPad16),
+          strings::Hex(FingerprintCat64(graph_fingerprint.low64,
+                                        signature_fingerprint.low64),
+                       strings::kZeroPad16),
+          ".pb"));
+}
+
+// Reads the optimized graph at `path` from the optimization cache. Returns
+// false if there is no usable entry.
+bool ReadOptimizedGraphFromCache(const string& path, GraphDef* graph) {
+  Env* env = Env::Default();
+  if (!env->FileExists(path).ok()) return false;
+  const Status status = ReadBinaryProto(env, path, graph);
+  if (!status.ok()) {
+    LOG(WARNING) << "Ignoring unreadable Grappler cache entry " << path << ": "
+                 << status;
+    graph->Clear();
+    return false;
+  }
+  return true;
+}
+
+// Stores `graph` at `path` in the optimization cache. The graph is written to
+// a temporary file first, so that concurrent readers never see a partially
+// written entry. Failures only disable caching.
+void WriteOptimizedGraphToCache(const string& path, const GraphDef& graph) {
+  Env* env = Env::Default();
+  Status status = env->RecursivelyCreateDir(string(io::Dirname(path)));
+  string temp_path = path;
+  if (status.ok() && !env->CreateUniqueFileName(&temp_path, ".tmp")) {
+    status = errors::Internal("Failed to create a temporary file name");
+  }
+  if (status.ok()) status = WriteBinaryProto(env, temp_path, graph);
+  if (status.ok()) status = env->RenameFile(temp_path, path);
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to write Grappler cache entry " << path << ": "
+                 << status;
+    env->DeleteFile(temp_path).IgnoreError();
+  }
+}
+
+// The threads on which library functions are optimized in parallel, shared by
+// all meta-optimizers so that they don't start threads for every graph.
+thread::ThreadPool* FunctionOptimizationThreadPool() {
+  static thread::ThreadPool* const thread_pool = new thread::ThreadPool(
+      Env::Default(), "meta_optimizer_functions",
+      std::max(1, port::MaxParallelism()));
+  return thread_pool;
+}
+
 }  // namespace
 
 #define MK_OPT(NAME, VALUE) \
@@ -183,7 +313,9 @@ std::unique_ptr<GraphOptimizer> MetaOptimizer::MakeNewOptimizer(
   MK_OPT("function", new FunctionOptimizer(
                          cfg_.function_optimization(),
                          /*lower_control_flow=*/!IsSingleThreadedExecutor()));
-  MK_OPT("constfold", new ConstantFolding(cpu_device_));
+  MK_OPT("constfold",
+         new ConstantFolding(RewriterConfig::ON, cpu_device_,
+                             cfg_.constant_folding_large_constants_dir()));
   MK_OPT("shape", new ShapeOptimizer());
   MK_OPT("remap", new Remapper(cfg_.remapping()));
   MK_OPT("layout", new GenericLayoutOptimizer());
@@ -191,10 +323,17 @@ std::unique_ptr<GraphOptimizer> MetaOptimizer::MakeNewOptimizer(
          new AutoMixedPrecision(AutoMixedPrecisionMode::CUDA));
   MK_OPT("auto_mixed_precision_mkl",
          new AutoMixedPrecision(AutoMixedPrecisionMode::MKL));
-  MK_OPT("memory", new MemoryOptimizer(RewriterConfig::MANUAL));
+  if (optimizer == "memory") {
+    auto memory_optimizer = MakeUnique<MemoryOptimizer>(RewriterConfig::MANUAL);
+    memory_optimizer->set_op_cost_database(op_cost_database_);
+    memory_optimizer->set_cpu_memory_budget(
+        cfg_.memory_optimizer_cpu_memory_budget());
+    return std::move(memory_optimizer);
+  }
   MK_OPT("common_subgraph_elimination",
          new CommonSubgraphElimination(cfg_.common_subgraph_elimination()));
   MK_OPT("arithmetic", new ArithmeticOptimizer(cfg_.arithmetic_optimization()));
+  MK_OPT("horizontal_fusion", new HorizontalFusion());
   MK_OPT("autoparallel", new AutoParallel(cfg_.auto_parallel().num_replicas()));
   MK_OPT("loop", new LoopOptimizer(cfg_.loop_optimization(), cpu_device_));
   MK_OPT("dependency", new DependencyOptimizer(cfg_.dependency_optimization()));
@@ -216,6 +355,17 @@ MetaOptimizer::MetaOptimizer(DeviceBase* cpu_device, const ConfigProto& cfg)
       cfg_(*config_proto_.mutable_graph_options()->mutable_rewrite_options()) {
   DCHECK(cpu_device_ == nullptr ||
          cpu_device_->attributes().device_type() == "CPU");
+  if (!cfg_.op_cost_database().empty()) {
+    auto op_cost_database = std::make_shared<OpCostDatabase>();
+    Status s = op_cost_database->Load(cfg_.op_cost_database());
+    if (s.ok()) {
+      VLOG(1) << "Loaded the measured costs of " << op_cost_database->num_ops()
+              << " ops from " << cfg_.op_cost_database();
+      op_cost_database_ = std::move(op_cost_database);
+    } else {
+      LOG(WARNING) << "Failed to load the op cost database: " << s;
+    }
+  }
 }
 
 Status MetaOptimizer::InitializeOptimizers(
@@ -243,8 +393,9 @@ Status MetaOptimizer::InitializeOptimizers(
     optimizers->push_back(MakeUnique<DebugStripper>());
   }
   if (cfg_.constant_folding() != RewriterConfig::OFF) {
-    optimizers->push_back(
-        MakeUnique<ConstantFolding>(cfg_.constant_folding(), cpu_device_));
+    optimizers->push_back(MakeUnique<ConstantFolding>(
+        cfg_.constant_folding(), cpu_device_,
+        cfg_.constant_folding_large_constants_dir()));
   }
   if (cfg_.shape_optimization() != RewriterConfig::OFF) {
     optimizers->push_back(MakeUnique<ShapeOptimizer>());
@@ -264,6 +415,10 @@ Status MetaOptimizer::InitializeOptimizers(
     optimizers->push_back(
         MakeUnique<ArithmeticOptimizer>(cfg_.arithmetic_optimization()));
   }
+  if (cfg_.horizontal_fusion() == RewriterConfig::ON) {
+    // Runs before the remapper, which fuses the MatMul layers.
+    optimizers->push_back(MakeUnique<HorizontalFusion>());
+  }
   if (cfg_.layout_optimizer() != RewriterConfig::OFF) {
     optimizers->push_back(MakeUnique<GenericLayoutOptimizer>());
   }
@@ -281,15 +436,20 @@ Status MetaOptimizer::InitializeOptimizers(
   auto global_jit_level =
       config_proto_.graph_options().optimizer_options().global_jit_level();
   if (MemoryOptimizerEnabled(cfg_.memory_optimization(), global_jit_level)) {
+    std::unique_ptr<MemoryOptimizer> memory_optimizer;
     if (cfg_.memory_optimizer_target_node_name_scope().empty()) {
-      optimizers->push_back(
+      memory_optimizer =
           // Use the default target node name prefix "gradients/"
-          MakeUnique<MemoryOptimizer>(cfg_.memory_optimization()));
+          MakeUnique<MemoryOptimizer>(cfg_.memory_optimization());
     } else {
-      optimizers->push_back(MakeUnique<MemoryOptimizer>(
+      memory_optimizer = MakeUnique<MemoryOptimizer>(
           cfg_.memory_optimization(),
-          cfg_.memory_optimizer_target_node_name_scope()));
+          cfg_.memory_optimizer_target_node_name_scope());
     }
+    memory_optimizer->set_op_cost_database(op_cost_database_);
+    memory_optimizer->set_cpu_memory_budget(
+        cfg_.memory_optimizer_cpu_memory_budget());
+    optimizers->push_back(std::move(memory_optimizer));
   }
   if (cfg_.auto_parallel().enable()) {
     optimizers->push_back(
@@ -521,7 +681,10 @@ Status MetaOptimizer::OptimizeGraph(Cluster* cluster, GrapplerItem&& item,
                                    }) != optimization_result.results.end();
 
   // Record graph optimization result.
-  optimization_results_.push_back(optimization_result);
+  {
+    mutex_lock lock(optimization_results_mu_);
+    optimization_results_.push_back(optimization_result);
+  }
 
   if (is_optimized) {
     TF_RETURN_IF_ERROR(TopologicalSort(optimized_graph));
@@ -600,10 +763,96 @@ Status MetaOptimizer::RunOptimizer(
   return Status::OK();
 }
 
+bool MetaOptimizer::CanOptimizeFunctionsInParallel() const {
+  if (cfg_.parallel_function_optimization() != RewriterConfig::ON) {
+    return false;
+  }
+  if (!cfg_.custom_optimizers().empty()) return false;
+  for (const string& optimizer_name : cfg_.optimizers()) {
+    if (MakeNewOptimizer(optimizer_name) == nullptr) return false;
+  }
+  return true;
+}
+
+Status MetaOptimizer::OptimizeFunction(
+    Cluster* cluster, const FunctionDef& func,
+    const FunctionLibraryDefinition& flib, int producer,
+    bool allow_non_differentiable_rewrites, bool is_tpu_graph,
+    GrapplerFunctionItem* func_item, GraphDef* optimized_func_graph) {
+  // Make a GrapplerItem from a FunctionDef.
+  TF_RETURN_IF_ERROR(MakeGrapplerFunctionItem(func, flib, producer, func_item));
+
+  // If we need to compute the gradient of optimized function at runtime, we
+  // can't perform non-differentiable rewrites.
+  func_item->optimization_options().allow_non_differentiable_rewrites =
+      allow_non_differentiable_rewrites;
+
+  // Device set available to the function is defined only by the runtime,
+  // when we instantiate and execute the function. We can't use all devices
+  // available to the main graph, because after partitioning the function
+  // call node might execute on a remote worker.
+  if (!func_item->devices().empty()) {
+    return errors::Internal("GrapplerFunctionItem devices must be empty.");
+  }
+
+  // We are not allowed to prune certain types of ops from the graph
+  // instantiated by the function definition, because we must guarantee
+  // function execution semantics wrt side effects (see
+  // function_optimizer.cc).
+  func_item->optimization_options().allow_pruning_stateful_and_dataset_ops =
+      false;
+
+  // Optimize function body graph.
+  if (is_tpu_graph) {
+    // Skip optimizing functions if this is a TPU graph. Currently, Grappler
+    // passes do not handle TPU functions correctly in a variety of ways
+    // (Note that due to the pre-placement TPU graph rewriting passes, the
+    // TPU-related ops are encapsulated away into functions). For example,
+    // TPU graphs contain TPUReplicateMetadata node that carries relevant
+    // TPU metadata and Grappler passes could prune that away. Grappler
+    // passes could also cause issues around shape inference. Since the
+    // desired and existing behavior is to not optimize TPU functions with
+    // Grappler, this check preserves that. The only exception is
+    // implementation selector what is required to swap in some TPU specific
+    // lowering code and is verified the work correctly on TPUs.
+    ImplementationSelector implementation_selector;
+
+    // Implementation selector needs to have access to valid function
+    // signature and attributes, and it doesn't need actual function body.
+    FunctionDefLibrary func_item_function_library;
+    func_item_function_library.Swap(func_item->graph.mutable_library());
+    *func_item->graph.mutable_library() =
+        GetFunctionDefLibraryStub(func_item_function_library);
+
+    return implementation_selector.Optimize(cluster, *func_item,
+                                            optimized_func_graph);
+  }
+  GrapplerFunctionItem func_item_copy = *func_item;
+  return OptimizeGraph(cluster, std::move(func_item_copy),
+                       optimized_func_graph);
+}
+
 Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
                                           GraphDef* optimized_graph) {
   VLOG(1) << "Starting optimization for grappler item: " << item.id;
-  optimization_results_.clear();
+  {
+    mutex_lock lock(optimization_results_mu_);
+    optimization_results_.clear();
+  }
+
+  // Reuse the result of an identical optimization, possibly from an earlier
+  // process, if the optimization cache is enabled.
+  string cache_path;
+  if (!cfg_.meta_optimizer_cache_dir().empty()) {
+    cache_path = OptimizationCachePath(cfg_.meta_optimizer_cache_dir(), item,
+                                       cluster, config_proto_,
+                                       op_cost_database_.get());
+    if (ReadOptimizedGraphFromCache(cache_path, optimized_graph)) {
+      VLOG(1) << "Loaded optimized graph for grappler item " << item.id
+              << " from " << cache_path;
+      return Status::OK();
+    }
+  }
 
   // Constructs a FunctionLibraryDefinition with functions that are reachable
   // from the nodes of the graph.
@@ -685,13 +934,14 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
 
   // Optimize each function only once.
   absl::flat_hash_set<string> optimized_funcs;
+  const bool is_tpu_graph = IsTPUGraphDef(*optimized_graph);
+  const bool parallel = CanOptimizeFunctionsInParallel();
   while (optimize_function_library) {
     optimize_function_library = false;
 
-    int function_idx = 0;
+    // Collect the functions that are optimized in this pass.
+    std::vector<const FunctionDef*> funcs;
     for (const FunctionDef& func : optimized_graph->library().function()) {
-      GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
-
       const string& func_name = func.signature().name();
 
       // Skip functions that are not reachable from the optimized graph.
@@ -710,87 +960,104 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
       // Skip tf.data functions as they are optimized by tf.data meta optimizer.
       if (IsTFDataFunction(func)) continue;
 
-      VLOG(3) << "Optimize function: function=" << func_name << " ["
-              << function_idx++ << " of "
-              << optimized_graph->library().function_size() << "]";
-
       // Function optimization might specialize nested function calls, so we
       // have to reset the flag and do at least one more pass over the library.
       optimize_function_library = true;
       optimized_funcs.insert(func_name);
+      funcs.push_back(&func);
+    }
 
-      // Make a GrapplerItem from a FunctionDef.
-      GrapplerFunctionItem func_item;
-      TF_RETURN_IF_ERROR(
-          MakeGrapplerFunctionItem(func, flib, producer, &func_item));
-
-      // If we need to compute the gradient of optimized function at runtime, we
-      // can't perform non-differentiable rewrites.
-      func_item.optimization_options().allow_non_differentiable_rewrites =
-          !differentiable_functions.contains(func_name);
-
-      // Device set available to the function is defined only by the runtime,
-      // when we instantiate and execute the function. We can't use all devices
-      // available to the main graph, because after partitioning the function
-      // call node might execute on a remote worker.
-      if (!func_item.devices().empty()) {
-        return errors::Internal("GrapplerFunctionItem devices must be empty.");
+    // Functions are optimized in waves of functions that do not call each
+    // other, callees first, so that callers see the optimized bodies of their
+    // callees. The functions of a wave may be optimized in parallel.
+    std::vector<std::vector<int>> callees(funcs.size());
+    {
+      absl::flat_hash_map<string, int> func_index;
+      for (int i = 0; i < funcs.size(); ++i) {
+        func_index[funcs[i]->signature().name()] = i;
+      }
+      for (int i = 0; i < funcs.size(); ++i) {
+        for (const string& callee : CalledFunctions(*funcs[i])) {
+          const int* callee_index = gtl::FindOrNull(func_index, callee);
+          if (callee_index != nullptr && *callee_index != i) {
+            callees[i].push_back(*callee_index);
+          }
+        }
       }
+    }
 
-      // We are not allowed to prune certain types of ops from the graph
-      // instantiated by the function definition, because we must guarantee
-      // function execution semantics wrt side effects (see
-      // function_optimizer.cc).
-      func_item.optimization_options().allow_pruning_stateful_and_dataset_ops =
-          false;
-
-      // Optimize function body graph.
-      GraphDef optimized_func_graph;
-      if (IsTPUGraphDef(*optimized_graph)) {
-        // Skip optimizing functions if this is a TPU graph. Currently, Grappler
-        // passes do not handle TPU functions correctly in a variety of ways
-        // (Note that due to the pre-placement TPU graph rewriting passes, the
-        // TPU-related ops are encapsulated away into functions). For example,
-        // TPU graphs contain TPUReplicateMetadata node that carries relevant
-        // TPU metadata and Grappler passes could prune that away. Grappler
-        // passes could also cause issues around shape inference. Since the
-        // desired and existing behavior is to not optimize TPU functions with
-        // Grappler, this check preserves that. The only exception is
-        // implementation selector what is required to swap in some TPU specific
-        // lowering code and is verified the work correctly on TPUs.
-        ImplementationSelector implementation_selector;
-
-        // Implementation selector needs to have access to valid function
-        // signature and attributes, and it doesn't need actual function body.
-        FunctionDefLibrary func_item_function_library;
-        func_item_function_library.Swap(func_item.graph.mutable_library());
-        *func_item.graph.mutable_library() =
-            GetFunctionDefLibraryStub(func_item_function_library);
-
-        TF_RETURN_IF_ERROR(implementation_selector.Optimize(
-            cluster, func_item, &optimized_func_graph));
-      } else {
-        GrapplerFunctionItem func_item_copy = func_item;
-        TF_RETURN_IF_ERROR(OptimizeGraph(cluster, std::move(func_item_copy),
-                                         &optimized_func_graph));
+    std::vector<bool> done(funcs.size(), false);
+    int num_done = 0;
+    while (num_done < funcs.size()) {
+      GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
+
+      std::vector<int> wave;
+      for (int i = 0; i < funcs.size(); ++i) {
+        if (done[i]) continue;
+        if (std::all_of(callees[i].begin(), callees[i].end(),
+                        [&](int callee) { return done[callee]; })) {
+          wave.push_back(i);
+        }
+      }
+      // Mutually recursive functions are optimized together.
+      if (wave.empty()) {
+        for (int i = 0; i < funcs.size(); ++i) {
+          if (!done[i]) wave.push_back(i);
+        }
       }
 
-      // Function body optimization might have created new specialized
-      // functions for each instantiation context. Add them to the library.
-      for (const FunctionDef& func_def :
-           optimized_func_graph.library().function()) {
-        if (flib.Find(func_def.signature().name()) == nullptr) {
-          TF_RETURN_IF_ERROR(flib.AddFunctionDef(func_def));
+      std::vector<GrapplerFunctionItem> func_items(wave.size());
+      std::vector<GraphDef> optimized_func_graphs(wave.size());
+      std::vector<Status> statuses(wave.size());
+      const auto optimize_function = [&](int i) {
+        const FunctionDef& func = *funcs[wave[i]];
+        VLOG(3) << "Optimize function: function=" << func.signature().name()
+                << " [" << num_done + i << " of " << funcs.size() << "]";
+        statuses[i] = OptimizeFunction(
+            cluster, func, flib, producer,
+            !differentiable_functions.contains(func.signature().name()),
+            is_tpu_graph, &func_items[i], &optimized_func_graphs[i]);
+      };
+      if (!parallel || wave.size() == 1) {
+        for (int i = 0; i < wave.size(); ++i) optimize_function(i);
+      } else {
+        BlockingCounter counter(wave.size());
+        for (int i = 0; i < wave.size(); ++i) {
+          FunctionOptimizationThreadPool()->Schedule([&, i]() {
+            optimize_function(i);
+            counter.DecrementCount();
+          });
         }
+        counter.Wait();
       }
 
-      // Convert optimized graph back to FunctionDef.
-      FunctionDef optimized_func;
-      func_item.SwapFunctionBody(std::move(optimized_func_graph));
-      TF_RETURN_IF_ERROR(MakeFunctionDef(func_item, flib, &optimized_func));
+      // Update the library in the order of the functions in the graph, so the
+      // result does not depend on the order in which the optimizations
+      // finished.
+      for (int i = 0; i < wave.size(); ++i) {
+        TF_RETURN_IF_ERROR(statuses[i]);
+        const string& func_name = funcs[wave[i]]->signature().name();
+
+        // Function body optimization might have created new specialized
+        // functions for each instantiation context. Add them to the library.
+        for (const FunctionDef& func_def :
+             optimized_func_graphs[i].library().function()) {
+          if (flib.Find(func_def.signature().name()) == nullptr) {
+            TF_RETURN_IF_ERROR(flib.AddFunctionDef(func_def));
+          }
+        }
+
+        // Convert optimized graph back to FunctionDef.
+        FunctionDef optimized_func;
+        func_items[i].SwapFunctionBody(std::move(optimized_func_graphs[i]));
+        TF_RETURN_IF_ERROR(
+            MakeFunctionDef(func_items[i], flib, &optimized_func));
 
-      // Replace optimized function with a new FunctionDef.
-      TF_RETURN_IF_ERROR(flib.ReplaceFunction(func_name, optimized_func));
+        // Replace optimized function with a new FunctionDef.
+        TF_RETURN_IF_ERROR(flib.ReplaceFunction(func_name, optimized_func));
+        done[wave[i]] = true;
+      }
+      num_done += wave.size();
     }
 
     // If optimized at least one function, update the graph library.
@@ -808,10 +1075,14 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
                         reinterpret_cast<uintptr_t>(optimized_graph)),
         *optimized_graph);
   }
+  if (!cache_path.empty()) {
+    WriteOptimizedGraphToCache(cache_path, *optimized_graph);
+  }
   return Status::OK();
 }
 
 void MetaOptimizer::PrintResult() {
+  mutex_lock lock(optimization_results_mu_);
   for (const GraphOptimizationResult& graph_result : optimization_results_) {
     LOG(INFO) << "Optimization results for grappler item: " << graph_result.id;
     for (const OptimizerResult& result : graph_result.results) {
@@ -840,6 +1111,7 @@ bool MetaOptimizerEnabled(const ConfigProto& cfg) {
          rewrite_cfg.debug_stripper() == RewriterConfig::ON ||
          rewrite_cfg.scoped_allocator_optimization() == RewriterConfig::ON ||
          rewrite_cfg.pin_to_host_optimization() == RewriterConfig::ON ||
+         rewrite_cfg.horizontal_fusion() == RewriterConfig::ON ||
          AutoMixedPrecisionEnabled(rewrite_cfg.auto_mixed_precision()) ||
          AutoMixedPrecisionEnabled(rewrite_cfg.auto_mixed_precision_mkl()) ||
          !rewrite_cfg.optimizers().empty() ||
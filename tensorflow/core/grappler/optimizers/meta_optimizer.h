@@ -20,10 +20,13 @@ limitations under the License.
 #include "tensorflow/core/framework/device_base.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/grappler/costs/op_cost_database.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/optimizers/graph_optimizer.h"
+#include "tensorflow/core/grappler/utils/functions.h"
 #include "tensorflow/core/grappler/verifiers/graph_verifier.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/protobuf/config.pb.h"
 #include "tensorflow/core/protobuf/rewriter_config.pb.h"
 #include "tensorflow/core/protobuf/verifier_config.pb.h"
@@ -86,9 +89,26 @@ class MetaOptimizer : public GraphOptimizer {
   Status OptimizeGraph(Cluster* cluster, GrapplerItem&& item,
                        GraphDef* optimized_graph);
 
+  // Returns true if the bodies of library functions may be optimized
+  // concurrently: only the built-in optimizers are known to be thread safe.
+  bool CanOptimizeFunctionsInParallel() const;
+
+  // Optimizes the body of the function `func` from the library `flib`.
+  // `func_item` is set to the item of the function, and `optimized_func_graph`
+  // to its optimized body. Functions can be optimized concurrently if
+  // CanOptimizeFunctionsInParallel().
+  Status OptimizeFunction(Cluster* cluster, const FunctionDef& func,
+                          const FunctionLibraryDefinition& flib, int producer,
+                          bool allow_non_differentiable_rewrites,
+                          bool is_tpu_graph, GrapplerFunctionItem* func_item,
+                          GraphDef* optimized_func_graph);
+
   DeviceBase* const cpu_device_;  // may be NULL
   ConfigProto config_proto_;
   RewriterConfig& cfg_;
+  // The measured op costs loaded from RewriterConfig::op_cost_database, if
+  // any. Passed to the optimizers that estimate costs.
+  std::shared_ptr<const OpCostDatabase> op_cost_database_;
 
   struct OptimizerResult {
     string optimizer_name;
@@ -106,7 +126,9 @@ class MetaOptimizer : public GraphOptimizer {
                       GrapplerItem* optimized_item, GraphDef* optimized_graph,
                       GraphOptimizationResult* optimization_result);
 
-  std::vector<GraphOptimizationResult> optimization_results_;
+  mutex optimization_results_mu_;
+  std::vector<GraphOptimizationResult> optimization_results_
+      TF_GUARDED_BY(optimization_results_mu_);
 };
 
 bool MetaOptimizerEnabled(const ConfigProto& cfg);
@@ -29,6 +29,9 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils/grappler_test.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/gtl/map_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/protobuf.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/protobuf/config.pb.h"
@@ -90,14 +93,27 @@ class TestOptimizerWithParams : public TestOptimizer {
 REGISTER_GRAPH_OPTIMIZER(TestOptimizerWithParams);
 
 // Record various properties of the GrapplerItems passed for optimization.
+// Function bodies can be optimized concurrently.
 class GrapplerItemPropertiesAccumulator : public CustomGraphOptimizer {
  public:
   static void SetOptimizationOptions(
       gtl::FlatMap<string, GrapplerItem::OptimizationOptions>*
           optimization_options) {
+    mutex_lock lock(mu_);
     optimization_options_ = optimization_options;
   }
-  static void ResetOptimizationOptions() { optimization_options_ = nullptr; }
+  static void ResetOptimizationOptions() {
+    mutex_lock lock(mu_);
+    optimization_options_ = nullptr;
+  }
+  static void SetOptimizedItemIds(std::vector<string>* optimized_item_ids) {
+    mutex_lock lock(mu_);
+    optimized_item_ids_ = optimized_item_ids;
+  }
+  static void SetOptimizingThreadIds(std::set<int32>* thread_ids) {
+    mutex_lock lock(mu_);
+    optimizing_thread_ids_ = thread_ids;
+  }
 
   GrapplerItemPropertiesAccumulator() {}
   string name() const override {
@@ -113,9 +129,16 @@ class GrapplerItemPropertiesAccumulator : public CustomGraphOptimizer {
   Status Optimize(Cluster* cluster, const GrapplerItem& item,
                   GraphDef* optimized_graph) override {
     *optimized_graph = item.graph;
+    mutex_lock lock(mu_);
     if (optimization_options_) {
       optimization_options_->insert({item.id, item.optimization_options()});
     }
+    if (optimized_item_ids_) {
+      optimized_item_ids_->push_back(item.id);
+    }
+    if (optimizing_thread_ids_) {
+      optimizing_thread_ids_->insert(Env::Default()->GetCurrentThreadId());
+    }
     return Status::OK();
   }
 
@@ -123,12 +146,18 @@ class GrapplerItemPropertiesAccumulator : public CustomGraphOptimizer {
                 const GraphDef& optimized_graph, double result) override {}
 
  private:
+  static mutex mu_;
   static gtl::FlatMap<string, GrapplerItem::OptimizationOptions>*
       optimization_options_;
+  static std::vector<string>* optimized_item_ids_;
+  static std::set<int32>* optimizing_thread_ids_;
 };
 
+mutex GrapplerItemPropertiesAccumulator::mu_(LINKER_INITIALIZED);
 gtl::FlatMap<string, GrapplerItem::OptimizationOptions>*
     GrapplerItemPropertiesAccumulator::optimization_options_;
+std::vector<string>* GrapplerItemPropertiesAccumulator::optimized_item_ids_;
+std::set<int32>* GrapplerItemPropertiesAccumulator::optimizing_thread_ids_;
 
 REGISTER_GRAPH_OPTIMIZER(GrapplerItemPropertiesAccumulator);
 
@@ -153,6 +182,40 @@ TEST_F(MetaOptimizerTest, RunsCustomOptimizer) {
   EXPECT_TRUE(TestOptimizer::IsOptimized());
 }
 
+TEST_F(MetaOptimizerTest, ReusesCachedOptimizedGraph) {
+  TrivialTestGraphInputYielder fake_input(4, 1, 10, false, {"CPU:0"});
+  GrapplerItem item;
+  ASSERT_TRUE(fake_input.NextItem(&item));
+
+  ConfigProto config_proto;
+  auto& rewriter_config =
+      *config_proto.mutable_graph_options()->mutable_rewrite_options();
+  rewriter_config.add_optimizers("TestOptimizer");
+  rewriter_config.set_min_graph_nodes(-1);
+  rewriter_config.set_meta_optimizer_cache_dir(io::JoinPath(
+      testing::TmpDir(),
+      strings::StrCat("grappler_cache_", Env::Default()->NowMicros())));
+
+  TestOptimizer::SetOptimized(false);
+  GraphDef output;
+  MetaOptimizer optimizer(nullptr, config_proto);
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+  EXPECT_TRUE(TestOptimizer::IsOptimized());
+
+  // An identical item is not optimized again.
+  TestOptimizer::SetOptimized(false);
+  GraphDef cached_output;
+  MetaOptimizer cached_optimizer(nullptr, config_proto);
+  TF_EXPECT_OK(cached_optimizer.Optimize(nullptr, item, &cached_output));
+  EXPECT_FALSE(TestOptimizer::IsOptimized());
+  CompareGraphs(output, cached_output);
+
+  // An item with different fetches is.
+  item.fetch.push_back(item.graph.node(0).name());
+  TF_EXPECT_OK(cached_optimizer.Optimize(nullptr, item, &cached_output));
+  EXPECT_TRUE(TestOptimizer::IsOptimized());
+}
+
 TEST_F(MetaOptimizerTest, RunsCustomOptimizerWithParams) {
   TrivialTestGraphInputYielder fake_input(4, 1, 10, false, {"CPU:0"});
   GrapplerItem item;
@@ -682,6 +745,137 @@ TEST_F(MetaOptimizerTest, OptimizeFunctionLibraryWithRestrictions) {
       optimization_options_my_mul_2->allow_non_differentiable_rewrites);
 }
 
+TEST_F(MetaOptimizerTest, OptimizeFunctionLibraryCalleesFirst) {
+  using test::function::NDef;
+
+  std::vector<string> optimized_item_ids;
+  GrapplerItemPropertiesAccumulator::SetOptimizedItemIds(&optimized_item_ids);
+
+  ConfigProto config_proto;
+  auto& rewriter_config =
+      *config_proto.mutable_graph_options()->mutable_rewrite_options();
+  rewriter_config.add_optimizers("GrapplerItemPropertiesAccumulator");
+  rewriter_config.set_min_graph_nodes(-1);
+
+  MetaOptimizer optimizer(nullptr, config_proto);
+
+  // MyOuter calls MyMul1 and MyMul2, which are independent of each other.
+  FunctionDef mul_func_1 = FunctionDefHelper::Create(
+      "MyMul1", {"x:float", "y:float"}, {"z:float"}, {},
+      {{{"mul"}, "Mul", {"x", "y"}, {{"T", DT_FLOAT}}}},
+      /*ret_def=*/
+      {{"z", "mul:z:0"}});
+
+  FunctionDef mul_func_2 = FunctionDefHelper::Create(
+      "MyMul2", {"x:float", "y:float"}, {"z:float"}, {},
+      {{{"mul"}, "Mul", {"x", "y"}, {{"T", DT_FLOAT}}}},
+      /*ret_def=*/
+      {{"z", "mul:z:0"}});
+
+  FunctionDef outer_func = FunctionDefHelper::Create(
+      "MyOuter", {"x:float", "y:float"}, {"z:float"}, {},
+      {{{"mul_1"}, "MyMul1", {"x", "y"}, {}},
+       {{"mul_2"}, "MyMul2", {"x", "y"}, {}},
+       {{"add"}, "Add", {"mul_1:z:0", "mul_2:z:0"}, {{"T", DT_FLOAT}}}},
+      /*ret_def=*/
+      {{"z", "add:z:0"}});
+
+  GrapplerItem item;
+  item.id = "main";
+  item.graph = test::function::GDef(
+      {NDef("x0", "Placeholder", {}, {{"dtype", DT_FLOAT}}, kDevice),
+       NDef("x1", "Placeholder", {}, {{"dtype", DT_FLOAT}}, kDevice),
+       NDef("outer", "MyOuter", {"x0", "x1"}, {}, kDevice)},
+      /*funcs=*/
+      {outer_func, mul_func_1, mul_func_2});
+  item.fetch = {"outer"};
+
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+  GrapplerItemPropertiesAccumulator::SetOptimizedItemIds(nullptr);
+
+  // The main graph is optimized first, and the callees before their caller.
+  ASSERT_EQ(optimized_item_ids.size(), 4);
+  EXPECT_EQ(optimized_item_ids[0], "main");
+  EXPECT_EQ(optimized_item_ids[3], "MyOuter");
+  EXPECT_EQ(output.library().function_size(), 3);
+}
+
+// Returns a graph calling the independent functions MyMul<i> for i < n.
+GrapplerItem IndependentFunctionsItem(int n) {
+  using test::function::NDef;
+
+  std::vector<NodeDef> nodes = {
+      NDef("x0", "Placeholder", {}, {{"dtype", DT_FLOAT}}, kDevice),
+      NDef("x1", "Placeholder", {}, {{"dtype", DT_FLOAT}}, kDevice)};
+  std::vector<FunctionDef> funcs;
+  GrapplerItem item;
+  item.id = "main";
+  for (int i = 0; i < n; ++i) {
+    const string func_name = strings::StrCat("MyMul", i);
+    funcs.push_back(FunctionDefHelper::Create(
+        func_name, {"x:float", "y:float"}, {"z:float"}, {},
+        {{{"mul"}, "Mul", {"x", "y"}, {{"T", DT_FLOAT}}},
+         {{"identity"}, "Identity", {"mul:z:0"}, {{"T", DT_FLOAT}}}},
+        /*ret_def=*/
+        {{"z", "identity:output:0"}}));
+    const string node_name = strings::StrCat("mul_", i);
+    nodes.push_back(NDef(node_name, func_name, {"x0", "x1"}, {}, kDevice));
+    item.fetch.push_back(node_name);
+  }
+  item.graph = test::function::GDef(nodes, funcs);
+  return item;
+}
+
+TEST_F(MetaOptimizerTest, OptimizeFunctionLibraryInParallel) {
+  GrapplerItem item = IndependentFunctionsItem(8);
+
+  GraphDef outputs[2];
+  for (bool parallel : {false, true}) {
+    ConfigProto config_proto;
+    auto& rewriter_config =
+        *config_proto.mutable_graph_options()->mutable_rewrite_options();
+    rewriter_config.set_min_graph_nodes(-1);
+    rewriter_config.set_parallel_function_optimization(
+        parallel ? RewriterConfig::ON : RewriterConfig::OFF);
+    MetaOptimizer optimizer(nullptr, config_proto);
+    TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &outputs[parallel]));
+  }
+
+  // The library is the same whether its functions were optimized in
+  // parallel or not.
+  CompareGraphs(outputs[0], outputs[1]);
+  ASSERT_EQ(outputs[0].library().function_size(),
+            outputs[1].library().function_size());
+  for (int i = 0; i < outputs[0].library().function_size(); ++i) {
+    CompareFunctions(outputs[0].library().function(i),
+                     outputs[1].library().function(i));
+  }
+}
+
+TEST_F(MetaOptimizerTest, CustomOptimizersOptimizeFunctionsSerially) {
+  GrapplerItem item = IndependentFunctionsItem(8);
+
+  std::set<int32> thread_ids;
+  GrapplerItemPropertiesAccumulator::SetOptimizingThreadIds(&thread_ids);
+
+  ConfigProto config_proto;
+  auto& rewriter_config =
+      *config_proto.mutable_graph_options()->mutable_rewrite_options();
+  rewriter_config.add_optimizers("GrapplerItemPropertiesAccumulator");
+  rewriter_config.set_min_graph_nodes(-1);
+  rewriter_config.set_parallel_function_optimization(RewriterConfig::ON);
+
+  MetaOptimizer optimizer(nullptr, config_proto);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+  GrapplerItemPropertiesAccumulator::SetOptimizingThreadIds(nullptr);
+
+  // Custom optimizers need not be thread safe, so all functions are
+  // optimized on the calling thread.
+  EXPECT_EQ(thread_ids, std::set<int32>{Env::Default()->GetCurrentThreadId()});
+}
+
 class SleepingOptimizer : public CustomGraphOptimizer {
  public:
   SleepingOptimizer() {}
@@ -60,6 +60,7 @@ static Costs::NanoSeconds PredictExecutionTime(
 
 Status EstimateEarliestExecutionTimes(
     const GrapplerItem& item, const Cluster* cluster,
+    const std::shared_ptr<const OpCostDatabase>& op_costs,
     std::unordered_map<const NodeDef*, Costs::NanoSeconds>* completion_times) {
   std::unordered_map<string, const NodeDef*> name_map;
   std::unordered_map<const NodeDef*, int> pending_inputs;
@@ -99,6 +100,7 @@ Status EstimateEarliestExecutionTimes(
                                  /*aggressive_shape_inference=*/false,
                                  /*include_tensor_values=*/false));
   OpLevelCostEstimator estimator;
+  estimator.set_op_cost_database(op_costs);
   VirtualPlacer placer(cluster->GetDevices());
 
   while (!ready_nodes.empty()) {
@@ -132,6 +134,7 @@ Status EstimateEarliestExecutionTimes(
 
 Status EstimateRequiredTimes(
     const GrapplerItem& item, const Cluster* cluster,
+    const std::shared_ptr<const OpCostDatabase>& op_costs,
     const std::unordered_map<const NodeDef*, Costs::NanoSeconds>&
         execution_times,
     std::unordered_map<const NodeDef*, Costs::NanoSeconds>* required_times) {
@@ -170,6 +173,7 @@ Status EstimateRequiredTimes(
                                  /*aggressive_shape_inference=*/false,
                                  /*include_tensor_values=*/false));
   OpLevelCostEstimator estimator;
+  estimator.set_op_cost_database(op_costs);
   VirtualPlacer placer(cluster->GetDevices());
 
   while (!ready_nodes.empty()) {
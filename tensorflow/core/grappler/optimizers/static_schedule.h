@@ -16,11 +16,13 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_STATIC_SCHEDULE_H_
 #define TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_STATIC_SCHEDULE_H_
 
+#include <memory>
 #include <unordered_map>
 
 #include "tensorflow/core/framework/node_def.pb.h"
 #include "tensorflow/core/grappler/clusters/cluster.h"
 #include "tensorflow/core/grappler/costs/cost_estimator.h"
+#include "tensorflow/core/grappler/costs/op_cost_database.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 
 namespace tensorflow {
@@ -31,8 +33,11 @@ namespace grappler {
 // In our estimation, we ensure that each node takes at least one nanosecond to
 // execute: therefore the execution times can be used to derive a topological
 // ordering of the graph (at least as long as there is no loop in the graph).
+// The measured costs in `op_costs`, if not null, take precedence over the
+// analytical estimates.
 Status EstimateEarliestExecutionTimes(
     const GrapplerItem& item, const Cluster* cluster,
+    const std::shared_ptr<const OpCostDatabase>& op_costs,
     std::unordered_map<const NodeDef*, Costs::NanoSeconds>* execution_times);
 
 // Compute the time by which the execution of each node must complete to ensure
@@ -40,6 +45,7 @@ Status EstimateEarliestExecutionTimes(
 // EstimateEarliestExecutionTimes function.
 Status EstimateRequiredTimes(
     const GrapplerItem& item, const Cluster* cluster,
+    const std::shared_ptr<const OpCostDatabase>& op_costs,
     const std::unordered_map<const NodeDef*, Costs::NanoSeconds>&
         execution_times,
     std::unordered_map<const NodeDef*, Costs::NanoSeconds>* required_times);
@@ -92,7 +92,8 @@ TEST_F(StaticScheduleTest, BasicGraph) {
 
   std::unordered_map<const NodeDef*, Costs::NanoSeconds> completion_times;
   Status status =
-      EstimateEarliestExecutionTimes(item, cluster.get(), &completion_times);
+      EstimateEarliestExecutionTimes(item, cluster.get(), nullptr,
+                                     &completion_times);
   TF_EXPECT_OK(status);
 
   EXPECT_EQ(item.graph.node_size(), completion_times.size());
@@ -137,7 +138,8 @@ TEST_F(StaticScheduleTest, BasicGraphWithCtrlDependencies) {
 
   std::unordered_map<const NodeDef*, Costs::NanoSeconds> completion_times;
   Status status =
-      EstimateEarliestExecutionTimes(item, cluster.get(), &completion_times);
+      EstimateEarliestExecutionTimes(item, cluster.get(), nullptr,
+                                     &completion_times);
   TF_EXPECT_OK(status);
 
   EXPECT_EQ(item.graph.node_size(), completion_times.size());
@@ -172,8 +174,8 @@ TEST_F(StaticScheduleTest, RequiredTimes) {
     execution_times[&node] = 0;
   }
   std::unordered_map<const NodeDef*, Costs::NanoSeconds> required_times;
-  Status status = EstimateRequiredTimes(item, cluster.get(), execution_times,
-                                        &required_times);
+  Status status = EstimateRequiredTimes(item, cluster.get(), nullptr,
+                                        execution_times, &required_times);
   TF_EXPECT_OK(status);
 
   EXPECT_EQ(item.graph.node_size(), required_times.size());
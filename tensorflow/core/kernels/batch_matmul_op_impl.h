@@ -20,6 +20,8 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
+#include <type_traits>
 #include <vector>
 
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
@@ -213,6 +215,125 @@ struct SequentialMatMulKernel {
   }
 };
 
+// Computes the m x N row-major product c = a * b of the m x k row-major matrix
+// `a` and the k x N row-major matrix `b`. A row of the result is accumulated
+// in registers; with N known at compile time, the inner loop is fully unrolled
+// and vectorized.
+template <typename Scalar, int N>
+void SmallGemmRowMajor(const Scalar* a, const Scalar* b, Scalar* c, int64 m,
+                       int64 k) {
+  for (int64 i = 0; i < m; ++i) {
+    Scalar acc[N] = {};
+    const Scalar* a_row = a + i * k;
+    for (int64 p = 0; p < k; ++p) {
+      const Scalar a_ip = a_row[p];
+      const Scalar* b_row = b + p * N;
+      for (int j = 0; j < N; ++j) acc[j] += a_ip * b_row[j];
+    }
+    std::copy_n(acc, N, c + i * N);
+  }
+}
+
+// Batch matmul kernel for many small real matrices. The per-call overhead of
+// the Eigen products dominates at these sizes, so the products use the
+// micro-kernels above, specialized on the number of output columns.
+// Transposed operands are packed to row-major once per distinct batch index,
+// so a broadcast operand is packed once per shard.
+template <typename Scalar,
+          bool IsSupported = std::is_same<Scalar, float>::value ||
+                             std::is_same<Scalar, double>::value>
+struct SmallMatMulKernel {
+  // Products larger than this are left to the Eigen kernels.
+  static constexpr int64 kMaxCost = 64 * 64 * 64;
+
+  static bool CanRun(int64 m, int64 k, int64 n) {
+    return (n == 4 || n == 8 || n == 16 || n == 32 || n == 64) && k > 0 &&
+           m * k * n <= kMaxCost;
+  }
+
+  static void Run(const Tensor& in_x, const Tensor& in_y, bool adj_x,
+                  bool adj_y, bool trans_x, bool trans_y,
+                  const MatMulBCast& bcast, Tensor* out, int start, int limit) {
+    const int64 m = out->dim_size(1);
+    const int64 n = out->dim_size(2);
+    const bool transpose_x = adj_x || trans_x;
+    const bool transpose_y = adj_y || trans_y;
+    const int64 k = in_x.dim_size(transpose_x ? 1 : 2);
+    switch (n) {
+#define HANDLE_COLS(N)                                                     \
+  case N:                                                                  \
+    return RunImpl<N>(in_x, in_y, transpose_x, transpose_y, bcast, out, m, \
+                      k, start, limit);
+      HANDLE_COLS(4)
+      HANDLE_COLS(8)
+      HANDLE_COLS(16)
+      HANDLE_COLS(32)
+      HANDLE_COLS(64)
+#undef HANDLE_COLS
+      default:
+        LOG(FATAL) << "Unsupported number of columns: " << n;
+    }
+  }
+
+ private:
+  // Copies the transpose of the rows x cols row-major matrix `src` to `dst`.
+  static void PackTransposed(const Scalar* src, int64 rows, int64 cols,
+                             Scalar* dst) {
+    for (int64 i = 0; i < rows; ++i) {
+      for (int64 j = 0; j < cols; ++j) dst[j * rows + i] = src[i * cols + j];
+    }
+  }
+
+  template <int N>
+  static void RunImpl(const Tensor& in_x, const Tensor& in_y, bool transpose_x,
+                      bool transpose_y, const MatMulBCast& bcast, Tensor* out,
+                      int64 m, int64 k, int start, int limit) {
+    const Scalar* x_data = in_x.flat<Scalar>().data();
+    const Scalar* y_data = in_y.flat<Scalar>().data();
+    Scalar* z_data = out->flat<Scalar>().data();
+    const bool should_bcast = bcast.IsBroadcastingRequired();
+    const auto& x_batch_indices = bcast.x_batch_indices();
+    const auto& y_batch_indices = bcast.y_batch_indices();
+
+    std::vector<Scalar> x_packed(transpose_x ? m * k : 0);
+    std::vector<Scalar> y_packed(transpose_y ? k * N : 0);
+    int64 x_packed_index = -1;
+    int64 y_packed_index = -1;
+    for (int64 i = start; i < limit; ++i) {
+      const int64 x_batch_index = should_bcast ? x_batch_indices[i] : i;
+      const int64 y_batch_index = should_bcast ? y_batch_indices[i] : i;
+      const Scalar* x = x_data + x_batch_index * m * k;
+      const Scalar* y = y_data + y_batch_index * k * N;
+      if (transpose_x) {
+        if (x_batch_index != x_packed_index) {
+          PackTransposed(x, k, m, x_packed.data());
+          x_packed_index = x_batch_index;
+        }
+        x = x_packed.data();
+      }
+      if (transpose_y) {
+        if (y_batch_index != y_packed_index) {
+          PackTransposed(y, N, k, y_packed.data());
+          y_packed_index = y_batch_index;
+        }
+        y = y_packed.data();
+      }
+      SmallGemmRowMajor<Scalar, N>(x, y, z_data + i * m * N, m, k);
+    }
+  }
+};
+
+// Other types always use the Eigen kernels.
+template <typename Scalar>
+struct SmallMatMulKernel<Scalar, false> {
+  static bool CanRun(int64 m, int64 k, int64 n) { return false; }
+
+  static void Run(const Tensor& in_x, const Tensor& in_y, bool adj_x,
+                  bool adj_y, bool trans_x, bool trans_y,
+                  const MatMulBCast& bcast, Tensor* out, int start, int limit) {
+  }
+};
+
 }  // namespace
 
 template <typename Device, typename Scalar>
@@ -248,13 +369,22 @@ struct LaunchBatchMatMul<CPUDevice, Scalar> {
     } else {
       // Parallelize over outer dims. For small matrices and large batches, it
       // is counter-productive to parallelize the inner matrix multiplies.
+      const bool use_small_kernel = SmallMatMulKernel<Scalar>::CanRun(
+          out->dim_size(1), in_x.dim_size(adj_x || trans_x ? 1 : 2),
+          out->dim_size(2));
       Shard(worker_threads.num_threads, worker_threads.workers, batch_size,
             cost_per_unit,
-            [&in_x, &in_y, adj_x, adj_y, trans_x, trans_y, &bcast, out](
-                int start, int limit) {
-              SequentialMatMulKernel<Scalar>::Run(in_x, in_y, adj_x, adj_y,
-                                                  trans_x, trans_y, bcast, out,
-                                                  start, limit);
+            [&in_x, &in_y, adj_x, adj_y, trans_x, trans_y, &bcast, out,
+             use_small_kernel](int start, int limit) {
+              if (use_small_kernel) {
+                SmallMatMulKernel<Scalar>::Run(in_x, in_y, adj_x, adj_y,
+                                               trans_x, trans_y, bcast, out,
+                                               start, limit);
+              } else {
+                SequentialMatMulKernel<Scalar>::Run(in_x, in_y, adj_x, adj_y,
+                                                    trans_x, trans_y, bcast,
+                                                    out, start, limit);
+              }
             });
     }
     if (conjugate_result) {
@@ -168,6 +168,15 @@ BM_BatchMatmulBCast(1, 128, 1024, 1024, 1024, false);
 BM_BatchMatmulBCast(128, 1, 1024, 1024, 1024, true);
 BM_BatchMatmulBCast(128, 1, 1024, 1024, 1024, false);
 
+// Many small matrices, e.g. attention blocks per head.
+BM_BatchMatmul(256, 32, 32, 32, false, false);
+BM_BatchMatmul(256, 32, 32, 32, false, true);
+BM_BatchMatmul(256, 32, 32, 32, true, false);
+BM_BatchMatmul(1024, 16, 64, 16, false, false);
+BM_BatchMatmul(1024, 64, 16, 64, false, true);
+BM_BatchMatmulBCast(1024, 1, 16, 64, 16, true);
+BM_BatchMatmulBCast(1024, 1, 16, 64, 16, false);
+
 // Matrix-vector multiplies.
 BM_BatchMatmulBCast(1, 128, 10000, 200, 1, true);
 BM_BatchMatmulBCast(1, 128, 10000, 200, 1, false);
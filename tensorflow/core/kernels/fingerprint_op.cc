@@ -14,12 +14,14 @@ limitations under the License.
 ==============================================================================*/
 #include <cstddef>
 #include <string>
+#include <vector>
 
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/kernels/string_hash_util.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/platform/byte_order.h"
 #include "tensorflow/core/platform/fingerprint.h"
@@ -52,14 +54,17 @@ void FarmhashFingerprint64(TTypes<uint8, 2>::ConstTensor input,
   }
 }
 
-void FarmhashFingerprint64(TTypes<tstring>::ConstFlat input,
+void FarmhashFingerprint64(const DeviceBase::CpuWorkerThreads& worker_threads,
+                           TTypes<tstring>::ConstFlat input,
                            TTypes<uint8, 2>::Matrix output) {
   DCHECK_EQ(output.dimension(0), input.dimension(0));
   DCHECK_EQ(output.dimension(1), sizeof(uint64));
+  std::vector<uint64> fingerprints(input.dimension(0));
+  HashStrings(worker_threads, input.data(), input.dimension(0),
+              [](StringPiece s) { return Fingerprint64(s); },
+              fingerprints.data());
   for (int64 i = 0; i < input.dimension(0); ++i) {
-    const uint64 fingerprint =
-        Fingerprint64({input(i).data(), input(i).size()});
-    CopyToBuffer(fingerprint, &output(i, 0));
+    CopyToBuffer(fingerprints[i], &output(i, 0));
   }
 }
 
@@ -99,6 +104,8 @@ class FingerprintOp : public OpKernel {
                        0, TensorShape{dim0, kFingerprintSize}, &output));
 
     if (input.dtype() == DT_STRING) {
+      const auto& worker_threads =
+          *context->device()->tensorflow_cpu_worker_threads();
       if (dim1 > 1) {
         Tensor temp;
         OP_REQUIRES_OK(context, context->allocate_temp(
@@ -110,14 +117,16 @@ class FingerprintOp : public OpKernel {
         // and each row contains the fingerprint value of corresponding string.
         // To compute fingerprints of multiple strings, this op fingerprints the
         // buffer containing the string fingerprints.
-        FarmhashFingerprint64(input.flat<tstring>(), temp.tensor<uint8, 2>());
+        FarmhashFingerprint64(worker_threads, input.flat<tstring>(),
+                              temp.tensor<uint8, 2>());
         FarmhashFingerprint64(static_cast<const Tensor&>(temp).shaped<uint8, 2>(
                                   {dim0, dim1 * kFingerprintSize}),
                               output->matrix<uint8>());
       } else {
         // In case dim1 == 1, each string computes into its own fingerprint
         // value. There is no need to fingerprint twice.
-        FarmhashFingerprint64(input.flat<tstring>(), output->matrix<uint8>());
+        FarmhashFingerprint64(worker_threads, input.flat<tstring>(),
+                              output->matrix<uint8>());
       }
     } else {
       auto data = input.bit_casted_shaped<uint8, 2>(
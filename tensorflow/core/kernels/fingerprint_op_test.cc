@@ -182,6 +182,33 @@ TEST_F(FingerprintOpTest, CompareBytesAndString) {
             strings_fingerprints.tensor_data());
 }
 
+// Many strings are hashed in groups and across threads; the results must not
+// depend on that.
+TEST_F(FingerprintOpTest, CompareBytesAndManyStrings) {
+  Tensor pods_tensor(DT_UINT8, {10000, 24});
+  Tensor strings_tensor(DT_STRING, {10000});
+
+  auto pods = pods_tensor.matrix<uint8>();
+  pods.setRandom();
+
+  auto strings = strings_tensor.vec<tstring>();
+  for (int64 i = 0; i < strings.size(); ++i) {
+    strings(i).assign(reinterpret_cast<const char*>(&pods(i, 0)),
+                      pods.dimension(1));
+  }
+
+  TF_ASSERT_OK(MakeFingerprintOp(&pods_tensor));
+  TF_ASSERT_OK(RunOpKernel());
+  Tensor pods_fingerprints = *GetOutput(0);
+
+  TF_ASSERT_OK(MakeFingerprintOp(&strings_tensor));
+  TF_ASSERT_OK(RunOpKernel());
+  Tensor strings_fingerprints = *GetOutput(0);
+
+  EXPECT_EQ(pods_fingerprints.tensor_data(),
+            strings_fingerprints.tensor_data());
+}
+
 TEST_F(FingerprintOpTest, SupportedMethods) {
   Tensor tensor(DT_STRING, TensorShape{1});
   TF_ASSERT_OK(MakeFingerprintOp(&tensor, "unsupported_method"));
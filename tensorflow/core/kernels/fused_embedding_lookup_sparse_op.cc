@@ -0,0 +1,427 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/math_ops.cc.
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "third_party/eigen3/Eigen/Core"
+#include "tensorflow/core/framework/bounds_check.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/prefetch.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace {
+
+enum class Combiner { kSum, kMean, kSqrtN };
+
+Status GetCombiner(OpKernelConstruction* context, Combiner* combiner) {
+  string combiner_str;
+  TF_RETURN_IF_ERROR(context->GetAttr("combiner", &combiner_str));
+  if (combiner_str == "sum") {
+    *combiner = Combiner::kSum;
+  } else if (combiner_str == "mean") {
+    *combiner = Combiner::kMean;
+  } else if (combiner_str == "sqrtn") {
+    *combiner = Combiner::kSqrtN;
+  } else {
+    return errors::InvalidArgument("Unknown combiner: ", combiner_str);
+  }
+  return Status::OK();
+}
+
+// Rows are accumulated in blocks of this many columns, so that the block of
+// the output row being accumulated stays in L1 while the embedding rows of a
+// segment are streamed through it.
+constexpr int64 kColumnBlock = 1024;
+
+// `Accumulate(n, alpha, x, y)` computes `y += alpha * x` on `n` elements. The
+// arrays are mapped as Eigen arrays so that the loop is vectorized.
+template <typename T>
+EIGEN_ALWAYS_INLINE void Accumulate(int64 n, T alpha, const T* x, T* y) {
+  using Array = Eigen::Array<T, Eigen::Dynamic, 1>;
+  Eigen::Map<Array>(y, n) += alpha * Eigen::Map<const Array>(x, n);
+}
+
+template <typename T>
+EIGEN_ALWAYS_INLINE T Dot(int64 n, const T* x, const T* y) {
+  using Vector = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+  return Eigen::Map<const Vector>(x, n).dot(Eigen::Map<const Vector>(y, n));
+}
+
+// Validated inputs shared by the forward and gradient kernels.
+template <typename T, typename Index, typename SegmentId>
+struct EmbeddingLookupSparseInputs {
+  const T* params = nullptr;
+  int64 num_params = 0;
+  int64 row_size = 0;
+  typename TTypes<Index>::ConstVec ids{nullptr, 0};
+  typename TTypes<SegmentId>::ConstVec segment_ids{nullptr, 0};
+  // Empty when all weights are 1.
+  typename TTypes<T>::ConstVec weights{nullptr, 0};
+  bool has_weights = false;
+  int64 num_segments = 0;
+  // The ids of segment `s` are `ids[segment_starts[s]:segment_starts[s + 1]]`.
+  std::vector<int64> segment_starts;
+  // The factor every weight of segment `s` is multiplied with: 1 for "sum",
+  // and the reciprocal of the total weight or of its L2 norm for "mean" and
+  // "sqrtn". Segments without ids get 0, unless they are divided by their
+  // total weight below.
+  std::vector<T> segment_scales;
+  // Whether the weighted sum of segment `s` is divided by a total weight of 0,
+  // for "mean" and "sqrtn" with weights. As in the unfused lookup, which
+  // divides the weighted sum by the total weight, the output is then NaN or
+  // infinite, even for segments without ids.
+  std::vector<bool> zero_total_weight;
+
+  T weight(int64 i) const { return has_weights ? weights(i) : T(1); }
+};
+
+template <typename T, typename Index, typename SegmentId>
+Status ValidateInputs(const Tensor& params, const Tensor& ids,
+                      const Tensor& segment_ids, const Tensor& weights,
+                      Combiner combiner,
+                      EmbeddingLookupSparseInputs<T, Index, SegmentId>* in) {
+  if (!TensorShapeUtils::IsVectorOrHigher(params.shape())) {
+    return errors::InvalidArgument("params must be at least 1 dimensional");
+  }
+  if (!TensorShapeUtils::IsVector(ids.shape())) {
+    return errors::InvalidArgument("ids should be a vector.");
+  }
+  if (!TensorShapeUtils::IsVector(segment_ids.shape())) {
+    return errors::InvalidArgument("segment_ids should be a vector.");
+  }
+  if (!TensorShapeUtils::IsVector(weights.shape())) {
+    return errors::InvalidArgument("weights should be a vector.");
+  }
+  const int64 num_ids = ids.NumElements();
+  if (num_ids != segment_ids.NumElements()) {
+    return errors::InvalidArgument(
+        "segment_ids and ids should have same size.");
+  }
+  in->has_weights = weights.NumElements() > 0;
+  if (in->has_weights && weights.NumElements() != num_ids) {
+    return errors::InvalidArgument(
+        "weights should be empty or have the same size as ids, got ",
+        weights.NumElements(), " and ", num_ids);
+  }
+
+  in->params = params.flat<T>().data();
+  in->num_params = params.dim_size(0);
+  in->row_size = params.NumElements() / std::max<int64>(in->num_params, 1);
+  in->ids = ids.vec<Index>();
+  in->segment_ids = segment_ids.vec<SegmentId>();
+  in->weights = weights.vec<T>();
+
+  // As in SparseSegmentSum, segment ids must be sorted and the number of
+  // output rows is the last segment id plus one.
+  in->num_segments =
+      num_ids > 0 ? internal::SubtleMustCopy(in->segment_ids(num_ids - 1)) + 1
+                  : 0;
+  if (in->num_segments < 0) {
+    return errors::InvalidArgument("segment ids must be >= 0");
+  }
+  in->segment_starts.assign(in->num_segments + 1, num_ids);
+  int64 next_segment = 0;
+  for (int64 i = 0; i < num_ids; ++i) {
+    const Index id = internal::SubtleMustCopy(in->ids(i));
+    if (!FastBoundsCheck(id, in->num_params)) {
+      return errors::InvalidArgument("ids[", i, "] = ", id, " is not in [0, ",
+                                     in->num_params, ")");
+    }
+    const SegmentId segment = internal::SubtleMustCopy(in->segment_ids(i));
+    if (segment < next_segment - 1 ||
+        !FastBoundsCheck(segment, in->num_segments)) {
+      return errors::InvalidArgument(
+          "Segment id ", segment, " out of range [0, ", in->num_segments,
+          "), possibly because 'segment_ids' input is not sorted.");
+    }
+    while (next_segment <= segment) {
+      in->segment_starts[next_segment++] = i;
+    }
+  }
+
+  in->segment_scales.assign(in->num_segments, T(0));
+  in->zero_total_weight.assign(in->num_segments, false);
+  for (int64 s = 0; s < in->num_segments; ++s) {
+    T total(0);
+    for (int64 i = in->segment_starts[s]; i < in->segment_starts[s + 1]; ++i) {
+      const T w = in->weight(i);
+      total += combiner == Combiner::kSqrtN ? w * w : w;
+    }
+    if (combiner == Combiner::kSum) {
+      if (in->segment_starts[s] < in->segment_starts[s + 1]) {
+        in->segment_scales[s] = T(1);
+      }
+    } else if (total != T(0)) {
+      in->segment_scales[s] =
+          T(1) / (combiner == Combiner::kMean ? total
+                                              : Eigen::numext::sqrt(total));
+    } else if (in->has_weights) {
+      in->segment_scales[s] = T(1) / total;
+      in->zero_total_weight[s] = true;
+    }
+  }
+  return Status::OK();
+}
+
+// Looks up rows of `params` and combines them per segment, without
+// materializing the gathered rows.
+template <typename T, typename Index, typename SegmentId>
+class FusedEmbeddingLookupSparseOp : public OpKernel {
+ public:
+  explicit FusedEmbeddingLookupSparseOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, GetCombiner(context, &combiner_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& params = context->input(0);
+    EmbeddingLookupSparseInputs<T, Index, SegmentId> in;
+    OP_REQUIRES_OK(context, (ValidateInputs<T, Index, SegmentId>(
+                                params, context->input(1), context->input(2),
+                                context->input(3), combiner_, &in)));
+
+    TensorShape output_shape = params.shape();
+    output_shape.set_dim(0, in.num_segments);
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &output));
+    if (output->NumElements() == 0) return;
+    T* out_data = output->flat<T>().data();
+    const int64 row_size = in.row_size;
+
+    // Every segment is combined by a single thread, directly into its output
+    // row.
+    auto combine = [&in, out_data, row_size](int64 begin, int64 end) {
+      for (int64 s = begin; s < end; ++s) {
+        T* out_row = out_data + s * row_size;
+        std::fill(out_row, out_row + row_size, T(0));
+        const int64 first = in.segment_starts[s];
+        const int64 last = in.segment_starts[s + 1];
+        const T scale = in.segment_scales[s];
+        if (scale == T(0)) continue;
+        // The weighted sum of a segment with a zero total weight is divided by
+        // 0 as a whole, rather than multiplying each term by 1 / 0.
+        const bool scale_sum = in.zero_total_weight[s];
+        for (int64 col = 0; col < row_size; col += kColumnBlock) {
+          const int64 block = std::min(kColumnBlock, row_size - col);
+          for (int64 i = first; i < last; ++i) {
+            if (i + 1 < last) {
+              port::prefetch<port::PREFETCH_HINT_T0>(
+                  in.params + in.ids(i + 1) * row_size + col);
+            }
+            Accumulate(block, scale_sum ? in.weight(i) : in.weight(i) * scale,
+                       in.params + in.ids(i) * row_size + col, out_row + col);
+          }
+        }
+        if (scale_sum) {
+          for (int64 col = 0; col < row_size; ++col) {
+            out_row[col] /= T(0);
+          }
+        }
+      }
+    };
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    const int64 num_ids = in.ids.size();
+    const int64 cost_per_segment =
+        (num_ids / in.num_segments + 1) * row_size * 2 * sizeof(T);
+    Shard(worker_threads->num_threads, worker_threads->workers,
+          in.num_segments, cost_per_segment, combine);
+  }
+
+ private:
+  Combiner combiner_;
+};
+
+// Computes the gradient of FusedEmbeddingLookupSparse with respect to the
+// rows of `params` that were looked up, one row per unique id, and with
+// respect to the weights.
+template <typename T, typename Index, typename SegmentId>
+class FusedEmbeddingLookupSparseGradOp : public OpKernel {
+ public:
+  explicit FusedEmbeddingLookupSparseGradOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, GetCombiner(context, &combiner_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& grad = context->input(0);
+    const Tensor& params = context->input(1);
+    const Tensor& weights = context->input(4);
+    const Tensor& output = context->input(5);
+    EmbeddingLookupSparseInputs<T, Index, SegmentId> in;
+    OP_REQUIRES_OK(context, (ValidateInputs<T, Index, SegmentId>(
+                                params, context->input(2), context->input(3),
+                                weights, combiner_, &in)));
+    TensorShape output_shape = params.shape();
+    output_shape.set_dim(0, in.num_segments);
+    OP_REQUIRES(context, grad.shape() == output_shape,
+                errors::InvalidArgument("grad must have shape ",
+                                        output_shape.DebugString(), ", got ",
+                                        grad.shape().DebugString()));
+    OP_REQUIRES(context, output.shape() == output_shape,
+                errors::InvalidArgument("output must have shape ",
+                                        output_shape.DebugString(), ", got ",
+                                        output.shape().DebugString()));
+
+    // Assign every id to a unique id, in order of first occurrence, and group
+    // the positions of every unique id.
+    const int64 num_ids = in.ids.size();
+    absl::flat_hash_map<Index, int64> unique_index;
+    unique_index.reserve(num_ids);
+    std::vector<int64> unique_of(num_ids);
+    std::vector<Index> unique_ids;
+    for (int64 i = 0; i < num_ids; ++i) {
+      auto it = unique_index.emplace(in.ids(i), unique_ids.size());
+      if (it.second) unique_ids.push_back(in.ids(i));
+      unique_of[i] = it.first->second;
+    }
+    const int64 num_unique = unique_ids.size();
+    std::vector<int64> unique_starts(num_unique + 1, 0);
+    for (int64 i = 0; i < num_ids; ++i) {
+      ++unique_starts[unique_of[i] + 1];
+    }
+    for (int64 u = 0; u < num_unique; ++u) {
+      unique_starts[u + 1] += unique_starts[u];
+    }
+    std::vector<int64> positions(num_ids);
+    {
+      std::vector<int64> next(unique_starts.begin(), unique_starts.end() - 1);
+      for (int64 i = 0; i < num_ids; ++i) {
+        positions[next[unique_of[i]]++] = i;
+      }
+    }
+
+    Tensor* unique_ids_out = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(
+                                0, TensorShape({num_unique}), &unique_ids_out));
+    std::copy(unique_ids.begin(), unique_ids.end(),
+              unique_ids_out->vec<Index>().data());
+    TensorShape params_grad_shape = params.shape();
+    params_grad_shape.set_dim(0, num_unique);
+    Tensor* params_grad = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(1, params_grad_shape,
+                                                     &params_grad));
+    Tensor* weights_grad = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(2, weights.shape(),
+                                                     &weights_grad));
+
+    const int64 row_size = in.row_size;
+    const T* grad_data = grad.flat<T>().data();
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+
+    // The gradient row of every unique id is accumulated by a single thread
+    // from the gradients of the segments it occurs in.
+    T* params_grad_data = params_grad->flat<T>().data();
+    auto accumulate = [&](int64 begin, int64 end) {
+      for (int64 u = begin; u < end; ++u) {
+        T* out_row = params_grad_data + u * row_size;
+        std::fill(out_row, out_row + row_size, T(0));
+        for (int64 col = 0; col < row_size; col += kColumnBlock) {
+          const int64 block = std::min(kColumnBlock, row_size - col);
+          for (int64 k = unique_starts[u]; k < unique_starts[u + 1]; ++k) {
+            const int64 i = positions[k];
+            const SegmentId s = in.segment_ids(i);
+            Accumulate(block, in.weight(i) * in.segment_scales[s],
+                       grad_data + s * row_size + col, out_row + col);
+          }
+        }
+      }
+    };
+    if (num_unique > 0 && row_size > 0) {
+      Shard(worker_threads->num_threads, worker_threads->workers, num_unique,
+            (num_ids / num_unique + 1) * row_size * 2 * sizeof(T),
+            accumulate);
+    }
+
+    if (!in.has_weights) return;
+    // With `out[s] = scale[s] * sum_i w[i] * params[ids[i]]`, the gradient of
+    // weight `i` in segment `s` is
+    //   scale[s] * (<grad[s], params[ids[i]]> - d[i] * <grad[s], out[s]>)
+    // where `d[i]` is the derivative of `1 / scale[s]` with respect to `w[i]`:
+    // 0 for "sum", 1 for "mean" and `w[i] * scale[s]` for "sqrtn".
+    std::vector<T> grad_dot_output(in.num_segments, T(0));
+    const T* output_data = output.flat<T>().data();
+    if (combiner_ != Combiner::kSum) {
+      for (int64 s = 0; s < in.num_segments; ++s) {
+        grad_dot_output[s] = Dot(row_size, grad_data + s * row_size,
+                                 output_data + s * row_size);
+      }
+    }
+    auto weights_grad_vec = weights_grad->vec<T>();
+    const Combiner combiner = combiner_;
+    auto weight_grads = [&](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        const SegmentId s = in.segment_ids(i);
+        const T scale = in.segment_scales[s];
+        T d(0);
+        if (combiner == Combiner::kMean) {
+          d = T(1);
+        } else if (combiner == Combiner::kSqrtN) {
+          d = in.weights(i) * scale;
+        }
+        weights_grad_vec(i) =
+            scale * (Dot(row_size, grad_data + s * row_size,
+                         in.params + in.ids(i) * row_size) -
+                     d * grad_dot_output[s]);
+      }
+    };
+    Shard(worker_threads->num_threads, worker_threads->workers, num_ids,
+          row_size * 2 * sizeof(T), weight_grads);
+  }
+
+ private:
+  Combiner combiner_;
+};
+
+#define REGISTER_KERNELS_FULL(type, index_type, segment_type)              \
+  REGISTER_KERNEL_BUILDER(                                                 \
+      Name("FusedEmbeddingLookupSparse")                                   \
+          .Device(DEVICE_CPU)                                              \
+          .TypeConstraint<type>("T")                                       \
+          .TypeConstraint<index_type>("Tidx")                              \
+          .TypeConstraint<segment_type>("Tsegmentids"),                    \
+      FusedEmbeddingLookupSparseOp<type, index_type, segment_type>);       \
+  REGISTER_KERNEL_BUILDER(                                                 \
+      Name("FusedEmbeddingLookupSparseGrad")                               \
+          .Device(DEVICE_CPU)                                              \
+          .TypeConstraint<type>("T")                                       \
+          .TypeConstraint<index_type>("Tidx")                              \
+          .TypeConstraint<segment_type>("Tsegmentids"),                    \
+      FusedEmbeddingLookupSparseGradOp<type, index_type, segment_type>)
+
+#define REGISTER_KERNELS(type)               \
+  REGISTER_KERNELS_FULL(type, int32, int32); \
+  REGISTER_KERNELS_FULL(type, int32, int64); \
+  REGISTER_KERNELS_FULL(type, int64, int32); \
+  REGISTER_KERNELS_FULL(type, int64, int64)
+
+TF_CALL_float(REGISTER_KERNELS);
+TF_CALL_double(REGISTER_KERNELS);
+
+#undef REGISTER_KERNELS
+#undef REGISTER_KERNELS_FULL
+
+}  // namespace
+}  // namespace tensorflow
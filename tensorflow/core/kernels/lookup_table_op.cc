@@ -16,6 +16,8 @@ limitations under the License.
 #include "tensorflow/core/kernels/lookup_table_op.h"
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <type_traits>
 #include <utility>
@@ -26,16 +28,88 @@ limitations under the License.
 #include "tensorflow/core/kernels/initializable_lookup_table.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace lookup {
 
+namespace {
+
+// Returns the shard that holds "key" in a mutable hash table with
+// "num_shards" shards.
+template <typename T>
+inline int KeyShard(const T& key, int num_shards) {
+  // Integral keys are often dense ids, so their bits are mixed before taking
+  // the modulus.
+  return ((static_cast<uint64>(key) * 0x9E3779B97F4A7C15ull) >> 32) %
+         num_shards;
+}
+
+inline int KeyShard(const tstring& key, int num_shards) {
+  return Hash64(key) % num_shards;
+}
+
+// Calls "fn(shard, positions)" for every shard of a table with "num_shards"
+// shards that holds some of "keys", where "positions" are the indices of these
+// keys. Shards are processed in parallel on the intra-op thread pool of "ctx".
+template <typename K, typename Fn>
+void ForEachKeyShard(OpKernelContext* ctx, int num_shards,
+                     typename TTypes<K>::ConstFlat keys, int64 cost_per_key,
+                     const Fn& fn) {
+  std::vector<std::vector<int64>> positions(num_shards);
+  for (int64 i = 0; i < keys.size(); ++i) {
+    positions[KeyShard(keys(i), num_shards)].push_back(i);
+  }
+  auto work = [&positions, &fn](int64 begin, int64 end) {
+    for (int64 s = begin; s < end; ++s) {
+      if (!positions[s].empty()) fn(s, positions[s]);
+    }
+  };
+  auto* worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
+  Shard(worker_threads->num_threads, worker_threads->workers, num_shards,
+        cost_per_key * (keys.size() / num_shards + 1), work);
+}
+
+// Reads the "num_shards" attr of a mutable hash table op. The attr is missing
+// from the ops predating it, in which case the table has a single shard.
+Status GetNumShards(OpKernel* kernel, int* num_shards) {
+  int64 n = 1;
+  TryGetNodeAttr(kernel->def(), "num_shards", &n);
+  if (n < 1) {
+    return errors::InvalidArgument("num_shards must be positive, got ", n);
+  }
+  *num_shards = static_cast<int>(n);
+  return Status::OK();
+}
+
+// Bucket-based estimate of the memory used by "table".
+template <typename Map>
+int64 MapMemoryUsed(const Map& table) {
+  int64 ret = 0;
+  for (unsigned i = 0; i < table.bucket_count(); ++i) {
+    size_t bucket_size = table.bucket_size(i);
+    if (bucket_size == 0) {
+      ret++;
+    } else {
+      ret += bucket_size;
+    }
+  }
+  return ret;
+}
+
+}  // namespace
+
 // Lookup table that wraps an unordered_map, where the key and value data type
 // is specified. Each individual value must be a scalar. If vector values are
 // required, use MutableHashTableOfTensors.
 //
 // This table is mutable and thread safe - Insert can be called at any time.
 //
+// The keys are split among "num_shards" unordered_maps by their hash, each
+// with its own lock. With more than one shard, Find, Insert and Remove process
+// the shards of a key batch in parallel, and concurrent calls only contend on
+// the shards they have in common. Import and Export lock all shards.
+//
 // Sample use case:
 //
 // MutableHashTableOfScalars<int64, int64> table;  // int64 -> int64.
@@ -47,11 +121,18 @@ namespace lookup {
 template <class K, class V>
 class MutableHashTableOfScalars final : public LookupInterface {
  public:
-  MutableHashTableOfScalars(OpKernelContext* ctx, OpKernel* kernel) {}
+  MutableHashTableOfScalars(OpKernelContext* ctx, OpKernel* kernel) {
+    OP_REQUIRES_OK(ctx, GetNumShards(kernel, &num_shards_));
+    shards_.reset(new TableShard[num_shards_]);
+  }
 
   size_t size() const override {
-    tf_shared_lock l(mu_);
-    return table_.size();
+    size_t ret = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      tf_shared_lock l(shards_[s].mu);
+      ret += shards_[s].table.size();
+    }
+    return ret;
   }
 
   Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
@@ -60,25 +141,45 @@ class MutableHashTableOfScalars final : public LookupInterface {
     const auto key_values = key.flat<K>();
     auto value_values = value->flat<V>();
 
-    tf_shared_lock l(mu_);
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      value_values(i) = gtl::FindWithDefault(
-          table_, SubtleMustCopyIfIntegral(key_values(i)), default_val);
+    if (num_shards_ == 1) {
+      tf_shared_lock l(shards_[0].mu);
+      for (int64 i = 0; i < key_values.size(); ++i) {
+        value_values(i) = gtl::FindWithDefault(
+            shards_[0].table, SubtleMustCopyIfIntegral(key_values(i)),
+            default_val);
+      }
+      return Status::OK();
     }
-
+    ForEachKeyShard<K>(
+        ctx, num_shards_, key_values, kFindCost,
+        [&](int s, const std::vector<int64>& positions) {
+          tf_shared_lock l(shards_[s].mu);
+          for (const int64 i : positions) {
+            value_values(i) = gtl::FindWithDefault(
+                shards_[s].table, SubtleMustCopyIfIntegral(key_values(i)),
+                default_val);
+          }
+        });
     return Status::OK();
   }
 
-  Status DoInsert(bool clear, const Tensor& keys, const Tensor& values) {
+  // Locks all shards, so that "clear" empties the table atomically.
+  Status DoInsert(bool clear, const Tensor& keys, const Tensor& values)
+      TF_NO_THREAD_SAFETY_ANALYSIS {
     const auto key_values = keys.flat<K>();
     const auto value_values = values.flat<V>();
 
-    mutex_lock l(mu_);
-    if (clear) {
-      table_.clear();
+    gtl::InlinedVector<mutex_lock, 1> locks;
+    locks.reserve(num_shards_);
+    for (int s = 0; s < num_shards_; ++s) {
+      locks.emplace_back(shards_[s].mu);
+      if (clear) {
+        shards_[s].table.clear();
+      }
     }
     for (int64 i = 0; i < key_values.size(); ++i) {
-      gtl::InsertOrUpdate(&table_, SubtleMustCopyIfIntegral(key_values(i)),
+      const K key = SubtleMustCopyIfIntegral(key_values(i));
+      gtl::InsertOrUpdate(&shards_[KeyShard(key, num_shards_)].table, key,
                           SubtleMustCopyIfIntegral(value_values(i)));
     }
     return Status::OK();
@@ -86,16 +187,42 @@ class MutableHashTableOfScalars final : public LookupInterface {
 
   Status Insert(OpKernelContext* ctx, const Tensor& keys,
                 const Tensor& values) override {
-    return DoInsert(false, keys, values);
+    if (num_shards_ == 1) {
+      return DoInsert(false, keys, values);
+    }
+    const auto key_values = keys.flat<K>();
+    const auto value_values = values.flat<V>();
+    ForEachKeyShard<K>(
+        ctx, num_shards_, key_values, kInsertCost,
+        [&](int s, const std::vector<int64>& positions) {
+          mutex_lock l(shards_[s].mu);
+          for (const int64 i : positions) {
+            gtl::InsertOrUpdate(&shards_[s].table,
+                                SubtleMustCopyIfIntegral(key_values(i)),
+                                SubtleMustCopyIfIntegral(value_values(i)));
+          }
+        });
+    return Status::OK();
   }
 
   Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
     const auto key_values = keys.flat<K>();
 
-    mutex_lock l(mu_);
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      table_.erase(SubtleMustCopyIfIntegral(key_values(i)));
+    if (num_shards_ == 1) {
+      mutex_lock l(shards_[0].mu);
+      for (int64 i = 0; i < key_values.size(); ++i) {
+        shards_[0].table.erase(SubtleMustCopyIfIntegral(key_values(i)));
+      }
+      return Status::OK();
     }
+    ForEachKeyShard<K>(ctx, num_shards_, key_values, kInsertCost,
+                       [&](int s, const std::vector<int64>& positions) {
+                         mutex_lock l(shards_[s].mu);
+                         for (const int64 i : positions) {
+                           shards_[s].table.erase(
+                               SubtleMustCopyIfIntegral(key_values(i)));
+                         }
+                       });
     return Status::OK();
   }
 
@@ -104,9 +231,15 @@ class MutableHashTableOfScalars final : public LookupInterface {
     return DoInsert(true, keys, values);
   }
 
-  Status ExportValues(OpKernelContext* ctx) override {
-    tf_shared_lock l(mu_);
-    int64 size = table_.size();
+  Status ExportValues(OpKernelContext* ctx) override
+      TF_NO_THREAD_SAFETY_ANALYSIS {
+    gtl::InlinedVector<tf_shared_lock, 1> locks;
+    locks.reserve(num_shards_);
+    int64 size = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      locks.emplace_back(shards_[s].mu);
+      size += shards_[s].table.size();
+    }
 
     Tensor* keys;
     Tensor* values;
@@ -118,9 +251,12 @@ class MutableHashTableOfScalars final : public LookupInterface {
     auto keys_data = keys->flat<K>();
     auto values_data = values->flat<V>();
     int64 i = 0;
-    for (auto it = table_.begin(); it != table_.end(); ++it, ++i) {
-      keys_data(i) = it->first;
-      values_data(i) = it->second;
+    for (int s = 0; s < num_shards_; ++s) {
+      const auto& table = shards_[s].table;
+      for (auto it = table.begin(); it != table.end(); ++it, ++i) {
+        keys_data(i) = it->first;
+        values_data(i) = it->second;
+      }
     }
     return Status::OK();
   }
@@ -135,21 +271,26 @@ class MutableHashTableOfScalars final : public LookupInterface {
 
   int64 MemoryUsed() const override {
     int64 ret = 0;
-    tf_shared_lock l(mu_);
-    for (unsigned i = 0; i < table_.bucket_count(); ++i) {
-      size_t bucket_size = table_.bucket_size(i);
-      if (bucket_size == 0) {
-        ret++;
-      } else {
-        ret += bucket_size;
-      }
+    for (int s = 0; s < num_shards_; ++s) {
+      tf_shared_lock l(shards_[s].mu);
+      ret += sizeof(TableShard) + MapMemoryUsed(shards_[s].table);
     }
     return sizeof(MutableHashTableOfScalars) + ret;
   }
 
  private:
-  mutable mutex mu_;
-  std::unordered_map<K, V> table_ TF_GUARDED_BY(mu_);
+  // Rough cost in cycles of looking up and inserting a key, used to decide
+  // how many threads work on a batch.
+  static constexpr int64 kFindCost = 100;
+  static constexpr int64 kInsertCost = 200;
+
+  struct TableShard {
+    mutable mutex mu;
+    std::unordered_map<K, V> table TF_GUARDED_BY(mu);
+  };
+
+  int num_shards_ = 1;
+  std::unique_ptr<TableShard[]> shards_;
 };
 
 // Lookup table that wraps an unordered_map. Behaves identical to
@@ -164,11 +305,17 @@ class MutableHashTableOfTensors final : public LookupInterface {
         ctx, TensorShapeUtils::IsVector(value_shape_),
         errors::InvalidArgument("Default value must be a vector, got shape ",
                                 value_shape_.DebugString()));
+    OP_REQUIRES_OK(ctx, GetNumShards(kernel, &num_shards_));
+    shards_.reset(new TableShard[num_shards_]);
   }
 
   size_t size() const override {
-    tf_shared_lock l(mu_);
-    return table_.size();
+    size_t ret = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      tf_shared_lock l(shards_[s].mu);
+      ret += shards_[s].table.size();
+    }
+    return ret;
   }
 
   Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
@@ -178,10 +325,10 @@ class MutableHashTableOfTensors final : public LookupInterface {
     auto value_values = value->flat_inner_dims<V, 2>();
     int64 value_dim = value_shape_.dim_size(0);
 
-    tf_shared_lock l(mu_);
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      ValueArray* value_vec =
-          gtl::FindOrNull(table_, SubtleMustCopyIfIntegral(key_values(i)));
+    auto find = [&](const TableShard& shard, int64 i)
+                    TF_SHARED_LOCKS_REQUIRED(shard.mu) {
+      const ValueArray* value_vec =
+          gtl::FindOrNull(shard.table, SubtleMustCopyIfIntegral(key_values(i)));
       if (value_vec != nullptr) {
         for (int64 j = 0; j < value_dim; j++) {
           value_values(i, j) = value_vec->at(j);
@@ -191,44 +338,85 @@ class MutableHashTableOfTensors final : public LookupInterface {
           value_values(i, j) = default_flat(j);
         }
       }
+    };
+    if (num_shards_ == 1) {
+      tf_shared_lock l(shards_[0].mu);
+      for (int64 i = 0; i < key_values.size(); ++i) {
+        find(shards_[0], i);
+      }
+      return Status::OK();
     }
-
+    ForEachKeyShard<K>(ctx, num_shards_, key_values, kFindCost * value_dim,
+                       [&](int s, const std::vector<int64>& positions) {
+                         tf_shared_lock l(shards_[s].mu);
+                         for (const int64 i : positions) {
+                           find(shards_[s], i);
+                         }
+                       });
     return Status::OK();
   }
 
-  Status DoInsert(bool clear, const Tensor& keys, const Tensor& values) {
+  // Locks all shards, so that "clear" empties the table atomically.
+  Status DoInsert(bool clear, const Tensor& keys, const Tensor& values)
+      TF_NO_THREAD_SAFETY_ANALYSIS {
     const auto key_values = keys.flat<K>();
     const auto value_values = values.flat_inner_dims<V, 2>();
     int64 value_dim = value_shape_.dim_size(0);
 
-    mutex_lock l(mu_);
-    if (clear) {
-      table_.clear();
+    gtl::InlinedVector<mutex_lock, 1> locks;
+    locks.reserve(num_shards_);
+    for (int s = 0; s < num_shards_; ++s) {
+      locks.emplace_back(shards_[s].mu);
+      if (clear) {
+        shards_[s].table.clear();
+      }
     }
     for (int64 i = 0; i < key_values.size(); ++i) {
-      ValueArray value_vec;
-      for (int64 j = 0; j < value_dim; j++) {
-        V value = value_values(i, j);
-        value_vec.push_back(value);
-      }
-      gtl::InsertOrUpdate(&table_, SubtleMustCopyIfIntegral(key_values(i)),
-                          value_vec);
+      const K key = SubtleMustCopyIfIntegral(key_values(i));
+      InsertOne(&shards_[KeyShard(key, num_shards_)], key, value_values, i,
+                value_dim);
     }
     return Status::OK();
   }
 
   Status Insert(OpKernelContext* ctx, const Tensor& keys,
                 const Tensor& values) override {
-    return DoInsert(false, keys, values);
+    if (num_shards_ == 1) {
+      return DoInsert(false, keys, values);
+    }
+    const auto key_values = keys.flat<K>();
+    const auto value_values = values.flat_inner_dims<V, 2>();
+    int64 value_dim = value_shape_.dim_size(0);
+    ForEachKeyShard<K>(ctx, num_shards_, key_values, kInsertCost * value_dim,
+                       [&](int s, const std::vector<int64>& positions) {
+                         mutex_lock l(shards_[s].mu);
+                         for (const int64 i : positions) {
+                           InsertOne(&shards_[s],
+                                     SubtleMustCopyIfIntegral(key_values(i)),
+                                     value_values, i, value_dim);
+                         }
+                       });
+    return Status::OK();
   }
 
   Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
     const auto key_values = keys.flat<K>();
 
-    mutex_lock l(mu_);
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      table_.erase(SubtleMustCopyIfIntegral(key_values(i)));
+    if (num_shards_ == 1) {
+      mutex_lock l(shards_[0].mu);
+      for (int64 i = 0; i < key_values.size(); ++i) {
+        shards_[0].table.erase(SubtleMustCopyIfIntegral(key_values(i)));
+      }
+      return Status::OK();
     }
+    ForEachKeyShard<K>(ctx, num_shards_, key_values, kInsertCost,
+                       [&](int s, const std::vector<int64>& positions) {
+                         mutex_lock l(shards_[s].mu);
+                         for (const int64 i : positions) {
+                           shards_[s].table.erase(
+                               SubtleMustCopyIfIntegral(key_values(i)));
+                         }
+                       });
     return Status::OK();
   }
 
@@ -237,9 +425,15 @@ class MutableHashTableOfTensors final : public LookupInterface {
     return DoInsert(true, keys, values);
   }
 
-  Status ExportValues(OpKernelContext* ctx) override {
-    tf_shared_lock l(mu_);
-    int64 size = table_.size();
+  Status ExportValues(OpKernelContext* ctx) override
+      TF_NO_THREAD_SAFETY_ANALYSIS {
+    gtl::InlinedVector<tf_shared_lock, 1> locks;
+    locks.reserve(num_shards_);
+    int64 size = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      locks.emplace_back(shards_[s].mu);
+      size += shards_[s].table.size();
+    }
     int64 value_dim = value_shape_.dim_size(0);
 
     Tensor* keys;
@@ -252,12 +446,15 @@ class MutableHashTableOfTensors final : public LookupInterface {
     auto keys_data = keys->flat<K>();
     auto values_data = values->matrix<V>();
     int64 i = 0;
-    for (auto it = table_.begin(); it != table_.end(); ++it, ++i) {
-      K key = it->first;
-      ValueArray value = it->second;
-      keys_data(i) = key;
-      for (int64 j = 0; j < value_dim; j++) {
-        values_data(i, j) = value[j];
+    for (int s = 0; s < num_shards_; ++s) {
+      const auto& table = shards_[s].table;
+      for (auto it = table.begin(); it != table.end(); ++it, ++i) {
+        K key = it->first;
+        ValueArray value = it->second;
+        keys_data(i) = key;
+        for (int64 j = 0; j < value_dim; j++) {
+          values_data(i, j) = value[j];
+        }
       }
     }
     return Status::OK();
@@ -273,23 +470,370 @@ class MutableHashTableOfTensors final : public LookupInterface {
 
   int64 MemoryUsed() const override {
     int64 ret = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      tf_shared_lock l(shards_[s].mu);
+      ret += sizeof(TableShard) + MapMemoryUsed(shards_[s].table);
+    }
+    return sizeof(MutableHashTableOfTensors) + ret;
+  }
+
+ private:
+  // Rough cost in cycles of looking up and inserting a value element, used to
+  // decide how many threads work on a batch.
+  static constexpr int64 kFindCost = 100;
+  static constexpr int64 kInsertCost = 200;
+
+  typedef gtl::InlinedVector<V, 4> ValueArray;
+
+  struct TableShard {
+    mutable mutex mu;
+    std::unordered_map<K, ValueArray> table TF_GUARDED_BY(mu);
+  };
+
+  static void InsertOne(TableShard* shard, const K& key,
+                        typename TTypes<V, 2>::ConstTensor value_values,
+                        int64 i, int64 value_dim)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(shard->mu) {
+    ValueArray value_vec;
+    for (int64 j = 0; j < value_dim; j++) {
+      V value = value_values(i, j);
+      value_vec.push_back(value);
+    }
+    gtl::InsertOrUpdate(&shard->table, key, value_vec);
+  }
+
+  TensorShape value_shape_;
+  int num_shards_ = 1;
+  std::unique_ptr<TableShard[]> shards_;
+};
+
+// Lookup table from int64 ids to values, for embeddings of ids that keep
+// arriving. It keeps, for every key, the number of lookups that found it and
+// the step of its last access, where a step is one call to Find. These
+// statistics bound the size of the table:
+//
+// - With an admission threshold of K > 1, a key is only added by Insert once
+//   Find has looked it up K times. Until then, lookups of the key return the
+//   default value and inserts of it are dropped. The lookups of at most
+//   max_candidates keys that are not in the table are counted, evicting the
+//   least frequently looked up ones like the keys of the table.
+// - With a TTL, keys that have not been accessed for that many steps are
+//   evicted.
+// - With a capacity, the least frequently looked up keys are evicted once the
+//   table grows beyond it, leaving it 10% below capacity so that the cost of
+//   eviction is amortized over many insertions. Ties are broken by evicting
+//   the least recently accessed key first.
+//
+// Lookups of keys in the table only take a shared lock, and update the
+// statistics of the keys atomically. Lookups of keys that are not in the
+// table take an exclusive lock if they need to be counted.
+//
+// ExportValues exports the keys as an [N, 3] matrix of key, lookup count and
+// last access step, so that checkpoints preserve the statistics. The counts
+// of keys that have not been admitted yet are not exported. The keys are
+// therefore exported and imported with the MutableEvictingHashTableExport and
+// MutableEvictingHashTableImport ops, rather than the generic ones.
+template <class V>
+class MutableEvictingHashTable final : public LookupInterface {
+ public:
+  MutableEvictingHashTable(OpKernelContext* ctx, OpKernel* kernel) {
+    OP_REQUIRES_OK(ctx,
+                   GetNodeAttr(kernel->def(), "value_shape", &value_shape_));
+    OP_REQUIRES(
+        ctx, TensorShapeUtils::IsScalar(value_shape_) ||
+                 TensorShapeUtils::IsVector(value_shape_),
+        errors::InvalidArgument(
+            "Default value must be a scalar or a vector, got shape ",
+            value_shape_.DebugString()));
+    OP_REQUIRES_OK(ctx, GetNodeAttr(kernel->def(), "capacity", &capacity_));
+    OP_REQUIRES_OK(ctx, GetNodeAttr(kernel->def(), "admission_threshold",
+                                    &admission_threshold_));
+    OP_REQUIRES_OK(ctx, GetNodeAttr(kernel->def(), "ttl_steps", &ttl_steps_));
+    OP_REQUIRES_OK(ctx, GetNodeAttr(kernel->def(), "max_candidates",
+                                    &max_candidates_));
+    if (max_candidates_ == 0 && capacity_ > 0) {
+      max_candidates_ = capacity_;
+    } else if (max_candidates_ == 0) {
+      max_candidates_ = kDefaultMaxCandidates;
+    }
+    value_dim_ = value_shape_.num_elements();
+  }
+
+  size_t size() const override {
     tf_shared_lock l(mu_);
-    for (unsigned i = 0; i < table_.bucket_count(); ++i) {
-      size_t bucket_size = table_.bucket_size(i);
-      if (bucket_size == 0) {
-        ret++;
-      } else {
-        ret += bucket_size;
+    return table_.size();
+  }
+
+  Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
+              const Tensor& default_value) override {
+    const auto default_flat = default_value.flat<V>();
+    const auto key_values = key.flat<int64>();
+    auto value_values = value->flat_inner_dims<V, 2>();
+
+    const int64 step = ++step_;
+    std::vector<int64> missing_keys;
+    {
+      tf_shared_lock l(mu_);
+      for (int64 i = 0; i < key_values.size(); ++i) {
+        const int64 k = SubtleMustCopyIfIntegral(key_values(i));
+        auto it = table_.find(k);
+        if (it != table_.end()) {
+          Entry& entry = it->second;
+          entry.count.fetch_add(1, std::memory_order_relaxed);
+          entry.last_access.store(step, std::memory_order_relaxed);
+          for (int64 j = 0; j < value_dim_; j++) {
+            value_values(i, j) = entry.value[j];
+          }
+          continue;
+        }
+        for (int64 j = 0; j < value_dim_; j++) {
+          value_values(i, j) = default_flat(j);
+        }
+        if (admission_threshold_ > 1) {
+          missing_keys.push_back(k);
+        }
       }
     }
-    return sizeof(MutableHashTableOfTensors) + ret;
+    if (missing_keys.empty() &&
+        (ttl_steps_ <= 0 ||
+         step < next_expiry_step_.load(std::memory_order_relaxed))) {
+      return Status::OK();
+    }
+
+    mutex_lock l(mu_);
+    for (const int64 k : missing_keys) {
+      // The key may have been inserted since it was looked up.
+      if (table_.count(k) > 0) continue;
+      Candidate& candidate = candidates_[k];
+      ++candidate.count;
+      candidate.last_access = step;
+    }
+    if (candidates_.size() > static_cast<size_t>(max_candidates_)) {
+      EvictLeastFrequent(max_candidates_, &candidates_);
+    }
+    MaybeExpire(step);
+    return Status::OK();
+  }
+
+  Status Insert(OpKernelContext* ctx, const Tensor& keys,
+                const Tensor& values) override {
+    const auto key_values = keys.flat<int64>();
+    const auto value_values = values.flat_inner_dims<V, 2>();
+
+    mutex_lock l(mu_);
+    for (int64 i = 0; i < key_values.size(); ++i) {
+      const int64 k = SubtleMustCopyIfIntegral(key_values(i));
+      auto it = table_.find(k);
+      if (it == table_.end()) {
+        int64 count = 1;
+        if (admission_threshold_ > 1) {
+          auto candidate = candidates_.find(k);
+          if (candidate == candidates_.end() ||
+              candidate->second.count < admission_threshold_) {
+            continue;
+          }
+          count = candidate->second.count;
+          candidates_.erase(candidate);
+        }
+        it = table_
+                 .emplace(std::piecewise_construct, std::forward_as_tuple(k),
+                          std::forward_as_tuple())
+                 .first;
+        it->second.count = count;
+      }
+      Entry& entry = it->second;
+      entry.last_access = step_.load();
+      entry.value.resize(value_dim_);
+      for (int64 j = 0; j < value_dim_; j++) {
+        entry.value[j] = SubtleMustCopyIfIntegral(value_values(i, j));
+      }
+    }
+    if (capacity_ > 0 && table_.size() > static_cast<size_t>(capacity_)) {
+      EvictLeastFrequent(capacity_, &table_);
+    }
+    return Status::OK();
+  }
+
+  Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
+    const auto key_values = keys.flat<int64>();
+
+    mutex_lock l(mu_);
+    for (int64 i = 0; i < key_values.size(); ++i) {
+      const int64 k = SubtleMustCopyIfIntegral(key_values(i));
+      table_.erase(k);
+      candidates_.erase(k);
+    }
+    return Status::OK();
+  }
+
+  Status ImportValues(OpKernelContext* ctx, const Tensor& keys,
+                      const Tensor& values) override {
+    const auto key_stats = keys.matrix<int64>();
+    const auto value_values = values.flat_inner_dims<V, 2>();
+
+    mutex_lock l(mu_);
+    table_.clear();
+    candidates_.clear();
+    int64 step = 0;
+    for (int64 i = 0; i < key_stats.dimension(0); ++i) {
+      Entry& entry = table_[key_stats(i, 0)];
+      entry.count = key_stats(i, 1);
+      entry.last_access = key_stats(i, 2);
+      step = std::max(step, key_stats(i, 2));
+      entry.value.resize(value_dim_);
+      for (int64 j = 0; j < value_dim_; j++) {
+        entry.value[j] = value_values(i, j);
+      }
+    }
+    step_ = step;
+    next_expiry_step_ = step + ttl_steps_;
+    return Status::OK();
+  }
+
+  Status ExportValues(OpKernelContext* ctx) override {
+    // The generic export op claims rank-1 keys.
+    if (ctx->op_kernel().type_string() != "MutableEvictingHashTableExport") {
+      return errors::InvalidArgument(
+          "MutableEvictingHashTable can only be exported with "
+          "MutableEvictingHashTableExport, got ",
+          ctx->op_kernel().type_string());
+    }
+    tf_shared_lock l(mu_);
+    const int64 size = table_.size();
+
+    Tensor* keys;
+    Tensor* values;
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("keys", TensorShape({size, 3}), &keys));
+    TensorShape values_shape({size});
+    values_shape.AppendShape(value_shape_);
+    TF_RETURN_IF_ERROR(ctx->allocate_output("values", values_shape, &values));
+
+    auto keys_data = keys->matrix<int64>();
+    auto values_data = values->flat_inner_dims<V, 2>();
+    int64 i = 0;
+    for (auto it = table_.begin(); it != table_.end(); ++it, ++i) {
+      keys_data(i, 0) = it->first;
+      keys_data(i, 1) = it->second.count;
+      keys_data(i, 2) = it->second.last_access;
+      for (int64 j = 0; j < value_dim_; j++) {
+        values_data(i, j) = it->second.value[j];
+      }
+    }
+    return Status::OK();
+  }
+
+  Status CheckKeyAndValueTensorsForImport(const Tensor& keys,
+                                          const Tensor& values) override {
+    TF_RETURN_IF_ERROR(CheckKeyAndValueTypes(keys, values));
+    if (!TensorShapeUtils::IsMatrix(keys.shape()) || keys.dim_size(1) != 3) {
+      return errors::InvalidArgument(
+          "Expected shape [N, 3] of key, count and last access step for keys, "
+          "got ",
+          keys.shape().DebugString());
+    }
+    TensorShape expected_value_shape({keys.dim_size(0)});
+    expected_value_shape.AppendShape(value_shape_);
+    if (values.shape() != expected_value_shape) {
+      return errors::InvalidArgument(
+          "Expected shape ", expected_value_shape.DebugString(),
+          " for value, got ", values.shape().DebugString());
+    }
+    return Status::OK();
+  }
+
+  DataType key_dtype() const override { return DT_INT64; }
+
+  DataType value_dtype() const override { return DataTypeToEnum<V>::v(); }
+
+  TensorShape key_shape() const final { return TensorShape(); }
+
+  TensorShape value_shape() const override { return value_shape_; }
+
+  int64 MemoryUsed() const override {
+    tf_shared_lock l(mu_);
+    return sizeof(MutableEvictingHashTable) + MapMemoryUsed(table_) +
+           MapMemoryUsed(candidates_) +
+           table_.size() * (sizeof(Entry) + value_dim_ * sizeof(V));
   }
 
  private:
+  typedef gtl::InlinedVector<V, 4> ValueArray;
+
+  // Used as max_candidates if neither it nor a capacity is set.
+  static constexpr int64 kDefaultMaxCandidates = 1 << 20;
+
+  struct Candidate {
+    int64 count = 0;
+    int64 last_access = 0;
+  };
+
+  // The statistics of the keys in the table are updated by concurrent
+  // lookups, under a shared lock.
+  struct Entry {
+    std::atomic<int64> count{0};
+    std::atomic<int64> last_access{0};
+    ValueArray value;
+  };
+
+  // Evicts the least frequently looked up keys of "map" until it is 10% below
+  // "limit".
+  template <typename Map>
+  void EvictLeastFrequent(int64 limit, Map* map)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const size_t target = limit - limit / 10;
+    if (map->size() <= target) return;
+    std::vector<std::pair<std::pair<int64, int64>, int64>> stats;
+    stats.reserve(map->size());
+    for (const auto& kv : *map) {
+      const int64 count = kv.second.count;
+      const int64 last_access = kv.second.last_access;
+      stats.push_back({{count, last_access}, kv.first});
+    }
+    const size_t num_evicted = map->size() - target;
+    std::nth_element(stats.begin(), stats.begin() + (num_evicted - 1),
+                     stats.end());
+    for (size_t i = 0; i < num_evicted; ++i) {
+      map->erase(stats[i].second);
+    }
+  }
+
+  // Evicts the keys not accessed in the last "ttl_steps_" steps. To amortize
+  // the cost of the scan, this only happens every "ttl_steps_ / 2" steps.
+  void MaybeExpire(int64 step) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (ttl_steps_ <= 0 || step < next_expiry_step_) return;
+    next_expiry_step_ = step + std::max<int64>(ttl_steps_ / 2, 1);
+    const int64 oldest = step - ttl_steps_;
+    for (auto it = table_.begin(); it != table_.end();) {
+      if (it->second.last_access < oldest) {
+        it = table_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (auto it = candidates_.begin(); it != candidates_.end();) {
+      if (it->second.last_access < oldest) {
+        it = candidates_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
   TensorShape value_shape_;
+  int64 value_dim_;
+  int64 capacity_;
+  int64 admission_threshold_;
+  int64 ttl_steps_;
+  int64 max_candidates_;
+
   mutable mutex mu_;
-  typedef gtl::InlinedVector<V, 4> ValueArray;
-  std::unordered_map<K, ValueArray> table_ TF_GUARDED_BY(mu_);
+  // The number of calls to Find so far.
+  std::atomic<int64> step_{0};
+  // Only written under an exclusive lock of "mu_".
+  std::atomic<int64> next_expiry_step_{0};
+  std::unordered_map<int64, Entry> table_ TF_GUARDED_BY(mu_);
+  std::unordered_map<int64, Candidate> candidates_ TF_GUARDED_BY(mu_);
 };
 
 namespace {
@@ -938,6 +1482,9 @@ REGISTER_KERNEL_BUILDER(Name("LookupTableExport").Device(DEVICE_CPU),
                         LookupTableExportOp);
 REGISTER_KERNEL_BUILDER(Name("LookupTableExportV2").Device(DEVICE_CPU),
                         LookupTableExportOp);
+REGISTER_KERNEL_BUILDER(
+    Name("MutableEvictingHashTableExport").Device(DEVICE_CPU),
+    LookupTableExportOp);
 
 // Clear the table and insert data.
 class LookupTableImportOp : public LookupTableOpKernel {
@@ -973,6 +1520,9 @@ REGISTER_KERNEL_BUILDER(Name("LookupTableImport").Device(DEVICE_CPU),
                         LookupTableImportOp);
 REGISTER_KERNEL_BUILDER(Name("LookupTableImportV2").Device(DEVICE_CPU),
                         LookupTableImportOp);
+REGISTER_KERNEL_BUILDER(
+    Name("MutableEvictingHashTableImport").Device(DEVICE_CPU),
+    LookupTableImportOp);
 
 // Register the HashTable op with the currently supported key and value types.
 #define REGISTER_KERNEL(key_dtype, value_dtype)                           \
@@ -1076,6 +1626,23 @@ REGISTER_KERNEL(tstring, int64);
 
 #undef REGISTER_KERNEL
 
+// Register the MutableEvictingHashTable op.
+#define REGISTER_KERNEL(value_dtype)                                      \
+  REGISTER_KERNEL_BUILDER(                                                \
+      Name("MutableEvictingHashTable")                                    \
+          .Device(DEVICE_CPU)                                             \
+          .TypeConstraint<int64>("key_dtype")                             \
+          .TypeConstraint<value_dtype>("value_dtype"),                    \
+      LookupTableOp<lookup::MutableEvictingHashTable<value_dtype>, int64, \
+                    value_dtype>)
+
+REGISTER_KERNEL(double);
+REGISTER_KERNEL(float);
+REGISTER_KERNEL(int32);
+REGISTER_KERNEL(int64);
+
+#undef REGISTER_KERNEL
+
 // Register the MutableDenseHashTable op.
 #define REGISTER_KERNEL(key_dtype, value_dtype)                            \
   REGISTER_KERNEL_BUILDER(                                                 \
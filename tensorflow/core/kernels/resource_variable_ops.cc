@@ -78,6 +78,7 @@ limitations under the License.
 #include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/util/util.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
@@ -843,6 +844,153 @@ TF_CALL_GPU_NUMBER_TYPES(REGISTER_GATHER_ND_GPU);
 #undef REGISTER_GATHER_ND_ALL_INDICES
 #undef REGISTER_GATHER_ND_FULL
 
+template <typename T, typename Index, typename SegmentId>
+class ResourceSparseGatherCombineOp : public OpKernel {
+ public:
+  explicit ResourceSparseGatherCombineOp(OpKernelConstruction* c)
+      : OpKernel(c) {
+    string combiner;
+    OP_REQUIRES_OK(c, c->GetAttr("combiner", &combiner));
+    mean_ = combiner == "mean";
+    sqrtn_ = combiner == "sqrtn";
+  }
+
+  void Compute(OpKernelContext* c) override {
+    const Tensor& indices = c->input(1);
+    const Tensor& segment_ids = c->input(2);
+    const Tensor& num_segments_t = c->input(3);
+    OP_REQUIRES(c, TensorShapeUtils::IsVector(indices.shape()),
+                errors::InvalidArgument("indices must be a vector, got shape ",
+                                        indices.shape().DebugString()));
+    OP_REQUIRES(c, segment_ids.shape() == indices.shape(),
+                errors::InvalidArgument(
+                    "segment_ids and indices must have the same shape, got ",
+                    segment_ids.shape().DebugString(), " and ",
+                    indices.shape().DebugString()));
+    OP_REQUIRES(c, TensorShapeUtils::IsScalar(num_segments_t.shape()),
+                errors::InvalidArgument("num_segments must be a scalar, got ",
+                                        num_segments_t.shape().DebugString()));
+    const int64 num_segments = num_segments_t.dtype() == DT_INT32
+                                   ? num_segments_t.scalar<int32>()()
+                                   : num_segments_t.scalar<int64>()();
+    OP_REQUIRES(c, num_segments >= 0,
+                errors::InvalidArgument("num_segments must be non-negative, ",
+                                        "got ", num_segments));
+
+    core::RefCountPtr<Var> v;
+    OP_REQUIRES_OK(c, LookupResource(c, HandleFromInput(c, 0), &v));
+    OP_REQUIRES_OK(c, EnsureSparseVariableAccess<CPUDevice, T>(c, v.get()));
+    // As in ResourceGatherOp, the lock is held for the whole operation to
+    // avoid copying the variable on a concurrent write.
+    tf_shared_lock ml(*v->mu());
+    const Tensor& params = *v->tensor();
+    OP_REQUIRES(c, params.dtype() == DataTypeToEnum<T>::v(),
+                errors::InvalidArgument(
+                    "Trying to gather ", DataTypeString(DataTypeToEnum<T>::v()),
+                    " values from a variable of type ",
+                    DataTypeString(params.dtype())));
+    OP_REQUIRES(
+        c, TensorShapeUtils::IsVectorOrHigher(params.shape()),
+        errors::InvalidArgument("params must be at least 1 dimensional"));
+
+    TensorShape result_shape({num_segments});
+    int64 row_size = 1;
+    for (int i = 1; i < params.dims(); ++i) {
+      result_shape.AddDim(params.dim_size(i));
+      row_size *= params.dim_size(i);
+    }
+    Tensor* out = nullptr;
+    OP_REQUIRES_OK(c, c->allocate_output(0, result_shape, &out));
+    auto out_flat = out->shaped<T, 2>({num_segments, row_size});
+    out_flat.setZero();
+
+    // Group the ids by segment, so that every segment is combined by a
+    // single thread.
+    const int64 n = indices.NumElements();
+    const int64 num_rows = params.dim_size(0);
+    const auto indices_vec = indices.vec<Index>();
+    const auto segment_vec = segment_ids.vec<SegmentId>();
+    std::vector<int64> segment_starts(num_segments + 1, 0);
+    for (int64 i = 0; i < n; ++i) {
+      const Index index = indices_vec(i);
+      const SegmentId segment = segment_vec(i);
+      OP_REQUIRES(c, FastBoundsCheck(index, num_rows),
+                  errors::InvalidArgument("indices[", i, "] = ", index,
+                                          " is not in [0, ", num_rows, ")"));
+      OP_REQUIRES(
+          c, FastBoundsCheck(segment, num_segments),
+          errors::InvalidArgument("segment_ids[", i, "] = ", segment,
+                                  " is not in [0, ", num_segments, ")"));
+      ++segment_starts[segment + 1];
+    }
+    if (n == 0 || row_size == 0) return;
+    for (int64 s = 0; s < num_segments; ++s) {
+      segment_starts[s + 1] += segment_starts[s];
+    }
+    std::vector<Index> sorted_indices(n);
+    {
+      std::vector<int64> next(segment_starts.begin(), segment_starts.end() - 1);
+      for (int64 i = 0; i < n; ++i) {
+        sorted_indices[next[segment_vec(i)]++] = indices_vec(i);
+      }
+    }
+
+    const T* params_data = params.flat<T>().data();
+    T* out_data = out_flat.data();
+    auto combine = [&](int64 begin, int64 end) {
+      for (int64 s = begin; s < end; ++s) {
+        const int64 first = segment_starts[s];
+        const int64 last = segment_starts[s + 1];
+        if (first == last) continue;
+        T* out_row = out_data + s * row_size;
+        for (int64 k = first; k < last; ++k) {
+          const T* row = params_data + sorted_indices[k] * row_size;
+          for (int64 j = 0; j < row_size; ++j) {
+            out_row[j] += row[j];
+          }
+        }
+        if (mean_ || sqrtn_) {
+          const T count = static_cast<T>(last - first);
+          const T scale = T(1) / (mean_ ? count : Eigen::numext::sqrt(count));
+          for (int64 j = 0; j < row_size; ++j) {
+            out_row[j] *= scale;
+          }
+        }
+      }
+    };
+    auto worker_threads = c->device()->tensorflow_cpu_worker_threads();
+    const int64 cost_per_segment = (n / std::max<int64>(num_segments, 1) + 1) *
+                                   row_size * sizeof(T);
+    Shard(worker_threads->num_threads, worker_threads->workers, num_segments,
+          cost_per_segment, combine);
+  }
+
+ private:
+  bool mean_;
+  bool sqrtn_;
+};
+
+#define REGISTER_SPARSE_GATHER_COMBINE_FULL(type, index_type, segment_type) \
+  REGISTER_KERNEL_BUILDER(                                                   \
+      Name("ResourceSparseGatherCombine")                                    \
+          .Device(DEVICE_CPU)                                                \
+          .TypeConstraint<type>("dtype")                                     \
+          .TypeConstraint<index_type>("Tindices")                            \
+          .TypeConstraint<segment_type>("Tsegmentids"),                      \
+      ResourceSparseGatherCombineOp<type, index_type, segment_type>)
+
+#define REGISTER_SPARSE_GATHER_COMBINE(type)               \
+  REGISTER_SPARSE_GATHER_COMBINE_FULL(type, int32, int32); \
+  REGISTER_SPARSE_GATHER_COMBINE_FULL(type, int32, int64); \
+  REGISTER_SPARSE_GATHER_COMBINE_FULL(type, int64, int32); \
+  REGISTER_SPARSE_GATHER_COMBINE_FULL(type, int64, int64)
+
+TF_CALL_float(REGISTER_SPARSE_GATHER_COMBINE);
+TF_CALL_double(REGISTER_SPARSE_GATHER_COMBINE);
+
+#undef REGISTER_SPARSE_GATHER_COMBINE
+#undef REGISTER_SPARSE_GATHER_COMBINE_FULL
+
 template <typename Device, typename T, typename Index, scatter_op::UpdateOp op>
 class ResourceScatterUpdateOp : public OpKernel {
  public:
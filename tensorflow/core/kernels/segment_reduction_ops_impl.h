@@ -23,6 +23,7 @@ limitations under the License.
 #define EIGEN_USE_GPU
 #endif  // GOOGLE_CUDA || TENSORFLOW_USE_ROCM
 
+#include <algorithm>
 #include <vector>
 
 #include "third_party/eigen3/Eigen/Core"
@@ -39,6 +40,7 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/util/util.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 #if GOOGLE_CUDA || TENSORFLOW_USE_ROCM
 #include "tensorflow/core/common_runtime/gpu/gpu_event_mgr.h"
@@ -128,79 +130,106 @@ class SegmentReductionOp : public OpKernel {
 #else
     Eigen::IndexList<Eigen::type2index<0> > dims_to_reduce;
 #endif
-    Index start = 0, end = 1;
-
-    Index uninitialized_index = 0;  // Index from which the output is not set.
-    Index out_index = internal::SubtleMustCopy(segment_vec(start));
-
-    // TODO(agarwal): if this loop becomes a bottleneck, consider sharding it
-    // across threads.
-    Eigen::DSizes<Eigen::DenseIndex, 1> out_slice_shape(num_col);
-    while (end <= num_indices) {
-      // We initialize next_index to 0 to avoid "warning: 'next_index' may be
-      // used uninitialized in this function" in the Mac build (since the
-      // compiler isn't smart enough to realize the code is safe).
-      Index next_index = 0;
-      if (end < num_indices) {
-        next_index = internal::SubtleMustCopy(segment_vec(end));
-        if (out_index == next_index) {
-          ++end;
-          continue;
-        }
-        // We have a new segment here.  Verify that the segment ids are growing.
-        OP_REQUIRES(context, out_index < next_index,
-                    errors::InvalidArgument("segment ids are not increasing"));
-      }
-
-      // Process segment [start, end)
-      const T* in_slice_ptr = &input_flat(start, 0);
-      typedef Eigen::TensorMap<Eigen::Tensor<T, 1, Eigen::RowMajor>,
-                               Eigen::Unaligned>
-          OutT;
 
+    // Validate the segment ids and find the segments: segment `p` reduces the
+    // input rows from `segment_starts[p]` to `segment_starts[p + 1]` into
+    // output row `segment_out[p]`.
+    // Every id is bounds checked, as the ids may change after `output_rows`
+    // was read from them.
+    std::vector<Index> segment_out;
+    std::vector<int64> segment_starts;
+    for (int64 i = 0; i < num_indices; ++i) {
+      const Index next_index = internal::SubtleMustCopy(segment_vec(i));
+      if (!segment_out.empty() && next_index == segment_out.back()) continue;
+      // We have a new segment here.  Verify that the segment ids are growing.
+      OP_REQUIRES(context,
+                  segment_out.empty() || segment_out.back() < next_index,
+                  errors::InvalidArgument("segment ids are not increasing"));
       OP_REQUIRES(
-          context, FastBoundsCheck(out_index, output_rows),
+          context, FastBoundsCheck(next_index, output_rows),
           errors::InvalidArgument(
-              "Segment id ", out_index, " out of range [0, ", output_rows,
+              "Segment id ", next_index, " out of range [0, ", output_rows,
               "), possibly because 'segment_ids' input is not sorted."));
-
-      // If there is a gap between two indices, we need to set that gap to the
-      // default value.
-      if (out_index > uninitialized_index) {
-        Eigen::DSizes<Eigen::DenseIndex, 2> gap_slice_shape(
-            out_index - uninitialized_index, num_col);
-        Eigen::TensorMap<Eigen::Tensor<T, 2, Eigen::RowMajor>, Eigen::Unaligned>
-            gap_slice(&output_flat(uninitialized_index, 0), gap_slice_shape);
-        gap_slice.setConstant(T(default_value));
+      segment_out.push_back(next_index);
+      segment_starts.push_back(i);
+    }
+    segment_starts.push_back(num_indices);
+    const int64 num_segments = segment_out.size();
+
+    // The segments are partitioned into blocks of about equally many input
+    // rows, each reduced by one thread. A block ends at the first segment
+    // boundary after its share of rows, so that no segment is split across
+    // threads. Segments that are larger than a block on their own are reduced
+    // afterwards, one at a time, with the whole threadpool.
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    const int64 max_blocks =
+        std::min<int64>(num_segments, 4 * worker_threads->num_threads);
+    const int64 rows_per_block = (num_indices + max_blocks - 1) / max_blocks;
+    std::vector<int64> block_starts;
+    for (int64 p = 0, next_row = 0; p < num_segments; ++p) {
+      if (segment_starts[p] >= next_row) {
+        block_starts.push_back(p);
+        next_row = segment_starts[p] + rows_per_block;
       }
+    }
+    block_starts.push_back(num_segments);
+    const int64 num_blocks = block_starts.size() - 1;
+    auto is_large = [&](int64 p) {
+      return num_blocks > 1 &&
+             segment_starts[p + 1] - segment_starts[p] > rows_per_block;
+    };
 
-      T* out_slice_ptr = &output_flat(out_index, 0);
-      OutT out_slice(out_slice_ptr, out_slice_shape);
-      // We don't use out_slice.device(context->eigen_device<Device>)
-      // because these pieces of work are likely to be very small and
-      // the context switching overhead dwarfs any benefit we get from
-      // using another thread to do this work.
-      if (start == end - 1) {
-        typedef Eigen::TensorMap<Eigen::Tensor<const T, 1, Eigen::RowMajor>,
-                                 Eigen::Unaligned>
-            InT;
-        InT in_slice(in_slice_ptr, out_slice_shape);
-        out_slice = in_slice;
-      } else {
-        Eigen::DSizes<Eigen::DenseIndex, 2> in_slice_shape(end - start,
-                                                           num_col);
-        typedef Eigen::TensorMap<Eigen::Tensor<const T, 2, Eigen::RowMajor>,
-                                 Eigen::Unaligned>
-            InT;
-        InT in_slice(in_slice_ptr, in_slice_shape);
-
-        out_slice = in_slice.reduce(dims_to_reduce, Reducer());
+    typedef Eigen::TensorMap<Eigen::Tensor<T, 1, Eigen::RowMajor>,
+                             Eigen::Unaligned>
+        OutT;
+    typedef Eigen::TensorMap<Eigen::Tensor<const T, 2, Eigen::RowMajor>,
+                             Eigen::Unaligned>
+        InT;
+    Eigen::DSizes<Eigen::DenseIndex, 1> out_slice_shape(num_col);
+    auto reduce_blocks = [&](int64 begin, int64 end) {
+      for (int64 p = block_starts[begin]; p < block_starts[end]; ++p) {
+        // Every segment sets the gap between the previous segment and itself
+        // to the default value, as we do not initialize the output buffer.
+        const Index gap_start = p == 0 ? 0 : segment_out[p - 1] + 1;
+        if (segment_out[p] > gap_start) {
+          Eigen::DSizes<Eigen::DenseIndex, 2> gap_slice_shape(
+              segment_out[p] - gap_start, num_col);
+          Eigen::TensorMap<Eigen::Tensor<T, 2, Eigen::RowMajor>,
+                           Eigen::Unaligned>
+              gap_slice(&output_flat(gap_start, 0), gap_slice_shape);
+          gap_slice.setConstant(T(default_value));
+        }
+        if (is_large(p)) continue;
+
+        const int64 start = segment_starts[p];
+        const int64 num_rows = segment_starts[p + 1] - start;
+        OutT out_slice(&output_flat(segment_out[p], 0), out_slice_shape);
+        if (num_rows == 1) {
+          typedef Eigen::TensorMap<Eigen::Tensor<const T, 1, Eigen::RowMajor>,
+                                   Eigen::Unaligned>
+              InRowT;
+          out_slice = InRowT(&input_flat(start, 0), out_slice_shape);
+        } else {
+          Eigen::DSizes<Eigen::DenseIndex, 2> in_slice_shape(num_rows,
+                                                             num_col);
+          InT in_slice(&input_flat(start, 0), in_slice_shape);
+          out_slice = in_slice.reduce(dims_to_reduce, Reducer());
+        }
       }
-      if (end >= num_indices) break;
-      start = end;
-      ++end;
-      uninitialized_index = out_index + 1;
-      out_index = next_index;
+    };
+    const int64 cost_per_block = rows_per_block * num_col * sizeof(T);
+    Shard(worker_threads->num_threads, worker_threads->workers, num_blocks,
+          cost_per_block, reduce_blocks);
+
+    for (int64 p = 0; p < num_segments; ++p) {
+      if (!is_large(p)) continue;
+      const int64 start = segment_starts[p];
+      Eigen::DSizes<Eigen::DenseIndex, 2> in_slice_shape(
+          segment_starts[p + 1] - start, num_col);
+      InT in_slice(&input_flat(start, 0), in_slice_shape);
+      OutT out_slice(&output_flat(segment_out[p], 0), out_slice_shape);
+      out_slice.device(context->eigen_device<CPUDevice>()) =
+          in_slice.reduce(dims_to_reduce, Reducer());
     }
   }
 };
@@ -325,19 +354,90 @@ struct UnsortedSegmentFunctor<CPUDevice, T, Index, InitialValueF, ReductionF> {
     }
     const int64 N = segment_ids.dimension(0);
     const int64 num_segments = output.dimension(0);
-    ReductionF reduction;
+    const int64 inner_dim = data.dimension(1);
+    // Validate the ids up front, so that the reduction below can be split
+    // across threads. The reduction itself still skips ids that are out of
+    // range, as the ids are read again there.
     for (int64 i = 0; i < N; ++i) {
       Index j = internal::SubtleMustCopy(segment_ids(i));
-      if (j < 0) {
-        continue;
-      }
-      OP_REQUIRES(ctx, FastBoundsCheck(j, num_segments),
+      OP_REQUIRES(ctx, j < 0 || FastBoundsCheck(j, num_segments),
                   errors::InvalidArgument(
                       "segment_ids", SliceDebugString(segment_ids_shape, i),
                       " = ", j, " is out of range [0, ", num_segments, ")"));
-      reduction(data.template chip<0>(i), output.template chip<0>(j));
+    }
+    ReductionF reduction;
+    // Reduces the input rows [row_begin, row_end) with ids in
+    // [segment_begin, segment_end) into `out`.
+    auto reduce_rows = [&](int64 row_begin, int64 row_end, int64 segment_begin,
+                           int64 segment_end,
+                           typename TTypes<T, 2>::Tensor out) {
+      for (int64 i = row_begin; i < row_end; ++i) {
+        Index j = internal::SubtleMustCopy(segment_ids(i));
+        if (j < segment_begin || j >= segment_end) {
+          continue;
+        }
+        reduction(data.template chip<0>(i), out.template chip<0>(j));
+      }
+    };
+
+    auto worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
+    const int num_threads = worker_threads->num_threads;
+    if (num_threads <= 1 || data.size() < kMinParallelSize) {
+      reduce_rows(0, N, 0, num_segments, output);
+      return;
+    }
+
+    if (num_segments * num_threads <= N) {
+      // The output is small compared to the input: every thread reduces a
+      // range of input rows into its own accumulator, and the accumulators are
+      // then reduced into the output. The first thread uses the output itself.
+      std::vector<Tensor> partials(num_threads - 1);
+      for (Tensor& partial : partials) {
+        OP_REQUIRES_OK(ctx, ctx->allocate_temp(
+                                DataTypeToEnum<T>::value,
+                                TensorShape({num_segments, inner_dim}),
+                                &partial));
+      }
+      auto accumulate = [&](int64 begin, int64 end) {
+        for (int64 k = begin; k < end; ++k) {
+          typename TTypes<T, 2>::Tensor acc =
+              k == 0 ? output : partials[k - 1].matrix<T>();
+          if (k > 0) acc.setConstant(InitialValueF()());
+          reduce_rows(N * k / num_threads, N * (k + 1) / num_threads, 0,
+                      num_segments, acc);
+        }
+      };
+      Shard(num_threads, worker_threads->workers, num_threads,
+            N / num_threads * inner_dim, accumulate);
+
+      auto combine = [&](int64 begin, int64 end) {
+        for (const Tensor& partial : partials) {
+          typename TTypes<T, 2>::ConstTensor partial_mat = partial.matrix<T>();
+          for (int64 j = begin; j < end; ++j) {
+            reduction(partial_mat.template chip<0>(j),
+                      output.template chip<0>(j));
+          }
+        }
+      };
+      Shard(num_threads, worker_threads->workers, num_segments,
+            (num_threads - 1) * inner_dim, combine);
+    } else {
+      // Otherwise every thread owns a range of output rows, and reduces the
+      // input rows with ids in that range.
+      auto reduce_segments = [&](int64 begin, int64 end) {
+        for (int64 k = begin; k < end; ++k) {
+          reduce_rows(0, N, num_segments * k / num_threads,
+                      num_segments * (k + 1) / num_threads, output);
+        }
+      };
+      Shard(num_threads, worker_threads->workers, num_threads,
+            N / num_threads * inner_dim, reduce_segments);
     }
   }
+
+ private:
+  // Inputs with fewer elements are reduced on the calling thread.
+  static constexpr int64 kMinParallelSize = 1 << 15;
 };
 
 template <typename T>
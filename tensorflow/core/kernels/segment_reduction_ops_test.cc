@@ -13,9 +13,12 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
 #include <functional>
+#include <limits>
 #include <vector>
 
+#include "absl/strings/match.h"
 #include "tensorflow/core/common_runtime/device.h"
 #include "tensorflow/core/common_runtime/device_factory.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
@@ -31,6 +34,7 @@ limitations under the License.
 #include "tensorflow/core/graph/testlib.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 #include "tensorflow/core/public/session_options.h"
@@ -113,6 +117,123 @@ BM_Reduce_Arg(64, 32, 2);
 BM_Reduce_Arg(4096, 32, 2);
 BM_Reduce_Arg(4096, 128, 2);
 
+BM_Reduce_Arg(262144, 16, 4);
+BM_Reduce_Arg(262144, 16, 65536);
+
+class SegmentReductionOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(const string& op) {
+    TF_EXPECT_OK(NodeDefBuilder("op", op)
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT32))
+                     .Finalize(node_def()));
+    TF_EXPECT_OK(InitOp());
+  }
+
+  void MakeUnsortedOp(const string& op) {
+    TF_EXPECT_OK(NodeDefBuilder("op", op)
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT32))
+                     .Input(FakeInput(DT_INT32))
+                     .Finalize(node_def()));
+    TF_EXPECT_OK(InitOp());
+  }
+};
+
+// The inputs below are large enough to be reduced on several threads. Their
+// values are small integers, so that the sums are exact in any order.
+TEST_F(SegmentReductionOpTest, LargeSortedSegments) {
+  const int num_rows = 100000;
+  const int num_cols = 3;
+  // Row i goes to segment 2 * (i / 7), except for one large segment in the
+  // middle, so that every other output row is a gap.
+  auto segment_of = [](int i) {
+    return 2 * (i >= 40000 && i < 70000 ? 40000 / 7 : i / 7);
+  };
+  std::vector<float> data(num_rows * num_cols);
+  std::vector<int32> ids(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    ids[i] = segment_of(i);
+    for (int j = 0; j < num_cols; ++j) data[i * num_cols + j] = (i + j) % 5;
+  }
+  const int num_segments = ids.back() + 1;
+  for (const string op : {"SegmentSum", "SegmentMax"}) {
+    inputs_.clear();
+    MakeOp(op);
+    AddInputFromArray<float>(TensorShape({num_rows, num_cols}), data);
+    AddInputFromArray<int32>(TensorShape({num_rows}), ids);
+    TF_ASSERT_OK(RunOpKernel());
+
+    const bool is_sum = op == "SegmentSum";
+    // The gaps are zero for both reductions.
+    Tensor expected(DT_FLOAT, TensorShape({num_segments, num_cols}));
+    auto expected_mat = expected.matrix<float>();
+    expected_mat.setZero();
+    std::vector<bool> seen(num_segments, false);
+    for (int i = 0; i < num_rows; ++i) {
+      for (int j = 0; j < num_cols; ++j) {
+        float& e = expected_mat(ids[i], j);
+        const float v = data[i * num_cols + j];
+        e = is_sum ? e + v : (seen[ids[i]] ? std::max(e, v) : v);
+      }
+      seen[ids[i]] = true;
+    }
+    test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+  }
+}
+
+TEST_F(SegmentReductionOpTest, LargeUnsortedSegments) {
+  const int num_rows = 100000;
+  const int num_cols = 2;
+  std::vector<float> data(num_rows * num_cols);
+  for (int i = 0; i < num_rows * num_cols; ++i) data[i] = i % 3;
+  // Both a small number of segments, which is reduced with per-thread
+  // accumulators, and a large one, which is partitioned by segment.
+  for (const int num_segments : {10, 50000}) {
+    std::vector<int32> ids(num_rows);
+    for (int i = 0; i < num_rows; ++i) {
+      ids[i] = i % 11 == 0 ? -1 : (i * 7919) % num_segments;
+    }
+    for (const string op : {"UnsortedSegmentSum", "UnsortedSegmentMax"}) {
+      inputs_.clear();
+      MakeUnsortedOp(op);
+      AddInputFromArray<float>(TensorShape({num_rows, num_cols}), data);
+      AddInputFromArray<int32>(TensorShape({num_rows}), ids);
+      AddInputFromArray<int32>(TensorShape({}), {num_segments});
+      TF_ASSERT_OK(RunOpKernel());
+
+      const bool is_sum = op == "UnsortedSegmentSum";
+      Tensor expected(DT_FLOAT, TensorShape({num_segments, num_cols}));
+      auto expected_mat = expected.matrix<float>();
+      expected_mat.setConstant(is_sum ? 0.0f
+                                      : std::numeric_limits<float>::lowest());
+      for (int i = 0; i < num_rows; ++i) {
+        if (ids[i] < 0) continue;
+        for (int j = 0; j < num_cols; ++j) {
+          float& e = expected_mat(ids[i], j);
+          const float v = data[i * num_cols + j];
+          e = is_sum ? e + v : std::max(e, v);
+        }
+      }
+      test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+    }
+  }
+}
+
+TEST_F(SegmentReductionOpTest, UnsortedSegmentIdOutOfRange) {
+  const int num_rows = 100000;
+  std::vector<int32> ids(num_rows, 0);
+  ids[num_rows - 1] = 10;
+  MakeUnsortedOp("UnsortedSegmentSum");
+  AddInputFromArray<float>(TensorShape({num_rows}),
+                           std::vector<float>(num_rows, 1.0f));
+  AddInputFromArray<int32>(TensorShape({num_rows}), ids);
+  AddInputFromArray<int32>(TensorShape({}), {10});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(s.ToString(), "is out of range [0, 10)"))
+      << s;
+}
+
 static void SparseSegmentMeanGradHelper(int iters, float uniqueness, int size) {
   testing::StopTiming();
   Graph* g = new Graph(OpRegistry::Global());
@@ -16,6 +16,7 @@ limitations under the License.
 // Contains OP to generate sparse crosses.
 #include <assert.h>
 
+#include <cstring>
 #include <limits>
 #include <string>
 #include <vector>
@@ -27,6 +28,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/kernels/string_hash_util.h"
 #include "tensorflow/core/lib/core/stringpiece.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/platform/fingerprint.h"
@@ -55,10 +57,12 @@ template <typename InternalType>
 class SparseTensorColumn : public ColumnInterface<InternalType> {
  public:
   SparseTensorColumn(const Tensor& values, std::vector<int64> feature_counts,
-                     std::vector<int64> feature_start_indices)
+                     std::vector<int64> feature_start_indices,
+                     std::vector<uint64> string_hashes)
       : values_(values),
         feature_counts_(std::move(feature_counts)),
-        feature_start_indices_(std::move(feature_start_indices)) {
+        feature_start_indices_(std::move(feature_start_indices)),
+        string_hashes_(std::move(string_hashes)) {
     CHECK_EQ(feature_counts_.size(), feature_start_indices_.size());
   }
 
@@ -74,6 +78,8 @@ class SparseTensorColumn : public ColumnInterface<InternalType> {
   const Tensor& values_;
   std::vector<int64> feature_counts_;
   std::vector<int64> feature_start_indices_;
+  // The hashes of string values, when crossing hashes.
+  std::vector<uint64> string_hashes_;
 };
 
 // A column that is backed by a sparse tensor.
@@ -83,10 +89,12 @@ class KeyedSparseTensorColumn : public ColumnInterface<InternalType> {
   KeyedSparseTensorColumn(const Tensor& values,
                           std::vector<int64> feature_counts,
                           std::vector<int64> feature_start_indices,
-                          std::vector<int64> key)
+                          std::vector<int64> key,
+                          std::vector<uint64> string_hashes)
       : values_(values),
         feature_counts_(std::move(feature_counts)),
-        feature_start_indices_(std::move(feature_start_indices)) {
+        feature_start_indices_(std::move(feature_start_indices)),
+        string_hashes_(std::move(string_hashes)) {
     DCHECK_EQ(feature_counts_.size(), feature_start_indices_.size());
     std::memcpy(key_, key.data(), sizeof(key_));
   }
@@ -104,6 +112,8 @@ class KeyedSparseTensorColumn : public ColumnInterface<InternalType> {
   tensorflow::uint64 key_[2];
   std::vector<int64> feature_counts_;
   std::vector<int64> feature_start_indices_;
+  // The hashes of string values, when crossing hashes.
+  std::vector<uint64> string_hashes_;
 };
 
 // InternalType is int64 only when using HashCrosser.
@@ -111,8 +121,7 @@ template <>
 int64 SparseTensorColumn<int64>::Feature(int64 batch, int64 n,
                                          bool strong_hash) const {
   const int64 start = feature_start_indices_[batch];
-  if (DT_STRING == values_.dtype())
-    return Fingerprint64(values_.vec<tstring>().data()[start + n]);
+  if (DT_STRING == values_.dtype()) return string_hashes_[start + n];
   return values_.vec<int64>().data()[start + n];
 }
 
@@ -120,16 +129,12 @@ template <>
 int64 KeyedSparseTensorColumn<int64>::Feature(int64 batch, int64 n,
                                               bool strong_hash) const {
   const int64 start = feature_start_indices_[batch];
+  if (DT_STRING == values_.dtype()) return string_hashes_[start + n];
   if (strong_hash) {
-    if (DT_STRING == values_.dtype()) {
-      return StrongKeyedHash(key_, values_.vec<tstring>()(start + n));
-    }
     return StrongKeyedHash(
         key_, {reinterpret_cast<const char*>(&values_.vec<int64>()(start + n)),
                sizeof(values_.dtype())});
   }
-  if (DT_STRING == values_.dtype())
-    return Fingerprint64(values_.vec<tstring>()(start + n));
   return Fingerprint64(
       {reinterpret_cast<const char*>(&values_.vec<int64>()(start + n)),
        sizeof(values_.dtype())});
@@ -172,7 +177,8 @@ StringPiece KeyedSparseTensorColumn<StringPiece>::Feature(
 template <typename InternalType>
 class DenseTensorColumn : public ColumnInterface<InternalType> {
  public:
-  explicit DenseTensorColumn(const Tensor& tensor) : tensor_(tensor) {}
+  DenseTensorColumn(const Tensor& tensor, std::vector<uint64> string_hashes)
+      : tensor_(tensor), string_hashes_(std::move(string_hashes)) {}
 
   int64 FeatureCount(int64 batch) const override { return tensor_.dim_size(1); }
 
@@ -182,14 +188,17 @@ class DenseTensorColumn : public ColumnInterface<InternalType> {
 
  private:
   const Tensor& tensor_;
+  // The hashes of string values, when crossing hashes.
+  std::vector<uint64> string_hashes_;
 };
 
 // A column that is backed by a dense tensor.
 template <typename InternalType>
 class KeyedDenseTensorColumn : public ColumnInterface<InternalType> {
  public:
-  explicit KeyedDenseTensorColumn(const Tensor& tensor, std::vector<int64> key)
-      : tensor_(tensor) {
+  KeyedDenseTensorColumn(const Tensor& tensor, std::vector<int64> key,
+                         std::vector<uint64> string_hashes)
+      : tensor_(tensor), string_hashes_(std::move(string_hashes)) {
     std::memcpy(key_, key.data(), sizeof(key_));
   }
 
@@ -202,30 +211,31 @@ class KeyedDenseTensorColumn : public ColumnInterface<InternalType> {
  private:
   const Tensor& tensor_;
   tensorflow::uint64 key_[2];
+  // The hashes of string values, when crossing hashes.
+  std::vector<uint64> string_hashes_;
 };
 
 // InternalType is int64 only when using HashCrosser.
 template <>
 int64 DenseTensorColumn<int64>::Feature(int64 batch, int64 n,
                                         bool strong_hash) const {
-  if (DT_STRING == tensor_.dtype())
-    return Fingerprint64(tensor_.matrix<tstring>()(batch, n));
+  if (DT_STRING == tensor_.dtype()) {
+    return string_hashes_[batch * tensor_.dim_size(1) + n];
+  }
   return tensor_.matrix<int64>()(batch, n);
 }
 
 template <>
 int64 KeyedDenseTensorColumn<int64>::Feature(int64 batch, int64 n,
                                              bool strong_hash) const {
+  if (DT_STRING == tensor_.dtype()) {
+    return string_hashes_[batch * tensor_.dim_size(1) + n];
+  }
   if (strong_hash) {
-    if (DT_STRING == tensor_.dtype()) {
-      return StrongKeyedHash(key_, tensor_.matrix<tstring>()(batch, n));
-    }
     return StrongKeyedHash(
         key_, {reinterpret_cast<const char*>(tensor_.matrix<int64>()(batch, n)),
                sizeof(tensor_.dtype())});
   }
-  if (DT_STRING == tensor_.dtype())
-    return Fingerprint64(tensor_.matrix<tstring>()(batch, n));
   return tensor_.matrix<int64>()(batch, n);
 }
 
@@ -586,10 +596,44 @@ int64 CrossCountByBatchIndex(
   return cross_count;
 }
 
+// Returns the hashes of the values of a string column when crossing hashes,
+// and nothing otherwise. Every value is hashed once here, instead of once for
+// every cross that contains it.
+template <typename InternalType>
+std::vector<uint64> HashStringValues(
+    const DeviceBase::CpuWorkerThreads& worker_threads, const Tensor& values,
+    const std::vector<int64>& key, bool strong_hash) {
+  return {};
+}
+
+template <>
+std::vector<uint64> HashStringValues<int64>(
+    const DeviceBase::CpuWorkerThreads& worker_threads, const Tensor& values,
+    const std::vector<int64>& key, bool strong_hash) {
+  if (values.dtype() != DT_STRING) return {};
+  const auto values_flat = values.flat<tstring>();
+  std::vector<uint64> hashes(values_flat.size());
+  if (strong_hash) {
+    uint64 hash_key[2];
+    std::memcpy(hash_key, key.data(), sizeof(hash_key));
+    HashStrings(
+        worker_threads, values_flat.data(), values_flat.size(),
+        [&hash_key](StringPiece s) {
+          return StrongKeyedHash(hash_key, string(s));
+        },
+        hashes.data());
+  } else {
+    HashStrings(worker_threads, values_flat.data(), values_flat.size(),
+                [](StringPiece s) { return Fingerprint64(s); }, hashes.data());
+  }
+  return hashes;
+}
+
 // Generate the columns given the sparse and dense inputs.
 template <typename InternalType>
 std::vector<std::unique_ptr<ColumnInterface<InternalType>>>
-GenerateColumnsFromInput(const OpInputList& indices_list_in,
+GenerateColumnsFromInput(const DeviceBase::CpuWorkerThreads& worker_threads,
+                         const OpInputList& indices_list_in,
                          const OpInputList& values_list_in,
                          const OpInputList& shapes_list_in,
                          const OpInputList& dense_list_in) {
@@ -609,10 +653,15 @@ GenerateColumnsFromInput(const OpInputList& indices_list_in,
   for (int i = 0; i < values_list_in.size(); ++i) {
     columns.emplace_back(new SparseTensorColumn<InternalType>(
         values_list_in[i], std::move(feature_counts[i]),
-        std::move(feature_start_indices[i])));
+        std::move(feature_start_indices[i]),
+        HashStringValues<InternalType>(worker_threads, values_list_in[i], {},
+                                       /*strong_hash=*/false)));
   }
   for (int i = 0; i < dense_list_in.size(); ++i) {
-    columns.emplace_back(new DenseTensorColumn<InternalType>(dense_list_in[i]));
+    columns.emplace_back(new DenseTensorColumn<InternalType>(
+        dense_list_in[i],
+        HashStringValues<InternalType>(worker_threads, dense_list_in[i], {},
+                                       /*strong_hash=*/false)));
   }
 
   return columns;
@@ -621,11 +670,11 @@ GenerateColumnsFromInput(const OpInputList& indices_list_in,
 // Generate the columns given the sparse and dense inputs.
 template <typename InternalType>
 std::vector<std::unique_ptr<ColumnInterface<InternalType>>>
-GenerateKeyedColumnsFromInput(const OpInputList& indices_list_in,
-                              const OpInputList& values_list_in,
-                              const OpInputList& shapes_list_in,
-                              const OpInputList& dense_list_in,
-                              std::vector<int64> keys) {
+GenerateKeyedColumnsFromInput(
+    const DeviceBase::CpuWorkerThreads& worker_threads,
+    const OpInputList& indices_list_in, const OpInputList& values_list_in,
+    const OpInputList& shapes_list_in, const OpInputList& dense_list_in,
+    std::vector<int64> keys, bool strong_hash) {
   std::vector<std::unique_ptr<ColumnInterface<InternalType>>> columns;
   const int64 batch_size = CalculateBatchSize(shapes_list_in, dense_list_in);
   const int64 number_of_columns = shapes_list_in.size();
@@ -642,11 +691,15 @@ GenerateKeyedColumnsFromInput(const OpInputList& indices_list_in,
   for (int i = 0; i < values_list_in.size(); ++i) {
     columns.emplace_back(new KeyedSparseTensorColumn<InternalType>(
         values_list_in[i], std::move(feature_counts[i]),
-        std::move(feature_start_indices[i]), keys));
+        std::move(feature_start_indices[i]), keys,
+        HashStringValues<InternalType>(worker_threads, values_list_in[i], keys,
+                                       strong_hash)));
   }
   for (int i = 0; i < dense_list_in.size(); ++i) {
-    columns.emplace_back(
-        new KeyedDenseTensorColumn<InternalType>(dense_list_in[i], keys));
+    columns.emplace_back(new KeyedDenseTensorColumn<InternalType>(
+        dense_list_in[i], keys,
+        HashStringValues<InternalType>(worker_threads, dense_list_in[i], keys,
+                                       strong_hash)));
   }
 
   return columns;
@@ -714,9 +767,11 @@ class SparseCrossOp : public OpKernel {
     OP_REQUIRES_OK(context, ValidateInput(indices_list_in, values_list_in,
                                           shapes_list_in, dense_list_in));
 
+    auto* worker_threads = context->device()->tensorflow_cpu_worker_threads();
     std::vector<std::unique_ptr<ColumnInterface<InternalType>>> columns =
-        GenerateColumnsFromInput<InternalType>(indices_list_in, values_list_in,
-                                               shapes_list_in, dense_list_in);
+        GenerateColumnsFromInput<InternalType>(*worker_threads, indices_list_in,
+                                               values_list_in, shapes_list_in,
+                                               dense_list_in);
 
     const tstring k_feature_separator = "_X_";
     typename CrossTraits<HASHED_OUTPUT, InternalType>::Crosser crosser(
@@ -746,7 +801,6 @@ class SparseCrossOp : public OpKernel {
       }
     };
 
-    auto* worker_threads = context->device()->tensorflow_cpu_worker_threads();
     // TODO(zakaria): optimize kCostPerUnit
     const int kCostPerUnit = 5000 * indices_list_in.size();
     Shard(worker_threads->num_threads, worker_threads->workers, batch_size,
@@ -780,9 +834,11 @@ class SparseCrossV2Op : public OpKernel {
     OP_REQUIRES_OK(context, context->input("sep", &sep_t));
     const tstring separator = sep_t->scalar<tstring>()();
 
+    auto* worker_threads = context->device()->tensorflow_cpu_worker_threads();
     std::vector<std::unique_ptr<ColumnInterface<tstring>>> columns =
-        GenerateColumnsFromInput<tstring>(indices_list_in, values_list_in,
-                                          shapes_list_in, dense_list_in);
+        GenerateColumnsFromInput<tstring>(*worker_threads, indices_list_in,
+                                          values_list_in, shapes_list_in,
+                                          dense_list_in);
     Tensor* indices_out;
     Tensor* values_out;
     Tensor* shape_out;
@@ -808,7 +864,6 @@ class SparseCrossV2Op : public OpKernel {
       }
     };
 
-    auto* worker_threads = context->device()->tensorflow_cpu_worker_threads();
     // TODO(zakaria): optimize kCostPerUnit
     const int kCostPerUnit = 5000 * indices_list_in.size();
     Shard(worker_threads->num_threads, worker_threads->workers, batch_size,
@@ -848,10 +903,11 @@ class SparseCrossHashedOp : public OpKernel {
     const auto salt = salt_t->flat<int64>();
     std::vector<int64> key_{salt(0), salt(1)};
 
+    auto* worker_threads = context->device()->tensorflow_cpu_worker_threads();
     std::vector<std::unique_ptr<ColumnInterface<int64>>> columns =
-        GenerateKeyedColumnsFromInput<int64>(indices_list_in, values_list_in,
-                                             shapes_list_in, dense_list_in,
-                                             key_);
+        GenerateKeyedColumnsFromInput<int64>(
+            *worker_threads, indices_list_in, values_list_in, shapes_list_in,
+            dense_list_in, key_, strong_hash);
     Tensor* indices_out;
     Tensor* values_out;
     Tensor* shape_out;
@@ -878,7 +934,6 @@ class SparseCrossHashedOp : public OpKernel {
       }
     };
 
-    auto* worker_threads = context->device()->tensorflow_cpu_worker_threads();
     // TODO(zakaria): optimize kCostPerUnit
     const int kCostPerUnit = 5000 * indices_list_in.size();
     Shard(worker_threads->num_threads, worker_threads->workers, batch_size,
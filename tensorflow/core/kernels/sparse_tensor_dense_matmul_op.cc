@@ -19,17 +19,149 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/sparse_tensor_dense_matmul_op.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "tensorflow/core/framework/bounds_check.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor_util.h"
 #include "tensorflow/core/kernels/fill_functor.h"
 #include "tensorflow/core/lib/bfloat16/bfloat16.h"
+#include "tensorflow/core/platform/mutex.h"
 
 namespace tensorflow {
 
 typedef Eigen::ThreadPoolDevice CPUDevice;
 typedef Eigen::GpuDevice GPUDevice;
 
+namespace {
+
+Status KOutOfBoundsError(int64 k, std::size_t i, int rhs_index_a,
+                         std::size_t lhs_right) {
+  return errors::InvalidArgument("k (", k, ") from index[", i, ",", rhs_index_a,
+                                 "] out of bounds (>=", lhs_right, ")");
+}
+
+Status MOutOfBoundsError(int64 m, std::size_t i, int lhs_index_a,
+                         int64 out_dim0) {
+  return errors::InvalidArgument("m (", m, ") from index[", i, ",", lhs_index_a,
+                                 "] out of bounds (>=", out_dim0, ")");
+}
+
+// The sparse operand of SparseTensorDenseMatMul in compressed sparse row form,
+// with one row per row of the output: a row of `a`, or a column of `a` if `a`
+// is adjointed.
+struct SparseMatMulCsr {
+  // The entries of output row `m` are `row_starts[m]` to `row_starts[m + 1]`,
+  // in the order in which they appear in `a_indices`.
+  std::vector<int64> row_starts;
+  // The position of every entry in `a_indices` and `a_values`.
+  std::vector<int64> entries;
+  // The row of `b`, or of its adjoint, every entry is multiplied with.
+  std::vector<int64> b_rows;
+};
+
+template <typename Tindices, bool ADJ_A>
+Status BuildSparseMatMulCsr(typename TTypes<Tindices>::ConstMatrix a_indices,
+                            int64 out_rows, int64 lhs_right,
+                            SparseMatMulCsr* csr) {
+  const int lhs_index_a = ADJ_A ? 1 : 0;
+  const int rhs_index_a = ADJ_A ? 0 : 1;
+  const int64 nnz = a_indices.dimension(0);
+  std::vector<int64> rows(nnz);
+  std::vector<int64> cols(nnz);
+  csr->row_starts.assign(out_rows + 1, 0);
+  for (int64 i = 0; i < nnz; ++i) {
+    const Tindices m = internal::SubtleMustCopy(a_indices(i, lhs_index_a));
+    const Tindices k = internal::SubtleMustCopy(a_indices(i, rhs_index_a));
+    if (!FastBoundsCheck(k, lhs_right)) {
+      return KOutOfBoundsError(k, i, rhs_index_a, lhs_right);
+    }
+    if (!FastBoundsCheck(m, out_rows)) {
+      return MOutOfBoundsError(m, i, lhs_index_a, out_rows);
+    }
+    rows[i] = m;
+    cols[i] = k;
+    ++csr->row_starts[m + 1];
+  }
+  for (int64 m = 0; m < out_rows; ++m) {
+    csr->row_starts[m + 1] += csr->row_starts[m];
+  }
+  // Scatter the entries stably, so that every output element accumulates its
+  // products in the same order as a pass over `a_indices` would.
+  csr->entries.resize(nnz);
+  csr->b_rows.resize(nnz);
+  std::vector<int64> next(csr->row_starts.begin(), csr->row_starts.end() - 1);
+  for (int64 i = 0; i < nnz; ++i) {
+    const int64 j = next[rows[i]]++;
+    csr->entries[j] = i;
+    csr->b_rows[j] = cols[i];
+  }
+  return Status::OK();
+}
+
+// Output rows are accumulated in blocks of this many columns, so that the
+// block stays in L1 while the rows of `b` it depends on are streamed through.
+constexpr int64 kColumnBlock = 512;
+
+// Computes `out = a * b` from the CSR form of `a`. Output rows are independent,
+// so blocks of rows are computed in parallel without synchronization, and
+// every row is an Eigen-vectorized sequence of axpys over contiguous rows of
+// `b`.
+template <typename T, bool ADJ_A, bool ADJ_B>
+void SparseMatMulCsrCompute(const CPUDevice& d, const SparseMatMulCsr& csr,
+                            typename TTypes<T>::ConstVec a_values,
+                            typename TTypes<T>::ConstMatrix b,
+                            typename TTypes<T>::Matrix out) {
+  const int64 out_rows = out.dimension(0);
+  const int64 n = out.dimension(1);
+  const T* b_data = b.data();
+  // The rows of an adjointed `b` are its columns, so transpose and conjugate
+  // it once up front to make them contiguous.
+  Eigen::Tensor<T, 2, Eigen::RowMajor> b_adjoint;
+  if (ADJ_B) {
+    b_adjoint.resize(b.dimension(1), b.dimension(0));
+    Eigen::array<int, 2> shuffle{1, 0};
+    b_adjoint.device(d) = b.shuffle(shuffle).conjugate();
+    b_data = b_adjoint.data();
+  }
+  T* out_data = out.data();
+
+  auto work = [&csr, &a_values, b_data, out_data, n](Eigen::Index begin,
+                                                     Eigen::Index end) {
+    using Array = Eigen::Array<T, Eigen::Dynamic, 1>;
+    for (Eigen::Index m = begin; m < end; ++m) {
+      T* out_row = out_data + m * n;
+      std::fill(out_row, out_row + n, T(0));
+      const int64 first = csr.row_starts[m];
+      const int64 last = csr.row_starts[m + 1];
+      for (int64 col = 0; col < n; col += kColumnBlock) {
+        const int64 block = std::min(kColumnBlock, n - col);
+        Eigen::Map<Array> out_block(out_row + col, block);
+        for (int64 j = first; j < last; ++j) {
+          const T a_value =
+              ADJ_A ? functor::MaybeConj(a_values(csr.entries[j]))
+                    : a_values(csr.entries[j]);
+          out_block += a_value * Eigen::Map<const Array>(
+                                     b_data + csr.b_rows[j] * n + col, block);
+        }
+      }
+    }
+  };
+  const double entries_per_row =
+      static_cast<double>(csr.entries.size()) / std::max<int64>(out_rows, 1);
+  const Eigen::TensorOpCost cost(
+      entries_per_row * n * sizeof(T), n * sizeof(T),
+      entries_per_row * n *
+          (Eigen::TensorOpCost::MulCost<T>() +
+           Eigen::TensorOpCost::AddCost<T>()));
+  d.parallelFor(out_rows, cost, work);
+}
+
+}  // namespace
+
 template <typename Device, typename T, typename Tindices>
 class SparseTensorDenseMatMulOp : public OpKernel {
  public:
@@ -133,6 +265,25 @@ class SparseTensorDenseMatMulOp : public OpKernel {
       return;
     }
 
+    if (std::is_same<Device, CPUDevice>::value) {
+      std::shared_ptr<const SparseMatMulCsr> csr;
+      OP_REQUIRES_OK(ctx, GetCsr(*a_indices, outer_left, inner_left, &csr));
+#define MAYBE_ADJOINT_CPU(ADJ_A, ADJ_B)                                    \
+  if (adjoint_a_ == ADJ_A && adjoint_b_ == ADJ_B) {                        \
+    SparseMatMulCsrCompute<T, ADJ_A, ADJ_B>(                               \
+        ctx->eigen_device<CPUDevice>(), *csr, a_values->vec<T>(),          \
+        b->matrix<T>(), out->matrix<T>());                                 \
+  }
+
+      MAYBE_ADJOINT_CPU(false, false);
+      MAYBE_ADJOINT_CPU(false, true);
+      MAYBE_ADJOINT_CPU(true, false);
+      MAYBE_ADJOINT_CPU(true, true);
+
+#undef MAYBE_ADJOINT_CPU
+      return;
+    }
+
 #define MAYBE_ADJOINT(ADJ_A, ADJ_B)                                        \
   if (adjoint_a_ == ADJ_A && adjoint_b_ == ADJ_B) {                        \
     Status functor_status = functor::SparseTensorDenseMatMulFunctor<       \
@@ -152,8 +303,51 @@ class SparseTensorDenseMatMulOp : public OpKernel {
   }
 
  private:
+  // Returns the CSR form of `a`. The form built for the previous call is
+  // reused if `a_indices` and the shapes it was validated against did not
+  // change, as is the case when `a` is a constant; only the values are read
+  // again. Comparing the indices costs a sequential pass over them, which is
+  // much cheaper than the scattered writes of the conversion.
+  Status GetCsr(const Tensor& a_indices, int64 out_rows, int64 lhs_right,
+                std::shared_ptr<const SparseMatMulCsr>* csr) {
+    {
+      tf_shared_lock l(mu_);
+      if (cached_csr_ != nullptr && cached_out_rows_ == out_rows &&
+          cached_lhs_right_ == lhs_right &&
+          cached_indices_.shape() == a_indices.shape() &&
+          cached_indices_.tensor_data() == a_indices.tensor_data()) {
+        *csr = cached_csr_;
+        return Status::OK();
+      }
+    }
+    auto new_csr = std::make_shared<SparseMatMulCsr>();
+    const auto a_indices_mat = a_indices.matrix<Tindices>();
+    TF_RETURN_IF_ERROR(
+        adjoint_a_
+            ? BuildSparseMatMulCsr<Tindices, true>(a_indices_mat, out_rows,
+                                                   lhs_right, new_csr.get())
+            : BuildSparseMatMulCsr<Tindices, false>(a_indices_mat, out_rows,
+                                                    lhs_right, new_csr.get()));
+    Tensor indices_copy = tensor::DeepCopy(a_indices);
+    {
+      mutex_lock l(mu_);
+      cached_indices_ = std::move(indices_copy);
+      cached_out_rows_ = out_rows;
+      cached_lhs_right_ = lhs_right;
+      cached_csr_ = new_csr;
+    }
+    *csr = std::move(new_csr);
+    return Status::OK();
+  }
+
   bool adjoint_a_;
   bool adjoint_b_;
+
+  mutex mu_;
+  Tensor cached_indices_ TF_GUARDED_BY(mu_);
+  int64 cached_out_rows_ TF_GUARDED_BY(mu_) = -1;
+  int64 cached_lhs_right_ TF_GUARDED_BY(mu_) = -1;
+  std::shared_ptr<const SparseMatMulCsr> cached_csr_ TF_GUARDED_BY(mu_);
 };
 
 #define REGISTER_CPU(TypeT, TypeIndex)           \
@@ -227,91 +421,17 @@ REGISTER_KERNELS_GPU(float);
 
 namespace functor {
 
-namespace {
-Status KOutOfBoundsError(int64 k, std::size_t i, int rhs_index_a,
-                         std::size_t lhs_right) {
-  return errors::InvalidArgument("k (", k, ") from index[", i, ",", rhs_index_a,
-                                 "] out of bounds (>=", lhs_right, ")");
-}
-
-Status MOutOfBoundsError(int64 m, std::size_t i, int lhs_index_a,
-                         int64 out_dim0) {
-  return errors::InvalidArgument("m (", m, ") from index[", i, ",", lhs_index_a,
-                                 "] out of bounds (>=", out_dim0, ")");
-}
-}  // namespace
-
 template <typename T, typename Tindices, bool ADJ_A, bool ADJ_B>
 struct SparseTensorDenseMatMulFunctor<CPUDevice, T, Tindices, ADJ_A, ADJ_B> {
-  // Vectorize certain operations above this size.
-  static constexpr std::size_t kNumVectorize = 32;
-
   static Status Compute(const CPUDevice& d, typename TTypes<T>::Matrix out,
                         typename TTypes<Tindices>::ConstMatrix a_indices,
                         typename TTypes<T>::ConstVec a_values,
                         typename TTypes<T>::ConstMatrix b) {
-    const std::size_t nnz = a_values.size();
-    const std::size_t rhs_right = (ADJ_B ? b.dimension(0) : b.dimension(1));
-    const std::size_t lhs_right = (ADJ_B ? b.dimension(1) : b.dimension(0));
-    const int lhs_index_a = ADJ_A ? 1 : 0;
-    const int rhs_index_a = ADJ_A ? 0 : 1;
-
-    out.setZero();
-
-    // TODO(ebrevdo): After many failed experiments, can't find a multi-threaded
-    // approach that achieves the performance of the single threaded
-    // one.  Perhaps Eigen threadpool implementation is just too slow?
-
-    if (rhs_right < kNumVectorize) {
-      // Disable vectorization if the RHS of output is too small
-      auto maybe_adjoint_b = MaybeAdjoint<decltype(b), ADJ_B>(b);
-
-      for (std::size_t i = 0; i < nnz; ++i) {
-        const Tindices m = internal::SubtleMustCopy(a_indices(i, lhs_index_a));
-        const Tindices k = internal::SubtleMustCopy(a_indices(i, rhs_index_a));
-        if (!FastBoundsCheck(k, lhs_right)) {
-          return KOutOfBoundsError(k, i, rhs_index_a, lhs_right);
-        }
-        if (!FastBoundsCheck(m, out.dimension(0))) {
-          return MOutOfBoundsError(m, i, lhs_index_a, out.dimension(0));
-        }
-        const T a_value = ADJ_A ? MaybeConj(a_values(i)) : a_values(i);
-        for (std::size_t n = 0; n < rhs_right; ++n) {
-          const T b_value = maybe_adjoint_b(k, n);
-          out(m, n) += a_value * b_value;
-        }
-      }
-    } else {
-      // Vectorization via Eigen.
-      const int b_chip_index = ADJ_B ? 1 : 0;
-
-#define LOOP_NNZ(b_passed)                                                  \
-  for (std::size_t i = 0; i < nnz; ++i) {                                   \
-    const Tindices m = internal::SubtleMustCopy(a_indices(i, lhs_index_a)); \
-    const Tindices k = internal::SubtleMustCopy(a_indices(i, rhs_index_a)); \
-    const T a_value = (ADJ_A) ? MaybeConj(a_values(i)) : a_values(i);       \
-    if (!FastBoundsCheck(k, lhs_right)) {                                   \
-      return KOutOfBoundsError(k, i, rhs_index_a, lhs_right);               \
-    }                                                                       \
-    if (!FastBoundsCheck(m, out.dimension(0))) {                            \
-      return MOutOfBoundsError(m, i, lhs_index_a, out.dimension(0));        \
-    }                                                                       \
-    out.template chip<0>(m) +=                                              \
-        b_passed.template chip<b_chip_index>(k) * a_value;                  \
-  }
-
-      if (ADJ_B) {
-        // Perform transpose and conjugation on B once, since we chip out B's
-        // columns in the nnz loop.
-        Eigen::array<int, 2> shuffle(1, 0);  // preserve dimension order
-        Eigen::Tensor<T, 2, Eigen::ColMajor> col_major_conj_b =
-            b.swap_layout().shuffle(shuffle).conjugate();
-        LOOP_NNZ(col_major_conj_b);
-      } else {
-        LOOP_NNZ(b);
-      }
-#undef LOOP_NNZ
-    }
+    const int64 lhs_right = ADJ_B ? b.dimension(1) : b.dimension(0);
+    SparseMatMulCsr csr;
+    TF_RETURN_IF_ERROR(BuildSparseMatMulCsr<Tindices, ADJ_A>(
+        a_indices, out.dimension(0), lhs_right, &csr));
+    SparseMatMulCsrCompute<T, ADJ_A, ADJ_B>(d, csr, a_values, b, out);
     return Status::OK();
   }
 };
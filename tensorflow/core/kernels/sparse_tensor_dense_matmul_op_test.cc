@@ -14,15 +14,105 @@ limitations under the License.
 ==============================================================================*/
 
 #include <random>
+#include <vector>
 
+#include "absl/strings/match.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 
+class SparseTensorDenseMatMulOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(bool adjoint_a, bool adjoint_b) {
+    TF_ASSERT_OK(NodeDefBuilder("matmul", "SparseTensorDenseMatMul")
+                     .Input(FakeInput(DT_INT64))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT64))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Attr("adjoint_a", adjoint_a)
+                     .Attr("adjoint_b", adjoint_b)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Runs the op on the entries `(indices[i], values[i])` of a 3x4 sparse `a`
+  // (4x3 if adjointed) and `b`, and checks the result against a dense
+  // product.
+  void RunAndCheck(bool adjoint_a, bool adjoint_b,
+                   const std::vector<int64>& indices,
+                   const std::vector<float>& values) {
+    const int64 nnz = values.size();
+    const int64 a_rows = adjoint_a ? 4 : 3;
+    const int64 a_cols = adjoint_a ? 3 : 4;
+    const int64 n = 70;  // Wider than a vector register.
+    std::vector<float> b(4 * n);
+    for (int64 i = 0; i < static_cast<int64>(b.size()); ++i) {
+      b[i] = static_cast<float>(i % 13) - 6.0f;
+    }
+    inputs_.clear();
+    AddInputFromArray<int64>(TensorShape({nnz, 2}), indices);
+    AddInputFromArray<float>(TensorShape({nnz}), values);
+    AddInputFromArray<int64>(TensorShape({2}), {a_rows, a_cols});
+    AddInputFromArray<float>(
+        adjoint_b ? TensorShape({n, 4}) : TensorShape({4, n}), b);
+    TF_ASSERT_OK(RunOpKernel());
+
+    Tensor expected(DT_FLOAT, TensorShape({3, n}));
+    auto expected_mat = expected.matrix<float>();
+    expected_mat.setZero();
+    for (int64 i = 0; i < nnz; ++i) {
+      const int64 m = indices[2 * i + (adjoint_a ? 1 : 0)];
+      const int64 k = indices[2 * i + (adjoint_a ? 0 : 1)];
+      for (int64 j = 0; j < n; ++j) {
+        expected_mat(m, j) += values[i] * (adjoint_b ? b[j * 4 + k]
+                                                     : b[k * n + j]);
+      }
+    }
+    test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+  }
+};
+
+TEST_F(SparseTensorDenseMatMulOpTest, MatchesDenseProduct) {
+  for (const bool adjoint_a : {false, true}) {
+    for (const bool adjoint_b : {false, true}) {
+      MakeOp(adjoint_a, adjoint_b);
+      // Unordered entries, with a duplicate and an empty output row.
+      const std::vector<int64> indices =
+          adjoint_a ? std::vector<int64>{3, 2, 0, 0, 1, 2, 3, 2}
+                    : std::vector<int64>{2, 3, 0, 0, 2, 1, 2, 3};
+      RunAndCheck(adjoint_a, adjoint_b, indices, {1.0f, -2.0f, 0.5f, 4.0f});
+    }
+  }
+}
+
+TEST_F(SparseTensorDenseMatMulOpTest, ReusesStructureOnlyForSameIndices) {
+  MakeOp(false, false);
+  RunAndCheck(false, false, {0, 1, 2, 3}, {1.0f, 2.0f});
+  // Same indices, new values.
+  RunAndCheck(false, false, {0, 1, 2, 3}, {-3.0f, 5.0f});
+  // New indices of the same shape.
+  RunAndCheck(false, false, {1, 0, 1, 3}, {-3.0f, 5.0f});
+}
+
+TEST_F(SparseTensorDenseMatMulOpTest, OutOfBoundsIndex) {
+  MakeOp(false, false);
+  AddInputFromArray<int64>(TensorShape({1, 2}), {0, 4});
+  AddInputFromArray<float>(TensorShape({1}), {1.0f});
+  AddInputFromArray<int64>(TensorShape({2}), {3, 4});
+  AddInputFromArray<float>(TensorShape({4, 2}), {1, 2, 3, 4, 5, 6, 7, 8});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(s.error_message(), "out of bounds")) << s;
+}
+
 Node* SparseTensorDenseMatMulNode(Graph* g, Node* a_indices, Node* a_values,
                                   Node* a_shape, Node* b, bool adjoint_a,
                                   bool adjoint_b) {
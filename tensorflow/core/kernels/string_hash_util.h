@@ -0,0 +1,70 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_STRING_HASH_UTIL_H_
+#define TENSORFLOW_CORE_KERNELS_STRING_HASH_UTIL_H_
+
+#include <algorithm>
+
+#include "tensorflow/core/framework/device_base.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/platform/prefetch.h"
+#include "tensorflow/core/platform/tstring.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+// Sets output[i] = hash(input[i]) for i in [0, n), where `hash` is a callable
+// that takes a StringPiece and returns a uint64.
+//
+// The strings are hashed in groups, and the bytes of the next group are
+// prefetched while a group is hashed, which hides most of the cache misses on
+// strings that are not stored inline. Large inputs are split across
+// `worker_threads`.
+template <typename Hash>
+void HashStrings(const DeviceBase::CpuWorkerThreads& worker_threads,
+                 const tstring* input, int64 n, const Hash& hash,
+                 uint64* output) {
+  constexpr int64 kGroupSize = 8;
+  auto hash_range = [&](int64 begin, int64 end) {
+    for (int64 group = begin; group < end; group += kGroupSize) {
+      const int64 group_end = std::min(group + kGroupSize, end);
+      const int64 next_group_end = std::min(group_end + kGroupSize, end);
+      for (int64 i = group_end; i < next_group_end; ++i) {
+        port::prefetch<port::PREFETCH_HINT_T0>(input[i].data());
+      }
+      for (int64 i = group; i < group_end; ++i) {
+        output[i] = hash(StringPiece(input[i].data(), input[i].size()));
+      }
+    }
+  };
+
+  // Hashing takes about a cycle per byte on top of a fixed cost per string;
+  // the length is estimated from the first strings.
+  constexpr int64 kCostPerString = 40;
+  constexpr int64 kSampleSize = 64;
+  const int64 sample_size = std::min(n, kSampleSize);
+  int64 sample_bytes = 0;
+  for (int64 i = 0; i < sample_size; ++i) sample_bytes += input[i].size();
+  const int64 cost_per_unit =
+      kCostPerString + (sample_size > 0 ? sample_bytes / sample_size : 0);
+  Shard(worker_threads.num_threads, worker_threads.workers, n, cost_per_unit,
+        hash_range);
+}
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_STRING_HASH_UTIL_H_
@@ -20,7 +20,10 @@ limitations under the License.
 #include "tensorflow/core/kernels/topk_op.h"
 
 #include <algorithm>
+#include <cstring>
+#include <functional>
 #include <numeric>
+#include <type_traits>
 #include <vector>
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -36,6 +39,205 @@ namespace tensorflow {
 typedef Eigen::ThreadPoolDevice CPUDevice;
 typedef Eigen::GpuDevice GPUDevice;
 
+namespace {
+
+// Maps values to unsigned integer keys that have the same order, so that the
+// top k values can be found by radix selection. NaNs get the smallest key, so
+// that they rank below all other values, as they never replace a value in the
+// TopN heap.
+template <typename T, typename Enable = void>
+struct TopKRadixKey;
+
+template <typename T>
+struct TopKRadixKey<
+    T, typename std::enable_if<std::is_integral<T>::value>::type> {
+  typedef typename std::make_unsigned<T>::type Key;
+  static Key Get(T value) {
+    const Key key = static_cast<Key>(value);
+    // Flipping the sign bit moves the negative values below the positive ones.
+    return std::is_signed<T>::value
+               ? static_cast<Key>(key ^ (Key(1) << (8 * sizeof(Key) - 1)))
+               : key;
+  }
+};
+
+template <typename Key, typename Float>
+Key FloatRadixKey(Float value) {
+  if (Eigen::numext::isnan(value)) return 0;
+  // -0 and +0 compare equal, so they need to get the same key.
+  if (value == Float(0)) value = Float(0);
+  Key bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  // Setting the sign bit moves the positive values above the negative ones,
+  // and flipping all bits of the negative values reverses their order.
+  const Key sign = Key(1) << (8 * sizeof(Key) - 1);
+  return (bits & sign) ? ~bits : (bits | sign);
+}
+
+template <>
+struct TopKRadixKey<float> {
+  typedef uint32 Key;
+  static Key Get(float value) { return FloatRadixKey<Key>(value); }
+};
+
+template <>
+struct TopKRadixKey<double> {
+  typedef uint64 Key;
+  static Key Get(double value) { return FloatRadixKey<Key>(value); }
+};
+
+template <>
+struct TopKRadixKey<Eigen::half> {
+  typedef uint32 Key;
+  static Key Get(Eigen::half value) {
+    return FloatRadixKey<Key>(static_cast<float>(value));
+  }
+};
+
+template <>
+struct TopKRadixKey<bfloat16> {
+  typedef uint32 Key;
+  static Key Get(bfloat16 value) {
+    return FloatRadixKey<Key>(static_cast<float>(value));
+  }
+};
+
+// Writes the indices of the k largest of input[0, n) to `out`, in increasing
+// index order. Of equal values, the ones with lower indices are selected.
+//
+// The k-th largest key is found one byte at a time, most significant first,
+// from histograms of the keys that agree with it in the bytes found so far.
+// The row is split into `num_chunks` chunks that are processed in parallel on
+// `worker_threads` (which may be null if `num_chunks` is 1). After the first
+// two passes over the row, every chunk only revisits its own candidates.
+template <typename T>
+void RadixSelectTopK(const T* input, int64 n, int64 k,
+                     const DeviceBase::CpuWorkerThreads* worker_threads,
+                     int num_chunks, int32* out) {
+  typedef TopKRadixKey<T> KeyFn;
+  typedef typename KeyFn::Key Key;
+  constexpr int kRadixBits = 8;
+  constexpr int kNumBuckets = 1 << kRadixBits;
+
+  auto chunk_start = [n, num_chunks](int64 c) { return n * c / num_chunks; };
+  auto for_each_chunk = [&](const std::function<void(int64)>& fn) {
+    if (num_chunks == 1) {
+      fn(0);
+      return;
+    }
+    Shard(worker_threads->num_threads, worker_threads->workers, num_chunks,
+          n / num_chunks * 10, [&fn](int64 begin, int64 end) {
+            for (int64 c = begin; c < end; ++c) fn(c);
+          });
+  };
+
+  std::vector<int64> histograms(num_chunks * kNumBuckets);
+  std::vector<int64> num_greater(num_chunks, 0);
+  std::vector<std::vector<int32>> candidates(num_chunks);
+  bool use_candidates = false;
+  // The keys found so far, and the number of keys that still have to be
+  // selected among the ones that match them.
+  Key prefix = 0;
+  Key mask = 0;
+  int64 remaining = k;
+  int digit = kNumBuckets - 1;
+  for (int shift = 8 * sizeof(Key) - kRadixBits; shift >= 0;
+       shift -= kRadixBits) {
+    const bool collect_candidates = mask != 0 && !use_candidates;
+    for_each_chunk([&](int64 c) {
+      int64* histogram = &histograms[c * kNumBuckets];
+      std::fill(histogram, histogram + kNumBuckets, 0);
+      if (use_candidates) {
+        std::vector<int32>& chunk_candidates = candidates[c];
+        auto kept = chunk_candidates.begin();
+        for (const int32 i : chunk_candidates) {
+          const Key key = KeyFn::Get(input[i]);
+          if ((key & mask) == prefix) {
+            ++histogram[(key >> shift) & (kNumBuckets - 1)];
+            *kept++ = i;
+          }
+        }
+        chunk_candidates.erase(kept, chunk_candidates.end());
+      } else {
+        for (int64 i = chunk_start(c); i < chunk_start(c + 1); ++i) {
+          const Key key = KeyFn::Get(input[i]);
+          if ((key & mask) == prefix) {
+            ++histogram[(key >> shift) & (kNumBuckets - 1)];
+            if (collect_candidates) candidates[c].push_back(i);
+          }
+        }
+      }
+    });
+    use_candidates |= collect_candidates;
+
+    // Find the bucket of the k-th largest key; all larger buckets are
+    // selected.
+    int64 count = 0;
+    for (digit = kNumBuckets - 1;; --digit) {
+      count = 0;
+      for (int c = 0; c < num_chunks; ++c) {
+        count += histograms[c * kNumBuckets + digit];
+      }
+      if (count >= remaining) break;
+      remaining -= count;
+    }
+    for (int c = 0; c < num_chunks; ++c) {
+      const int64* histogram = &histograms[c * kNumBuckets];
+      num_greater[c] = std::accumulate(histogram + digit + 1,
+                                       histogram + kNumBuckets, num_greater[c]);
+    }
+    prefix |= static_cast<Key>(Key(digit) << shift);
+    mask |= static_cast<Key>(Key(kNumBuckets - 1) << shift);
+    // Stop early if the whole bucket is selected.
+    if (count == remaining) break;
+  }
+
+  // Every chunk writes its keys above the prefix and, in index order, its
+  // share of the keys equal to it.
+  std::vector<int64> offsets(num_chunks);
+  std::vector<int64> num_equal(num_chunks);
+  for (int64 c = 0, offset = 0; c < num_chunks; ++c) {
+    num_equal[c] =
+        std::min(histograms[c * kNumBuckets + digit], remaining);
+    remaining -= num_equal[c];
+    offsets[c] = offset;
+    offset += num_greater[c] + num_equal[c];
+  }
+  for_each_chunk([&](int64 c) {
+    int32* chunk_out = out + offsets[c];
+    int64 equal_left = num_equal[c];
+    for (int64 i = chunk_start(c); i < chunk_start(c + 1); ++i) {
+      const Key key = KeyFn::Get(input[i]) & mask;
+      if (key > prefix || (key == prefix && equal_left-- > 0)) {
+        *chunk_out++ = i;
+      }
+    }
+  });
+}
+
+// Sorts the indices [begin, end) by decreasing value of input, and by
+// increasing index among equal values. Compares the keys used by
+// RadixSelectTopK(), which order NaNs consistently.
+template <typename T>
+void SortTopKIndices(const T* input, int32* begin, int32* end) {
+  typedef TopKRadixKey<T> KeyFn;
+  std::sort(begin, end, [input](const int32 a, const int32 b) {
+    const auto key_a = KeyFn::Get(input[a]);
+    const auto key_b = KeyFn::Get(input[b]);
+    return key_a > key_b || (key_a == key_b && a < b);
+  });
+}
+
+// Rows shorter than this are handled by the TopN heap even for large k, as
+// the histogram passes of the radix selection don't pay off.
+constexpr int64 kMinRadixCols = 1 << 10;
+
+// Rows are split across threads when there are fewer rows than threads and
+// every thread gets at least this many columns.
+constexpr int64 kMinColsPerChunk = 1 << 15;
+
+}  // namespace
+
 template <typename Device, typename T>
 class TopK : public OpKernel {
  public:
@@ -151,11 +353,6 @@ struct TopKFunctor<CPUDevice, T> {
         const auto comp = [input_data](const int32 a, const int32 b) {
           return input_data[b] < input_data[a];
         };
-        // TODO(ebrevdo): For large k < num_cols, instead of using
-        // TopN, it may be faster to create a temporary vector of
-        // values 0..num_cols - 1 and then use std::partial_sort_copy
-        // of this into indices. Choosing the appropriate minimum k or
-        // ratio of k/num_cols will require some experimentation.
         if (k == num_cols) {
           auto* begin = &indices(b, 0);
           auto* end = &indices(b, k);
@@ -178,6 +375,13 @@ struct TopKFunctor<CPUDevice, T> {
             }
             run_begin = run_end;
           }
+        } else if (num_cols >= kMinRadixCols && k > num_cols / 16) {
+          // For large k, a heap would take most values in; select them by
+          // radix instead, and sort the selection if needed.
+          RadixSelectTopK(input_data, num_cols, k, nullptr, 1, &indices(b, 0));
+          if (sorted) {
+            SortTopKIndices(input_data, &indices(b, 0), &indices(b, k));
+          }
         } else {
           // Use the TopN heap object to sort.
           gtl::TopN<int32, decltype(stable_comp)> filter(k, stable_comp);
@@ -222,6 +426,24 @@ struct TopKFunctor<CPUDevice, T> {
                                  ? kint64max
                                  : static_cast<int64>(total_cost);
     auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
+
+    // With fewer rows than threads, every row is split across the threads
+    // instead.
+    if (k < num_cols && num_rows < worker_threads.num_threads &&
+        num_cols >= 2 * kMinColsPerChunk) {
+      const int num_chunks = std::min<int64>(worker_threads.num_threads,
+                                             num_cols / kMinColsPerChunk);
+      for (int64 b = 0; b < num_rows; ++b) {
+        const T* input_data = &input(b, 0);
+        RadixSelectTopK(input_data, num_cols, k, &worker_threads, num_chunks,
+                        &indices(b, 0));
+        if (sorted) SortTopKIndices(input_data, &indices(b, 0), &indices(b, k));
+        std::transform(&indices(b, 0), &indices(b, k), &values(b, 0),
+                       [b, &input](const int32 loc) { return input(b, loc); });
+      }
+      return Status::OK();
+    }
+
     Shard(worker_threads.num_threads, worker_threads.workers, num_rows,
           final_cost, SortIndices);
 
@@ -13,9 +13,12 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
 #include <functional>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/framework/bounds_check.h"
@@ -26,6 +29,8 @@ limitations under the License.
 #include "tensorflow/core/lib/bfloat16/bfloat16.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace {
@@ -68,6 +73,36 @@ struct UniqueOpHashMap<bfloat16, TIndex> {
   using map_type = std::unordered_map<bfloat16, TIndex>;
 };
 
+// `UniqueOpPartitioner` assigns elements of type `T` to one of
+// `num_partitions` partitions for the parallel implementation of `UniqueOp`.
+// Only integral types are partitioned: they are the common case (sparse ids)
+// and, unlike floating-point types, equal values always have equal bit
+// patterns, so equal values can never land in different partitions.
+template <typename T, typename Enable = void>
+struct UniqueOpPartitioner {
+  static constexpr bool kEnabled = false;
+  static int Partition(const T& value, int num_partitions) { return 0; }
+};
+
+template <typename T>
+struct UniqueOpPartitioner<
+    T, typename std::enable_if<std::is_integral<T>::value>::type> {
+  static constexpr bool kEnabled = true;
+  static int Partition(T value, int num_partitions) {
+    // `std::hash` is the identity for integers, so mix the bits before
+    // reducing to avoid sending strided ids to the same partition.
+    const uint64 h = static_cast<uint64>(value) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<int>((h >> 32) % num_partitions);
+  }
+};
+
+// Inputs with at least this many elements are uniquified in parallel when
+// more than one intra-op thread is available.
+constexpr int64 kDefaultParallelThreshold = 1 << 16;
+// Upper bound on the number of hash partitions (and input blocks) used by the
+// parallel implementation.
+constexpr int kMaxPartitions = 64;
+
 // `UniqueOp` computes the unique elements in the input tensor.
 //
 // * `T` is the element type.
@@ -76,7 +111,19 @@ struct UniqueOpHashMap<bfloat16, TIndex> {
 template <typename T, typename TIndex>
 class UniqueOp : public OpKernel {
  public:
-  explicit UniqueOp(OpKernelConstruction* context) : OpKernel(context) {}
+  explicit UniqueOp(OpKernelConstruction* context) : OpKernel(context) {
+    // A non-positive threshold disables the parallel implementation.
+    OP_REQUIRES_OK(context, ReadInt64FromEnvVar("TF_UNIQUE_PARALLEL_THRESHOLD",
+                                                kDefaultParallelThreshold,
+                                                &parallel_threshold_));
+    // The serial implementation always emits unique elements in order of
+    // first occurrence. The parallel implementation does so too unless this
+    // is disabled, in which case the order of `y` is unspecified (`idx` is
+    // still consistent with it), which saves two passes over the input.
+    OP_REQUIRES_OK(context, ReadBoolFromEnvVar("TF_UNIQUE_PRESERVE_ORDER",
+                                               /*default_val=*/true,
+                                               &preserve_order_));
+  }
 
   void Compute(OpKernelContext* context) override {
     const Tensor& input = context->input(0);
@@ -150,26 +197,34 @@ class UniqueOp : public OpKernel {
       auto Tin = input.flat<T>();
       const int64 N = static_cast<int64>(Tin.size());
 
-      typename UniqueOpHashMap<T, TIndex>::map_type uniq;
-      uniq.reserve(2 * N);
-      for (Eigen::Index i = 0, j = 0; i < N; ++i) {
-        auto it = uniq.emplace(Tin(i), j);
-        idx_vec(i) = it.first->second;
-        if (it.second) {
-          ++j;
+      const int num_threads =
+          context->device()->tensorflow_cpu_worker_threads()->num_threads;
+      if (UniqueOpPartitioner<T>::kEnabled && parallel_threshold_ > 0 &&
+          N >= parallel_threshold_ && num_threads > 1) {
+        ComputeParallel(context, input, axis, idx_vec, &uniq_size);
+        if (!context->status().ok()) return;
+      } else {
+        typename UniqueOpHashMap<T, TIndex>::map_type uniq;
+        uniq.reserve(2 * N);
+        for (Eigen::Index i = 0, j = 0; i < N; ++i) {
+          auto it = uniq.emplace(Tin(i), j);
+          idx_vec(i) = it.first->second;
+          if (it.second) {
+            ++j;
+          }
         }
-      }
 
-      uniq_size = static_cast<int64>(uniq.size());
-      TensorShape output_shape(input.shape());
-      output_shape.set_dim(axis, uniq_size);
-      Tensor* output = nullptr;
-      OP_REQUIRES_OK(context,
-                     context->allocate_output(0, output_shape, &output));
-      auto Tout = output->flat<T>();
+        uniq_size = static_cast<int64>(uniq.size());
+        TensorShape output_shape(input.shape());
+        output_shape.set_dim(axis, uniq_size);
+        Tensor* output = nullptr;
+        OP_REQUIRES_OK(context,
+                       context->allocate_output(0, output_shape, &output));
+        auto Tout = output->flat<T>();
 
-      for (const auto& it : uniq) {
-        Tout(it.second) = it.first;
+        for (const auto& it : uniq) {
+          Tout(it.second) = it.first;
+        }
       }
     } else {
       // General implementation when unique is run over multiple elements.
@@ -237,6 +292,149 @@ class UniqueOp : public OpKernel {
       }
     }
   }
+
+ private:
+  // Uniquifies the single-element input `input` using all intra-op threads.
+  //
+  // The input is split into contiguous blocks whose positions are bucketed by
+  // `UniqueOpPartitioner`, so that all occurrences of a value belong to the
+  // same partition. Each partition is then deduplicated independently by
+  // visiting its buckets in block order, and output positions are assigned
+  // with a prefix sum: over the first occurrences of each block when
+  // preserving order, and over the partition sizes otherwise.
+  void ComputeParallel(OpKernelContext* context, const Tensor& input,
+                       int64 axis, typename TTypes<TIndex>::Vec idx_vec,
+                       int64* uniq_size) {
+    auto Tin = input.flat<T>();
+    const int64 N = static_cast<int64>(Tin.size());
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    const int num_parts = std::min(worker_threads->num_threads, kMaxPartitions);
+    const int64 block_size = (N + num_parts - 1) / num_parts;
+    // Runs `work` over the range of blocks (or, equivalently, partitions).
+    auto shard = [worker_threads, num_parts, block_size](
+                     int64 cost_per_element,
+                     const std::function<void(int64, int64)>& work) {
+      Shard(worker_threads->num_threads, worker_threads->workers, num_parts,
+            block_size * cost_per_element, work);
+    };
+
+    // `buckets[b * num_parts + p]` holds the positions in block `b` whose
+    // value belongs to partition `p`, in increasing order.
+    std::vector<std::vector<TIndex>> buckets(num_parts * num_parts);
+    shard(/*cost_per_element=*/10, [&](int64 start, int64 limit) {
+      for (int64 b = start; b < limit; ++b) {
+        std::vector<TIndex>* block_buckets = &buckets[b * num_parts];
+        const int64 end = std::min(N, (b + 1) * block_size);
+        for (int64 i = b * block_size; i < end; ++i) {
+          block_buckets[UniqueOpPartitioner<T>::Partition(Tin(i), num_parts)]
+              .push_back(i);
+        }
+      }
+    });
+
+    // Deduplicate each partition. When preserving order, `idx_vec(i)` is set
+    // to the position of the first occurrence of `Tin(i)`; otherwise it is set
+    // to the index of `Tin(i)` among the unique elements of its partition,
+    // whose first occurrences are recorded in `part_firsts`.
+    std::vector<int64> part_sizes(num_parts);
+    std::vector<std::vector<TIndex>> part_firsts(preserve_order_ ? 0
+                                                                 : num_parts);
+    shard(/*cost_per_element=*/50, [&](int64 start, int64 limit) {
+      for (int64 p = start; p < limit; ++p) {
+        size_t part_elements = 0;
+        for (int b = 0; b < num_parts; ++b) {
+          part_elements += buckets[b * num_parts + p].size();
+        }
+        typename UniqueOpHashMap<T, TIndex>::map_type uniq;
+        uniq.reserve(part_elements);
+        for (int b = 0; b < num_parts; ++b) {
+          for (const TIndex i : buckets[b * num_parts + p]) {
+            auto it = uniq.emplace(
+                Tin(i), preserve_order_ ? i : static_cast<TIndex>(uniq.size()));
+            idx_vec(i) = it.first->second;
+            if (it.second && !preserve_order_) {
+              part_firsts[p].push_back(i);
+            }
+          }
+        }
+        part_sizes[p] = static_cast<int64>(uniq.size());
+      }
+    });
+
+    *uniq_size = 0;
+    for (const int64 size : part_sizes) {
+      *uniq_size += size;
+    }
+    TensorShape output_shape(input.shape());
+    output_shape.set_dim(axis, *uniq_size);
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &output));
+    auto Tout = output->flat<T>();
+
+    if (preserve_order_) {
+      // A position is a first occurrence iff `idx_vec` points back at it.
+      // Rank the first occurrences of each block with an exclusive prefix sum
+      // over the per-block counts, then map every position to the rank of its
+      // first occurrence.
+      std::vector<int64> block_offsets(num_parts + 1, 0);
+      shard(/*cost_per_element=*/1, [&](int64 start, int64 limit) {
+        for (int64 b = start; b < limit; ++b) {
+          const int64 end = std::min(N, (b + 1) * block_size);
+          int64 count = 0;
+          for (int64 i = b * block_size; i < end; ++i) {
+            count += (idx_vec(i) == i);
+          }
+          block_offsets[b + 1] = count;
+        }
+      });
+      for (int b = 0; b < num_parts; ++b) {
+        block_offsets[b + 1] += block_offsets[b];
+      }
+      std::vector<TIndex> rank(N);
+      shard(/*cost_per_element=*/2, [&](int64 start, int64 limit) {
+        for (int64 b = start; b < limit; ++b) {
+          const int64 end = std::min(N, (b + 1) * block_size);
+          TIndex next = static_cast<TIndex>(block_offsets[b]);
+          for (int64 i = b * block_size; i < end; ++i) {
+            if (idx_vec(i) == i) {
+              rank[i] = next;
+              Tout(next) = Tin(i);
+              ++next;
+            }
+          }
+        }
+      });
+      shard(/*cost_per_element=*/2, [&](int64 start, int64 limit) {
+        const int64 end = std::min(N, limit * block_size);
+        for (int64 i = start * block_size; i < end; ++i) {
+          idx_vec(i) = rank[idx_vec(i)];
+        }
+      });
+    } else {
+      // Partition `p` owns the output range starting at the sum of the sizes
+      // of the partitions before it.
+      std::vector<int64> part_offsets(num_parts, 0);
+      for (int p = 1; p < num_parts; ++p) {
+        part_offsets[p] = part_offsets[p - 1] + part_sizes[p - 1];
+      }
+      shard(/*cost_per_element=*/2, [&](int64 start, int64 limit) {
+        for (int64 p = start; p < limit; ++p) {
+          const TIndex offset = static_cast<TIndex>(part_offsets[p]);
+          for (int64 j = 0; j < part_sizes[p]; ++j) {
+            Tout(offset + j) = Tin(part_firsts[p][j]);
+          }
+          for (int b = 0; b < num_parts; ++b) {
+            for (const TIndex i : buckets[b * num_parts + p]) {
+              idx_vec(i) += offset;
+            }
+          }
+        }
+      });
+    }
+  }
+
+  int64 parallel_threshold_;
+  bool preserve_order_;
 };
 
 #define REGISTER_UNIQUE(type)                                    \
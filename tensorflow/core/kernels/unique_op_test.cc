@@ -13,13 +13,20 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
+#include <cstdlib>
 #include <functional>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/graph/algorithm.h"
@@ -37,6 +44,90 @@ namespace {
 
 const int kMaxStrLen = 40;
 
+class UniqueOpTest : public OpsTestBase {
+ protected:
+  // The parallel implementation is selected when the op kernel is created,
+  // so the environment is set up before `InitOp()`.
+  void MakeOp(bool preserve_order) {
+    setenv("TF_UNIQUE_PARALLEL_THRESHOLD", "1024", /*overwrite=*/1);
+    setenv("TF_UNIQUE_PRESERVE_ORDER", preserve_order ? "true" : "false",
+           /*overwrite=*/1);
+    TF_ASSERT_OK(NodeDefBuilder("unique_op", "UniqueWithCounts")
+                     .Input(FakeInput(DT_INT64))
+                     .Attr("out_idx", DT_INT32)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    unsetenv("TF_UNIQUE_PARALLEL_THRESHOLD");
+    unsetenv("TF_UNIQUE_PRESERVE_ORDER");
+  }
+
+  // Returns `num_elements` ids drawn from `num_distinct` strided values.
+  static std::vector<int64> MakeIds(int num_elements, int num_distinct) {
+    std::vector<int64> ids(num_elements);
+    for (int i = 0; i < num_elements; ++i) {
+      ids[i] = static_cast<int64>(std::rand() % num_distinct) * 64 - 1000;
+    }
+    return ids;
+  }
+};
+
+TEST_F(UniqueOpTest, LargeInputPreservesFirstOccurrenceOrder) {
+  MakeOp(/*preserve_order=*/true);
+  const std::vector<int64> ids = MakeIds(100000, 5000);
+  AddInputFromArray<int64>(TensorShape({static_cast<int64>(ids.size())}),
+                           ids);
+  TF_ASSERT_OK(RunOpKernel());
+
+  std::unordered_map<int64, int32> index;
+  std::vector<int64> expected_y;
+  std::vector<int32> expected_idx;
+  std::vector<int32> expected_count;
+  for (const int64 id : ids) {
+    auto it = index.emplace(id, static_cast<int32>(expected_y.size()));
+    if (it.second) {
+      expected_y.push_back(id);
+      expected_count.push_back(0);
+    }
+    expected_idx.push_back(it.first->second);
+    ++expected_count[it.first->second];
+  }
+
+  const int64 num_unique = static_cast<int64>(expected_y.size());
+  Tensor y(DT_INT64, TensorShape({num_unique}));
+  test::FillValues<int64>(&y, expected_y);
+  test::ExpectTensorEqual<int64>(y, *GetOutput(0));
+  Tensor idx(DT_INT32, TensorShape({static_cast<int64>(ids.size())}));
+  test::FillValues<int32>(&idx, expected_idx);
+  test::ExpectTensorEqual<int32>(idx, *GetOutput(1));
+  Tensor count(DT_INT32, TensorShape({num_unique}));
+  test::FillValues<int32>(&count, expected_count);
+  test::ExpectTensorEqual<int32>(count, *GetOutput(2));
+}
+
+TEST_F(UniqueOpTest, LargeInputUnordered) {
+  MakeOp(/*preserve_order=*/false);
+  const std::vector<int64> ids = MakeIds(100000, 5000);
+  AddInputFromArray<int64>(TensorShape({static_cast<int64>(ids.size())}),
+                           ids);
+  TF_ASSERT_OK(RunOpKernel());
+
+  auto y = GetOutput(0)->vec<int64>();
+  auto idx = GetOutput(1)->vec<int32>();
+  auto count = GetOutput(2)->vec<int32>();
+  std::unordered_map<int64, int32> expected_count;
+  for (const int64 id : ids) {
+    ++expected_count[id];
+  }
+  ASSERT_EQ(static_cast<int64>(expected_count.size()), y.size());
+  for (int64 i = 0; i < y.size(); ++i) {
+    ASSERT_EQ(1, expected_count.count(y(i)));
+    EXPECT_EQ(expected_count[y(i)], count(i));
+  }
+  for (int64 i = 0; i < static_cast<int64>(ids.size()); ++i) {
+    EXPECT_EQ(ids[i], y(idx(i)));
+  }
+}
+
 TensorProto GetRandomInt32TensorProto(int dim, int max_int) {
   TensorProto tensor_proto;
   tensor_proto.set_dtype(DT_INT32);
@@ -110,6 +201,47 @@ static void BM_Unique_INT32_Repeat(int iters, int dim, int max_int) {
       .Run(iters);
 }
 
+// Uniquifies `dim` int64 ids in which every distinct value occurs `dup` times
+// on average. When `parallel` is false the kernel is forced onto the serial
+// implementation, for comparison.
+static void BM_Unique_INT64_Helper(int iters, int dim, int dup, bool parallel) {
+  testing::StopTiming();
+  Graph* g = new Graph(OpRegistry::Global());
+
+  Tensor input(DT_INT64, TensorShape({dim}));
+  auto input_flat = input.flat<int64>();
+  const int num_distinct = std::max(1, dim / dup);
+  for (int i = 0; i < dim; ++i) {
+    input_flat(i) = std::rand() % num_distinct;
+  }
+
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "Unique")
+                  .Input(test::graph::Constant(g, input))
+                  .Attr("T", DT_INT64)
+                  .Finalize(g, &node));
+  FixupSourceAndSinkEdges(g);
+
+  testing::BytesProcessed(static_cast<int64>(iters) * dim * sizeof(int64));
+  testing::UseRealTime();
+  if (!parallel) {
+    setenv("TF_UNIQUE_PARALLEL_THRESHOLD", "0", /*overwrite=*/1);
+  }
+  test::Benchmark bm("cpu", g, nullptr, nullptr, nullptr,
+                     "SINGLE_THREADED_EXECUTOR");
+  unsetenv("TF_UNIQUE_PARALLEL_THRESHOLD");
+  testing::StartTiming();
+  bm.Run(iters);
+}
+
+static void BM_Unique_INT64(int iters, int dim, int dup) {
+  BM_Unique_INT64_Helper(iters, dim, dup, /*parallel=*/true);
+}
+
+static void BM_Unique_INT64_Serial(int iters, int dim, int dup) {
+  BM_Unique_INT64_Helper(iters, dim, dup, /*parallel=*/false);
+}
+
 TensorProto GetRandomStringsTensorProto(int dim, int max_str_len) {
   TensorProto tensor_proto;
   tensor_proto.set_dtype(DT_STRING);
@@ -191,6 +323,34 @@ BENCHMARK(BM_Unique_INT32_Repeat)
     ->ArgPair(64 * 1024, 64 * 1024 * 1024)
     ->ArgPair(1024 * 1024, 64 * 1024 * 1024);
 
+BENCHMARK(BM_Unique_INT64)
+    ->ArgPair(10 * 1000, 1)
+    ->ArgPair(10 * 1000, 10)
+    ->ArgPair(10 * 1000, 100)
+    ->ArgPair(100 * 1000, 1)
+    ->ArgPair(100 * 1000, 10)
+    ->ArgPair(100 * 1000, 100)
+    ->ArgPair(1000 * 1000, 1)
+    ->ArgPair(1000 * 1000, 10)
+    ->ArgPair(1000 * 1000, 100)
+    ->ArgPair(10 * 1000 * 1000, 1)
+    ->ArgPair(10 * 1000 * 1000, 10)
+    ->ArgPair(10 * 1000 * 1000, 100);
+
+BENCHMARK(BM_Unique_INT64_Serial)
+    ->ArgPair(10 * 1000, 1)
+    ->ArgPair(10 * 1000, 10)
+    ->ArgPair(10 * 1000, 100)
+    ->ArgPair(100 * 1000, 1)
+    ->ArgPair(100 * 1000, 10)
+    ->ArgPair(100 * 1000, 100)
+    ->ArgPair(1000 * 1000, 1)
+    ->ArgPair(1000 * 1000, 10)
+    ->ArgPair(1000 * 1000, 100)
+    ->ArgPair(10 * 1000 * 1000, 1)
+    ->ArgPair(10 * 1000 * 1000, 10)
+    ->ArgPair(10 * 1000 * 1000, 100);
+
 BENCHMARK(BM_Unique_STRING)
     ->Arg(32)
     ->Arg(256)
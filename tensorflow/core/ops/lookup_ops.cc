@@ -370,6 +370,7 @@ REGISTER_OP("MutableHashTableV2")
     .Attr("use_node_name_sharing: bool = false")
     .Attr("key_dtype: type")
     .Attr("value_dtype: type")
+    .Attr("num_shards: int >= 1 = 1")
     .SetIsStateful()
     .SetShapeFn([](InferenceContext* c) {
       return MutableHashTableShape(c, /*key=*/c->Scalar(),
@@ -395,6 +396,7 @@ REGISTER_OP("MutableHashTableOfTensorsV2")
     .Attr("key_dtype: type")
     .Attr("value_dtype: type")
     .Attr("value_shape: shape = {}")
+    .Attr("num_shards: int >= 1 = 1")
     .SetIsStateful()
     .SetShapeFn([](InferenceContext* c) {
       PartialTensorShape value_p;
@@ -404,6 +406,88 @@ REGISTER_OP("MutableHashTableOfTensorsV2")
       return MutableHashTableShape(c, /*key=*/c->Scalar(), /*value=*/value_s);
     });
 
+REGISTER_OP("MutableEvictingHashTable")
+    .Output("table_handle: resource")
+    .Attr("container: string = ''")
+    .Attr("shared_name: string = ''")
+    .Attr("use_node_name_sharing: bool = false")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .Attr("value_shape: shape = {}")
+    .Attr("capacity: int >= 0 = 0")
+    .Attr("admission_threshold: int >= 1 = 1")
+    .Attr("ttl_steps: int >= 0 = 0")
+    .Attr("max_candidates: int >= 0 = 0")
+    .SetIsStateful()
+    .SetShapeFn([](InferenceContext* c) {
+      PartialTensorShape value_p;
+      TF_RETURN_IF_ERROR(c->GetAttr("value_shape", &value_p));
+      ShapeHandle value_s;
+      TF_RETURN_IF_ERROR(c->MakeShapeFromPartialTensorShape(value_p, &value_s));
+      return MutableHashTableShape(c, /*key=*/c->Scalar(), /*value=*/value_s);
+    });
+
+// Returns the shape of "num_keys" values of the table in input 0, checking
+// that they have type "value_dtype_attr".
+Status EvictingHashTableValuesShape(InferenceContext* c,
+                                    DimensionHandle num_keys,
+                                    const string& value_dtype_attr,
+                                    ShapeHandle* values) {
+  auto* handle_data = c->input_handle_shapes_and_types(0);
+  if (handle_data == nullptr || handle_data->size() != 2) {
+    *values = c->UnknownShape();
+    return Status::OK();
+  }
+  const ShapeAndType& value_shape_and_type = (*handle_data)[1];
+  DataType value_dtype;
+  TF_RETURN_IF_ERROR(c->GetAttr(value_dtype_attr, &value_dtype));
+  if (value_shape_and_type.dtype != value_dtype) {
+    return errors::InvalidArgument(
+        "Trying to read value with wrong dtype. "
+        "Expected ",
+        DataTypeString(value_shape_and_type.dtype), " got ",
+        DataTypeString(value_dtype));
+  }
+  return c->Concatenate(c->Vector(num_keys), value_shape_and_type.shape,
+                        values);
+}
+
+REGISTER_OP("MutableEvictingHashTableExport")
+    .Input("table_handle: resource")
+    .Output("keys: int64")
+    .Output("values: Tvalues")
+    .Attr("Tvalues: type")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &handle));
+      DimensionHandle num_keys = c->UnknownDim();
+      ShapeHandle values;
+      TF_RETURN_IF_ERROR(
+          EvictingHashTableValuesShape(c, num_keys, "Tvalues", &values));
+      c->set_output(0, c->Matrix(num_keys, 3));
+      c->set_output(1, values);
+      return Status::OK();
+    });
+
+REGISTER_OP("MutableEvictingHashTableImport")
+    .Input("table_handle: resource")
+    .Input("keys: int64")
+    .Input("values: Tvalues")
+    .Attr("Tvalues: type")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle handle;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &handle));
+      ShapeHandle keys;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 2, &keys));
+      DimensionHandle unused;
+      TF_RETURN_IF_ERROR(c->WithValue(c->Dim(keys, 1), 3, &unused));
+      ShapeHandle values;
+      TF_RETURN_IF_ERROR(
+          EvictingHashTableValuesShape(c, c->Dim(keys, 0), "Tvalues", &values));
+      TF_RETURN_IF_ERROR(c->Merge(values, c->input(2), &values));
+      return Status::OK();
+    });
+
 REGISTER_OP("MutableDenseHashTable")
     .Input("empty_key: key_dtype")
     .Output("table_handle: Ref(string)")
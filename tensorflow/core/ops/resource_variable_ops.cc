@@ -21,6 +21,7 @@
 #include "tensorflow/core/framework/shape_inference.h"
 #include "tensorflow/core/lib/core/errors.h"
 
+using ::tensorflow::shape_inference::DimensionHandle;
 using ::tensorflow::shape_inference::InferenceContext;
 using ::tensorflow::shape_inference::ShapeAndType;
 using ::tensorflow::shape_inference::ShapeHandle;
@@ -301,6 +302,38 @@ REGISTER_OP("ResourceGatherNd")
     .Attr("Tindices: {int32,int64}")
     .SetShapeFn(shape_inference::GatherNdShape);
 
+REGISTER_OP("ResourceSparseGatherCombine")
+    .Input("resource: resource")
+    .Input("indices: Tindices")
+    .Input("segment_ids: Tsegmentids")
+    .Input("num_segments: Tnumsegments")
+    .Attr("combiner: {'sum', 'mean', 'sqrtn'} = 'sum'")
+    .Output("output: dtype")
+    .Attr("dtype: {float, double}")
+    .Attr("Tindices: {int32,int64}")
+    .Attr("Tsegmentids: {int32,int64} = DT_INT32")
+    .Attr("Tnumsegments: {int32,int64} = DT_INT32")
+    .SetShapeFn([](InferenceContext* c) {
+      std::vector<ShapeAndType> handle_shape_and_type;
+      TF_RETURN_IF_ERROR(shape_inference::ValidateVariableResourceHandle(
+          c, &handle_shape_and_type));
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &unused));
+      TF_RETURN_IF_ERROR(c->Merge(c->input(1), c->input(2), &unused));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 0, &unused));
+
+      ShapeHandle params_subshape;
+      TF_RETURN_IF_ERROR(
+          c->Subshape(handle_shape_and_type[0].shape, 1, &params_subshape));
+      DimensionHandle num_segments;
+      TF_RETURN_IF_ERROR(c->MakeDimForScalarInput(3, &num_segments));
+      ShapeHandle out;
+      TF_RETURN_IF_ERROR(
+          c->Concatenate(c->Vector(num_segments), params_subshape, &out));
+      c->set_output(0, out);
+      return Status::OK();
+    });
+
 namespace {
 
 Status ResourceScatterUpdateShape(InferenceContext* c) {
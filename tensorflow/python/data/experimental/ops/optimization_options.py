@@ -41,7 +41,9 @@ class MapVectorizationOptions(options.OptionsBase):
       name="enabled",
       ty=bool,
       docstring=
-      "Whether to vectorize map transformations. If None, defaults to False."
+      "Whether to vectorize map transformations. Only map functions whose ops "
+      "all support vectorization, and without ragged outputs, are vectorized. "
+      "If None, defaults to False."
   )
 
   use_choose_fastest = options.create_option(
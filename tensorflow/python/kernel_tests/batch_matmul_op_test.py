@@ -94,6 +94,8 @@ class BatchMatmulOpTest(test.TestCase):
     CompareNonEmpty(self, [7, 2, 3], [7, 3, 5])
     CompareNonEmpty(self, [10, 64, 75], [10, 75, 30])
     CompareNonEmpty(self, [5, 7, 2, 3], [5, 7, 3, 5])
+    CompareNonEmpty(self, [12, 32, 16], [12, 16, 32])
+    CompareNonEmpty(self, [3, 4, 5, 8], [3, 4, 8, 4])
 
   def _testBroadcasting(self, dtype, adjoint_a, adjoint_b, use_static_shape):
 
@@ -112,6 +114,8 @@ class BatchMatmulOpTest(test.TestCase):
     CompareNonEmpty(self, [2, 3], [5, 2, 3, 5])
     CompareNonEmpty(self, [4, 5, 1, 2, 3], [1, 1, 3, 5])
     CompareNonEmpty(self, [1, 2, 1, 4, 2, 1, 3, 4], [3, 2, 1, 1, 1, 2, 4, 2])
+    CompareNonEmpty(self, [12, 5, 16], [16, 8])
+    CompareNonEmpty(self, [5, 16], [12, 16, 64])
 
   def _testEmpty(self, dtype, adjoint_a, adjoint_b, use_static_shape):
 
@@ -18,12 +18,14 @@ from __future__ import absolute_import
 from __future__ import division
 from __future__ import print_function
 
+import contextlib
 import itertools
 import math
 
 import numpy as np
 from six.moves import xrange  # pylint: disable=redefined-builtin
 
+from tensorflow.python.client import session
 from tensorflow.python.framework import constant_op
 from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import ops
@@ -33,10 +35,12 @@ from tensorflow.python.ops import array_ops
 from tensorflow.python.ops import data_flow_ops
 from tensorflow.python.ops import embedding_ops
 from tensorflow.python.ops import gradient_checker
+from tensorflow.python.ops import gradients_impl
 from tensorflow.python.ops import init_ops
 from tensorflow.python.ops import linalg_ops
 from tensorflow.python.ops import math_ops
 from tensorflow.python.ops import partitioned_variables
+from tensorflow.python.ops import resource_variable_ops
 from tensorflow.python.ops import state_ops
 from tensorflow.python.ops import variable_scope
 from tensorflow.python.ops import variables
@@ -650,6 +654,30 @@ class EmbeddingLookupTest(test.TestCase):
     self.assertAllEqual(embedding, [[[1.0], [1.0]], [[1.0]]])
 
 
+@contextlib.contextmanager
+def _LookupSparsePath(fused):
+  """Lets embedding_lookup_sparse take its fused path only if `fused`.
+
+  The fused path is only taken for parameters placed on the CPU, so if `fused`
+  the parameters created in this context are placed there.
+
+  Args:
+    fused: Whether to take the fused path.
+
+  Yields:
+    Nothing.
+  """
+  # pylint: disable=protected-access
+  can_fuse = embedding_ops._can_fuse_lookup_sparse
+  # pylint: enable=protected-access
+  with test.mock.patch.object(
+      embedding_ops,
+      "_can_fuse_lookup_sparse",
+      side_effect=lambda params: fused and can_fuse(params)):
+    with ops.device("/device:CPU:0" if fused else None):
+      yield
+
+
 class EmbeddingLookupSparseTest(test.TestCase):
 
   def _RandomIdsAndWeights(self, batch_size, vocab_size):
@@ -702,12 +730,12 @@ class EmbeddingLookupSparseTest(test.TestCase):
     grouped_ignored_weights = self._GroupByBatchEntry(
         np.ones(np.sum(vals_per_batch_entry)), vals_per_batch_entry)
 
-    for num_shards, combiner, dtype, ignore_weights in itertools.product(
+    for num_shards, combiner, dtype, ignore_weights, fused in itertools.product(
         [1, 5], ["sum", "mean", "sqrtn"],
         [dtypes.float16, dtypes.bfloat16, dtypes.float32, dtypes.float64],
-        [True, False]):
+        [True, False], [True, False]):
 
-      with self.cached_session():
+      with self.cached_session(), _LookupSparsePath(fused):
         p, params, feed_dict = _EmbeddingParams(
             num_shards, vocab_size, shape=param_shape, dtype=dtype)
         embedding_sum = embedding_ops.embedding_lookup_sparse(
@@ -754,10 +782,10 @@ class EmbeddingLookupSparseTest(test.TestCase):
     sp_ids, sp_weights, _, _, _ = (self._RandomIdsAndWeights(
         batch_size, vocab_size))
 
-    for num_shards, combiner, dtype, ignore_weights in itertools.product(
-        [1, 3], ["sum", "mean", "sqrtn"], [dtypes.float32,
-                                           dtypes.float64], [True, False]):
-      with self.cached_session():
+    for num_shards, combiner, dtype, ignore_weights, fused in itertools.product(
+        [1, 3], ["sum", "mean", "sqrtn"], [dtypes.float32, dtypes.float64],
+        [True, False], [True, False]):
+      with self.cached_session(), _LookupSparsePath(fused):
         x, params, _ = _EmbeddingParams(
             num_shards, vocab_size, shape=param_shape, dtype=dtype)
 
@@ -774,6 +802,142 @@ class EmbeddingLookupSparseTest(test.TestCase):
             x, x_shape, y, y_shape, x_init_value=x_init_value)
       self.assertLess(err, 1e-5 if dtype == dtypes.float64 else 2e-3)
 
+  @test_util.run_deprecated_v1
+  def testEmbeddingLookupSparseCombinedOnParameterServer(self):
+    vocab_size = 13
+    batch_size = 10
+    sp_ids, _, _, _, _ = self._RandomIdsAndWeights(batch_size, vocab_size)
+    init_value = np.random.rand(vocab_size, 2, 3)
+    workers, _ = test.create_local_cluster(num_workers=1, num_ps=1)
+
+    for num_shards, combiner, partition_strategy in itertools.product(
+        [1, 3], ["sum", "mean", "sqrtn"], ["mod", "div"]):
+      if partition_strategy == "mod":
+        shards = [init_value[p::num_shards] for p in range(num_shards)]
+      else:
+        shards = np.array_split(init_value, num_shards)
+      with ops.Graph().as_default() as graph, ops.device("/job:worker/task:0"):
+        # Only the variables placed on the parameter servers take the fused
+        # path, not the ones of the caller's own job.
+        params = []
+        for device in ["/job:ps/task:0/device:CPU:0", "/job:worker/task:0"]:
+          with ops.device(device):
+            params.append(
+                [resource_variable_ops.ResourceVariable(s) for s in shards])
+        fused = embedding_ops.embedding_lookup_sparse(
+            params[0],
+            sp_ids,
+            None,
+            partition_strategy=partition_strategy,
+            combiner=combiner)
+        unfused = embedding_ops.embedding_lookup_sparse(
+            params[1],
+            sp_ids,
+            None,
+            partition_strategy=partition_strategy,
+            combiner=combiner)
+        op_types = [op.type for op in graph.get_operations()]
+        self.assertEqual(num_shards,
+                         op_types.count("ResourceSparseGatherCombine"))
+
+        loss_weights = np.random.rand(batch_size, 2, 3)
+        fused_grads = gradients_impl.gradients(
+            math_ops.reduce_sum(fused * loss_weights), params[0])
+        unfused_grads = gradients_impl.gradients(
+            math_ops.reduce_sum(unfused * loss_weights), params[1])
+        with session.Session(workers[0].target) as sess:
+          sess.run(variables.global_variables_initializer())
+          self.assertAllClose(sess.run(unfused), sess.run(fused))
+          self.assertAllClose(
+              sess.run([ops.convert_to_tensor(g) for g in unfused_grads]),
+              sess.run([ops.convert_to_tensor(g) for g in fused_grads]))
+
+  @test_util.run_deprecated_v1
+  def testEmbeddingLookupSparseNotCombinedOnLocalVariables(self):
+    vocab_size = 13
+    batch_size = 10
+    sp_ids, _, _, _, _ = self._RandomIdsAndWeights(batch_size, vocab_size)
+    init_value = np.random.rand(vocab_size, 2, 3)
+
+    # Variables of the "localhost" job, or without a job, are local to the
+    # caller even if it runs on another job.
+    for device, caller_device in [
+        ("/job:localhost/replica:0/task:0/device:CPU:0", ""),
+        ("/job:localhost/replica:0/task:0/device:CPU:0", "/job:worker"),
+        ("/device:CPU:0", "")]:
+      with ops.Graph().as_default() as graph, ops.device(caller_device):
+        with ops.device(device):
+          params = resource_variable_ops.ResourceVariable(init_value)
+        embedding_ops.embedding_lookup_sparse(params, sp_ids, None)
+        self.assertNotIn("ResourceSparseGatherCombine",
+                         [op.type for op in graph.get_operations()])
+
+  @test_util.run_deprecated_v1
+  def testEmbeddingLookupSparseFusedOnlyOnCpu(self):
+    sp_ids, _, _, _, _ = self._RandomIdsAndWeights(4, 12)
+    params_value = np.random.rand(12, 2)
+    # Parameters without a device may end up on a GPU.
+    for device, fused in [("", False), ("/device:CPU:0", True),
+                          ("/device:GPU:0", False)]:
+      with ops.Graph().as_default() as graph:
+        with ops.device(device):
+          params = constant_op.constant(params_value)
+        embedding_ops.embedding_lookup_sparse(params, sp_ids, None)
+        op_types = [op.type for op in graph.get_operations()]
+        self.assertEqual(fused, "FusedEmbeddingLookupSparse" in op_types)
+
+  @test_util.run_deprecated_v1
+  def testEmbeddingLookupSparseZeroTotalWeight(self):
+    params = np.random.rand(3, 2)
+    # Row 0 has a zero total weight, and row 1 has no ids.
+    sp_ids = sparse_tensor.SparseTensor([[0, 0], [2, 0]], [0, 1], [3, 1])
+    sp_weights = sparse_tensor.SparseTensor([[0, 0], [2, 0]], [0.0, 2.0],
+                                            [3, 1])
+    nan_row = [np.nan, np.nan]
+    expected = {
+        "sum": [[0.0, 0.0], [0.0, 0.0], 2.0 * params[1]],
+        # As the weighted sums are divided by the total weights, rows with a
+        # zero total weight are NaN.
+        "mean": [nan_row, nan_row, params[1]],
+        "sqrtn": [nan_row, nan_row, params[1]],
+    }
+    for combiner, fused in itertools.product(["sum", "mean", "sqrtn"],
+                                             [True, False]):
+      with self.cached_session(), _LookupSparsePath(fused):
+        embeddings = embedding_ops.embedding_lookup_sparse(
+            constant_op.constant(params), sp_ids, sp_weights,
+            combiner=combiner)
+        self.assertAllClose(expected[combiner], self.evaluate(embeddings))
+
+  @test_util.run_deprecated_v1
+  def testGradientsFusedEmbeddingLookupSparse(self):
+    vocab_size = 12
+    batch_size = 4
+    param_shape = [2, 3]
+    sp_ids, sp_weights, _, weights, _ = self._RandomIdsAndWeights(
+        batch_size, vocab_size)
+
+    for combiner in ["sum", "mean", "sqrtn"]:
+      with ops.Graph().as_default(), self.cached_session():
+        params_value = np.random.rand(vocab_size, *param_shape)
+        with ops.device("/device:CPU:0"):
+          x = constant_op.constant(params_value)
+        w = constant_op.constant(weights, dtypes.float64)
+        y = embedding_ops.embedding_lookup_sparse(
+            x,
+            sp_ids,
+            sparse_tensor.SparseTensor(sp_weights.indices, w,
+                                       sp_weights.dense_shape),
+            combiner=combiner)
+        self.assertIn(
+            "FusedEmbeddingLookupSparse",
+            [op.type for op in ops.get_default_graph().get_operations()])
+        err = gradient_checker.compute_gradient_error(
+            [x, w], [params_value.shape, weights.shape],
+            y, [batch_size] + param_shape,
+            x_init_value=[params_value, weights])
+      self.assertLess(err, 1e-5)
+
   @test_util.run_deprecated_v1
   def testIncompatibleShapes(self):
     with self.cached_session():
@@ -19,6 +19,8 @@ from __future__ import print_function
 
 import os
 import tempfile
+import threading
+import time
 
 import numpy as np
 import six
@@ -41,8 +43,11 @@ from tensorflow.python.framework import sparse_tensor
 from tensorflow.python.framework import test_util
 from tensorflow.python.ops import array_ops
 from tensorflow.python.ops import control_flow_ops
+from tensorflow.python.ops import gen_lookup_ops
 from tensorflow.python.ops import lookup_ops
 from tensorflow.python.ops import map_fn
+from tensorflow.python.ops import math_ops
+from tensorflow.python.ops import random_ops
 from tensorflow.python.ops import string_ops
 from tensorflow.python.ops import variables
 from tensorflow.python.platform import test
@@ -2839,6 +2844,58 @@ class MutableHashTableOpTest(test.TestCase):
       self.assertAllEqual([b"brain", b"salad", b"surgery"], sorted_keys)
       self.assertAllEqual([0, 1, 2], sorted_values)
 
+  def testShardedMutableHashTable(self):
+    with self.cached_session():
+      keys = ["key_%d" % i for i in range(100)]
+      table = lookup_ops.MutableHashTable(
+          dtypes.string, dtypes.int64, -1, num_shards=8)
+      self.evaluate(table.insert(keys, list(range(100))))
+      self.assertAllEqual(100, self.evaluate(table.size()))
+      self.evaluate(table.insert(keys[:10], list(range(100, 110))))
+      self.assertAllEqual(100, self.evaluate(table.size()))
+
+      self.evaluate(table.remove(keys[90:] + ["tank"]))
+      self.assertAllEqual(90, self.evaluate(table.size()))
+
+      result = self.evaluate(table.lookup(keys + ["tank"]))
+      self.assertAllEqual(
+          list(range(100, 110)) + list(range(10, 90)) + [-1] * 11, result)
+
+      exported_keys, exported_values = self.evaluate(table.export())
+      self.assertAllEqual(sorted(compat.as_bytes(k) for k in keys[:90]),
+                          np.sort(exported_keys))
+      self.assertAllEqual(
+          list(range(10, 90)) + list(range(100, 110)),
+          np.sort(exported_values))
+
+  def testShardedMutableHashTableOfTensors(self):
+    with self.cached_session():
+      keys = np.arange(1000, dtype=np.int64) * 7
+      values = np.stack([keys, -keys], axis=1)
+      table = lookup_ops.MutableHashTable(
+          dtypes.int64, dtypes.int64, [0, 0], num_shards=5)
+      self.evaluate(table.insert(keys, values))
+      self.assertAllEqual(1000, self.evaluate(table.size()))
+      self.evaluate(table.remove(keys[::2]))
+      self.assertAllEqual(500, self.evaluate(table.size()))
+
+      result = self.evaluate(table.lookup(keys))
+      values[::2] = 0
+      self.assertAllEqual(values, result)
+
+      exported_keys, exported_values = self.evaluate(table.export())
+      self.assertAllEqual(keys[1::2], np.sort(exported_keys))
+      self.assertAllEqual(
+          np.stack([exported_keys, -exported_keys], axis=1), exported_values)
+
+  def testShardedMutableHashTableInvalidNumShards(self):
+    with self.cached_session():
+      with self.assertRaisesRegexp(
+          (ValueError, errors_impl.InvalidArgumentError), "num_shards"):
+        table = lookup_ops.MutableHashTable(
+            dtypes.int64, dtypes.int64, -1, num_shards=0)
+        self.evaluate(table.size())
+
   @test_util.run_v1_only("SaverV1")
   def testSaveRestore(self):
     save_dir = os.path.join(self.get_temp_dir(), "save_restore")
@@ -3402,6 +3459,125 @@ class MutableHashTableOpTest(test.TestCase):
       self.assertAllEqual((b"brain", b"salad", b"n/a"), result)
 
 
+class MutableEvictingHashTableOpTest(test.TestCase):
+
+  def testAdmissionThreshold(self):
+    with self.cached_session():
+      table = lookup_ops.MutableEvictingHashTable(
+          dtypes.int64, -1, admission_threshold=2)
+      self.assertAllEqual([-1, -1], self.evaluate(table.lookup([1, 2])))
+      # Both keys have only been looked up once, so they are not admitted.
+      self.evaluate(table.insert([1, 2], [10, 20]))
+      self.assertAllEqual(0, self.evaluate(table.size()))
+
+      self.assertAllEqual([-1], self.evaluate(table.lookup([1])))
+      self.evaluate(table.insert([1, 2], [10, 20]))
+      self.assertAllEqual(1, self.evaluate(table.size()))
+      self.assertAllEqual([10, -1], self.evaluate(table.lookup([1, 2])))
+
+  def testCapacityEvictsLeastFrequentKeys(self):
+    with self.cached_session():
+      table = lookup_ops.MutableEvictingHashTable(
+          dtypes.float32, [0.0, 0.0], capacity=10)
+      keys = np.arange(10, dtype=np.int64)
+      values = np.stack([keys, keys], axis=1).astype(np.float32)
+      self.evaluate(table.insert(keys, values))
+      self.assertAllEqual(10, self.evaluate(table.size()))
+      self.evaluate(table.lookup(keys[5:]))
+      self.evaluate(table.lookup(keys[5:]))
+
+      # Going beyond capacity evicts down to 9 keys, starting with the keys
+      # that have been looked up least often, then least recently, then the
+      # smallest ones.
+      self.evaluate(table.insert([10, 11], [[10.0, 10.0], [11.0, 11.0]]))
+      self.assertAllEqual(9, self.evaluate(table.size()))
+      exported_keys, _ = self.evaluate(table.export())
+      self.assertAllEqual(list(range(3, 12)), np.sort(exported_keys[:, 0]))
+      self.assertAllEqual([[0.0, 0.0], [5.0, 5.0], [11.0, 11.0]],
+                          self.evaluate(table.lookup([0, 5, 11])))
+
+  def testTtlEvictsStaleKeys(self):
+    with self.cached_session():
+      table = lookup_ops.MutableEvictingHashTable(
+          dtypes.int64, -1, ttl_steps=2)
+      self.evaluate(table.insert([1, 2], [10, 20]))
+      for _ in range(3):
+        self.assertAllEqual([10], self.evaluate(table.lookup([1])))
+      self.assertAllEqual(1, self.evaluate(table.size()))
+      self.assertAllEqual([10, -1], self.evaluate(table.lookup([1, 2])))
+
+  def testExportImportStatistics(self):
+    with self.cached_session():
+      table = lookup_ops.MutableEvictingHashTable(
+          dtypes.int64, -1, admission_threshold=2)
+      self.evaluate(table.lookup([1, 2, 1]))
+      self.evaluate(table.lookup([2, 3]))
+      self.evaluate(table.insert([1, 2, 3], [10, 20, 30]))
+      self.evaluate(table.lookup([1]))
+
+      exported_keys, exported_values = self.evaluate(table.export())
+      order = np.argsort(exported_keys[:, 0])
+      # Key 1 has been looked up three times, last at step 3, and key 2 twice,
+      # last at step 2. Key 3 has not been admitted.
+      self.assertAllEqual([[1, 3, 3], [2, 2, 2]], exported_keys[order])
+      self.assertAllEqual([10, 20], exported_values[order])
+
+      restored = lookup_ops.MutableEvictingHashTable(
+          dtypes.int64, -1, admission_threshold=2)
+      self.evaluate(
+          gen_lookup_ops.mutable_evicting_hash_table_import(
+              restored.resource_handle, exported_keys, exported_values))
+      self.assertAllEqual(2, self.evaluate(restored.size()))
+      self.assertAllEqual([10, 20, -1],
+                          self.evaluate(restored.lookup([1, 2, 3])))
+
+      # The generic ops expect rank-1 keys.
+      with self.assertRaisesOpError("MutableEvictingHashTableExport"):
+        self.evaluate(
+            gen_lookup_ops.lookup_table_export_v2(table.resource_handle,
+                                                  dtypes.int64, dtypes.int64))
+      with self.assertRaisesOpError("Expected shape"):
+        self.evaluate(
+            gen_lookup_ops.lookup_table_import_v2(restored.resource_handle,
+                                                  [1, 2], [10, 20]))
+
+  def testMaxCandidates(self):
+    with self.cached_session():
+      table = lookup_ops.MutableEvictingHashTable(
+          dtypes.int64, -1, admission_threshold=2, max_candidates=2)
+      self.evaluate(table.lookup([1]))
+      # Counting the lookups of three keys forgets the least recently looked
+      # up one.
+      self.evaluate(table.lookup([2, 3]))
+      self.evaluate(table.lookup([1, 2]))
+      self.evaluate(table.insert([1, 2], [10, 20]))
+      self.assertAllEqual(1, self.evaluate(table.size()))
+      self.assertAllEqual([-1, 20], self.evaluate(table.lookup([1, 2])))
+
+  @test_util.run_v1_only("SaverV1")
+  def testSaveRestore(self):
+    save_dir = os.path.join(self.get_temp_dir(), "save_restore")
+    save_path = os.path.join(tempfile.mkdtemp(prefix=save_dir), "hash")
+
+    with self.session(graph=ops.Graph()) as sess:
+      table = lookup_ops.MutableEvictingHashTable(
+          dtypes.float32, [-1.0, -1.0], name="t1")
+      save = saver.Saver()
+      self.evaluate(table.insert([1, 2], [[1.0, 1.0], [2.0, 2.0]]))
+      self.evaluate(table.lookup([1]))
+      save.save(sess, save_path)
+
+    with self.session(graph=ops.Graph()) as sess:
+      table = lookup_ops.MutableEvictingHashTable(
+          dtypes.float32, [-1.0, -1.0], name="t1")
+      save = saver.Saver()
+      save.restore(sess, save_path)
+      exported_keys, exported_values = self.evaluate(table.export())
+      order = np.argsort(exported_keys[:, 0])
+      self.assertAllEqual([[1, 2, 1], [2, 1, 0]], exported_keys[order])
+      self.assertAllEqual([[1.0, 1.0], [2.0, 2.0]], exported_values[order])
+
+
 class MutableHashTableBenchmark(test.Benchmark):
 
   def _create_table(self):
@@ -3450,6 +3626,43 @@ class MutableHashTableBenchmark(test.Benchmark):
       assert sess.run(size) >= 1000 * 32
 
 
+  def benchmark_concurrent_batch_10000_insert_and_find_scalar(self):
+    table = self._create_table()
+    keys = random_ops.random_uniform(
+        [10000], maxval=1000000, dtype=dtypes.int64)
+    insert = table.insert(keys, math_ops.cast(keys, dtypes.float32))
+    with ops.control_dependencies([insert]):
+      find = table.lookup(keys)
+    num_threads = 8
+    num_steps = 100
+    with session.Session() as sess:
+      sess.run(find)
+
+      def _run_steps():
+        for _ in range(num_steps):
+          sess.run(find)
+
+      threads = [
+          threading.Thread(target=_run_steps) for _ in range(num_threads)
+      ]
+      start = time.time()
+      for t in threads:
+        t.start()
+      for t in threads:
+        t.join()
+      wall_time = time.time() - start
+    self.report_benchmark(
+        iters=num_threads * num_steps,
+        wall_time=wall_time / (num_threads * num_steps))
+
+
+class ShardedMutableHashTableBenchmark(MutableHashTableBenchmark):
+
+  def _create_table(self):
+    return lookup_ops.MutableHashTable(
+        dtypes.int64, dtypes.float32, 0.0, num_shards=16)
+
+
 class DenseHashTableBenchmark(MutableHashTableBenchmark):
 
   def _create_table(self):
@@ -926,6 +926,58 @@ class ResourceVariableOpsTest(test_util.TensorFlowTestCase,
     value = self.evaluate(value_op)
     self.assertAllEqual([0, 27, 63], value)
 
+  @test_util.run_in_graph_and_eager_modes
+  def testSparseGatherCombine(self):
+    init_value = np.reshape(np.arange(12, dtype=np.float32), (4, 3))
+    v = resource_variable_ops.ResourceVariable(init_value, name="var4")
+    self.evaluate(variables.global_variables_initializer())
+
+    indices = [3, 0, 1, 3, 2]
+    segment_ids = [1, 1, 0, 3, 1]
+    rows = init_value[indices]
+    counts = np.array([1., 3., 0., 1.], dtype=np.float32)
+    sums = np.zeros((4, 3), dtype=np.float32)
+    np.add.at(sums, segment_ids, rows)
+    for combiner, expected in [
+        ("sum", sums),
+        ("mean", sums / np.maximum(counts, 1.)[:, None]),
+        ("sqrtn", sums / np.sqrt(np.maximum(counts, 1.))[:, None])]:
+      value_op = resource_variable_ops.resource_sparse_gather_combine(
+          v.handle, indices, segment_ids, 4, dtype=dtypes.float32,
+          combiner=combiner)
+      self.assertAllEqual([4, 3], value_op.shape)
+      self.assertAllClose(expected, self.evaluate(value_op))
+
+  @test_util.run_in_graph_and_eager_modes
+  def testSparseGatherCombineOutOfRange(self):
+    v = resource_variable_ops.ResourceVariable(
+        np.zeros((4, 3), dtype=np.float32), name="var5")
+    self.evaluate(variables.global_variables_initializer())
+    with self.assertRaisesOpError("indices"):
+      self.evaluate(
+          resource_variable_ops.resource_sparse_gather_combine(
+              v.handle, [0, 4], [0, 1], 2, dtype=dtypes.float32))
+    with self.assertRaisesOpError("segment_ids"):
+      self.evaluate(
+          resource_variable_ops.resource_sparse_gather_combine(
+              v.handle, [0, 1], [0, 2], 2, dtype=dtypes.float32))
+
+  @test_util.run_in_graph_and_eager_modes
+  def testSparseGatherCombineGradient(self):
+    v = resource_variable_ops.ResourceVariable(
+        np.ones((4, 2), dtype=np.float32), name="var6")
+    self.evaluate(variables.global_variables_initializer())
+    with backprop.GradientTape() as tape:
+      combined = resource_variable_ops.resource_sparse_gather_combine(
+          v.handle, [3, 0, 3, 1], [0, 0, 0, 1], 2, dtype=dtypes.float32,
+          combiner="mean")
+      loss = math_ops.reduce_sum(combined * [[1., 2.], [3., 4.]])
+    grad = tape.gradient(loss, v)
+    self.assertIsInstance(grad, ops.IndexedSlices)
+    self.assertAllClose(
+        [[1. / 3, 2. / 3], [3., 4.], [0., 0.], [2. / 3, 4. / 3]],
+        self.evaluate(ops.convert_to_tensor(grad)))
+
   @test_util.run_deprecated_v1
   def testToFromProto(self):
     with self.cached_session():
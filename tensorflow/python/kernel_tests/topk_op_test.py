@@ -166,6 +166,44 @@ class TopKTest(test.TestCase):
       values = -np.sort(-inputs, axis=1)[:, :k]
       self._validateTopK(inputs, k, values, indices)
 
+  def testLargeRowTopK(self):
+    # Few rows with many columns are split across threads on CPU.
+    n = 1 << 17
+    for k in [1000, 50000]:
+      inputs = np.random.permutation(
+          np.linspace(0, 100, 2 * n, dtype=np.float32)).reshape(2, n)
+      indices = np.argsort(-inputs, axis=1)[:, :k]
+      values = -np.sort(-inputs, axis=1)[:, :k]
+      self._validateTopK(inputs, k, values, indices)
+
+  def testLargeRowStableTopK(self):
+    n = 1 << 17
+    # Lots of repeated integers taking values in [-50, 50].
+    inputs = np.random.randint(-50, 51, size=(1, n)).astype(np.int32)
+    indices = np.argsort(-inputs, axis=1, kind="mergesort")[:, :5000]
+    values = -np.sort(-inputs, axis=1)[:, :5000]
+    self._validateTopK(inputs, 5000, values, indices)
+    self._validateTopK(inputs, 5000, values, indices, sorted=False)
+
+  def testLargeTopKWithNan(self):
+    # NaNs rank below all other values, the lower indices first.
+    for n in [2048, 1 << 17]:
+      k = n - 50
+      inputs = np.random.permutation(
+          np.linspace(-100, 100, n, dtype=np.float32)).reshape(1, n)
+      inputs[0, np.random.choice(n, 100, replace=False)] = np.nan
+      indices = np.argsort(
+          np.where(np.isnan(inputs), np.inf, -inputs), axis=1,
+          kind="mergesort")[:, :k]
+      for sorted_ in [True, False]:
+        with self.cached_session(use_gpu=False):
+          values_op, indices_op = nn_ops.top_k(inputs, k, sorted=sorted_)
+          tf_values, tf_indices = self.evaluate([values_op, indices_op])
+        expected_indices = indices if sorted_ else np.sort(indices, axis=1)
+        self.assertAllEqual(expected_indices, tf_indices)
+        self.assertAllClose(
+            np.take_along_axis(inputs, expected_indices, axis=1), tf_values)
+
   def testTopAll(self):
     inputs = [[0.1, 0.3, 0.2, 0.4], [0.1, 0.3, 0.3, 0.2]]
     self._validateTopK(inputs, 4, [[0.4, 0.3, 0.2, 0.1], [0.3, 0.3, 0.2, 0.1]],
@@ -249,6 +287,27 @@ class TopKBenchmark(test.Benchmark):
                 "Throughput: %0.03g GB/s" % (name, r["wall_time"], throughput))
           sys.stdout.flush()
 
+  def benchmarkTopKLargeRows(self):
+    for (m, n, p) in itertools.product(
+        [1, 4, 64],
+        [100000, 1000000],
+        [0.0001, 0.01, 0.1, 0.5]):
+      k = int(p * n)
+      name = "m_%d_n_%d_k_%g_use_gpu_False" % (m, n, k)
+      with ops.Graph().as_default():
+        with ops.device("/cpu:0"):
+          x = random_ops.random_uniform((m, n))
+          v = resource_variable_ops.ResourceVariable(x)
+          op = nn_ops.top_k(v, k)
+        with session.Session() as sess:
+          v.initializer.run()
+          r = self.run_op_benchmark(sess, op, min_iters=10, name=name)
+          gb_processed_input = m * n / 1.0e9
+          throughput = gb_processed_input / r["wall_time"]
+          print("Benchmark: %s \t wall_time: %0.03g s \t "
+                "Throughput: %0.03g GB/s" % (name, r["wall_time"], throughput))
+          sys.stdout.flush()
+
 
 if __name__ == "__main__":
   test.main()
@@ -21,6 +21,7 @@ from six.moves import xrange  # pylint: disable=redefined-builtin
 
 from tensorflow.python.compat import compat
 from tensorflow.python.framework import constant_op
+from tensorflow.python.framework import device as pydev
 from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import ops
 from tensorflow.python.framework import sparse_tensor
@@ -30,6 +31,8 @@ from tensorflow.python.ops import clip_ops
 # Imports gradient definitions.
 from tensorflow.python.ops import data_flow_grad  # pylint: disable=unused-import
 from tensorflow.python.ops import data_flow_ops
+from tensorflow.python.ops import gen_math_ops
+from tensorflow.python.ops import gen_resource_variable_ops
 from tensorflow.python.ops import math_ops
 from tensorflow.python.ops import resource_variable_ops
 from tensorflow.python.ops import sparse_ops
@@ -83,6 +86,209 @@ def _clip(params, ids, max_norm):
             else math_ops.range(ids_rank, params_rank)))
 
 
+def _partition_ids(params, flat_ids, partition_strategy):
+  """Assigns `flat_ids` to the partitions in `params`.
+
+  Args:
+    params: A list of tensors or variables, the partitions of the embedding.
+    flat_ids: A 1-D `Tensor` of ids into the full embedding.
+    partition_strategy: Either "mod" or "div", see `embedding_lookup`.
+
+  Returns:
+    A pair `(p_assignments, new_ids)`, where `p_assignments` is an int32 tensor
+    with the partition of every id, and `new_ids` holds the ids within their
+    partition.
+
+  Raises:
+    ValueError: If `partition_strategy` is not recognized.
+  """
+  np = len(params)
+  if partition_strategy == "mod":
+    p_assignments = flat_ids % np
+    new_ids = flat_ids // np
+  elif partition_strategy == "div":
+    # Compute num_total_ids as the sum of dim-0 of params, then assign to
+    # partitions based on a constant number of ids per partition. Optimize
+    # if we already know the full shape statically.
+    dim_0_size = tensor_shape.Dimension(
+        tensor_shape.dimension_value(params[0].get_shape()[0]))
+    for p in xrange(1, np):
+      dim_0_size += tensor_shape.Dimension(
+          tensor_shape.dimension_value(params[p].get_shape()[0]))
+    if dim_0_size.value:
+      num_total_ids = constant_op.constant(dim_0_size.value, flat_ids.dtype)
+    else:
+      dim_0_sizes = []
+      for p in xrange(np):
+        param_p_dim = tensor_shape.dimension_value(params[p].get_shape()[0])
+        if param_p_dim is not None:
+          dim_0_sizes.append(param_p_dim)
+        else:
+          with ops.colocate_with(params[p]):
+            dim_0_sizes.append(array_ops.shape(params[p])[0])
+      num_total_ids = math_ops.reduce_sum(
+          math_ops.cast(array_ops.stack(dim_0_sizes), flat_ids.dtype))
+    ids_per_partition = num_total_ids // np
+    extras = num_total_ids % np
+
+    p_assignments = math_ops.maximum(flat_ids // (ids_per_partition + 1),
+                                     (flat_ids - extras) // ids_per_partition)
+
+    # Emulate a conditional using a boolean indicator tensor
+    new_ids = array_ops.where(p_assignments < extras,
+                              flat_ids % (ids_per_partition + 1),
+                              (flat_ids - extras) % ids_per_partition)
+  else:
+    raise ValueError("Unrecognized partition strategy: " + partition_strategy)
+
+  # Cast partition assignments to int32 for use in dynamic_partition.
+  # There really should not be more than 2^32 partitions.
+  return math_ops.cast(p_assignments, dtypes.int32), new_ids
+
+
+def _can_gather_combine_on_ps(params, caller_device):
+  """Whether `params` are resource variables placed on parameter servers.
+
+  A variable counts as being on a parameter server if it is placed on a CPU of
+  the "ps" job, or of a job other than the one of `caller_device`. The
+  variables of the caller's own job, and of the "localhost" job, are not
+  remote, so combining their embeddings where they live saves no transfers.
+
+  Args:
+    params: A list of variables.
+    caller_device: The device of the ops that consume the embeddings.
+
+  Returns:
+    True if the embeddings of `params` can be combined next to them.
+  """
+  caller_job = pydev.DeviceSpec.from_string(caller_device or "").job
+  for p in params:
+    if not isinstance(p, resource_variable_ops.BaseResourceVariable):
+      return False
+    if p.dtype not in (dtypes.float32, dtypes.float64):
+      return False
+    spec = pydev.DeviceSpec.from_string(p.device)
+    if spec.device_type not in (None, "CPU"):
+      return False
+    if spec.job != "ps" and (spec.job in (None, "localhost") or
+                             caller_job is None or spec.job == caller_job):
+      return False
+  return True
+
+
+def _gather_combine_on_ps(params, ids, segment_ids, partition_strategy,
+                          combiner, name):
+  """Looks up and combines embeddings next to the variables holding them.
+
+  Every partition in `params` gathers the rows it holds and sums them per
+  segment with `ResourceSparseGatherCombine`, so only one row per segment and
+  partition is transferred from the parameter servers instead of one row per
+  id.
+
+  Args:
+    params: A list of resource variables, see `_can_gather_combine_on_ps`.
+    ids: A 1-D `Tensor` of ids into the full embedding.
+    segment_ids: A 1-D `Tensor` with the segment of every id.
+    partition_strategy: Either "mod" or "div", see `embedding_lookup`.
+    combiner: One of "sum", "mean" or "sqrtn".
+    name: A name for the result.
+
+  Returns:
+    A dense `Tensor` with one combined embedding per segment.
+  """
+  num_segments = math_ops.maximum(
+      math_ops.reduce_max(segment_ids) + 1,
+      array_ops.zeros([], dtype=segment_ids.dtype))
+  np = len(params)
+  if np == 1:
+    with ops.colocate_with(params[0]):
+      embeddings = gen_resource_variable_ops.resource_sparse_gather_combine(
+          params[0].handle,
+          ids,
+          segment_ids,
+          num_segments,
+          dtype=params[0].dtype,
+          combiner=combiner)
+    return array_ops.identity(embeddings, name=name)
+
+  p_assignments, new_ids = _partition_ids(params, ids, partition_strategy)
+  gather_ids = data_flow_ops.dynamic_partition(new_ids, p_assignments, np)
+  gather_segment_ids = data_flow_ops.dynamic_partition(segment_ids,
+                                                       p_assignments, np)
+  partial_sums = []
+  for p in xrange(np):
+    with ops.colocate_with(params[p]):
+      partial_sums.append(
+          gen_resource_variable_ops.resource_sparse_gather_combine(
+              params[p].handle,
+              gather_ids[p],
+              gather_segment_ids[p],
+              num_segments,
+              dtype=params[p].dtype,
+              combiner="sum"))
+  if combiner == "sum":
+    return math_ops.add_n(partial_sums, name=name)
+
+  embeddings = math_ops.add_n(partial_sums)
+  counts = math_ops.unsorted_segment_sum(
+      array_ops.ones_like(segment_ids, dtype=embeddings.dtype), segment_ids,
+      num_segments)
+  if combiner == "sqrtn":
+    counts = math_ops.sqrt(counts)
+  # Reshape counts to allow broadcast
+  ones = array_ops.fill(
+      array_ops.expand_dims(array_ops.rank(embeddings) - 1, 0), 1)
+  counts = array_ops.reshape(
+      counts, array_ops.concat([array_ops.shape(counts), ones], 0))
+  return math_ops.div_no_nan(embeddings, counts, name=name)
+
+
+def _can_fuse_lookup_sparse(params):
+  """Whether `FusedEmbeddingLookupSparse` can look up `params` on the CPU.
+
+  Only parameters explicitly placed on the CPU are looked up by the fused
+  kernel. Parameters without a device may be placed on a GPU, where the fused
+  kernel would read them in full and copy them to the host.
+
+  Args:
+    params: A list of the `Tensor`s or variables holding the embedding.
+
+  Returns:
+    True if the fused kernel should be used.
+  """
+  if len(params) != 1:
+    return False
+  if params[0].dtype.base_dtype not in (dtypes.float32, dtypes.float64):
+    return False
+  spec = pydev.DeviceSpec.from_string(params[0].device or "")
+  return spec.device_type == "CPU"
+
+
+def _fused_lookup_sparse(params, ids, segment_ids, weights, combiner, name):
+  """Looks up and combines embeddings without materializing gathered rows.
+
+  Args:
+    params: A `Tensor` or variable holding the full embedding.
+    ids: A 1-D `Tensor` of ids into `params`.
+    segment_ids: A sorted 1-D `Tensor` with the segment of every id.
+    weights: A 1-D `Tensor` with the weight of every id, or `None`.
+    combiner: One of "sum", "mean" or "sqrtn".
+    name: A name for the result.
+
+  Returns:
+    A dense `Tensor` with one combined embedding per segment.
+  """
+  params = ops.convert_to_tensor(params, name="params")
+  if weights is None:
+    weights = array_ops.zeros([0], dtype=params.dtype)
+  elif weights.dtype != params.dtype:
+    weights = math_ops.cast(weights, params.dtype)
+  if segment_ids.dtype not in (dtypes.int32, dtypes.int64):
+    segment_ids = math_ops.cast(segment_ids, dtypes.int32)
+  return gen_math_ops.fused_embedding_lookup_sparse(
+      params, ids, segment_ids, weights, combiner=combiner, name=name)
+
+
 def _embedding_lookup_and_transform(params,
                                     ids,
                                     partition_strategy="mod",
@@ -151,50 +357,8 @@ def _embedding_lookup_and_transform(params,
       flat_ids = array_ops.reshape(ids, [-1])
       original_indices = math_ops.range(array_ops.size(flat_ids))
 
-      # Create p_assignments and set new_ids depending on the strategy.
-      if partition_strategy == "mod":
-        p_assignments = flat_ids % np
-        new_ids = flat_ids // np
-      elif partition_strategy == "div":
-        # Compute num_total_ids as the sum of dim-0 of params, then assign to
-        # partitions based on a constant number of ids per partition. Optimize
-        # if we already know the full shape statically.
-        dim_0_size = tensor_shape.Dimension(
-            tensor_shape.dimension_value(params[0].get_shape()[0]))
-        for p in xrange(1, np):
-          dim_0_size += tensor_shape.Dimension(
-              tensor_shape.dimension_value(params[p].get_shape()[0]))
-        if dim_0_size.value:
-          num_total_ids = constant_op.constant(dim_0_size.value, flat_ids.dtype)
-        else:
-          dim_0_sizes = []
-          for p in xrange(np):
-            param_p_dim = tensor_shape.dimension_value(params[p].get_shape()[0])
-            if param_p_dim is not None:
-              dim_0_sizes.append(param_p_dim)
-            else:
-              with ops.colocate_with(params[p]):
-                dim_0_sizes.append(array_ops.shape(params[p])[0])
-          num_total_ids = math_ops.reduce_sum(
-              math_ops.cast(array_ops.stack(dim_0_sizes), flat_ids.dtype))
-        ids_per_partition = num_total_ids // np
-        extras = num_total_ids % np
-
-        p_assignments = math_ops.maximum(flat_ids // (ids_per_partition + 1),
-                                         (flat_ids - extras) //
-                                         ids_per_partition)
-
-        # Emulate a conditional using a boolean indicator tensor
-        new_ids = array_ops.where(p_assignments < extras,
-                                  flat_ids % (ids_per_partition + 1),
-                                  (flat_ids - extras) % ids_per_partition)
-      else:
-        raise ValueError("Unrecognized partition strategy: " +
-                         partition_strategy)
-
-      # Cast partition assignments to int32 for use in dynamic_partition.
-      # There really should not be more than 2^32 partitions.
-      p_assignments = math_ops.cast(p_assignments, dtypes.int32)
+      p_assignments, new_ids = _partition_ids(params, flat_ids,
+                                              partition_strategy)
       # Partition list of ids based on assignments into np separate lists
       gather_ids = data_flow_ops.dynamic_partition(new_ids, p_assignments, np)
       # Similarly, partition the original indices.
@@ -506,6 +670,18 @@ def embedding_lookup_sparse(params,
     segment_ids = sp_ids.indices[:, 0]
 
     ids = sp_ids.values
+    if (ignore_weights and max_norm is None and
+        _can_gather_combine_on_ps(params, segment_ids.device)):
+      # Combine the embeddings on the parameter servers, so that only one
+      # row per example leaves them.
+      return _gather_combine_on_ps(params, ids, segment_ids,
+                                   partition_strategy, combiner, name)
+    if max_norm is None and _can_fuse_lookup_sparse(params):
+      # Combine the looked up rows as they are read, instead of gathering
+      # them into an intermediate tensor first.
+      return _fused_lookup_sparse(
+          params[0], ids, segment_ids,
+          None if ignore_weights else sp_weights.values, combiner, name)
     ids, idx = array_ops.unique(ids)
 
     embeddings = embedding_lookup(
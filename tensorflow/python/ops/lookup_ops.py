@@ -1682,7 +1682,8 @@ class MutableHashTable(LookupInterface):
                value_dtype,
                default_value,
                name="MutableHashTable",
-               checkpoint=True):
+               checkpoint=True,
+               num_shards=1):
     """Creates an empty `MutableHashTable` object.
 
     Creates a table, the type of its keys and values are specified by key_dtype
@@ -1696,6 +1697,10 @@ class MutableHashTable(LookupInterface):
       checkpoint: if True, the contents of the table are saved to and restored
         from checkpoints. If `shared_name` is empty for a checkpointed table, it
         is shared using the table node name.
+      num_shards: The number of independently locked shards the keys are split
+        into. With more than one shard, lookups, inserts and removals of a key
+        batch run in parallel, and concurrent operations on the table contend
+        less.
 
     Returns:
       A `MutableHashTable` object.
@@ -1710,6 +1715,7 @@ class MutableHashTable(LookupInterface):
     self._key_dtype = key_dtype
     self._value_dtype = value_dtype
     self._name = name
+    self._num_shards = num_shards
 
     self._shared_name = None
     if context.executing_eagerly():
@@ -1723,7 +1729,7 @@ class MutableHashTable(LookupInterface):
 
     self._resource_handle = self._create_resource()
     if checkpoint:
-      saveable = MutableHashTable._Saveable(self, name)
+      saveable = self._Saveable(self, name)
       if not context.executing_eagerly():
         ops.add_to_collection(ops.GraphKeys.SAVEABLE_OBJECTS, saveable)
 
@@ -1738,6 +1744,7 @@ class MutableHashTable(LookupInterface):
           use_node_name_sharing=use_node_name_sharing,
           key_dtype=self._key_dtype,
           value_dtype=self._value_dtype,
+          num_shards=self._num_shards,
           name=self._name)
     else:
       table_ref = gen_lookup_ops.mutable_hash_table_of_tensors_v2(
@@ -1746,6 +1753,7 @@ class MutableHashTable(LookupInterface):
           key_dtype=self._key_dtype,
           value_dtype=self._value_dtype,
           value_shape=self._default_value.get_shape(),
+          num_shards=self._num_shards,
           name=self._name)
 
     if context.executing_eagerly():
@@ -1871,7 +1879,7 @@ class MutableHashTable(LookupInterface):
     return {
         "table":
             functools.partial(
-                MutableHashTable._Saveable, table=self, name=self._name,
+                self._Saveable, table=self, name=self._name,
                 table_name=self._name)
     }
 
@@ -1898,6 +1906,127 @@ class MutableHashTable(LookupInterface):
                                                        restored_tensors[1])
 
 
+class MutableEvictingHashTable(MutableHashTable):
+  """A mutable hash table from int64 ids that evicts rarely used keys.
+
+  The table tracks how often every key has been looked up and when it was last
+  looked up or inserted, where time is counted in calls to `lookup`. It uses
+  these statistics to bound its size:
+
+  * Inserting a key only adds it to the table once it has been looked up
+    `admission_threshold` times. Until then, lookups of the key return the
+    default value, and inserts of it are dropped.
+  * Keys that have not been accessed in the last `ttl_steps` lookups are
+    evicted.
+  * When the table grows beyond `capacity` keys, the least frequently looked up
+    keys are evicted until it is 10% below capacity.
+
+  The lookups of at most `max_candidates` keys that are not in the table are
+  counted, so the memory used for admission is bounded as well.
+
+  `export` returns the keys as an `[N, 3]` matrix of key, lookup count and last
+  access step, so that checkpoints preserve the statistics.
+
+  Example usage:
+
+  ```python
+  table = MutableEvictingHashTable(value_dtype=tf.float32,
+                                   default_value=[0.0] * 8,
+                                   capacity=1000000,
+                                   admission_threshold=3)
+  embeddings = table.lookup(ids)
+  sess.run(table.insert(ids, new_embeddings))
+  ```
+  """
+
+  def __init__(self,
+               value_dtype,
+               default_value,
+               capacity=0,
+               admission_threshold=1,
+               ttl_steps=0,
+               max_candidates=0,
+               name="MutableEvictingHashTable",
+               checkpoint=True):
+    """Creates an empty `MutableEvictingHashTable` object.
+
+    Args:
+      value_dtype: the type of the value tensors.
+      default_value: The value to use if a key is missing in the table. Either
+        a scalar or a vector.
+      capacity: If positive, the maximum number of keys in the table.
+      admission_threshold: The number of lookups of a key after which
+        inserting it adds it to the table.
+      ttl_steps: If positive, keys not accessed in this many lookups of the
+        table are evicted.
+      max_candidates: The maximum number of keys that are not in the table
+        whose lookups are counted towards `admission_threshold`. If 0, defaults
+        to `capacity` if it is positive, and to 1048576 otherwise.
+      name: A name for the operation (optional).
+      checkpoint: if True, the contents of the table are saved to and restored
+        from checkpoints. If `shared_name` is empty for a checkpointed table, it
+        is shared using the table node name.
+
+    Returns:
+      A `MutableEvictingHashTable` object.
+    """
+    self._capacity = capacity
+    self._admission_threshold = admission_threshold
+    self._ttl_steps = ttl_steps
+    self._max_candidates = max_candidates
+    super(MutableEvictingHashTable, self).__init__(
+        dtypes.int64, value_dtype, default_value, name=name,
+        checkpoint=checkpoint)
+
+  def _create_resource(self):
+    use_node_name_sharing = self._checkpoint and self._shared_name is None
+    table_ref = gen_lookup_ops.mutable_evicting_hash_table(
+        shared_name=self._shared_name,
+        use_node_name_sharing=use_node_name_sharing,
+        key_dtype=self._key_dtype,
+        value_dtype=self._value_dtype,
+        value_shape=self._default_value.get_shape(),
+        capacity=self._capacity,
+        admission_threshold=self._admission_threshold,
+        ttl_steps=self._ttl_steps,
+        max_candidates=self._max_candidates,
+        name=self._name)
+
+    if context.executing_eagerly():
+      self._table_name = None
+    else:
+      self._table_name = table_ref.op.name.split("/")[-1]
+    return table_ref
+
+  def export(self, name=None):
+    """Returns tensors of all keys and values in the table.
+
+    Args:
+      name: A name for the operation (optional).
+
+    Returns:
+      A pair of tensors, the first an `[N, 3]` matrix of the keys, their lookup
+        counts and their last access steps, the second containing the values.
+    """
+    with ops.name_scope(name, "%s_lookup_table_export_values" % self.name,
+                        [self.resource_handle]):
+      with ops.colocate_with(self.resource_handle):
+        return gen_lookup_ops.mutable_evicting_hash_table_export(
+            self.resource_handle, self._value_dtype)
+
+  class _Saveable(MutableHashTable._Saveable):
+    """SaveableObject implementation for MutableEvictingHashTable."""
+
+    def restore(self, restored_tensors, restored_shapes):
+      del restored_shapes  # unused
+      # pylint: disable=protected-access
+      with ops.name_scope("%s_table_restore" % self.table_name):
+        with ops.colocate_with(self.op.resource_handle):
+          return gen_lookup_ops.mutable_evicting_hash_table_import(
+              self.op.resource_handle, restored_tensors[0],
+              restored_tensors[1])
+
+
 @tf_export("lookup.experimental.DenseHashTable")
 class DenseHashTable(LookupInterface):
   """A generic mutable hash table implementation using tensors as backing store.
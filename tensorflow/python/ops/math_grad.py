@@ -387,6 +387,23 @@ def _SparseSegmentSqrtNWithNumSegmentsGrad(op, grad):
                                               dim0), None, None, None)
 
 
+@ops.RegisterGradient("FusedEmbeddingLookupSparse")
+def _FusedEmbeddingLookupSparseGrad(op, grad):
+  """Gradient for FusedEmbeddingLookupSparse."""
+  params, ids, segment_ids, weights = op.inputs
+  unique_ids, params_grad, weights_grad = (
+      gen_math_ops.fused_embedding_lookup_sparse_grad(
+          grad,
+          params,
+          ids,
+          segment_ids,
+          weights,
+          op.outputs[0],
+          combiner=op.get_attr("combiner")))
+  return (ops.IndexedSlices(params_grad, unique_ids,
+                            array_ops.shape(params)), None, None, weights_grad)
+
+
 def _SegmentMinOrMaxGrad(op, grad):
   """ Gradient for SegmentMin and SegmentMax. """
   zeros = array_ops.zeros_like(op.inputs[0], dtype=op.inputs[0].dtype)
@@ -2082,6 +2082,30 @@ def _GatherGrad(op, grad):
   return (ops.IndexedSlices(values, indices, params_shape), None)
 
 
+@ops.RegisterGradient("ResourceSparseGatherCombine")
+def _SparseGatherCombineGrad(op, grad):
+  """Gradient for sparse gather combine op."""
+  handle = op.inputs[0]
+  indices = op.inputs[1]
+  segment_ids = op.inputs[2]
+  num_segments = op.inputs[3]
+  combiner = op.get_attr("combiner")
+  values = array_ops.gather(grad, segment_ids)
+  if combiner != b"sum":
+    counts = math_ops.unsorted_segment_sum(
+        array_ops.ones_like(segment_ids, dtype=grad.dtype), segment_ids,
+        num_segments)
+    if combiner == b"sqrtn":
+      counts = math_ops.sqrt(counts)
+    scale = array_ops.gather(math_ops.reciprocal(counts), segment_ids)
+    scale_shape = array_ops.concat(
+        [array_ops.shape(scale),
+         array_ops.ones([array_ops.rank(values) - 1], dtypes.int32)], 0)
+    values *= array_ops.reshape(scale, scale_shape)
+  return (ops.IndexedSlices(values, indices, variable_shape(handle)), None,
+          None, None)
+
+
 def _to_proto_fn(v, export_scope=None):
   """Converts Variable and ResourceVariable to VariableDef for collections."""
   return v.to_proto(export_scope=export_scope)